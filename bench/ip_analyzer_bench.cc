@@ -0,0 +1,717 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: bench/ip_analyzer_bench.cc
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#include "address_class.hh"
+#include "address_format.hh"
+#include "batch_processor.hh"
+#include "ip_analyzer.hh"
+#include "ipv4_block_parser.hh"
+#include "lookup_server.hh"
+#include "prefix_set.hh"
+#include "prefix_table.hh"
+#include "range_kernels.hh"
+#include "record_writer.hh"
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+    constexpr size_t kCorpusSize = 1 << 14;
+
+    enum class Corpus
+    {
+        kIPv4,
+        kIPv6,
+        kMixed,
+        kMalformed,
+    };
+
+    std::string RandomIPv4(std::mt19937 &rng, bool with_cidr)
+    {
+        const uint32_t value = rng();
+        std::string text = fmt::format("{}.{}.{}.{}", value >> 24, (value >> 16) & 0xFF, (value >> 8) & 0xFF, value & 0xFF);
+        if (with_cidr)
+        {
+            text += fmt::format("/{}", rng() % 33);
+        }
+        return text;
+    }
+
+    // Random addresses shaped like real traffic: a global prefix, a run of
+    // zero groups and a short interface identifier, in compressed notation.
+    std::string RandomIPv6(std::mt19937 &rng, bool with_cidr)
+    {
+        IPv6Value address{};
+        const int prefix_groups = 2 + static_cast<int>(rng() % 3);
+        for (int i = 0; i < prefix_groups * 2; ++i)
+        {
+            address.bytes[i] = static_cast<uint8_t>(rng());
+        }
+        address.bytes[0] = static_cast<uint8_t>(0x20 | (address.bytes[0] & 0x0F));
+        for (int i = 16 - static_cast<int>(rng() % 5); i < 16; ++i)
+        {
+            address.bytes[i] = static_cast<uint8_t>(rng());
+        }
+
+        fmt::memory_buffer buffer;
+        format_address(buffer, IPValue(address));
+        if (with_cidr)
+        {
+            fmt::format_to(std::back_inserter(buffer), "/{}", rng() % 129);
+        }
+        return fmt::to_string(buffer);
+    }
+
+    std::string RandomMalformed(std::mt19937 &rng)
+    {
+        switch (rng() % 6)
+        {
+        case 0:
+            return fmt::format("{}.{}.{}.{}", 256 + rng() % 700, rng() % 256, rng() % 256, rng() % 256);
+        case 1:
+            return fmt::format("abc.{}.{}.{}", rng() % 256, rng() % 256, rng() % 256);
+        case 2:
+            return RandomIPv4(rng, false) + "/" + std::to_string(33 + rng() % 60);
+        case 3:
+            return "2001:db8::1::" + std::to_string(rng() % 9999);
+        case 4:
+            return fmt::format("{}.{}.{}", rng() % 256, rng() % 256, rng() % 256);
+        default:
+            return fmt::format("{:x}:zz::1", rng() % 0xFFFF);
+        }
+    }
+
+    const std::vector<std::string> &Lines(Corpus corpus, bool with_cidr = true)
+    {
+        static std::vector<std::string> cache[4][2];
+        auto &lines = cache[static_cast<int>(corpus)][with_cidr];
+        if (lines.empty())
+        {
+            std::mt19937 rng(1234 + static_cast<int>(corpus));
+            lines.reserve(kCorpusSize);
+            for (size_t i = 0; i < kCorpusSize; ++i)
+            {
+                switch (corpus)
+                {
+                case Corpus::kIPv4:
+                    lines.push_back(RandomIPv4(rng, with_cidr));
+                    break;
+                case Corpus::kIPv6:
+                    lines.push_back(RandomIPv6(rng, with_cidr));
+                    break;
+                case Corpus::kMixed:
+                    lines.push_back(rng() % 2 ? RandomIPv4(rng, with_cidr) : RandomIPv6(rng, with_cidr));
+                    break;
+                case Corpus::kMalformed:
+                    lines.push_back(RandomMalformed(rng));
+                    break;
+                }
+            }
+        }
+        return lines;
+    }
+
+    const std::vector<IPAnalyzer> &Analyzers(Corpus corpus)
+    {
+        static std::vector<IPAnalyzer> cache[3];
+        auto &analyzers = cache[static_cast<int>(corpus)];
+        if (analyzers.empty())
+        {
+            for (const auto &line : Lines(corpus))
+            {
+                analyzers.emplace_back(line);
+            }
+        }
+        return analyzers;
+    }
+
+    std::string Joined(Corpus corpus)
+    {
+        std::string text;
+        for (const auto &line : Lines(corpus))
+        {
+            text += line;
+            text += '\n';
+        }
+        return text;
+    }
+
+    void BM_ParseIPv4(benchmark::State &state)
+    {
+        const auto &lines = Lines(Corpus::kIPv4, false);
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            uint32_t value;
+            benchmark::DoNotOptimize(parse_ipv4(lines[i++ % kCorpusSize], value));
+            benchmark::DoNotOptimize(value);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_ParseIPv4);
+
+    void BM_ParseIPv6(benchmark::State &state)
+    {
+        const auto &lines = Lines(Corpus::kIPv6, false);
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            std::array<uint8_t, 16> bytes;
+            benchmark::DoNotOptimize(parse_ipv6(lines[i++ % kCorpusSize], bytes));
+            benchmark::DoNotOptimize(bytes);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_ParseIPv6);
+
+    // Whole regions of newline-separated IPv4 lines into packed columns.
+    void BM_ParseIPv4Block(benchmark::State &state, bool with_cidr)
+    {
+        std::string region;
+        for (const auto &line : Lines(Corpus::kIPv4, with_cidr))
+        {
+            region += line;
+            region += '\n';
+        }
+        std::vector<uint32_t> addresses(kCorpusSize);
+        std::vector<uint8_t> cidrs(kCorpusSize);
+        for (auto _ : state)
+        {
+            IPv4BlockParser parser(region);
+            benchmark::DoNotOptimize(parser.next(addresses, cidrs));
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * kCorpusSize);
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(region.size()));
+    }
+    BENCHMARK_CAPTURE(BM_ParseIPv4Block, addresses, false);
+    BENCHMARK_CAPTURE(BM_ParseIPv4Block, prefixes, true);
+
+    void BM_IPv4AddressConstruct(benchmark::State &state)
+    {
+        const auto &lines = Lines(Corpus::kIPv4, false);
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            IPv4Address address(lines[i++ % kCorpusSize]);
+            benchmark::DoNotOptimize(address);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_IPv4AddressConstruct);
+
+    void BM_IPv6AddressConstruct(benchmark::State &state)
+    {
+        const auto &lines = Lines(Corpus::kIPv6, false);
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            IPv6Address address(lines[i++ % kCorpusSize]);
+            benchmark::DoNotOptimize(address);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_IPv6AddressConstruct);
+
+    void BM_AnalyzerConstruct(benchmark::State &state, Corpus corpus)
+    {
+        const auto &lines = Lines(corpus);
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            try
+            {
+                IPAnalyzer analyzer(lines[i++ % kCorpusSize]);
+                benchmark::DoNotOptimize(analyzer);
+            }
+            catch (const std::exception &)
+            {
+            }
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK_CAPTURE(BM_AnalyzerConstruct, ipv4, Corpus::kIPv4);
+    BENCHMARK_CAPTURE(BM_AnalyzerConstruct, ipv6, Corpus::kIPv6);
+    BENCHMARK_CAPTURE(BM_AnalyzerConstruct, mixed, Corpus::kMixed);
+    BENCHMARK_CAPTURE(BM_AnalyzerConstruct, malformed, Corpus::kMalformed);
+
+    template <typename Getter>
+    void RunGetter(benchmark::State &state, Corpus corpus, Getter getter)
+    {
+        const auto &analyzers = Analyzers(corpus);
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(getter(analyzers[i++ % kCorpusSize]));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+#define IP_ANALYZER_GETTER_BENCHMARK(name, expression)                                   \
+    void name(benchmark::State &state, Corpus corpus)                                    \
+    {                                                                                    \
+        RunGetter(state, corpus, [](const IPAnalyzer &analyzer) { return expression; }); \
+    }                                                                                    \
+    BENCHMARK_CAPTURE(name, ipv4, Corpus::kIPv4);                                        \
+    BENCHMARK_CAPTURE(name, ipv6, Corpus::kIPv6)
+
+    IP_ANALYZER_GETTER_BENCHMARK(BM_GetNetwork, analyzer.get_network());
+    IP_ANALYZER_GETTER_BENCHMARK(BM_GetNetmask, analyzer.get_netmask());
+    IP_ANALYZER_GETTER_BENCHMARK(BM_GetBroadcast, analyzer.get_broadcast());
+    IP_ANALYZER_GETTER_BENCHMARK(BM_GetHostRange, analyzer.get_host_range());
+    IP_ANALYZER_GETTER_BENCHMARK(BM_GetNumHosts, analyzer.get_num_hosts());
+    IP_ANALYZER_GETTER_BENCHMARK(BM_IsPrivate, analyzer.is_private());
+    IP_ANALYZER_GETTER_BENCHMARK(BM_NetworkValue, analyzer.network_value());
+    IP_ANALYZER_GETTER_BENCHMARK(BM_NetmaskValue, analyzer.netmask_value());
+    IP_ANALYZER_GETTER_BENCHMARK(BM_BroadcastValue, analyzer.broadcast_value());
+    IP_ANALYZER_GETTER_BENCHMARK(BM_HostRangeValue, analyzer.host_range_value());
+
+#undef IP_ANALYZER_GETTER_BENCHMARK
+
+    void BM_ToString(benchmark::State &state, Corpus corpus)
+    {
+        const auto &analyzers = Analyzers(corpus);
+        std::vector<std::shared_ptr<IPAddress>> addresses;
+        for (const auto &analyzer : analyzers)
+        {
+            addresses.push_back(analyzer.get_ip());
+        }
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(addresses[i++ % kCorpusSize]->to_string());
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK_CAPTURE(BM_ToString, ipv4, Corpus::kIPv4);
+    BENCHMARK_CAPTURE(BM_ToString, ipv6, Corpus::kIPv6);
+
+    void BM_ToBinaryString(benchmark::State &state, Corpus corpus)
+    {
+        const auto &analyzers = Analyzers(corpus);
+        std::vector<std::shared_ptr<IPAddress>> addresses;
+        for (const auto &analyzer : analyzers)
+        {
+            addresses.push_back(analyzer.get_ip());
+        }
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(addresses[i++ % kCorpusSize]->to_binary_string());
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK_CAPTURE(BM_ToBinaryString, ipv4, Corpus::kIPv4);
+    BENCHMARK_CAPTURE(BM_ToBinaryString, ipv6, Corpus::kIPv6);
+
+    void BM_FormatAddress(benchmark::State &state, Corpus corpus)
+    {
+        const auto &analyzers = Analyzers(corpus);
+        char text[kIPv6TextMaxLength];
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(format_address(text, analyzers[i++ % kCorpusSize].ip_value()));
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK_CAPTURE(BM_FormatAddress, ipv4, Corpus::kIPv4);
+    BENCHMARK_CAPTURE(BM_FormatAddress, ipv6, Corpus::kIPv6);
+
+    void BM_RangeKernelV4(benchmark::State &state)
+    {
+        std::vector<uint32_t> addresses;
+        std::vector<uint8_t> cidrs;
+        for (const auto &analyzer : Analyzers(Corpus::kIPv4))
+        {
+            addresses.push_back(analyzer.ip_value().v4().value);
+            cidrs.push_back(analyzer.get_cidr());
+        }
+        std::vector<uint32_t> network(kCorpusSize), broadcast(kCorpusSize), first(kCorpusSize), last(kCorpusSize);
+        for (auto _ : state)
+        {
+            compute_ranges_v4(addresses, cidrs, {network, broadcast, first, last});
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * kCorpusSize);
+    }
+    BENCHMARK(BM_RangeKernelV4);
+
+    // Every prefix a /24, as when summarizing addresses by their /24.
+    void BM_RangeKernelV4Uniform(benchmark::State &state)
+    {
+        std::vector<uint32_t> addresses;
+        for (const auto &analyzer : Analyzers(Corpus::kIPv4))
+        {
+            addresses.push_back(analyzer.ip_value().v4().value);
+        }
+        const std::vector<uint8_t> cidrs(addresses.size(), 24);
+        std::vector<uint32_t> network(kCorpusSize), broadcast(kCorpusSize), first(kCorpusSize), last(kCorpusSize);
+        for (auto _ : state)
+        {
+            compute_ranges_v4(addresses, cidrs, {network, broadcast, first, last});
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * kCorpusSize);
+    }
+    BENCHMARK(BM_RangeKernelV4Uniform);
+
+    void BM_RangeKernelV6Uniform(benchmark::State &state)
+    {
+        std::vector<IPv6Value> addresses;
+        for (const auto &analyzer : Analyzers(Corpus::kIPv6))
+        {
+            addresses.push_back(analyzer.ip_value().v6());
+        }
+        const std::vector<uint8_t> cidrs(addresses.size(), 64);
+        std::vector<IPv6Value> network(kCorpusSize), broadcast(kCorpusSize), first(kCorpusSize), last(kCorpusSize);
+        for (auto _ : state)
+        {
+            compute_ranges_v6(addresses, cidrs, {network, broadcast, first, last});
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * kCorpusSize);
+    }
+    BENCHMARK(BM_RangeKernelV6Uniform);
+
+    std::vector<uint32_t> RandomProbes()
+    {
+        std::mt19937 rng(99);
+        std::vector<uint32_t> probes(kCorpusSize);
+        for (auto &probe : probes)
+        {
+            probe = rng();
+        }
+        return probes;
+    }
+
+    void BM_ClassifyV4(benchmark::State &state)
+    {
+        const auto probes = RandomProbes();
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(classify(IPv4Value{probes[i++ % kCorpusSize]}));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_ClassifyV4);
+
+    void BM_ClassifyBatchV4(benchmark::State &state)
+    {
+        const auto probes = RandomProbes();
+        std::vector<AddressClassMask> classes(kCorpusSize);
+        for (auto _ : state)
+        {
+            classify_batch(probes, classes);
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * kCorpusSize);
+    }
+    BENCHMARK(BM_ClassifyBatchV4);
+
+    void BM_PrefixTableLookupV4(benchmark::State &state)
+    {
+        const PrefixTable table(Analyzers(Corpus::kIPv4));
+        const auto probes = RandomProbes();
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(table.lookup(IPv4Value{probes[i++ % kCorpusSize]}));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_PrefixTableLookupV4);
+
+    void BM_PrefixTableBuildV4(benchmark::State &state)
+    {
+        const auto prefixes = Analyzers(Corpus::kIPv4);
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(PrefixTable(prefixes).size());
+        }
+    }
+    BENCHMARK(BM_PrefixTableBuildV4)->Unit(benchmark::kMillisecond);
+
+    void BM_PrefixTableLoad(benchmark::State &state, IndexCheck check)
+    {
+        const std::string path = "ip_analyzer_bench.idx";
+        PrefixTable(Analyzers(Corpus::kIPv4)).save(path);
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(PrefixTable::load(path, check).size());
+        }
+        std::remove(path.c_str());
+    }
+    BENCHMARK_CAPTURE(BM_PrefixTableLoad, header, IndexCheck::kHeader)->Unit(benchmark::kMicrosecond);
+    BENCHMARK_CAPTURE(BM_PrefixTableLoad, checksum, IndexCheck::kChecksum)->Unit(benchmark::kMillisecond);
+
+    // One 1k address lookup batch per iteration over a Unix socket, request
+    // to complete response, with the latency percentiles as counters.
+    void BM_LookupServerRoundTrip(benchmark::State &state)
+    {
+        const std::string path = "ip_analyzer_bench.sock";
+        LookupServer server(PrefixTable(Analyzers(Corpus::kIPv4)), "unix:" + path);
+        std::thread loop([&] { server.run(); });
+
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strcpy(address.sun_path, path.c_str());
+        if (::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            throw std::runtime_error("cannot connect to the lookup server");
+        }
+
+        constexpr uint32_t kBatch = 1000;
+        constexpr uint32_t kPayload = lookup_protocol::kRequestHeaderSize + kBatch * 4;
+        const auto probes = RandomProbes();
+        std::vector<char> request(lookup_protocol::kLengthSize + kPayload);
+        std::memcpy(request.data(), &kPayload, 4);
+        request[4] = static_cast<char>(lookup_protocol::Op::kLookup);
+        request[5] = 4;
+        std::memcpy(request.data() + 8, &kBatch, 4);
+        for (uint32_t i = 0; i < kBatch; ++i)
+        {
+            const uint32_t network = __builtin_bswap32(probes[i]);
+            std::memcpy(request.data() + 12 + i * 4, &network, 4);
+        }
+
+        const size_t response_size =
+            lookup_protocol::kLengthSize + lookup_protocol::kResponseHeaderSize + kBatch * lookup_protocol::kLookupItemSize;
+        std::vector<char> response(response_size);
+        std::vector<double> latencies;
+        for (auto _ : state)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            ::send(fd, request.data(), request.size(), 0);
+            for (size_t received = 0; received < response_size;)
+            {
+                const ssize_t n = ::read(fd, response.data() + received, response_size - received);
+                if (n <= 0)
+                {
+                    throw std::runtime_error("lookup server closed the connection");
+                }
+                received += static_cast<size_t>(n);
+            }
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        }
+        ::close(fd);
+        server.stop();
+        loop.join();
+
+        std::sort(latencies.begin(), latencies.end());
+        state.counters["p50_us"] = latencies[latencies.size() / 2];
+        state.counters["p99_us"] = latencies[latencies.size() * 99 / 100];
+        state.SetItemsProcessed(state.iterations() * kBatch);
+    }
+    BENCHMARK(BM_LookupServerRoundTrip)->Unit(benchmark::kMicrosecond);
+
+    // ACL-sized prefix lists: mostly /16../32 IPv4 networks.
+    std::vector<IPAnalyzer> RandomPrefixes(size_t count, unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        std::vector<IPAnalyzer> prefixes;
+        prefixes.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            prefixes.emplace_back(IPValue(IPv4Value{static_cast<uint32_t>(rng())}), static_cast<uint8_t>(16 + rng() % 17));
+        }
+        return prefixes;
+    }
+
+    // A withdrawal and an announcement per iteration against a 900k
+    // prefix table, as from a BGP feed.
+    void BM_PrefixTableUpdate(benchmark::State &state)
+    {
+        const auto prefixes = RandomPrefixes(900000, 7);
+        const auto updates = RandomPrefixes(kCorpusSize, 8);
+        PrefixTable table(prefixes);
+        table.add(updates[0]);
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            table.remove(prefixes[i % prefixes.size()]);
+            benchmark::DoNotOptimize(table.add(updates[i % kCorpusSize]));
+            ++i;
+        }
+        state.SetItemsProcessed(state.iterations() * 2);
+    }
+    BENCHMARK(BM_PrefixTableUpdate)->Unit(benchmark::kMicrosecond);
+
+    // The same through LivePrefixTable, publishing every 1000 updates; the
+    // replay onto the retired copy is included.
+    void BM_LivePrefixTableUpdate(benchmark::State &state)
+    {
+        const auto prefixes = RandomPrefixes(900000, 7);
+        const auto updates = RandomPrefixes(kCorpusSize, 8);
+        LivePrefixTable live{PrefixTable(prefixes)};
+        live.add(updates[0]);
+        live.publish();
+        live.add(updates[1]);
+        live.publish();
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            live.remove(prefixes[i % prefixes.size()]);
+            benchmark::DoNotOptimize(live.add(updates[i % kCorpusSize]));
+            if (++i % 500 == 0)
+            {
+                live.publish();
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * 2);
+    }
+    BENCHMARK(BM_LivePrefixTableUpdate)->Unit(benchmark::kMicrosecond);
+
+    // Lookups through LivePrefixTable from 1 to 32 threads, each pinning the
+    // table once per 64 lookups. With no shared writes on the read side the
+    // per-thread rate should stay flat as threads are added.
+    void BM_LivePrefixTableLookup(benchmark::State &state)
+    {
+        static LivePrefixTable live{PrefixTable(RandomPrefixes(900000, 7))};
+        static const auto probes = RandomProbes();
+        constexpr size_t kPinBatch = 64;
+        LivePrefixTable::Reader reader(live);
+        size_t i = static_cast<size_t>(state.thread_index()) * 4099;
+        for (auto _ : state)
+        {
+            const auto table = reader.snapshot();
+            for (size_t j = 0; j < kPinBatch; ++j)
+            {
+                benchmark::DoNotOptimize(table->lookup(IPv4Value{probes[i++ % kCorpusSize]}));
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * kPinBatch);
+    }
+    BENCHMARK(BM_LivePrefixTableLookup)->ThreadRange(1, 32)->UseRealTime();
+
+    void BM_PrefixSetBuild(benchmark::State &state)
+    {
+        const auto prefixes = RandomPrefixes(static_cast<size_t>(state.range(0)), 5);
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(PrefixSet(prefixes));
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(BM_PrefixSetBuild)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+
+    void BM_PrefixSetContainsV4(benchmark::State &state)
+    {
+        const PrefixSet set(RandomPrefixes(1 << 20, 5));
+        const auto probes = RandomProbes();
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(set.contains(IPv4Value{probes[i++ % kCorpusSize]}));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_PrefixSetContainsV4);
+
+    // Both directions of an ACL diff between two 1M prefix lists.
+    void BM_PrefixSetDiff(benchmark::State &state)
+    {
+        const PrefixSet before(RandomPrefixes(1 << 20, 5));
+        const PrefixSet after(RandomPrefixes(1 << 20, 6));
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(before.subtract(after));
+            benchmark::DoNotOptimize(after.subtract(before));
+        }
+    }
+    BENCHMARK(BM_PrefixSetDiff)->Unit(benchmark::kMillisecond);
+
+    void BM_BatchLines(benchmark::State &state, Corpus corpus, OutputFormat format)
+    {
+        const std::string input = Joined(corpus);
+        const auto writer = make_record_writer(format);
+        fmt::memory_buffer output;
+        for (auto _ : state)
+        {
+            BatchStats stats;
+            output.clear();
+            BatchProcessor::format_lines(input, *writer, output, stats);
+            benchmark::DoNotOptimize(output.data());
+        }
+        state.SetItemsProcessed(state.iterations() * kCorpusSize);
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(input.size()));
+    }
+    BENCHMARK_CAPTURE(BM_BatchLines, ipv4, Corpus::kIPv4, OutputFormat::kText);
+    BENCHMARK_CAPTURE(BM_BatchLines, ipv6, Corpus::kIPv6, OutputFormat::kText);
+    BENCHMARK_CAPTURE(BM_BatchLines, mixed, Corpus::kMixed, OutputFormat::kText);
+    BENCHMARK_CAPTURE(BM_BatchLines, malformed, Corpus::kMalformed, OutputFormat::kText);
+    BENCHMARK_CAPTURE(BM_BatchLines, mixed_ndjson, Corpus::kMixed, OutputFormat::kNdjson);
+    BENCHMARK_CAPTURE(BM_BatchLines, mixed_csv, Corpus::kMixed, OutputFormat::kCsv);
+    BENCHMARK_CAPTURE(BM_BatchLines, mixed_binary, Corpus::kMixed, OutputFormat::kBinary);
+
+    // process_stream reading the mixed corpus, 32 times over, from a pipe
+    // with the output going to /dev/null: the `zcat | ip-analyzer --batch`
+    // case. The feeder thread produces 64 KiB pieces at 50 MB/s, about the
+    // rate of zcat, so the run takes as long as the slower of feeding and
+    // analysis only when the two overlap.
+    void BM_BatchPipe(benchmark::State &state)
+    {
+        const std::string input = Joined(Corpus::kMixed);
+        constexpr int kRepeats = 32;
+        static constexpr size_t kPiece = 64 * 1024;
+        static constexpr auto kPieceTime = std::chrono::microseconds(kPiece / 50);
+        std::FILE *out = std::fopen("/dev/null", "w");
+        for (auto _ : state)
+        {
+            int fds[2];
+            if (pipe(fds) != 0)
+            {
+                throw std::runtime_error("pipe failed");
+            }
+            std::thread feeder([&input, fd = fds[1]]
+                               {
+                auto deadline = std::chrono::steady_clock::now();
+                for (int i = 0; i < kRepeats; ++i)
+                {
+                    for (size_t sent = 0; sent < input.size();)
+                    {
+                        const ssize_t written = ::write(fd, input.data() + sent, std::min(kPiece, input.size() - sent));
+                        if (written <= 0)
+                        {
+                            break;
+                        }
+                        sent += static_cast<size_t>(written);
+                        // Time blocked on a full pipe is not made up for.
+                        deadline = std::max(deadline, std::chrono::steady_clock::now()) + kPieceTime * written / kPiece;
+                        std::this_thread::sleep_until(deadline);
+                    }
+                }
+                ::close(fd); });
+            std::FILE *in = fdopen(fds[0], "r");
+            BatchProcessor processor(out, static_cast<unsigned>(state.range(0)));
+            benchmark::DoNotOptimize(processor.process_stream(in));
+            std::fclose(in);
+            feeder.join();
+        }
+        std::fclose(out);
+        state.SetItemsProcessed(state.iterations() * kCorpusSize * kRepeats);
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(input.size()) * kRepeats);
+    }
+    BENCHMARK(BM_BatchPipe)->Arg(1)->Arg(2)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/address_class.cc
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#include "address_class.hh"
+#include "cpu_features.hh"
+#include <bit>
+#include <stdexcept>
+
+#if defined(IP_ANALYZER_X86_DISPATCH)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+    constexpr std::array<const char *, kAddressClassCount> kAddressClassNames = {
+        "Unspecified",
+        "Loopback",
+        "Private",
+        "Shared Address Space",
+        "Link-Local",
+        "Site-Local",
+        "Documentation",
+        "Benchmarking",
+        "Multicast",
+        "Reserved",
+        "Limited Broadcast",
+        "IETF Protocol Assignments",
+        "6to4",
+        "Teredo",
+        "IPv4-Mapped",
+        "IPv4/IPv6 Translation",
+        "Discard-Only",
+        "ORCHIDv2",
+        "AS112",
+        "AMT",
+    };
+
+    void CheckSizes(size_t addresses, size_t out)
+    {
+        if (addresses != out)
+        {
+            throw std::invalid_argument("classify_batch: output size does not match input size");
+        }
+    }
+
+}
+
+const char *address_class_name(AddressClass address_class)
+{
+    const auto bit = static_cast<AddressClassMask>(address_class);
+    if (!std::has_single_bit(bit) || static_cast<size_t>(std::countr_zero(bit)) >= kAddressClassCount)
+    {
+        return "Unknown";
+    }
+    return kAddressClassNames[std::countr_zero(bit)];
+}
+
+std::string address_class_names(AddressClassMask mask)
+{
+    std::string names;
+    address_class_names(mask, names);
+    return names;
+}
+
+// Vector kernels over the classifier tables. Each handles the leading part
+// of a batch that fills whole registers and returns where it stopped.
+struct BatchClassifier
+{
+#if defined(IP_ANALYZER_X86_DISPATCH)
+    IP_ANALYZER_TARGET_AVX2 static size_t classify_v4_avx2(const uint32_t *addresses, size_t n, AddressClassMask *out)
+    {
+        const auto &table = kClassifierV4;
+        const int *slots = reinterpret_cast<const int *>(table.slots_.data());
+        const size_t fine_count = table.slots_.back().begin + table.slots_.back().count;
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m256i address = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(addresses + i));
+            const __m256i leading = _mm256_srli_epi32(address, 24);
+            __m256i classes = _mm256_i32gather_epi32(slots, leading, 8);
+            const __m256i refine = _mm256_srli_epi32(_mm256_i32gather_epi32(slots + 1, leading, 8), 16);
+            if (!_mm256_testz_si256(refine, refine))
+            {
+                for (size_t f = 0; f < fine_count; ++f)
+                {
+                    const auto &fine = table.fine_[f];
+                    const __m256i hit = _mm256_cmpeq_epi32(_mm256_and_si256(address, _mm256_set1_epi32(static_cast<int>(fine.mask))),
+                                                           _mm256_set1_epi32(static_cast<int>(fine.network)));
+                    classes = _mm256_or_si256(classes, _mm256_and_si256(hit, _mm256_set1_epi32(static_cast<int>(fine.classes))));
+                }
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), classes);
+        }
+        return i;
+    }
+#endif
+};
+
+void classify_batch(std::span<const uint32_t> addresses, std::span<AddressClassMask> out)
+{
+    CheckSizes(addresses.size(), out.size());
+
+    const size_t n = addresses.size();
+    size_t i = 0;
+
+#if defined(IP_ANALYZER_X86_DISPATCH)
+    if (simd_level() == SimdLevel::kAvx2 || simd_level() == SimdLevel::kAvx512)
+    {
+        i = BatchClassifier::classify_v4_avx2(addresses.data(), n, out.data());
+    }
+#endif
+
+    for (; i < n; ++i)
+    {
+        out[i] = classify(IPv4Value{addresses[i]});
+    }
+}
+
+void classify_batch(std::span<const IPv6Value> addresses, std::span<AddressClassMask> out)
+{
+    CheckSizes(addresses.size(), out.size());
+
+    for (size_t i = 0; i < addresses.size(); ++i)
+    {
+        out[i] = classify(addresses[i]);
+    }
+}
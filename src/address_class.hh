@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/address_class.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include "ip_analyzer.hh"
+#include "uint128.hh"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+// Categories from the IANA IPv4 and IPv6 special-purpose address registries.
+// An address can belong to several (e.g. Teredo is inside the IETF protocol
+// assignments block), so classification returns a bitmask.
+enum class AddressClass : uint32_t
+{
+    kUnspecified = 1u << 0,
+    kLoopback = 1u << 1,
+    kPrivate = 1u << 2,
+    kSharedAddress = 1u << 3,
+    kLinkLocal = 1u << 4,
+    kSiteLocal = 1u << 5,
+    kDocumentation = 1u << 6,
+    kBenchmarking = 1u << 7,
+    kMulticast = 1u << 8,
+    kReserved = 1u << 9,
+    kBroadcast = 1u << 10,
+    kProtocolAssignments = 1u << 11,
+    k6to4 = 1u << 12,
+    kTeredo = 1u << 13,
+    kIPv4Mapped = 1u << 14,
+    kTranslation = 1u << 15,
+    kDiscardOnly = 1u << 16,
+    kOrchid = 1u << 17,
+    kAs112 = 1u << 18,
+    kAmt = 1u << 19,
+};
+
+using AddressClassMask = uint32_t;
+
+constexpr size_t kAddressClassCount = 20;
+
+constexpr bool has_class(AddressClassMask mask, AddressClass address_class)
+{
+    return (mask & static_cast<AddressClassMask>(address_class)) != 0;
+}
+
+const char *address_class_name(AddressClass address_class);
+
+// Comma separated names of every class in `mask`; empty for none. The
+// template appends them to any string type, e.g. one in an arena.
+std::string address_class_names(AddressClassMask mask);
+
+template <typename String>
+void address_class_names(AddressClassMask mask, String &out)
+{
+    for (bool first = true; mask != 0; mask &= mask - 1, first = false)
+    {
+        if (!first)
+        {
+            out += ", ";
+        }
+        out += address_class_name(static_cast<AddressClass>(mask & -mask));
+    }
+}
+
+template <typename Int>
+struct SpecialRange
+{
+    Int network;
+    uint8_t cidr;
+    AddressClass address_class;
+};
+
+constexpr uint128 ipv6_from_groups(uint16_t g0, uint16_t g1 = 0, uint16_t g2 = 0, uint16_t g3 = 0,
+                                   uint16_t g4 = 0, uint16_t g5 = 0, uint16_t g6 = 0, uint16_t g7 = 0)
+{
+    uint128 value = 0;
+    for (uint16_t group : {g0, g1, g2, g3, g4, g5, g6, g7})
+    {
+        value = (value << 16) | group;
+    }
+    return value;
+}
+
+inline constexpr std::array<SpecialRange<uint32_t>, 19> kSpecialRangesV4 = {{
+    {0x00000000, 8, AddressClass::kUnspecified},
+    {0x0A000000, 8, AddressClass::kPrivate},
+    {0x64400000, 10, AddressClass::kSharedAddress},
+    {0x7F000000, 8, AddressClass::kLoopback},
+    {0xA9FE0000, 16, AddressClass::kLinkLocal},
+    {0xAC100000, 12, AddressClass::kPrivate},
+    {0xC0000000, 24, AddressClass::kProtocolAssignments},
+    {0xC0000200, 24, AddressClass::kDocumentation},
+    {0xC01FC400, 24, AddressClass::kAs112},
+    {0xC034C100, 24, AddressClass::kAmt},
+    {0xC0586300, 24, AddressClass::k6to4},
+    {0xC0A80000, 16, AddressClass::kPrivate},
+    {0xC0AF3000, 24, AddressClass::kAs112},
+    {0xC6120000, 15, AddressClass::kBenchmarking},
+    {0xC6336400, 24, AddressClass::kDocumentation},
+    {0xCB007100, 24, AddressClass::kDocumentation},
+    {0xE0000000, 4, AddressClass::kMulticast},
+    {0xF0000000, 4, AddressClass::kReserved},
+    {0xFFFFFFFF, 32, AddressClass::kBroadcast},
+}};
+
+inline constexpr std::array<SpecialRange<uint128>, 20> kSpecialRangesV6 = {{
+    {ipv6_from_groups(0), 128, AddressClass::kUnspecified},
+    {ipv6_from_groups(0, 0, 0, 0, 0, 0, 0, 1), 128, AddressClass::kLoopback},
+    {ipv6_from_groups(0, 0, 0, 0, 0, 0xFFFF), 96, AddressClass::kIPv4Mapped},
+    {ipv6_from_groups(0x64, 0xFF9B), 96, AddressClass::kTranslation},
+    {ipv6_from_groups(0x64, 0xFF9B, 1), 48, AddressClass::kTranslation},
+    {ipv6_from_groups(0x100), 64, AddressClass::kDiscardOnly},
+    {ipv6_from_groups(0x2001), 23, AddressClass::kProtocolAssignments},
+    {ipv6_from_groups(0x2001), 32, AddressClass::kTeredo},
+    {ipv6_from_groups(0x2001, 0x2), 48, AddressClass::kBenchmarking},
+    {ipv6_from_groups(0x2001, 0x3), 32, AddressClass::kAmt},
+    {ipv6_from_groups(0x2001, 0x4, 0x112), 48, AddressClass::kAs112},
+    {ipv6_from_groups(0x2001, 0x20), 28, AddressClass::kOrchid},
+    {ipv6_from_groups(0x2001, 0xDB8), 32, AddressClass::kDocumentation},
+    {ipv6_from_groups(0x2002), 16, AddressClass::k6to4},
+    {ipv6_from_groups(0x2620, 0x4F, 0x8000), 48, AddressClass::kAs112},
+    {ipv6_from_groups(0x3FFF), 20, AddressClass::kDocumentation},
+    {ipv6_from_groups(0xFC00), 7, AddressClass::kPrivate},
+    {ipv6_from_groups(0xFE80), 10, AddressClass::kLinkLocal},
+    {ipv6_from_groups(0xFEC0), 10, AddressClass::kSiteLocal},
+    {ipv6_from_groups(0xFF00), 8, AddressClass::kMulticast},
+}};
+
+// Compiles a special range table into a 256 entry table indexed by the
+// leading byte. Ranges of /8 or shorter are folded into the classes of every
+// byte they cover; longer ranges sit in a short per-byte list that is checked
+// with branchless masked compares. Most addresses cost a single load.
+template <typename Int, int Width, size_t N>
+class SpecialRangeClassifier
+{
+public:
+    constexpr explicit SpecialRangeClassifier(const std::array<SpecialRange<Int>, N> &ranges)
+    {
+        size_t next = 0;
+        for (size_t byte = 0; byte < slots_.size(); ++byte)
+        {
+            Slot &slot = slots_[byte];
+            slot.begin = static_cast<uint16_t>(next);
+            for (const auto &range : ranges)
+            {
+                const auto leading = static_cast<size_t>(range.network >> (Width - 8));
+                const auto classes = static_cast<AddressClassMask>(range.address_class);
+                if (range.cidr <= 8)
+                {
+                    const size_t mask = (0xFF00u >> range.cidr) & 0xFF;
+                    if ((byte & mask) == leading)
+                    {
+                        slot.classes |= classes;
+                    }
+                }
+                else if (leading == byte)
+                {
+                    fine_[next++] = {mask(range.cidr), range.network, classes};
+                }
+            }
+            slot.count = static_cast<uint16_t>(next - slot.begin);
+        }
+    }
+
+    constexpr AddressClassMask classify(Int address) const
+    {
+        const Slot &slot = slots_[static_cast<size_t>(address >> (Width - 8))];
+        AddressClassMask result = slot.classes;
+        for (size_t i = slot.begin, end = slot.begin + slot.count; i < end; ++i)
+        {
+            result |= (address & fine_[i].mask) == fine_[i].network ? fine_[i].classes : 0;
+        }
+        return result;
+    }
+
+private:
+    friend struct BatchClassifier;
+
+    struct Slot
+    {
+        AddressClassMask classes = 0;
+        uint16_t begin = 0;
+        uint16_t count = 0;
+    };
+
+    struct Fine
+    {
+        Int mask = 0;
+        Int network = 0;
+        AddressClassMask classes = 0;
+    };
+
+    static constexpr Int mask(uint8_t cidr)
+    {
+        return static_cast<Int>(~Int{0} << (Width - cidr));
+    }
+
+    std::array<Slot, 256> slots_{};
+    std::array<Fine, N> fine_{};
+};
+
+inline constexpr SpecialRangeClassifier<uint32_t, 32, kSpecialRangesV4.size()> kClassifierV4(kSpecialRangesV4);
+inline constexpr SpecialRangeClassifier<uint128, 128, kSpecialRangesV6.size()> kClassifierV6(kSpecialRangesV6);
+
+constexpr AddressClassMask classify(IPv4Value address)
+{
+    return kClassifierV4.classify(address.value);
+}
+
+constexpr AddressClassMask classify(const IPv6Value &address)
+{
+    return kClassifierV6.classify(to_uint128(address));
+}
+
+constexpr AddressClassMask classify(const IPValue &address)
+{
+    return address.is_ipv4() ? classify(address.v4()) : classify(address.v6());
+}
+
+// Batch classification; `out` must be as long as `addresses`. The IPv4
+// version looks up eight leading bytes per gather and only evaluates the
+// longer ranges, with SIMD compares, when one of the eight needs them.
+void classify_batch(std::span<const uint32_t> addresses, std::span<AddressClassMask> out);
+void classify_batch(std::span<const IPv6Value> addresses, std::span<AddressClassMask> out);
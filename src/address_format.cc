@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/address_format.cc
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#include "address_format.hh"
+#include <array>
+#include <cstring>
+#include <system_error>
+
+namespace
+{
+
+    struct OctetText
+    {
+        std::array<char, 3> digits;
+        uint8_t length;
+    };
+
+    constexpr std::array<OctetText, 256> MakeOctetTable()
+    {
+        std::array<OctetText, 256> table{};
+        for (int value = 0; value < 256; ++value)
+        {
+            auto &entry = table[value];
+            if (value >= 100)
+            {
+                entry.digits = {static_cast<char>('0' + value / 100), static_cast<char>('0' + value / 10 % 10),
+                                static_cast<char>('0' + value % 10)};
+                entry.length = 3;
+            }
+            else if (value >= 10)
+            {
+                entry.digits = {static_cast<char>('0' + value / 10), static_cast<char>('0' + value % 10), 0};
+                entry.length = 2;
+            }
+            else
+            {
+                entry.digits = {static_cast<char>('0' + value), 0, 0};
+                entry.length = 1;
+            }
+        }
+        return table;
+    }
+
+    constexpr std::array<std::array<char, 8>, 256> MakeBinaryTable()
+    {
+        std::array<std::array<char, 8>, 256> table{};
+        for (int value = 0; value < 256; ++value)
+        {
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                table[value][bit] = (value & (0x80 >> bit)) ? '1' : '0';
+            }
+        }
+        return table;
+    }
+
+    constexpr auto kOctetTable = MakeOctetTable();
+    constexpr auto kBinaryTable = MakeBinaryTable();
+    constexpr char kHexDigits[] = "0123456789abcdef";
+
+    std::to_chars_result Emit(std::span<char> out, const char *text, size_t length)
+    {
+        if (out.size() < length)
+        {
+            return {out.data() + out.size(), std::errc::value_too_large};
+        }
+        std::memcpy(out.data(), text, length);
+        return {out.data() + length, std::errc()};
+    }
+
+    char *AppendGroup(char *p, uint16_t group)
+    {
+        const int digits = group >= 0x1000 ? 4 : group >= 0x100 ? 3 : group >= 0x10 ? 2 : 1;
+        for (int shift = (digits - 1) * 4; shift >= 0; shift -= 4)
+        {
+            *p++ = kHexDigits[(group >> shift) & 0xF];
+        }
+        return p;
+    }
+
+    template <size_t MaxLength, typename Address, typename Formatter>
+    void AppendTo(fmt::memory_buffer &out, const Address &address, Formatter formatter)
+    {
+        const size_t offset = out.size();
+        out.resize(offset + MaxLength);
+        const auto result = formatter(std::span<char>(out.data() + offset, MaxLength), address);
+        out.resize(static_cast<size_t>(result.ptr - out.data()));
+    }
+
+}
+
+std::to_chars_result format_address(std::span<char> out, IPv4Value address)
+{
+    char text[kIPv4TextMaxLength + 1];
+    char *p = text;
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        const auto &octet = kOctetTable[(address.value >> shift) & 0xFF];
+        std::memcpy(p, octet.digits.data(), 3);
+        p += octet.length;
+        *p++ = '.';
+    }
+    return Emit(out, text, static_cast<size_t>(p - text - 1));
+}
+
+std::to_chars_result format_address(std::span<char> out, const IPv6Value &address)
+{
+    std::array<uint16_t, 8> groups;
+    for (size_t i = 0; i < 8; ++i)
+    {
+        groups[i] = static_cast<uint16_t>((address.bytes[2 * i] << 8) | address.bytes[2 * i + 1]);
+    }
+
+    int best_start = -1;
+    int best_length = 1;
+    for (int i = 0; i < 8;)
+    {
+        if (groups[i] != 0)
+        {
+            ++i;
+            continue;
+        }
+        int j = i;
+        while (j < 8 && groups[j] == 0)
+        {
+            ++j;
+        }
+        if (j - i > best_length)
+        {
+            best_start = i;
+            best_length = j - i;
+        }
+        i = j;
+    }
+
+    char text[kIPv6TextMaxLength];
+    char *p = text;
+    for (int i = 0; i < 8; ++i)
+    {
+        if (i == best_start)
+        {
+            *p++ = ':';
+            if (i == 0)
+            {
+                *p++ = ':';
+            }
+            i += best_length - 1;
+            continue;
+        }
+        p = AppendGroup(p, groups[i]);
+        if (i < 7)
+        {
+            *p++ = ':';
+        }
+    }
+    return Emit(out, text, static_cast<size_t>(p - text));
+}
+
+std::to_chars_result format_address(std::span<char> out, const IPValue &address)
+{
+    return address.is_ipv4() ? format_address(out, address.v4()) : format_address(out, address.v6());
+}
+
+std::to_chars_result format_address_expanded(std::span<char> out, const IPv6Value &address)
+{
+    char text[kIPv6TextMaxLength + 1];
+    char *p = text;
+    for (size_t i = 0; i < 16; i += 2)
+    {
+        *p++ = kHexDigits[address.bytes[i] >> 4];
+        *p++ = kHexDigits[address.bytes[i] & 0xF];
+        *p++ = kHexDigits[address.bytes[i + 1] >> 4];
+        *p++ = kHexDigits[address.bytes[i + 1] & 0xF];
+        *p++ = ':';
+    }
+    return Emit(out, text, kIPv6TextMaxLength);
+}
+
+std::to_chars_result format_binary(std::span<char> out, IPv4Value address)
+{
+    char text[kIPv4BinaryLength];
+    for (int i = 0; i < 4; ++i)
+    {
+        std::memcpy(text + 8 * i, kBinaryTable[(address.value >> (24 - 8 * i)) & 0xFF].data(), 8);
+    }
+    return Emit(out, text, kIPv4BinaryLength);
+}
+
+std::to_chars_result format_binary(std::span<char> out, const IPv6Value &address)
+{
+    char text[kIPv6BinaryLength];
+    for (size_t i = 0; i < 16; ++i)
+    {
+        std::memcpy(text + 8 * i, kBinaryTable[address.bytes[i]].data(), 8);
+    }
+    return Emit(out, text, kIPv6BinaryLength);
+}
+
+std::to_chars_result format_binary(std::span<char> out, const IPValue &address)
+{
+    return address.is_ipv4() ? format_binary(out, address.v4()) : format_binary(out, address.v6());
+}
+
+void format_address(fmt::memory_buffer &out, const IPValue &address)
+{
+    AppendTo<kIPv6TextMaxLength>(out, address, [](std::span<char> span, const IPValue &value)
+                                 { return format_address(span, value); });
+}
+
+void format_address_expanded(fmt::memory_buffer &out, const IPValue &address)
+{
+    AppendTo<kIPv6TextMaxLength>(out, address, [](std::span<char> span, const IPValue &value)
+                                 { return value.is_ipv4() ? format_address(span, value.v4())
+                                                          : format_address_expanded(span, value.v6()); });
+}
+
+void format_binary(fmt::memory_buffer &out, const IPValue &address)
+{
+    AppendTo<kIPv6BinaryLength>(out, address, [](std::span<char> span, const IPValue &value)
+                                { return format_binary(span, value); });
+}
@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/address_format.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include "ip_analyzer.hh"
+#include <charconv>
+#include <cstddef>
+#include <span>
+#include <fmt/format.h>
+
+// Allocation-free address formatting. The span overloads follow
+// std::to_chars: they return one past the last written character, or
+// std::errc::value_too_large if the buffer cannot hold the result.
+
+constexpr size_t kIPv4TextMaxLength = 15;
+constexpr size_t kIPv6TextMaxLength = 39;
+constexpr size_t kIPv4BinaryLength = 32;
+constexpr size_t kIPv6BinaryLength = 128;
+
+std::to_chars_result format_address(std::span<char> out, IPv4Value address);
+// RFC 5952 canonical text: lowercase, no leading zeros, longest zero run as "::".
+std::to_chars_result format_address(std::span<char> out, const IPv6Value &address);
+std::to_chars_result format_address(std::span<char> out, const IPValue &address);
+// Eight fully padded groups, e.g. 2001:0db8:0000:0000:0000:0000:0000:0001.
+std::to_chars_result format_address_expanded(std::span<char> out, const IPv6Value &address);
+
+std::to_chars_result format_binary(std::span<char> out, IPv4Value address);
+std::to_chars_result format_binary(std::span<char> out, const IPv6Value &address);
+std::to_chars_result format_binary(std::span<char> out, const IPValue &address);
+
+void format_address(fmt::memory_buffer &out, const IPValue &address);
+void format_address_expanded(fmt::memory_buffer &out, const IPValue &address);
+void format_binary(fmt::memory_buffer &out, const IPValue &address);
@@ -0,0 +1,1044 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/arrow_ipc.cc
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#include "arrow_ipc.hh"
+#include "address_class.hh"
+#include "range_kernels.hh"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+namespace
+{
+
+    constexpr char kFileMagic[6] = {'A', 'R', 'R', 'O', 'W', '1'};
+    constexpr uint32_t kContinuation = 0xFFFFFFFF;
+    constexpr int16_t kMetadataV4 = 3;
+    constexpr int16_t kMetadataV5 = 4;
+    constexpr size_t kBufferAlignment = 64;
+
+    // MessageHeader union members.
+    constexpr uint8_t kSchemaHeader = 1;
+    constexpr uint8_t kDictionaryBatchHeader = 2;
+    constexpr uint8_t kRecordBatchHeader = 3;
+
+    // Type union members.
+    enum TypeId : uint8_t
+    {
+        kNullType = 1,
+        kIntType = 2,
+        kFloatingPointType = 3,
+        kBinaryType = 4,
+        kUtf8Type = 5,
+        kBoolType = 6,
+        kDecimalType = 7,
+        kDateType = 8,
+        kTimeType = 9,
+        kTimestampType = 10,
+        kIntervalType = 11,
+        kFixedSizeBinaryType = 15,
+        kDurationType = 18,
+        kLargeBinaryType = 19,
+        kLargeUtf8Type = 20,
+    };
+
+    size_t ValueWidth(ArrowType type)
+    {
+        switch (type)
+        {
+        case ArrowType::kUint8:
+            return 1;
+        case ArrowType::kUint32:
+            return 4;
+        case ArrowType::kUint64:
+            return 8;
+        case ArrowType::kFixedSizeBinary16:
+            return 16;
+        default:
+            return 0;
+        }
+    }
+
+    constexpr size_t AlignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    void RequireLittleEndian()
+    {
+        if constexpr (std::endian::native != std::endian::little)
+        {
+            throw std::runtime_error("Arrow IPC support requires a little endian host");
+        }
+    }
+
+    struct MalformedFlatbuffer
+    {
+    };
+
+    // Read access to a flatbuffers table. Every offset is bounds checked;
+    // violations throw MalformedFlatbuffer.
+    class FlatTable
+    {
+    public:
+        static FlatTable root(std::span<const uint8_t> buffer)
+        {
+            const FlatTable start(buffer, 0);
+            return FlatTable(buffer, start.follow(0));
+        }
+
+        template <typename T>
+        T scalar(size_t id, T fallback) const
+        {
+            const size_t field = field_offset(id);
+            return field == 0 ? fallback : load<T>(position_ + field);
+        }
+
+        std::optional<FlatTable> table(size_t id) const
+        {
+            const size_t field = field_offset(id);
+            if (field == 0)
+            {
+                return std::nullopt;
+            }
+            return FlatTable(buffer_, follow(position_ + field));
+        }
+
+        // Position of the first element and the length of a vector field.
+        std::pair<size_t, size_t> vector(size_t id, size_t element_size) const
+        {
+            const size_t field = field_offset(id);
+            if (field == 0)
+            {
+                return {0, 0};
+            }
+            const size_t start = follow(position_ + field);
+            const size_t length = load<uint32_t>(start);
+            check(start + 4, length * element_size);
+            return {start + 4, length};
+        }
+
+        FlatTable element(std::pair<size_t, size_t> vector, size_t index) const
+        {
+            return FlatTable(buffer_, follow(vector.first + 4 * index));
+        }
+
+        std::string string(size_t id) const
+        {
+            const auto [start, length] = vector(id, 1);
+            return std::string(reinterpret_cast<const char *>(buffer_.data() + start), length);
+        }
+
+        template <typename T>
+        T load(size_t position) const
+        {
+            check(position, sizeof(T));
+            T value;
+            std::memcpy(&value, buffer_.data() + position, sizeof(T));
+            return value;
+        }
+
+    private:
+        FlatTable(std::span<const uint8_t> buffer, size_t position) : buffer_(buffer), position_(position)
+        {
+            check(position, 4);
+        }
+
+        size_t follow(size_t position) const { return position + load<uint32_t>(position); }
+
+        size_t field_offset(size_t id) const
+        {
+            const int64_t vtable = static_cast<int64_t>(position_) - load<int32_t>(position_);
+            if (vtable < 0)
+            {
+                throw MalformedFlatbuffer{};
+            }
+            const auto vtable_size = load<uint16_t>(static_cast<size_t>(vtable));
+            if (4 + 2 * id + 2 > vtable_size)
+            {
+                return 0;
+            }
+            return load<uint16_t>(static_cast<size_t>(vtable) + 4 + 2 * id);
+        }
+
+        void check(size_t position, size_t size) const
+        {
+            if (position > buffer_.size() || size > buffer_.size() - position)
+            {
+                throw MalformedFlatbuffer{};
+            }
+        }
+
+        std::span<const uint8_t> buffer_;
+        size_t position_;
+    };
+
+    // A flatbuffers object to serialize: a table of scalar and child fields,
+    // a string, a vector of tables or a vector of 8 byte aligned structs.
+    struct FlatObject
+    {
+        enum class Kind
+        {
+            kTable,
+            kString,
+            kTableVector,
+            kStructVector
+        };
+
+        struct Field
+        {
+            uint16_t id;
+            uint8_t size;
+            uint64_t value;
+            // Index into `children` for offset fields, -1 for scalars.
+            int child;
+        };
+
+        Kind kind = Kind::kTable;
+        std::vector<Field> fields;
+        std::vector<FlatObject> children;
+        std::string bytes;
+        uint32_t count = 0;
+
+        FlatObject &scalar(uint16_t id, uint8_t size, uint64_t value)
+        {
+            fields.push_back({id, size, value, -1});
+            return *this;
+        }
+
+        FlatObject &child(uint16_t id, FlatObject object)
+        {
+            fields.push_back({id, 4, 0, static_cast<int>(children.size())});
+            children.push_back(std::move(object));
+            return *this;
+        }
+
+        static FlatObject string(std::string_view text)
+        {
+            FlatObject object;
+            object.kind = Kind::kString;
+            object.bytes = text;
+            return object;
+        }
+
+        static FlatObject tables(std::vector<FlatObject> elements)
+        {
+            FlatObject object;
+            object.kind = Kind::kTableVector;
+            object.count = static_cast<uint32_t>(elements.size());
+            object.children = std::move(elements);
+            return object;
+        }
+
+        template <typename T>
+        static FlatObject structs(std::span<const T> elements)
+        {
+            static_assert(alignof(T) == 8 && sizeof(T) % 8 == 0);
+            FlatObject object;
+            object.kind = Kind::kStructVector;
+            object.count = static_cast<uint32_t>(elements.size());
+            object.bytes.assign(reinterpret_cast<const char *>(elements.data()), elements.size_bytes());
+            return object;
+        }
+    };
+
+    void Pad(std::vector<uint8_t> &out, size_t alignment, size_t remainder = 0)
+    {
+        while (out.size() % alignment != remainder)
+        {
+            out.push_back(0);
+        }
+    }
+
+    void StoreLittleEndian(std::vector<uint8_t> &out, size_t position, uint64_t value, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            out[position + i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+    }
+
+    void Append(std::vector<uint8_t> &out, uint64_t value, size_t size)
+    {
+        out.resize(out.size() + size);
+        StoreLittleEndian(out, out.size() - size, value, size);
+    }
+
+    // Objects are written parent first, so every uoffset points forward as
+    // the format requires; vtables precede their tables.
+    size_t WriteFlat(std::vector<uint8_t> &out, const FlatObject &object)
+    {
+        switch (object.kind)
+        {
+        case FlatObject::Kind::kString:
+        {
+            Pad(out, 4);
+            const size_t position = out.size();
+            Append(out, object.bytes.size(), 4);
+            out.insert(out.end(), object.bytes.begin(), object.bytes.end());
+            out.push_back(0);
+            return position;
+        }
+        case FlatObject::Kind::kStructVector:
+        {
+            Pad(out, 8, 4);
+            const size_t position = out.size();
+            Append(out, object.count, 4);
+            out.insert(out.end(), object.bytes.begin(), object.bytes.end());
+            return position;
+        }
+        case FlatObject::Kind::kTableVector:
+        {
+            Pad(out, 4);
+            const size_t position = out.size();
+            Append(out, object.count, 4);
+            out.resize(out.size() + 4 * object.count);
+            for (size_t i = 0; i < object.count; ++i)
+            {
+                const size_t slot = position + 4 + 4 * i;
+                StoreLittleEndian(out, slot, WriteFlat(out, object.children[i]) - slot, 4);
+            }
+            return position;
+        }
+        case FlatObject::Kind::kTable:
+            break;
+        }
+
+        // Widest fields first keeps the inline part free of padding.
+        std::vector<FlatObject::Field> fields = object.fields;
+        std::stable_sort(fields.begin(), fields.end(), [](const auto &a, const auto &b)
+                         { return a.size > b.size; });
+        std::vector<size_t> offsets(fields.size());
+        size_t inline_size = 4;
+        uint16_t slots = 0;
+        for (size_t i = 0; i < fields.size(); ++i)
+        {
+            inline_size = AlignUp(inline_size, fields[i].size);
+            offsets[i] = inline_size;
+            inline_size += fields[i].size;
+            slots = std::max<uint16_t>(slots, fields[i].id + 1);
+        }
+
+        Pad(out, 2);
+        const size_t vtable = out.size();
+        Append(out, 4 + 2 * slots, 2);
+        Append(out, inline_size, 2);
+        out.resize(out.size() + 2 * slots);
+        for (size_t i = 0; i < fields.size(); ++i)
+        {
+            StoreLittleEndian(out, vtable + 4 + 2 * fields[i].id, offsets[i], 2);
+        }
+
+        Pad(out, 8);
+        const size_t table = out.size();
+        out.resize(table + inline_size);
+        StoreLittleEndian(out, table, table - vtable, 4);
+        for (size_t i = 0; i < fields.size(); ++i)
+        {
+            StoreLittleEndian(out, table + offsets[i], fields[i].value, fields[i].size);
+        }
+        for (size_t i = 0; i < fields.size(); ++i)
+        {
+            if (fields[i].child >= 0)
+            {
+                const size_t slot = table + offsets[i];
+                StoreLittleEndian(out, slot, WriteFlat(out, object.children[static_cast<size_t>(fields[i].child)]) - slot, 4);
+            }
+        }
+        return table;
+    }
+
+    std::vector<uint8_t> Serialize(const FlatObject &root)
+    {
+        std::vector<uint8_t> out(4);
+        StoreLittleEndian(out, 0, WriteFlat(out, root), 4);
+        return out;
+    }
+
+    FlatObject SchemaObject(const std::vector<ArrowField> &schema)
+    {
+        std::vector<FlatObject> fields;
+        for (const ArrowField &field : schema)
+        {
+            FlatObject type;
+            uint8_t type_id = kIntType;
+            if (field.type == ArrowType::kFixedSizeBinary16)
+            {
+                type_id = kFixedSizeBinaryType;
+                type.scalar(0, 4, 16);
+            }
+            else
+            {
+                type.scalar(0, 4, ValueWidth(field.type) * 8).scalar(1, 1, 0);
+            }
+
+            FlatObject object;
+            object.child(0, FlatObject::string(field.name))
+                .scalar(1, 1, 0)
+                .scalar(2, 1, type_id)
+                .child(3, std::move(type))
+                .child(5, FlatObject::tables({}));
+            fields.push_back(std::move(object));
+        }
+
+        FlatObject object;
+        object.scalar(0, 2, 0).child(1, FlatObject::tables(std::move(fields)));
+        return object;
+    }
+
+    FlatObject MessageObject(uint8_t header_type, FlatObject header, uint64_t body_length)
+    {
+        FlatObject object;
+        object.scalar(0, 2, kMetadataV5).scalar(1, 1, header_type).child(2, std::move(header)).scalar(3, 8, body_length);
+        return object;
+    }
+
+    struct FieldNode
+    {
+        int64_t length;
+        int64_t null_count;
+    };
+
+    struct BufferRange
+    {
+        int64_t offset;
+        int64_t length;
+    };
+
+}
+
+struct ArrowReader::Message
+{
+    uint8_t header_type;
+    std::span<const uint8_t> metadata;
+    std::span<const std::byte> body;
+};
+
+ArrowReader::ArrowReader(const std::string &path) : path_(path), file_(path), data_(file_.view())
+{
+    RequireLittleEndian();
+    end_ = data_.size();
+    if (data_.size() >= sizeof(kFileMagic) && std::memcmp(data_.data(), kFileMagic, sizeof(kFileMagic)) == 0)
+    {
+        // The file format wraps a stream in magic bytes and a footer; the
+        // footer repeats the batch offsets, which a sequential reader does
+        // not need.
+        constexpr size_t kTrailerSize = 4 + sizeof(kFileMagic);
+        if (data_.size() < 8 + kTrailerSize || std::memcmp(data_.data() + data_.size() - sizeof(kFileMagic), kFileMagic, sizeof(kFileMagic)) != 0)
+        {
+            fail("truncated file");
+        }
+        int32_t footer_size;
+        std::memcpy(&footer_size, data_.data() + data_.size() - kTrailerSize, sizeof(footer_size));
+        if (footer_size < 0 || static_cast<size_t>(footer_size) > data_.size() - 8 - kTrailerSize)
+        {
+            fail("bad footer size");
+        }
+        offset_ = 8;
+        end_ = data_.size() - kTrailerSize - static_cast<size_t>(footer_size);
+    }
+
+    const auto message = next_message();
+    if (!message || message->header_type != kSchemaHeader)
+    {
+        fail("missing schema");
+    }
+    read_schema(*message);
+}
+
+std::optional<size_t> ArrowReader::find(std::string_view name) const
+{
+    for (size_t i = 0; i < schema_.size(); ++i)
+    {
+        if (schema_[i].name == name)
+        {
+            return i;
+        }
+    }
+    return std::nullopt;
+}
+
+void ArrowReader::fail(const std::string &reason) const
+{
+    throw std::runtime_error("'" + path_ + "' is not a supported Arrow IPC file: " + reason);
+}
+
+std::optional<ArrowReader::Message> ArrowReader::next_message()
+{
+    const auto load32 = [&](size_t position)
+    {
+        uint32_t value;
+        std::memcpy(&value, data_.data() + position, sizeof(value));
+        return value;
+    };
+
+    if (end_ - offset_ < 4)
+    {
+        return std::nullopt;
+    }
+    // Streams written before format 0.15 have no continuation marker.
+    size_t prefix = 4;
+    size_t metadata_size = load32(offset_);
+    if (metadata_size == kContinuation)
+    {
+        if (end_ - offset_ < 8)
+        {
+            fail("truncated message");
+        }
+        prefix = 8;
+        metadata_size = load32(offset_ + 4);
+    }
+    if (metadata_size == 0)
+    {
+        return std::nullopt;
+    }
+    if (metadata_size > end_ - offset_ - prefix)
+    {
+        fail("truncated message");
+    }
+
+    Message message{};
+    message.metadata = std::span(reinterpret_cast<const uint8_t *>(data_.data()) + offset_ + prefix, metadata_size);
+    uint64_t body_length = 0;
+    try
+    {
+        const FlatTable root = FlatTable::root(message.metadata);
+        if (root.scalar<int16_t>(0, 0) < kMetadataV4)
+        {
+            fail("metadata version older than V4");
+        }
+        message.header_type = root.scalar<uint8_t>(1, 0);
+        body_length = static_cast<uint64_t>(root.scalar<int64_t>(3, 0));
+    }
+    catch (const MalformedFlatbuffer &)
+    {
+        fail("malformed message metadata");
+    }
+
+    const size_t body = offset_ + prefix + metadata_size;
+    if (body_length > end_ - body)
+    {
+        fail("truncated message body");
+    }
+    message.body = std::as_bytes(std::span(data_.data() + body, body_length));
+    offset_ = body + body_length;
+    return message;
+}
+
+void ArrowReader::read_schema(const Message &message)
+{
+    try
+    {
+        const auto schema = FlatTable::root(message.metadata).table(2);
+        if (!schema)
+        {
+            fail("missing schema");
+        }
+        if (schema->scalar<int16_t>(0, 0) != 0)
+        {
+            fail("big endian data");
+        }
+
+        const auto fields = schema->vector(1, 4);
+        for (size_t i = 0; i < fields.second; ++i)
+        {
+            const FlatTable field = schema->element(fields, i);
+            const auto type_id = field.scalar<uint8_t>(2, 0);
+            const auto type = field.table(3);
+            if (field.table(4))
+            {
+                fail("dictionary encoded columns are not supported");
+            }
+
+            ArrowType kind = ArrowType::kOther;
+            size_t buffers = 2;
+            switch (type_id)
+            {
+            case kNullType:
+                buffers = 0;
+                break;
+            case kIntType:
+                if (type && type->scalar<uint8_t>(1, 0) == 0)
+                {
+                    const auto width = type->scalar<int32_t>(0, 0);
+                    kind = width == 8 ? ArrowType::kUint8 : width == 32 ? ArrowType::kUint32 : width == 64 ? ArrowType::kUint64 : kind;
+                }
+                break;
+            case kFixedSizeBinaryType:
+                if (type && type->scalar<int32_t>(0, 0) == 16)
+                {
+                    kind = ArrowType::kFixedSizeBinary16;
+                }
+                break;
+            case kFloatingPointType:
+            case kBoolType:
+            case kDecimalType:
+            case kDateType:
+            case kTimeType:
+            case kTimestampType:
+            case kIntervalType:
+            case kDurationType:
+                break;
+            case kBinaryType:
+            case kUtf8Type:
+            case kLargeBinaryType:
+            case kLargeUtf8Type:
+                buffers = 3;
+                break;
+            default:
+                fail("column '" + field.string(0) + "' has a nested or unsupported type");
+            }
+            schema_.push_back({field.string(0), kind});
+            buffer_counts_.push_back(buffers);
+        }
+    }
+    catch (const MalformedFlatbuffer &)
+    {
+        fail("malformed schema");
+    }
+    columns_.resize(schema_.size());
+}
+
+bool ArrowReader::next_batch()
+{
+    for (;;)
+    {
+        const auto message = next_message();
+        if (!message)
+        {
+            return false;
+        }
+        // Dictionary encoded columns are rejected with the schema, so
+        // dictionaries can only belong to nothing we read.
+        if (message->header_type == kDictionaryBatchHeader)
+        {
+            continue;
+        }
+        if (message->header_type != kRecordBatchHeader)
+        {
+            fail("unexpected message type");
+        }
+        read_batch(*message);
+        return true;
+    }
+}
+
+void ArrowReader::read_batch(const Message &message)
+{
+    try
+    {
+        const auto batch = FlatTable::root(message.metadata).table(2);
+        if (!batch)
+        {
+            fail("missing record batch");
+        }
+        if (batch->table(3))
+        {
+            fail("compressed record batches are not supported");
+        }
+        const auto rows = batch->scalar<int64_t>(0, 0);
+        const auto nodes = batch->vector(1, sizeof(FieldNode));
+        const auto buffers = batch->vector(2, sizeof(BufferRange));
+        size_t buffer_count = 0;
+        for (const size_t count : buffer_counts_)
+        {
+            buffer_count += count;
+        }
+        if (rows < 0 || nodes.second != schema_.size() || buffers.second != buffer_count)
+        {
+            fail("record batch does not match the schema");
+        }
+        rows_ = static_cast<uint64_t>(rows);
+
+        size_t buffer = 0;
+        for (size_t i = 0; i < schema_.size(); ++i)
+        {
+            const auto length = batch->load<int64_t>(nodes.first + sizeof(FieldNode) * i);
+            const auto null_count = batch->load<int64_t>(nodes.first + sizeof(FieldNode) * i + 8);
+            columns_[i] = {};
+            const size_t width = ValueWidth(schema_[i].type);
+            if (width != 0)
+            {
+                const auto offset = batch->load<int64_t>(buffers.first + sizeof(BufferRange) * (buffer + 1));
+                const auto size = batch->load<int64_t>(buffers.first + sizeof(BufferRange) * (buffer + 1) + 8);
+                if (length != rows || null_count < 0 || offset < 0 || size < 0 ||
+                    static_cast<uint64_t>(offset) > message.body.size() ||
+                    static_cast<uint64_t>(size) > message.body.size() - static_cast<uint64_t>(offset) ||
+                    static_cast<uint64_t>(size) / width < rows_)
+                {
+                    fail("column '" + schema_[i].name + "' lies outside the record batch");
+                }
+                columns_[i].values = message.body.subspan(static_cast<size_t>(offset), rows_ * width);
+                columns_[i].null_count = static_cast<uint64_t>(null_count);
+            }
+            buffer += buffer_counts_[i];
+        }
+    }
+    catch (const MalformedFlatbuffer &)
+    {
+        fail("malformed record batch");
+    }
+}
+
+ArrowWriter::ArrowWriter(const std::string &path, std::vector<ArrowField> schema)
+    : path_(path), temporary_(path + ".tmp"), schema_(std::move(schema))
+{
+    RequireLittleEndian();
+    for (const ArrowField &field : schema_)
+    {
+        if (ValueWidth(field.type) == 0)
+        {
+            throw std::invalid_argument("ArrowWriter cannot write column '" + field.name + "'");
+        }
+    }
+
+    out_ = std::fopen(temporary_.c_str(), "wb");
+    if (out_ == nullptr)
+    {
+        throw std::system_error(errno, std::generic_category(), "cannot create '" + temporary_ + "'");
+    }
+    const char magic[8] = {'A', 'R', 'R', 'O', 'W', '1', 0, 0};
+    write(magic, sizeof(magic));
+    write_message(Serialize(MessageObject(kSchemaHeader, SchemaObject(schema_), 0)), {});
+    blocks_.clear();
+}
+
+ArrowWriter::~ArrowWriter()
+{
+    if (out_ != nullptr)
+    {
+        std::fclose(out_);
+        std::remove(temporary_.c_str());
+    }
+}
+
+void ArrowWriter::write_batch(uint64_t rows, std::span<const std::span<const std::byte>> columns)
+{
+    if (columns.size() != schema_.size())
+    {
+        throw std::invalid_argument("ArrowWriter batch does not match the schema");
+    }
+
+    std::vector<FieldNode> nodes;
+    std::vector<BufferRange> buffers;
+    std::vector<std::span<const std::byte>> body;
+    const std::byte zeros[kBufferAlignment] = {};
+    int64_t offset = 0;
+    for (size_t i = 0; i < columns.size(); ++i)
+    {
+        if (columns[i].size() != rows * ValueWidth(schema_[i].type))
+        {
+            throw std::invalid_argument("ArrowWriter column '" + schema_[i].name + "' has the wrong length");
+        }
+        nodes.push_back({static_cast<int64_t>(rows), 0});
+        // Without nulls the validity bitmap may be left empty.
+        buffers.push_back({offset, 0});
+        buffers.push_back({offset, static_cast<int64_t>(columns[i].size())});
+        body.push_back(columns[i]);
+        const size_t padding = AlignUp(columns[i].size(), kBufferAlignment) - columns[i].size();
+        body.push_back(std::span(zeros, padding));
+        offset += static_cast<int64_t>(columns[i].size() + padding);
+    }
+
+    FlatObject batch;
+    batch.scalar(0, 8, rows)
+        .child(1, FlatObject::structs(std::span<const FieldNode>(nodes)))
+        .child(2, FlatObject::structs(std::span<const BufferRange>(buffers)));
+    write_message(Serialize(MessageObject(kRecordBatchHeader, std::move(batch), static_cast<uint64_t>(offset))), body);
+}
+
+void ArrowWriter::write_message(const std::vector<uint8_t> &metadata, std::span<const std::span<const std::byte>> body)
+{
+    // The prefix and the padded metadata together are a multiple of 8.
+    const size_t metadata_size = AlignUp(8 + metadata.size(), 8) - 8;
+    Block block{static_cast<int64_t>(position_), static_cast<int32_t>(8 + metadata_size), 0, 0};
+
+    const uint32_t prefix[2] = {kContinuation, static_cast<uint32_t>(metadata_size)};
+    const uint8_t zeros[8] = {};
+    write(prefix, sizeof(prefix));
+    write(metadata.data(), metadata.size());
+    write(zeros, metadata_size - metadata.size());
+    for (const auto part : body)
+    {
+        write(part.data(), part.size());
+        block.body_length += static_cast<int64_t>(part.size());
+    }
+    blocks_.push_back(block);
+}
+
+void ArrowWriter::write(const void *data, size_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+    if (std::fwrite(data, 1, size, out_) != size)
+    {
+        throw std::system_error(errno, std::generic_category(), "cannot write '" + temporary_ + "'");
+    }
+    position_ += size;
+}
+
+void ArrowWriter::finish()
+{
+    if (out_ == nullptr)
+    {
+        return;
+    }
+
+    const uint32_t end_of_stream[2] = {kContinuation, 0};
+    write(end_of_stream, sizeof(end_of_stream));
+
+    static_assert(sizeof(Block) == 24);
+    FlatObject footer;
+    footer.scalar(0, 2, kMetadataV5)
+        .child(1, SchemaObject(schema_))
+        .child(2, FlatObject::structs(std::span<const Block>()))
+        .child(3, FlatObject::structs(std::span<const Block>(blocks_)));
+    const std::vector<uint8_t> metadata = Serialize(footer);
+    write(metadata.data(), metadata.size());
+    const auto footer_size = static_cast<int32_t>(metadata.size());
+    write(&footer_size, sizeof(footer_size));
+    write(kFileMagic, sizeof(kFileMagic));
+
+    const int error = errno;
+    const bool closed = std::fclose(std::exchange(out_, nullptr)) == 0;
+    if (!closed || std::rename(temporary_.c_str(), path_.c_str()) != 0)
+    {
+        const int code = closed ? errno : error;
+        std::remove(temporary_.c_str());
+        throw std::system_error(code, std::generic_category(), "cannot write '" + path_ + "'");
+    }
+}
+
+ArrowPrefixReader::ArrowPrefixReader(const std::string &path) : reader_(path)
+{
+    const auto &schema = reader_.schema();
+    const auto is_address = [&](size_t index)
+    {
+        return schema[index].type == ArrowType::kUint32 || schema[index].type == ArrowType::kFixedSizeBinary16;
+    };
+
+    std::optional<size_t> address = reader_.find("address");
+    for (size_t i = 0; !address && i < schema.size(); ++i)
+    {
+        if (is_address(i))
+        {
+            address = i;
+        }
+    }
+    if (!address || !is_address(*address))
+    {
+        throw std::runtime_error("'" + path + "' has no uint32 or fixed_size_binary(16) address column");
+    }
+    address_ = *address;
+
+    cidr_ = reader_.find("cidr");
+    if (cidr_ && schema[*cidr_].type != ArrowType::kUint8)
+    {
+        throw std::runtime_error("'" + path + "': the cidr column must be uint8");
+    }
+}
+
+bool ArrowPrefixReader::ipv4_only() const
+{
+    return reader_.schema()[address_].type == ArrowType::kUint32;
+}
+
+bool ArrowPrefixReader::next(PrefixColumn &out)
+{
+    if (!reader_.next_batch())
+    {
+        return false;
+    }
+    out.clear();
+
+    const size_t rows = reader_.rows();
+    const ArrowColumn &addresses = reader_.column(address_);
+    if (addresses.null_count != 0 || (cidr_ && reader_.column(*cidr_).null_count != 0))
+    {
+        throw std::runtime_error("null addresses and prefix lengths are not supported");
+    }
+    cidrs_.resize(rows);
+    if (cidr_)
+    {
+        std::memcpy(cidrs_.data(), reader_.column(*cidr_).values.data(), rows);
+    }
+    else
+    {
+        std::fill(cidrs_.begin(), cidrs_.end(), ipv4_only() ? 32 : 128);
+    }
+
+    if (ipv4_only())
+    {
+        v4_.resize(rows);
+        std::memcpy(v4_.data(), addresses.values.data(), rows * sizeof(uint32_t));
+        out.append_v4(v4_, cidrs_);
+        return true;
+    }
+
+    constexpr uint8_t kMappedPrefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF};
+    out.reserve(0, rows);
+    for (size_t i = 0; i < rows; ++i)
+    {
+        IPv6Value address;
+        std::memcpy(address.bytes.data(), addresses.values.data() + 16 * i, 16);
+        if (cidrs_[i] >= 96 && std::memcmp(address.bytes.data(), kMappedPrefix, sizeof(kMappedPrefix)) == 0)
+        {
+            uint32_t v4;
+            std::memcpy(&v4, address.bytes.data() + 12, sizeof(v4));
+            out.push_back(IPv4Value{std::byteswap(v4)}, static_cast<uint8_t>(cidrs_[i] - 96));
+        }
+        else
+        {
+            out.push_back(address, cidrs_[i]);
+        }
+    }
+    return true;
+}
+
+namespace
+{
+
+    std::vector<ArrowField> AnalysisSchema(bool ipv4_only)
+    {
+        if (ipv4_only)
+        {
+            return {{"network", ArrowType::kUint32}, {"cidr", ArrowType::kUint8}, {"broadcast", ArrowType::kUint32},
+                    {"first", ArrowType::kUint32}, {"last", ArrowType::kUint32}, {"hosts", ArrowType::kUint64},
+                    {"classes", ArrowType::kUint32}};
+        }
+        return {{"family", ArrowType::kUint8}, {"network", ArrowType::kFixedSizeBinary16}, {"cidr", ArrowType::kUint8},
+                {"first", ArrowType::kFixedSizeBinary16}, {"last", ArrowType::kFixedSizeBinary16},
+                {"hosts", ArrowType::kFixedSizeBinary16}, {"classes", ArrowType::kUint32}};
+    }
+
+    template <typename T>
+    std::span<const std::byte> Bytes(const std::vector<T> &values)
+    {
+        return std::as_bytes(std::span(values));
+    }
+
+    IPv6Value MappedIPv4(uint32_t address)
+    {
+        IPv6Value mapped{};
+        mapped.bytes[10] = 0xFF;
+        mapped.bytes[11] = 0xFF;
+        const uint32_t network_order = std::byteswap(address);
+        std::memcpy(mapped.bytes.data() + 12, &network_order, sizeof(network_order));
+        return mapped;
+    }
+
+    // A uint128 as 16 little-endian bytes, independent of its in-memory
+    // representation.
+    IPv6Value LittleEndian128(uint128 value)
+    {
+        IPv6Value bytes;
+        for (size_t i = 0; i < 8; ++i)
+        {
+            bytes.bytes[i] = static_cast<uint8_t>(uint128_low(value) >> (8 * i));
+            bytes.bytes[8 + i] = static_cast<uint8_t>(uint128_high(value) >> (8 * i));
+        }
+        return bytes;
+    }
+
+}
+
+ArrowAnalysisWriter::ArrowAnalysisWriter(const std::string &path, bool ipv4_only)
+    : ipv4_only_(ipv4_only), writer_(path, AnalysisSchema(ipv4_only))
+{
+}
+
+void ArrowAnalysisWriter::write(const PrefixColumn &prefixes)
+{
+    if (ipv4_only_)
+    {
+        write_v4(prefixes);
+    }
+    else
+    {
+        write_mixed(prefixes);
+    }
+}
+
+void ArrowAnalysisWriter::write_v4(const PrefixColumn &prefixes)
+{
+    if (!prefixes.v6_addresses().empty())
+    {
+        throw std::invalid_argument("IPv6 prefix in IPv4-only Arrow output");
+    }
+    const auto addresses = prefixes.v4_addresses();
+    const auto cidrs = prefixes.v4_cidrs();
+    const size_t n = addresses.size();
+    for (auto *column : {&network_, &broadcast_, &first_, &last_, &classes_})
+    {
+        column->resize(n);
+    }
+    hosts_.resize(n);
+
+    compute_ranges_v4(addresses, cidrs, {network_, broadcast_, first_, last_});
+    classify_batch(addresses, classes_);
+    for (size_t i = 0; i < n; ++i)
+    {
+        hosts_[i] = static_cast<uint64_t>(host_count(cidrs[i], 32));
+    }
+
+    const std::span<const std::byte> columns[] = {Bytes(network_), std::as_bytes(cidrs), Bytes(broadcast_), Bytes(first_),
+                                                  Bytes(last_), Bytes(hosts_), Bytes(classes_)};
+    writer_.write_batch(n, columns);
+}
+
+void ArrowAnalysisWriter::write_mixed(const PrefixColumn &prefixes)
+{
+    const auto v4 = prefixes.v4_addresses();
+    const auto v6 = prefixes.v6_addresses();
+    for (auto *column : {&network_, &broadcast_, &first_, &last_})
+    {
+        column->resize(v4.size());
+    }
+    std::vector<IPv6Value> network6(v6.size()), broadcast6(v6.size()), first6(v6.size()), last6(v6.size());
+    std::vector<AddressClassMask> classes4(v4.size()), classes6(v6.size());
+    compute_ranges_v4(v4, prefixes.v4_cidrs(), {network_, broadcast_, first_, last_});
+    compute_ranges_v6(v6, prefixes.v6_cidrs(), {network6, broadcast6, first6, last6});
+    classify_batch(v4, classes4);
+    classify_batch(v6, classes6);
+
+    const size_t n = prefixes.size();
+    std::vector<uint8_t> families(n), cidrs(n);
+    std::vector<IPv6Value> network(n), first(n), last(n), hosts(n);
+    classes_.resize(n);
+    for (size_t i = 0, i4 = 0, i6 = 0; i < n; ++i)
+    {
+        if (prefixes.is_ipv4(i))
+        {
+            families[i] = 4;
+            cidrs[i] = static_cast<uint8_t>(prefixes.v4_cidrs()[i4] + 96);
+            network[i] = MappedIPv4(network_[i4]);
+            first[i] = MappedIPv4(first_[i4]);
+            last[i] = MappedIPv4(last_[i4]);
+            hosts[i] = LittleEndian128(host_count(prefixes.v4_cidrs()[i4], 32));
+            classes_[i] = classes4[i4++];
+        }
+        else
+        {
+            families[i] = 6;
+            cidrs[i] = prefixes.v6_cidrs()[i6];
+            network[i] = network6[i6];
+            first[i] = first6[i6];
+            last[i] = last6[i6];
+            hosts[i] = LittleEndian128(host_count(cidrs[i], 128));
+            classes_[i] = classes6[i6++];
+        }
+    }
+
+    const std::span<const std::byte> columns[] = {Bytes(families), Bytes(network), Bytes(cidrs), Bytes(first),
+                                                  Bytes(last), Bytes(hosts), Bytes(classes_)};
+    writer_.write_batch(n, columns);
+}
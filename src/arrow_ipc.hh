@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/arrow_ipc.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include "mapped_input.hh"
+#include "prefix_column.hh"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Column types the Arrow IPC reader and writer work with. Other flat column
+// types are reported as kOther so that they can be skipped; nested and
+// dictionary encoded columns are rejected.
+enum class ArrowType
+{
+    kUint8,
+    kUint32,
+    kUint64,
+    kFixedSizeBinary16,
+    kOther
+};
+
+struct ArrowField
+{
+    std::string name;
+    ArrowType type;
+};
+
+struct ArrowColumn
+{
+    // The values buffer; empty for kOther columns.
+    std::span<const std::byte> values;
+    uint64_t null_count = 0;
+};
+
+// Reads record batches from an Arrow IPC file or stream. The file is mapped
+// and column values are returned in place. Throws std::system_error when the
+// file cannot be read and std::runtime_error when it is not valid or uses
+// features that are not supported, such as compressed batches.
+class ArrowReader
+{
+public:
+    explicit ArrowReader(const std::string &path);
+
+    const std::vector<ArrowField> &schema() const { return schema_; }
+    std::optional<size_t> find(std::string_view name) const;
+
+    // Advances to the next record batch; false after the last one.
+    bool next_batch();
+    uint64_t rows() const { return rows_; }
+    const ArrowColumn &column(size_t index) const { return columns_[index]; }
+
+private:
+    struct Message;
+
+    std::optional<Message> next_message();
+    void read_schema(const Message &message);
+    void read_batch(const Message &message);
+    [[noreturn]] void fail(const std::string &reason) const;
+
+    std::string path_;
+    MappedFile file_;
+    std::string_view data_;
+    size_t offset_ = 0;
+    size_t end_ = 0;
+    std::vector<ArrowField> schema_;
+    std::vector<size_t> buffer_counts_;
+    uint64_t rows_ = 0;
+    std::vector<ArrowColumn> columns_;
+};
+
+// Writes record batches of kUint8, kUint32, kUint64 and kFixedSizeBinary16
+// columns without nulls as an Arrow IPC file. The file appears under `path`
+// when finish() succeeds; a writer destroyed before that leaves nothing
+// behind. Throws std::system_error on I/O failure.
+class ArrowWriter
+{
+public:
+    ArrowWriter(const std::string &path, std::vector<ArrowField> schema);
+    ~ArrowWriter();
+
+    ArrowWriter(const ArrowWriter &) = delete;
+    ArrowWriter &operator=(const ArrowWriter &) = delete;
+
+    // `columns` holds the values of every field, `rows` elements each.
+    void write_batch(uint64_t rows, std::span<const std::span<const std::byte>> columns);
+    void finish();
+
+private:
+    struct Block
+    {
+        int64_t offset;
+        int32_t metadata_length;
+        int32_t padding;
+        int64_t body_length;
+    };
+
+    void write_message(const std::vector<uint8_t> &metadata, std::span<const std::span<const std::byte>> body);
+    void write(const void *data, size_t size);
+
+    std::string path_;
+    std::string temporary_;
+    std::FILE *out_ = nullptr;
+    uint64_t position_ = 0;
+    std::vector<ArrowField> schema_;
+    std::vector<Block> blocks_;
+};
+
+// Reads prefixes from an Arrow IPC file, one record batch at a time. The
+// address column is the one named "address", or else the first uint32 or
+// fixed_size_binary(16) column. uint32 values are IPv4 addresses as
+// numbers. 16-byte values are IPv6 addresses in network order, and
+// IPv4-mapped ones (::ffff:0:0/96) become IPv4. An optional uint8 column
+// named "cidr" holds the prefix lengths (IPv6 lengths for 16-byte
+// addresses); without it every address is a host prefix.
+class ArrowPrefixReader
+{
+public:
+    explicit ArrowPrefixReader(const std::string &path);
+
+    // True when the address column is uint32.
+    bool ipv4_only() const;
+    // Replaces `out` with the prefixes of the next record batch; false after
+    // the last one. Throws std::runtime_error on null values and
+    // std::invalid_argument on prefix lengths too large for the family.
+    bool next(PrefixColumn &out);
+
+private:
+    ArrowReader reader_;
+    size_t address_ = 0;
+    std::optional<size_t> cidr_;
+    std::vector<uint32_t> v4_;
+    std::vector<uint8_t> cidrs_;
+};
+
+// Writes the analysis of prefix batches as an Arrow IPC file, one record
+// batch per call and one row per prefix in input order. IPv4-only output
+// has the uint32 columns network, broadcast, first and last, plus cidr
+// (uint8), hosts (uint64) and classes (uint32 AddressClassMask). Mixed
+// output adds a family column (4 or 6) and stores the addresses as
+// fixed_size_binary(16), with IPv4 in mapped form. The cidr of a 16-byte
+// row is always an IPv6 length, so an IPv4 /24 is stored as /120: the file
+// reads back through ArrowPrefixReader as the same networks. Its hosts
+// column is fixed_size_binary(16) too, the exact count as a little-endian
+// uint128.
+class ArrowAnalysisWriter
+{
+public:
+    ArrowAnalysisWriter(const std::string &path, bool ipv4_only);
+
+    // Throws std::invalid_argument for IPv6 prefixes in IPv4-only output.
+    void write(const PrefixColumn &prefixes);
+    void finish() { writer_.finish(); }
+
+private:
+    void write_v4(const PrefixColumn &prefixes);
+    void write_mixed(const PrefixColumn &prefixes);
+
+    bool ipv4_only_;
+    ArrowWriter writer_;
+    std::vector<uint32_t> network_, broadcast_, first_, last_;
+    std::vector<uint64_t> hosts_;
+    std::vector<uint32_t> classes_;
+};
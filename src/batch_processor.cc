@@ -0,0 +1,315 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/batch_processor.cc
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#include "batch_processor.hh"
+#include "ip_analyzer.hh"
+#include "mapped_input.hh"
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+    // Parses a trimmed line and writes its record or error; `on_parsed` runs
+    // in between, so the timed path can read the clock there.
+    template <typename OnParsed>
+    inline void WriteLine(std::string_view line, const RecordWriter &writer, fmt::memory_buffer &buffer, BatchStats &stats,
+                          OnParsed &&on_parsed)
+    {
+        const auto parsed = IPAnalyzer::parse(line);
+        on_parsed();
+        if (parsed)
+        {
+            ++(parsed->ip_value().is_ipv4() ? stats.ipv4 : stats.ipv6);
+            writer.write_record(buffer, line, *parsed);
+        }
+        else
+        {
+            stats.record_error(parsed.error());
+            writer.write_error(buffer, line, parsed.error());
+        }
+    }
+
+    struct Shard
+    {
+        std::vector<char> storage;
+        std::string_view input;
+        fmt::memory_buffer output;
+        BatchStats stats;
+        bool done = false;
+    };
+
+}
+
+BatchProcessor::BatchProcessor(std::FILE *out, unsigned threads, OutputFormat format, const GeoEnricher *geo)
+    : out_(out), threads_(threads == 0 ? 1 : threads), writer_(make_record_writer(format, geo))
+{
+    buffer_.reserve(kFlushThreshold + 4096);
+    writer_->write_header(buffer_);
+}
+
+BatchProcessor::~BatchProcessor()
+{
+    flush();
+}
+
+// Runs a bounded window of shards through the worker pool. An input thread
+// produces shards from `source`, the workers analyze them and the calling
+// thread writes finished shards in order, so reading, analysis and writing
+// overlap and none of them waits on another's I/O. Output never runs ahead
+// of input and memory stays within the window.
+template <typename Source>
+bool BatchProcessor::process_sharded(Source &&source)
+{
+    const size_t window = static_cast<size_t>(threads_) * 4;
+    std::vector<Shard> ring(window);
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable shard_done;
+    std::condition_variable slot_free;
+    size_t produced = 0;
+    size_t claimed = 0;
+    size_t consumed = 0;
+    bool input_done = false;
+    bool finished = false;
+    std::exception_ptr input_error;
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads_);
+    for (unsigned i = 0; i < threads_; ++i)
+    {
+        workers.emplace_back([&]
+                             {
+            std::unique_lock lock(mutex);
+            for (;;)
+            {
+                work_ready.wait(lock, [&] { return claimed < produced || finished; });
+                if (claimed == produced)
+                {
+                    return;
+                }
+                Shard &shard = ring[claimed++ % window];
+                lock.unlock();
+                format_lines(shard.input, *writer_, shard.output, shard.stats);
+                lock.lock();
+                shard.done = true;
+                shard_done.notify_all();
+            } });
+    }
+
+    bool ok = flush();
+    std::thread input([&]
+                      {
+        try
+        {
+            for (size_t next = 0;; ++next)
+            {
+                {
+                    std::unique_lock lock(mutex);
+                    slot_free.wait(lock, [&] { return next - consumed < window; });
+                }
+                Shard &shard = ring[next % window];
+                shard.done = false;
+                shard.output.clear();
+                shard.stats = {};
+                if (!source(shard))
+                {
+                    break;
+                }
+                {
+                    std::lock_guard guard(mutex);
+                    ++produced;
+                }
+                work_ready.notify_one();
+            }
+        }
+        catch (...)
+        {
+            input_error = std::current_exception();
+        }
+        std::lock_guard guard(mutex);
+        input_done = true;
+        shard_done.notify_all(); });
+
+    for (;;)
+    {
+        Shard *shard;
+        {
+            std::unique_lock lock(mutex);
+            shard_done.wait(lock, [&] { return consumed < produced ? ring[consumed % window].done : input_done; });
+            if (consumed == produced)
+            {
+                break;
+            }
+            shard = &ring[consumed % window];
+        }
+        stats_ += shard->stats;
+        ok = write(std::string_view(shard->output.data(), shard->output.size())) && ok;
+        {
+            std::lock_guard guard(mutex);
+            ++consumed;
+        }
+        slot_free.notify_one();
+    }
+
+    input.join();
+    {
+        std::lock_guard guard(mutex);
+        finished = true;
+    }
+    work_ready.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    if (input_error)
+    {
+        std::rethrow_exception(input_error);
+    }
+
+    return ok && std::fflush(out_) == 0;
+}
+
+bool BatchProcessor::process_stream(std::FILE *in)
+{
+    // Streams go through the pipeline even with one worker, so reads from
+    // a pipe overlap with analysis and writes.
+    std::vector<char> carry;
+    bool eof = false;
+    const bool ok = process_sharded([&](Shard &shard)
+                                    {
+        if (eof)
+        {
+            return false;
+        }
+
+        shard.storage.swap(carry);
+        carry.clear();
+        size_t complete = 0;
+        while (complete == 0 && !eof)
+        {
+            const size_t offset = shard.storage.size();
+            shard.storage.resize(offset + kReadChunkSize);
+            const size_t read = std::fread(shard.storage.data() + offset, 1, kReadChunkSize, in);
+            shard.storage.resize(offset + read);
+            eof = read == 0;
+
+            const std::string_view data(shard.storage.data(), shard.storage.size());
+            const size_t last_newline = data.rfind('\n');
+            complete = eof ? data.size() : last_newline == std::string_view::npos ? 0 : last_newline + 1;
+        }
+
+        carry.assign(shard.storage.begin() + complete, shard.storage.end());
+        shard.input = std::string_view(shard.storage.data(), complete);
+        return complete > 0 || !eof; });
+    return ok && !std::ferror(in);
+}
+
+bool BatchProcessor::process_region(std::string_view region)
+{
+    if (threads_ > 1 && region.size() > kShardSize)
+    {
+        return process_sharded([&](Shard &shard)
+                               {
+            if (region.empty())
+            {
+                return false;
+            }
+
+            size_t end = region.size();
+            if (end > kShardSize)
+            {
+                const auto newline = region.find('\n', kShardSize);
+                end = newline == std::string_view::npos ? region.size() : newline + 1;
+            }
+            shard.input = region.substr(0, end);
+            region.remove_prefix(end);
+            return true; });
+    }
+
+    stats_.bytes += region.size();
+    LineScanner scanner(region);
+    std::string_view line;
+    while (scanner.next(line))
+    {
+        format_line(line, *writer_, buffer_, stats_);
+        if (buffer_.size() >= kFlushThreshold)
+        {
+            flush();
+        }
+    }
+    return flush();
+}
+
+void BatchProcessor::process_line(std::string_view line)
+{
+    stats_.bytes += line.size() + 1;
+    format_line(line, *writer_, buffer_, stats_);
+    if (buffer_.size() >= kFlushThreshold)
+    {
+        flush();
+    }
+}
+
+void BatchProcessor::format_lines(std::string_view region, const RecordWriter &writer, fmt::memory_buffer &out, BatchStats &stats)
+{
+    stats.bytes += region.size();
+    LineScanner scanner(region);
+    std::string_view line;
+    while (scanner.next(line))
+    {
+        format_line(line, writer, out, stats);
+    }
+}
+
+void BatchProcessor::format_line(std::string_view line, const RecordWriter &writer, fmt::memory_buffer &buffer, BatchStats &stats)
+{
+    line = trim_line(line);
+    if (line.empty())
+    {
+        return;
+    }
+
+    // Reading the clock costs about as much as parsing a short line, so only
+    // a sample of the lines is timed, on a separate path.
+    if (++stats.lines % BatchStats::kTimingSampleInterval == 0) [[unlikely]]
+    {
+        format_timed_line(line, writer, buffer, stats);
+        return;
+    }
+
+    WriteLine(line, writer, buffer, stats, [] {});
+}
+
+void BatchProcessor::format_timed_line(std::string_view line, const RecordWriter &writer, fmt::memory_buffer &buffer,
+                                       BatchStats &stats)
+{
+    const uint64_t start = monotonic_nanos();
+    uint64_t parsed_at = 0;
+    WriteLine(line, writer, buffer, stats, [&] { parsed_at = monotonic_nanos(); });
+    stats.parse_time.record(parsed_at - start);
+    stats.format_time.record(monotonic_nanos() - parsed_at);
+}
+
+bool BatchProcessor::flush()
+{
+    if (buffer_.size() == 0)
+    {
+        return true;
+    }
+
+    const bool ok = write(std::string_view(buffer_.data(), buffer_.size())) && std::fflush(out_) == 0;
+    buffer_.clear();
+    return ok;
+}
+
+bool BatchProcessor::write(std::string_view data)
+{
+    return std::fwrite(data.data(), 1, data.size(), out_) == data.size();
+}
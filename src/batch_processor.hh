@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/batch_processor.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include "ip_analyzer.hh"
+#include "metrics.hh"
+#include "record_writer.hh"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string_view>
+#include <fmt/format.h>
+
+// Counters of one batch run. Every worker fills its own copy and the copies
+// are summed in input order, so the hot path never shares a cache line.
+struct alignas(kCacheLineSize) BatchStats
+{
+    // One line in this many has its stage latencies recorded.
+    static constexpr uint64_t kTimingSampleInterval = 64;
+
+    uint64_t lines = 0;
+    uint64_t failures = 0;
+    uint64_t ipv4 = 0;
+    uint64_t ipv6 = 0;
+    // Input bytes, line terminators included.
+    uint64_t bytes = 0;
+    // Failed lines by cause, indexed by ParseError.
+    std::array<uint64_t, kParseErrorCount> errors{};
+    // Sampled per-line latencies of parsing a line into an IPAnalyzer and of
+    // deriving and writing its record.
+    LatencyHistogram parse_time;
+    LatencyHistogram format_time;
+
+    void record_error(ParseError error)
+    {
+        ++failures;
+        ++errors[static_cast<size_t>(error)];
+    }
+
+    uint64_t error_count(ParseError error) const { return errors[static_cast<size_t>(error)]; }
+
+    BatchStats &operator+=(const BatchStats &other)
+    {
+        lines += other.lines;
+        failures += other.failures;
+        ipv4 += other.ipv4;
+        ipv6 += other.ipv6;
+        bytes += other.bytes;
+        for (size_t i = 0; i < errors.size(); ++i)
+        {
+            errors[i] += other.errors[i];
+        }
+        parse_time += other.parse_time;
+        format_time += other.format_time;
+        return *this;
+    }
+};
+
+// Analyzes newline separated CIDRs and writes one record per line in the
+// chosen OutputFormat. Results are collected in a large buffer and written
+// out in blocks. With more than one thread the input is cut into line
+// aligned shards that a worker pool analyzes concurrently; shard results are
+// written in input order. Streams are always sharded: one thread reads ahead
+// while the workers analyze and the calling thread writes, so blocking reads
+// from a pipe and writes to a slow consumer overlap with the analysis.
+class BatchProcessor
+{
+public:
+    static constexpr size_t kReadChunkSize = 1 << 20;
+    static constexpr size_t kFlushThreshold = 1 << 20;
+    static constexpr size_t kShardSize = 1 << 20;
+
+    // `geo`, when given, enriches every record and must outlive the processor.
+    explicit BatchProcessor(std::FILE *out, unsigned threads = 1, OutputFormat format = OutputFormat::kText,
+                            const GeoEnricher *geo = nullptr);
+    ~BatchProcessor();
+
+    BatchProcessor(const BatchProcessor &) = delete;
+    BatchProcessor &operator=(const BatchProcessor &) = delete;
+
+    bool process_stream(std::FILE *in);
+    bool process_region(std::string_view region);
+    void process_line(std::string_view line);
+    bool flush();
+
+    const BatchStats &stats() const { return stats_; }
+
+    static void format_line(std::string_view line, const RecordWriter &writer, fmt::memory_buffer &out, BatchStats &stats);
+    static void format_lines(std::string_view region, const RecordWriter &writer, fmt::memory_buffer &out, BatchStats &stats);
+
+private:
+    [[gnu::noinline]] static void format_timed_line(std::string_view line, const RecordWriter &writer, fmt::memory_buffer &out,
+                                                    BatchStats &stats);
+    template <typename Source>
+    bool process_sharded(Source &&source);
+    bool write(std::string_view data);
+
+    std::FILE *out_;
+    unsigned threads_;
+    std::unique_ptr<RecordWriter> writer_;
+    fmt::memory_buffer buffer_;
+    BatchStats stats_;
+};
@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/cpu_features.cc
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#include "cpu_features.hh"
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+
+    constexpr std::array<std::string_view, 5> kLevelNames = {"scalar", "sse2", "avx2", "avx512", "neon"};
+
+    SimdLevel DetectLevel()
+    {
+#if defined(IP_ANALYZER_X86_DISPATCH)
+        // Also checks that the OS saves the wider register state.
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+        {
+            return SimdLevel::kAvx512;
+        }
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return SimdLevel::kAvx2;
+        }
+        return SimdLevel::kSse2;
+#elif defined(__ARM_NEON)
+        return SimdLevel::kNeon;
+#else
+        return SimdLevel::kScalar;
+#endif
+    }
+
+    SimdLevel InitialLevel()
+    {
+        if (const char *name = std::getenv("IP_ANALYZER_SIMD"))
+        {
+            const auto level = parse_simd_level(name);
+            if (level && simd_level_supported(*level))
+            {
+                return *level;
+            }
+        }
+        return detected_simd_level();
+    }
+
+    std::atomic<SimdLevel> &ActiveLevel()
+    {
+        static std::atomic<SimdLevel> level{InitialLevel()};
+        return level;
+    }
+
+}
+
+SimdLevel detected_simd_level()
+{
+    static const SimdLevel level = DetectLevel();
+    return level;
+}
+
+bool simd_level_supported(SimdLevel level)
+{
+    const SimdLevel best = detected_simd_level();
+    if (level == SimdLevel::kScalar || level == best)
+    {
+        return true;
+    }
+    return best != SimdLevel::kNeon && level != SimdLevel::kNeon && level <= best;
+}
+
+SimdLevel simd_level()
+{
+    return ActiveLevel().load(std::memory_order_relaxed);
+}
+
+void set_simd_level(SimdLevel level)
+{
+    if (!simd_level_supported(level))
+    {
+        throw std::invalid_argument(std::string("SIMD level not supported: ") + simd_level_name(level));
+    }
+    ActiveLevel().store(level, std::memory_order_relaxed);
+}
+
+const char *simd_level_name(SimdLevel level)
+{
+    return kLevelNames[static_cast<size_t>(level)].data();
+}
+
+std::optional<SimdLevel> parse_simd_level(std::string_view name)
+{
+    for (size_t i = 0; i < kLevelNames.size(); ++i)
+    {
+        if (name == kLevelNames[i])
+        {
+            return static_cast<SimdLevel>(i);
+        }
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/cpu_features.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// On x86-64 the SIMD kernels are compiled for every level with target
+// attributes, whatever -march the build uses, and picked at run time.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define IP_ANALYZER_X86_DISPATCH 1
+#define IP_ANALYZER_TARGET_AVX2 [[gnu::target("avx2")]]
+#define IP_ANALYZER_TARGET_AVX512 [[gnu::target("avx512f")]]
+#endif
+
+// Instruction set levels of the SIMD kernels, in ascending order per
+// architecture. x86-64 has kScalar through kAvx512; NEON builds have
+// kScalar and kNeon; other targets only kScalar.
+enum class SimdLevel : uint8_t
+{
+    kScalar,
+    kSse2,
+    kAvx2,
+    kAvx512,
+    kNeon,
+};
+
+// Best level this CPU and build support.
+SimdLevel detected_simd_level();
+bool simd_level_supported(SimdLevel level);
+
+// Level the kernels dispatch to: detected_simd_level(), unless the
+// IP_ANALYZER_SIMD environment variable names a supported level at startup.
+SimdLevel simd_level();
+// Throws std::invalid_argument when `level` is not supported.
+void set_simd_level(SimdLevel level);
+
+const char *simd_level_name(SimdLevel level);
+std::optional<SimdLevel> parse_simd_level(std::string_view name);
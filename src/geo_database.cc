@@ -0,0 +1,558 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/geo_database.cc
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#include "geo_database.hh"
+#include "mapped_input.hh"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+
+    constexpr std::string_view kMetadataMarker("\xAB\xCD\xEFMaxMind.com", 14);
+    // The metadata must start within this many bytes of the end of the file.
+    constexpr size_t kMetadataSearchSize = 128 * 1024;
+    // Zero bytes between the search tree and the data section.
+    constexpr size_t kDataSectionSeparator = 16;
+    // Nesting limit for the values of malformed files.
+    constexpr int kMaxDepth = 32;
+
+    enum class DataType : uint8_t
+    {
+        kExtended = 0,
+        kPointer = 1,
+        kString = 2,
+        kDouble = 3,
+        kBytes = 4,
+        kUint16 = 5,
+        kUint32 = 6,
+        kMap = 7,
+        kInt32 = 8,
+        kUint64 = 9,
+        kUint128 = 10,
+        kArray = 11,
+        kContainer = 12,
+        kEndMarker = 13,
+        kBoolean = 14,
+        kFloat = 15
+    };
+
+    struct DataValue
+    {
+        DataType type;
+        uint32_t size;
+        // Start of the payload.
+        size_t offset;
+        // Reached through a pointer, so the payload is not at the cursor.
+        bool pointed;
+    };
+
+    // Decoder of the MMDB data section format. Pointers are relative to the
+    // start of `section`. Every read is bounds-checked and fails instead of
+    // throwing, so a corrupt record only loses its own fields.
+    class DataReader
+    {
+    public:
+        explicit DataReader(std::string_view section) : data_(section) {}
+
+        // Reads the control bytes at `cursor` and follows a pointer. Leaves
+        // `cursor` at the payload, or past the pointer when `value.pointed`.
+        bool header(size_t &cursor, DataValue &value) const
+        {
+            if (!control(cursor, value))
+            {
+                return false;
+            }
+            value.pointed = value.type == DataType::kPointer;
+            if (!value.pointed)
+            {
+                return true;
+            }
+            size_t target = value.offset;
+            if (!control(target, value) || value.type == DataType::kPointer)
+            {
+                return false;
+            }
+            value.pointed = true;
+            return true;
+        }
+
+        bool read_string(size_t &cursor, std::string_view &text) const
+        {
+            DataValue value;
+            if (!header(cursor, value) || value.type != DataType::kString || !payload(cursor, value))
+            {
+                return false;
+            }
+            text = data_.substr(value.offset, value.size);
+            return true;
+        }
+
+        bool read_unsigned(size_t &cursor, uint64_t &number) const
+        {
+            DataValue value;
+            if (!header(cursor, value) || value.size > 8 || !payload(cursor, value))
+            {
+                return false;
+            }
+            if (value.type != DataType::kUint16 && value.type != DataType::kUint32 && value.type != DataType::kUint64 &&
+                value.type != DataType::kUint128)
+            {
+                return false;
+            }
+            number = 0;
+            for (uint32_t i = 0; i < value.size; ++i)
+            {
+                number = number << 8 | static_cast<uint8_t>(data_[value.offset + i]);
+            }
+            return true;
+        }
+
+        // Calls `visit(key, cursor)` for every entry of the map at `cursor`;
+        // `visit` must consume the value at `cursor`.
+        template <typename Visit>
+        bool read_map(size_t &cursor, Visit &&visit, int depth = 0) const
+        {
+            DataValue map;
+            if (depth > kMaxDepth || !header(cursor, map) || map.type != DataType::kMap)
+            {
+                return false;
+            }
+            size_t entry = map.offset;
+            for (uint32_t i = 0; i < map.size; ++i)
+            {
+                std::string_view key;
+                if (!read_string(entry, key) || !visit(key, entry))
+                {
+                    return false;
+                }
+            }
+            if (!map.pointed)
+            {
+                cursor = entry;
+            }
+            return true;
+        }
+
+        bool skip(size_t &cursor, int depth = 0) const
+        {
+            DataValue value;
+            if (depth > kMaxDepth || !header(cursor, value))
+            {
+                return false;
+            }
+            if (value.pointed)
+            {
+                return true;
+            }
+            switch (value.type)
+            {
+            case DataType::kMap:
+                for (uint64_t i = 0; i < uint64_t{value.size} * 2; ++i)
+                {
+                    if (!skip(cursor, depth + 1))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            case DataType::kArray:
+                for (uint32_t i = 0; i < value.size; ++i)
+                {
+                    if (!skip(cursor, depth + 1))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            case DataType::kBoolean:
+                return true;
+            default:
+                return payload(cursor, value);
+            }
+        }
+
+    private:
+        bool byte(size_t &cursor, uint32_t &value) const
+        {
+            if (cursor >= data_.size())
+            {
+                return false;
+            }
+            value = static_cast<uint8_t>(data_[cursor++]);
+            return true;
+        }
+
+        bool bytes(size_t &cursor, size_t count, uint32_t &value) const
+        {
+            value = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                uint32_t next;
+                if (!byte(cursor, next))
+                {
+                    return false;
+                }
+                value = value << 8 | next;
+            }
+            return true;
+        }
+
+        // Checks that the payload is in bounds and moves an unpointed
+        // cursor past it.
+        bool payload(size_t &cursor, const DataValue &value) const
+        {
+            if (value.offset > data_.size() || value.size > data_.size() - value.offset)
+            {
+                return false;
+            }
+            if (!value.pointed)
+            {
+                cursor = value.offset + value.size;
+            }
+            return true;
+        }
+
+        // Decodes a control byte and its extended type and size bytes. For a
+        // pointer, `value.offset` is the target.
+        bool control(size_t &cursor, DataValue &value) const
+        {
+            uint32_t first;
+            if (!byte(cursor, first))
+            {
+                return false;
+            }
+            uint32_t type = first >> 5;
+            if (type == static_cast<uint32_t>(DataType::kPointer))
+            {
+                constexpr uint32_t kPointerBias[] = {0, 2048, 526336, 0};
+                const uint32_t length = (first >> 3) & 3;
+                uint32_t target;
+                if (!bytes(cursor, length + 1, target))
+                {
+                    return false;
+                }
+                if (length < 3)
+                {
+                    target |= (first & 7) << (8 * (length + 1));
+                }
+                value = {DataType::kPointer, 0, size_t{target} + kPointerBias[length], false};
+                return true;
+            }
+            if (type == static_cast<uint32_t>(DataType::kExtended))
+            {
+                if (!byte(cursor, type))
+                {
+                    return false;
+                }
+                type += 7;
+                if (type <= static_cast<uint32_t>(DataType::kMap) || type > static_cast<uint32_t>(DataType::kFloat))
+                {
+                    return false;
+                }
+            }
+
+            uint32_t size = first & 0x1F;
+            if (size >= 29)
+            {
+                constexpr uint32_t kSizeBias[] = {29, 285, 65821};
+                const size_t length = size - 28;
+                if (!bytes(cursor, length, size))
+                {
+                    return false;
+                }
+                size += kSizeBias[length - 1];
+            }
+            value = {static_cast<DataType>(type), size, cursor, false};
+            return true;
+        }
+
+        std::string_view data_;
+    };
+
+    [[noreturn]] void ThrowInvalidDatabase(const std::string &path, const char *reason)
+    {
+        throw std::runtime_error("Invalid MMDB file '" + path + "': " + reason);
+    }
+
+    struct CacheEntry
+    {
+        uint64_t owner = 0;
+        uint64_t block = 0;
+        GeoRecord record;
+    };
+
+    static_assert(std::has_single_bit(GeoEnricher::kCacheSize));
+
+    std::array<CacheEntry, GeoEnricher::kCacheSize> &ThreadCache()
+    {
+        thread_local std::array<CacheEntry, GeoEnricher::kCacheSize> cache;
+        return cache;
+    }
+
+    // The /24 or /48 containing the address, tagged with the family.
+    uint64_t CacheBlock(const IPValue &address)
+    {
+        if (address.is_ipv4())
+        {
+            return address.v4().value >> 8;
+        }
+        uint64_t block = uint64_t{1} << 63;
+        for (size_t i = 0; i < 6; ++i)
+        {
+            block |= uint64_t{address.v6().bytes[i]} << (40 - 8 * i);
+        }
+        return block;
+    }
+
+    std::atomic<uint64_t> &NextEnricherId()
+    {
+        static std::atomic<uint64_t> id{1};
+        return id;
+    }
+
+}
+
+GeoDatabase GeoDatabase::open(const std::string &path)
+{
+    auto mapping = std::make_shared<const MappedFile>(path, MappedFile::Access::kRandom);
+    const std::string_view data = mapping->view();
+
+    const size_t search = std::min(data.size(), kMetadataSearchSize);
+    const size_t marker = data.substr(data.size() - search).rfind(kMetadataMarker);
+    if (marker == std::string_view::npos)
+    {
+        ThrowInvalidDatabase(path, "metadata not found");
+    }
+    const size_t metadata_start = data.size() - search + marker;
+
+    GeoDatabase database;
+    uint64_t node_count = 0;
+    uint64_t record_size = 0;
+    uint64_t ip_version = 0;
+    uint64_t major_version = 0;
+    const DataReader metadata(data.substr(metadata_start + kMetadataMarker.size()));
+    size_t cursor = 0;
+    const bool parsed = metadata.read_map(cursor, [&](std::string_view key, size_t &value)
+                                          {
+        if (key == "node_count")
+        {
+            return metadata.read_unsigned(value, node_count);
+        }
+        if (key == "record_size")
+        {
+            return metadata.read_unsigned(value, record_size);
+        }
+        if (key == "ip_version")
+        {
+            return metadata.read_unsigned(value, ip_version);
+        }
+        if (key == "binary_format_major_version")
+        {
+            return metadata.read_unsigned(value, major_version);
+        }
+        if (key == "database_type")
+        {
+            return metadata.read_string(value, database.database_type_);
+        }
+        return metadata.skip(value); });
+    if (!parsed)
+    {
+        ThrowInvalidDatabase(path, "malformed metadata");
+    }
+    if (major_version != 2)
+    {
+        ThrowInvalidDatabase(path, "unsupported format version");
+    }
+    if (record_size != 24 && record_size != 28 && record_size != 32)
+    {
+        ThrowInvalidDatabase(path, "unsupported record size");
+    }
+    if (ip_version != 4 && ip_version != 6)
+    {
+        ThrowInvalidDatabase(path, "unsupported IP version");
+    }
+    if (node_count == 0 || node_count >= uint64_t{1} << record_size)
+    {
+        ThrowInvalidDatabase(path, "bad node count");
+    }
+    const uint64_t tree_size = node_count * record_size / 4;
+    if (tree_size + kDataSectionSeparator > metadata_start)
+    {
+        ThrowInvalidDatabase(path, "search tree out of bounds");
+    }
+
+    database.tree_ = reinterpret_cast<const uint8_t *>(data.data());
+    database.data_ = data.substr(tree_size + kDataSectionSeparator, metadata_start - tree_size - kDataSectionSeparator);
+    database.node_count_ = static_cast<uint32_t>(node_count);
+    database.record_size_ = static_cast<unsigned>(record_size);
+    database.ip_version_ = static_cast<unsigned>(ip_version);
+    database.mapping_ = std::move(mapping);
+
+    if (database.ip_version_ == 6)
+    {
+        uint32_t node = 0;
+        for (int depth = 0; depth < 96 && node < database.node_count_; ++depth)
+        {
+            node = database.child(node, 0);
+        }
+        database.ipv4_start_ = node;
+    }
+    return database;
+}
+
+uint32_t GeoDatabase::child(uint32_t node, unsigned bit) const
+{
+    const uint8_t *p = tree_ + size_t{node} * record_size_ / 4;
+    switch (record_size_)
+    {
+    case 24:
+        p += bit * 3;
+        return uint32_t{p[0]} << 16 | uint32_t{p[1]} << 8 | p[2];
+    case 28:
+        if (bit == 0)
+        {
+            return uint32_t{p[3] & 0xF0u} << 20 | uint32_t{p[0]} << 16 | uint32_t{p[1]} << 8 | p[2];
+        }
+        return uint32_t{p[3] & 0x0Fu} << 24 | uint32_t{p[4]} << 16 | uint32_t{p[5]} << 8 | p[6];
+    default:
+        p += bit * 4;
+        return uint32_t{p[0]} << 24 | uint32_t{p[1]} << 16 | uint32_t{p[2]} << 8 | p[3];
+    }
+}
+
+unsigned GeoDatabase::lookup(const IPValue &address, GeoRecord &record) const
+{
+    const IPv6Value bytes = address.v6();
+    unsigned bits = 128;
+    uint32_t node = 0;
+    if (address.is_ipv4())
+    {
+        bits = 32;
+        node = ip_version_ == 6 ? ipv4_start_ : 0;
+    }
+    else if (ip_version_ == 4)
+    {
+        return 0;
+    }
+
+    unsigned depth = 0;
+    while (depth < bits && node < node_count_)
+    {
+        node = child(node, (bytes.bytes[depth / 8] >> (7 - depth % 8)) & 1);
+        ++depth;
+    }
+    if (node > node_count_)
+    {
+        decode(node, record);
+    }
+    return depth;
+}
+
+void GeoDatabase::decode(uint32_t record, GeoRecord &geo) const
+{
+    const uint64_t distance = record - node_count_;
+    if (distance < kDataSectionSeparator)
+    {
+        return;
+    }
+
+    const DataReader reader(data_);
+    uint64_t asn = 0;
+    std::string_view as_org, organization, country, registered_country;
+    const auto iso_code = [&reader](std::string_view &code)
+    {
+        return [&reader, &code](std::string_view key, size_t &value)
+        { return key == "iso_code" ? reader.read_string(value, code) : reader.skip(value); };
+    };
+    size_t cursor = distance - kDataSectionSeparator;
+    const bool parsed = reader.read_map(cursor, [&](std::string_view key, size_t &value)
+                                        {
+        if (key == "autonomous_system_number")
+        {
+            return reader.read_unsigned(value, asn);
+        }
+        if (key == "autonomous_system_organization")
+        {
+            return reader.read_string(value, as_org);
+        }
+        if (key == "organization")
+        {
+            return reader.read_string(value, organization);
+        }
+        if (key == "country")
+        {
+            return reader.read_map(value, iso_code(country), 1);
+        }
+        if (key == "registered_country")
+        {
+            return reader.read_map(value, iso_code(registered_country), 1);
+        }
+        return reader.skip(value); });
+    if (!parsed)
+    {
+        return;
+    }
+
+    if (geo.asn == 0 && asn <= UINT32_MAX)
+    {
+        geo.asn = static_cast<uint32_t>(asn);
+    }
+    if (geo.country.empty())
+    {
+        geo.country = country.empty() ? registered_country : country;
+    }
+    if (geo.org.empty())
+    {
+        geo.org = as_org.empty() ? organization : as_org;
+    }
+}
+
+GeoEnricher::GeoEnricher(std::vector<GeoDatabase> databases)
+    : databases_(std::move(databases)), id_(NextEnricherId().fetch_add(1, std::memory_order_relaxed))
+{
+}
+
+GeoRecord GeoEnricher::resolve(const IPValue &address, bool &cacheable) const
+{
+    const unsigned block_length = address.is_ipv4() ? 24 : 48;
+    GeoRecord record;
+    cacheable = true;
+    for (const GeoDatabase &database : databases_)
+    {
+        cacheable = database.lookup(address, record) <= block_length && cacheable;
+    }
+    return record;
+}
+
+GeoRecord GeoEnricher::lookup_uncached(const IPValue &address) const
+{
+    bool cacheable;
+    return resolve(address, cacheable);
+}
+
+GeoRecord GeoEnricher::lookup(const IPValue &address) const
+{
+    const uint64_t block = CacheBlock(address);
+    constexpr int kIndexShift = 64 - std::countr_zero(kCacheSize);
+    CacheEntry &entry = ThreadCache()[(block * 0x9E3779B97F4A7C15) >> kIndexShift];
+    if (entry.owner == id_ && entry.block == block)
+    {
+        return entry.record;
+    }
+
+    bool cacheable;
+    const GeoRecord record = resolve(address, cacheable);
+    if (cacheable)
+    {
+        entry = {id_, block, record};
+    }
+    return record;
+}
@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/geo_database.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include "ip_analyzer.hh"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class MappedFile;
+
+// Enrichment fields of one address. The strings point into the mapped
+// database and stay valid as long as the database is alive.
+struct GeoRecord
+{
+    // Autonomous system number, 0 when unknown.
+    uint32_t asn = 0;
+    // ISO 3166-1 alpha-2 code, empty when unknown.
+    std::string_view country;
+    // Organization owning the autonomous system, empty when unknown.
+    std::string_view org;
+
+    bool operator==(const GeoRecord &) const = default;
+};
+
+// Read-only MaxMind DB (MMDB format 2) file such as GeoLite2-ASN or
+// GeoLite2-Country. The binary search tree and the data section are used
+// in place from a memory mapping, so a lookup walks the tree and decodes
+// the fields it needs without allocating.
+//
+// The fields are taken from the MaxMind schema: autonomous_system_number
+// and autonomous_system_organization (or organization), and the iso_code
+// of country, falling back to registered_country.
+class GeoDatabase
+{
+public:
+    // Throws std::system_error when the file cannot be mapped and
+    // std::runtime_error when it is not a valid MMDB file.
+    static GeoDatabase open(const std::string &path);
+
+    // Fills the fields the database has for the address and leaves the
+    // others alone. Returns the prefix length, in the address's own family,
+    // of the database network containing it; the result holds for every
+    // address of that network. Malformed records yield no fields.
+    unsigned lookup(const IPValue &address, GeoRecord &record) const;
+
+    std::string_view database_type() const { return database_type_; }
+    unsigned ip_version() const { return ip_version_; }
+    uint32_t node_count() const { return node_count_; }
+
+private:
+    GeoDatabase() = default;
+
+    uint32_t child(uint32_t node, unsigned bit) const;
+    void decode(uint32_t record, GeoRecord &geo) const;
+
+    std::shared_ptr<const MappedFile> mapping_;
+    const uint8_t *tree_ = nullptr;
+    std::string_view data_;
+    std::string_view database_type_;
+    uint32_t node_count_ = 0;
+    unsigned record_size_ = 0;
+    unsigned ip_version_ = 0;
+    // Node of ::/96 in an IPv6 tree, where MaxMind keeps the IPv4 space.
+    uint32_t ipv4_start_ = 0;
+};
+
+// Joins any number of GeoDatabases, e.g. an ASN and a country database;
+// for each field the first database that has it wins. Results are cached
+// per thread by /24 (IPv4) or /48 (IPv6) in a small direct-mapped table,
+// for networks no longer than that, so the sorted or clustered inputs of a
+// batch mostly skip the tree walks. Lookups may run on any number of
+// threads at once.
+class GeoEnricher
+{
+public:
+    static constexpr size_t kCacheSize = 256;
+
+    explicit GeoEnricher(std::vector<GeoDatabase> databases);
+
+    GeoRecord lookup(const IPValue &address) const;
+    GeoRecord lookup_uncached(const IPValue &address) const;
+
+    const std::vector<GeoDatabase> &databases() const { return databases_; }
+
+private:
+    // `cacheable` tells whether the result holds for the address's whole
+    // cache block.
+    GeoRecord resolve(const IPValue &address, bool &cacheable) const;
+
+    std::vector<GeoDatabase> databases_;
+    // Distinguishes this enricher's entries in the per-thread cache.
+    uint64_t id_;
+};
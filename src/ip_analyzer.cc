@@ -5,103 +5,282 @@
 // Copyright (c) 2024 Volker Schwaberow
 
 #include "ip_analyzer.hh"
+#include "address_class.hh"
+#include "address_format.hh"
 #include <stdexcept>
-#include <sstream>
-#include <bitset>
 #include <algorithm>
-#include <regex>
-#include <iomanip>
+#include <charconv>
 
-IPv6Address::IPv6Address(std::string_view address)
+namespace
 {
-    std::string expanded_address = expand_ipv6_address(address);
-    std::fill(bytes_.begin(), bytes_.end(), 0);
 
-    std::istringstream iss(expanded_address);
-    std::string group;
-    size_t i = 0;
-    while (std::getline(iss, group, ':') && i < 16)
+    constexpr bool IsDigit(char c)
     {
-        if (!group.empty())
+        return static_cast<unsigned char>(c - '0') < 10;
+    }
+
+    constexpr int HexValue(char c)
+    {
+        const auto digit = static_cast<unsigned char>(c - '0');
+        if (digit < 10)
+        {
+            return digit;
+        }
+        const auto letter = static_cast<unsigned char>((c | 0x20) - 'a');
+        return letter < 6 ? letter + 10 : -1;
+    }
+
+    // Whole-string parse: trailing characters after a valid address are a
+    // format error.
+    ParseError ParseWholeIPv4(std::string_view address, uint32_t &value)
+    {
+        const auto [ptr, error] = parse_ipv4(address, value);
+        if (error == ParseError::kNone && ptr != address.data() + address.size())
+        {
+            return ParseError::kInvalidFormat;
+        }
+        return error;
+    }
+
+    ParseError ParseWholeIPv6(std::string_view address, std::array<uint8_t, 16> &bytes)
+    {
+        const auto [ptr, error] = parse_ipv6(address, bytes);
+        if (error == ParseError::kNone && ptr != address.data() + address.size())
         {
-            uint16_t value = std::stoi(group, nullptr, 16);
-            bytes_[i++] = static_cast<uint8_t>(value >> 8);
-            bytes_[i++] = static_cast<uint8_t>(value & 0xFF);
+            return ParseError::kInvalidFormat;
         }
+        return error;
     }
 
-    if (i != 16)
+    template <typename T>
+    T ValueOrThrow(std::expected<T, ParseError> &&result)
     {
-        throw std::invalid_argument("Invalid IPv6 address format");
+        if (!result)
+        {
+            throw std::invalid_argument(parse_error_message(result.error()));
+        }
+        return *std::move(result);
     }
+
+    constexpr uint32_t IPv4Mask(uint8_t cidr)
+    {
+        return cidr == 0 ? 0 : 0xFFFFFFFF << (32 - cidr);
+    }
+
+
 }
 
-std::string IPv6Address::expand_ipv6_address(std::string_view address)
+ParseResult parse_ipv4(std::string_view text, uint32_t &value)
 {
-    std::string expanded = std::string(address);
-    auto double_colon_pos = expanded.find("::");
+    const char *p = text.data();
+    const char *const end = p + text.size();
 
-    if (double_colon_pos != std::string::npos)
+    if (p == end)
     {
-        std::string left = expanded.substr(0, double_colon_pos);
-        std::string right = expanded.substr(double_colon_pos + 2);
+        return {p, ParseError::kEmpty};
+    }
 
-        int left_groups = std::count(left.begin(), left.end(), ':') + 1;
-        int right_groups = std::count(right.begin(), right.end(), ':') + 1;
-        int missing_groups = 8 - left_groups - right_groups;
+    uint32_t result = 0;
+    for (int octet = 0; octet < 4; ++octet)
+    {
+        if (octet > 0)
+        {
+            if (p == end || *p != '.')
+            {
+                return {p, ParseError::kInvalidFormat};
+            }
+            ++p;
+        }
 
-        std::string middle(missing_groups, ':');
-        expanded = left + middle + right;
+        const char *const start = p;
+        uint32_t octet_value = 0;
+        while (p != end && p - start < 3 && IsDigit(*p))
+        {
+            octet_value = octet_value * 10 + static_cast<uint32_t>(*p - '0');
+            ++p;
+        }
+
+        if (p == start)
+        {
+            return {p, p == end ? ParseError::kInvalidFormat : ParseError::kInvalidCharacter};
+        }
+        if (octet_value > 255 || (p != end && IsDigit(*p)))
+        {
+            return {start, ParseError::kOctetOutOfRange};
+        }
+        result = (result << 8) | octet_value;
     }
 
-    std::istringstream iss(expanded);
-    std::ostringstream oss;
-    std::string group;
-    int i = 0;
-    while (std::getline(iss, group, ':'))
+    value = result;
+    return {p, ParseError::kNone};
+}
+
+ParseResult parse_ipv6(std::string_view text, std::array<uint8_t, 16> &bytes)
+{
+    const char *p = text.data();
+    const char *const end = p + text.size();
+
+    if (p == end)
     {
-        if (i++ > 0)
-            oss << ':';
-        oss << std::setfill('0') << std::setw(4) << (group.empty() ? "0" : group);
+        return {p, ParseError::kEmpty};
     }
 
-    while (i < 8)
+    std::array<uint8_t, 16> result{};
+    int length = 0;
+    int gap = -1;
+
+    if (*p == ':')
     {
-        oss << ":0000";
-        i++;
+        if (end - p < 2 || p[1] != ':')
+        {
+            return {p, ParseError::kInvalidFormat};
+        }
+        gap = 0;
+        p += 2;
     }
 
-    return oss.str();
-}
+    while (p != end && HexValue(*p) >= 0)
+    {
+        const char *const start = p;
+        uint32_t group = 0;
+        while (p != end && p - start < 4 && HexValue(*p) >= 0)
+        {
+            group = (group << 4) | static_cast<uint32_t>(HexValue(*p));
+            ++p;
+        }
 
-IPv6Address::IPv6Address(const std::array<uint8_t, 16> &bytes) : bytes_(bytes) {}
+        if (p != end && *p == '.')
+        {
+            uint32_t ipv4 = 0;
+            const auto tail = parse_ipv4(std::string_view(start, end - start), ipv4);
+            if (!tail)
+            {
+                return tail;
+            }
+            if (length > 12)
+            {
+                return {start, ParseError::kInvalidFormat};
+            }
+            for (int shift = 24; shift >= 0; shift -= 8)
+            {
+                result[length++] = static_cast<uint8_t>(ipv4 >> shift);
+            }
+            p = tail.ptr;
+            break;
+        }
 
-std::string IPv6Address::to_string() const
+        if (p != end && HexValue(*p) >= 0)
+        {
+            return {start, ParseError::kGroupOutOfRange};
+        }
+        if (length == 16)
+        {
+            return {start, ParseError::kInvalidFormat};
+        }
+        result[length++] = static_cast<uint8_t>(group >> 8);
+        result[length++] = static_cast<uint8_t>(group);
+
+        if (p == end || *p != ':')
+        {
+            break;
+        }
+        if (end - p >= 2 && p[1] == ':')
+        {
+            if (gap >= 0)
+            {
+                return {p, ParseError::kInvalidFormat};
+            }
+            gap = length;
+            p += 2;
+            continue;
+        }
+        ++p;
+        if (p == end || HexValue(*p) < 0)
+        {
+            return {p, ParseError::kInvalidFormat};
+        }
+    }
+
+    if (gap < 0)
+    {
+        if (length != 16)
+        {
+            return {p, ParseError::kInvalidFormat};
+        }
+    }
+    else
+    {
+        if (length > 14)
+        {
+            return {p, ParseError::kInvalidFormat};
+        }
+        const int tail_length = length - gap;
+        std::copy_backward(result.begin() + gap, result.begin() + length, result.end());
+        std::fill_n(result.begin() + gap, 16 - tail_length - gap, 0);
+    }
+
+    bytes = result;
+    return {p, ParseError::kNone};
+}
+
+const char *parse_error_message(ParseError error)
 {
-    std::ostringstream oss;
-    for (size_t i = 0; i < 16; i += 2)
+    switch (error)
     {
-        if (i > 0)
-            oss << ':';
-        oss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(bytes_[i]);
-        oss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(bytes_[i + 1]);
+    case ParseError::kNone:
+        return "No error";
+    case ParseError::kEmpty:
+        return "Empty address";
+    case ParseError::kInvalidCharacter:
+        return "Invalid character in address";
+    case ParseError::kInvalidFormat:
+        return "Invalid address format";
+    case ParseError::kOctetOutOfRange:
+        return "Invalid octet value";
+    case ParseError::kGroupOutOfRange:
+        return "Invalid group value";
+    case ParseError::kInvalidCidr:
+        return "Invalid CIDR value";
+    case ParseError::kCidrOutOfRange:
+        return "CIDR value too large for the address family";
     }
-    return oss.str();
+    return "Unknown error";
 }
 
-std::string IPv6Address::to_binary_string() const
+IPv6Address::IPv6Address(std::string_view address) : IPv6Address(ValueOrThrow(parse(address)))
 {
-    std::ostringstream oss;
-    for (auto byte : bytes_)
+}
+
+std::expected<IPv6Address, ParseError> IPv6Address::parse(std::string_view address)
+{
+    std::array<uint8_t, 16> bytes;
+    const ParseError error = ParseWholeIPv6(address, bytes);
+    if (error != ParseError::kNone)
     {
-        oss << std::bitset<8>(byte).to_string();
+        return std::unexpected(error);
     }
-    return oss.str();
+    return IPv6Address(bytes);
+}
+
+IPv6Address::IPv6Address(const std::array<uint8_t, 16> &bytes) : bytes_(bytes) {}
+
+std::string IPv6Address::to_string() const
+{
+    char text[kIPv6TextMaxLength];
+    const auto result = format_address_expanded(text, IPv6Value{bytes_});
+    return std::string(text, result.ptr);
+}
+
+std::string IPv6Address::to_binary_string() const
+{
+    char text[kIPv6BinaryLength];
+    const auto result = format_binary(text, IPv6Value{bytes_});
+    return std::string(text, result.ptr);
 }
 
 bool IPv6Address::is_private() const
 {
-    return (bytes_[0] == 0xFD || bytes_[0] == 0xFC);
+    return has_class(classify(IPv6Value{bytes_}), AddressClass::kPrivate);
 }
 
 std::array<uint8_t, 16> IPv6Address::to_bytes() const
@@ -109,218 +288,174 @@ std::array<uint8_t, 16> IPv6Address::to_bytes() const
     return bytes_;
 }
 
-IPAnalyzer::IPAnalyzer(std::string_view ip_cidr)
+std::shared_ptr<IPAddress> make_ip_address(const IPValue &value)
 {
-    auto slash_pos = ip_cidr.find('/');
-    std::string_view ip_str;
-
-    if (slash_pos == std::string_view::npos)
-    {
-        ip_str = ip_cidr;
-        cidr_ = ip_cidr.find(':') != std::string_view::npos ? 128 : 32;
-    }
-    else
+    if (value.is_ipv4())
     {
-        ip_str = ip_cidr.substr(0, slash_pos);
-        cidr_ = static_cast<uint8_t>(std::stoi(std::string(ip_cidr.substr(slash_pos + 1))));
+        return std::make_shared<IPv4Address>(value.v4().value);
     }
+    return std::make_shared<IPv6Address>(value.v6().bytes);
+}
 
-    if (ip_str.find(':') != std::string_view::npos)
+std::expected<IPValue, ParseError> parse_address(std::string_view text)
+{
+    if (text.find(':') != std::string_view::npos)
     {
-        ip_ = std::make_shared<IPv6Address>(ip_str);
-        if (cidr_ > 128)
-            throw std::invalid_argument("Invalid IPv6 CIDR value");
+        std::array<uint8_t, 16> bytes;
+        const ParseError error = ParseWholeIPv6(text, bytes);
+        if (error != ParseError::kNone)
+        {
+            return std::unexpected(error);
+        }
+        return IPValue(IPv6Value{bytes});
     }
-    else
+
+    uint32_t value = 0;
+    const ParseError error = ParseWholeIPv4(text, value);
+    if (error != ParseError::kNone)
     {
-        ip_ = std::make_shared<IPv4Address>(ip_str);
-        if (cidr_ > 32)
-            throw std::invalid_argument("Invalid IPv4 CIDR value");
+        return std::unexpected(error);
     }
+    return IPValue(IPv4Value{value});
 }
 
-std::shared_ptr<IPAddress> IPAnalyzer::get_ip() const
+IPAnalyzer::IPAnalyzer(std::string_view ip_cidr) : IPAnalyzer(ValueOrThrow(parse(ip_cidr)))
 {
-    return ip_;
 }
 
-std::shared_ptr<IPAddress> IPAnalyzer::get_network() const
+IPAnalyzer::IPAnalyzer(const IPValue &ip, uint8_t cidr) : IPAnalyzer(ValueOrThrow(make(ip, cidr)))
 {
-    if (ip_->is_ipv4())
+}
+
+std::expected<IPAnalyzer, ParseError> IPAnalyzer::parse(std::string_view ip_cidr)
+{
+    const auto slash_pos = ip_cidr.find('/');
+    const auto address = parse_address(ip_cidr.substr(0, slash_pos));
+    if (!address)
     {
-        auto ipv4 = std::dynamic_pointer_cast<IPv4Address>(ip_);
-        uint32_t ip_int = ipv4->to_uint32();
-        uint32_t mask = 0xFFFFFFFF << (32 - cidr_);
-        uint32_t network = ip_int & mask;
-        return std::make_shared<IPv4Address>(network);
+        return std::unexpected(address.error());
     }
-    else
+    if (slash_pos == std::string_view::npos)
     {
-        auto ipv6 = std::dynamic_pointer_cast<IPv6Address>(ip_);
-        std::array<uint8_t, 16> ip_bytes = ipv6->to_bytes();
-        std::array<uint8_t, 16> network_bytes = ip_bytes;
-
-        int fullBytes = cidr_ / 8;
-        int remainingBits = cidr_ % 8;
-
-        if (remainingBits > 0)
-        {
-            network_bytes[fullBytes] &= static_cast<uint8_t>(0xFF << (8 - remainingBits));
-        }
-
-        for (int i = fullBytes + (remainingBits > 0 ? 1 : 0); i < 16; ++i)
-        {
-            network_bytes[i] = 0;
-        }
+        return IPAnalyzer(Unchecked{}, *address, address->is_ipv4() ? 32 : 128);
+    }
 
-        return std::make_shared<IPv6Address>(network_bytes);
+    const auto cidr_str = ip_cidr.substr(slash_pos + 1);
+    const char *const cidr_end = cidr_str.data() + cidr_str.size();
+    unsigned int cidr = 0;
+    const auto [ptr, ec] = std::from_chars(cidr_str.data(), cidr_end, cidr);
+    if (ec != std::errc() || ptr != cidr_end)
+    {
+        return std::unexpected(ParseError::kInvalidCidr);
+    }
+    if (cidr > (address->is_ipv4() ? 32u : 128u))
+    {
+        return std::unexpected(ParseError::kCidrOutOfRange);
     }
+    return IPAnalyzer(Unchecked{}, *address, static_cast<uint8_t>(cidr));
 }
 
-std::shared_ptr<IPAddress> IPAnalyzer::get_netmask() const
+std::expected<IPAnalyzer, ParseError> IPAnalyzer::make(const IPValue &ip, uint8_t cidr)
 {
-    if (ip_->is_ipv4())
+    if (cidr > (ip.is_ipv4() ? 32 : 128))
     {
-        uint32_t mask = 0xFFFFFFFF << (32 - cidr_);
-        return std::make_shared<IPv4Address>(mask);
+        return std::unexpected(ParseError::kCidrOutOfRange);
     }
-    else
-    {
-        std::array<uint8_t, 16> mask;
-        int fullBytes = cidr_ / 8;
-        int remainingBits = cidr_ % 8;
-
-        std::fill_n(mask.begin(), fullBytes, 0xFF);
+    return IPAnalyzer(Unchecked{}, ip, cidr);
+}
 
-        if (remainingBits > 0)
-        {
-            mask[fullBytes] = static_cast<uint8_t>(0xFF << (8 - remainingBits));
-        }
+std::shared_ptr<IPAddress> IPAnalyzer::get_ip() const
+{
+    return make_ip_address(ip_);
+}
 
-        std::fill(mask.begin() + fullBytes + (remainingBits > 0 ? 1 : 0), mask.end(), 0);
+std::shared_ptr<IPAddress> IPAnalyzer::get_network() const
+{
+    return make_ip_address(network_value());
+}
 
-        return std::make_shared<IPv6Address>(mask);
-    }
+std::shared_ptr<IPAddress> IPAnalyzer::get_netmask() const
+{
+    return make_ip_address(netmask_value());
 }
 
 std::shared_ptr<IPAddress> IPAnalyzer::get_broadcast() const
 {
-    if (ip_->is_ipv4())
-    {
-        auto ipv4 = std::dynamic_pointer_cast<IPv4Address>(ip_);
-        uint32_t ip_int = ipv4->to_uint32();
-        uint32_t mask = 0xFFFFFFFF << (32 - cidr_);
-        uint32_t broadcast = ip_int | ~mask;
-        return std::make_shared<IPv4Address>(broadcast);
-    }
-    else
-    {
-        auto ipv6 = std::dynamic_pointer_cast<IPv6Address>(ip_);
-        std::array<uint8_t, 16> ip_bytes = ipv6->to_bytes();
-        int fullBytes = cidr_ / 8;
-        int remainingBits = cidr_ % 8;
-
-        for (int i = fullBytes; i < 16; ++i)
-        {
-            ip_bytes[i] = 0xFF;
-        }
+    return make_ip_address(broadcast_value());
+}
 
-        if (remainingBits > 0)
-        {
-            ip_bytes[fullBytes] |= static_cast<uint8_t>(0xFF >> remainingBits);
-        }
+std::pair<std::shared_ptr<IPAddress>, std::shared_ptr<IPAddress>> IPAnalyzer::get_host_range() const
+{
+    const auto [first, last] = host_range_value();
+    return {make_ip_address(first), make_ip_address(last)};
+}
 
-        return std::make_shared<IPv6Address>(ip_bytes);
+IPValue IPAnalyzer::network_value() const
+{
+    if (ip_.is_ipv4())
+    {
+        return IPv4Value{ip_.v4().value & IPv4Mask(cidr_)};
     }
+    return to_ipv6_value(to_uint128(ip_.v6()) & ipv6_mask(cidr_));
 }
 
-std::pair<std::shared_ptr<IPAddress>, std::shared_ptr<IPAddress>> IPAnalyzer::get_host_range() const
+IPValue IPAnalyzer::netmask_value() const
 {
-    if (ip_->is_ipv4())
+    if (ip_.is_ipv4())
     {
-        auto ipv4 = std::dynamic_pointer_cast<IPv4Address>(ip_);
-        uint32_t ip_int = ipv4->to_uint32();
-        uint32_t mask = 0xFFFFFFFF << (32 - cidr_);
-        uint32_t network = ip_int & mask;
-        uint32_t broadcast = ip_int | ~mask;
-
-        uint32_t first_host = (cidr_ == 32 || cidr_ == 31) ? network : network + 1;
-        uint32_t last_host = (cidr_ == 32 || cidr_ == 31) ? broadcast : broadcast - 1;
-
-        return {
-            std::make_shared<IPv4Address>(first_host),
-            std::make_shared<IPv4Address>(last_host)};
+        return IPv4Value{IPv4Mask(cidr_)};
     }
-    else
-    {
-        auto ipv6 = std::dynamic_pointer_cast<IPv6Address>(ip_);
-        std::array<uint8_t, 16> network_bytes = ipv6->to_bytes();
-        std::array<uint8_t, 16> last_bytes = network_bytes;
-
-        int fullBytes = cidr_ / 8;
-        int remainingBits = cidr_ % 8;
+    return to_ipv6_value(ipv6_mask(cidr_));
+}
 
-        for (int i = fullBytes; i < 16; ++i)
-        {
-            last_bytes[i] = 0xFF;
-        }
-        if (remainingBits > 0)
-        {
-            last_bytes[fullBytes] |= static_cast<uint8_t>(0xFF >> remainingBits);
-        }
+IPValue IPAnalyzer::broadcast_value() const
+{
+    if (ip_.is_ipv4())
+    {
+        return IPv4Value{ip_.v4().value | ~IPv4Mask(cidr_)};
+    }
+    return to_ipv6_value(to_uint128(ip_.v6()) | ~ipv6_mask(cidr_));
+}
 
-        if (cidr_ < 128)
-        {
-            for (int i = 15; i >= 0; --i)
-            {
-                if (++network_bytes[i] != 0)
-                    break;
-            }
+std::pair<IPValue, IPValue> IPAnalyzer::host_range_value() const
+{
+    if (ip_.is_ipv4())
+    {
+        const uint32_t network = network_value().v4().value;
+        const uint32_t broadcast = broadcast_value().v4().value;
 
-            for (int i = 15; i >= 0; --i)
-            {
-                if (--last_bytes[i] != 0xFF)
-                    break;
-            }
-        }
+        const uint32_t first_host = (cidr_ == 32 || cidr_ == 31) ? network : network + 1;
+        const uint32_t last_host = (cidr_ == 32 || cidr_ == 31) ? broadcast : broadcast - 1;
 
-        return {
-            std::make_shared<IPv6Address>(network_bytes),
-            std::make_shared<IPv6Address>(last_bytes)};
+        return {IPv4Value{first_host}, IPv4Value{last_host}};
     }
+
+    // Network and broadcast differ in every host bit, so for prefixes
+    // shorter than /127 neither +1 nor -1 can carry out of the host part.
+    const uint128 mask = ipv6_mask(cidr_);
+    const uint128 address = to_uint128(ip_.v6());
+    const uint128 adjust = cidr_ < 127 ? 1 : 0;
+    return {to_ipv6_value((address & mask) + adjust), to_ipv6_value((address | ~mask) - adjust)};
 }
 
-uint64_t IPAnalyzer::get_num_hosts() const
+uint128 host_count(uint8_t cidr, uint8_t width)
 {
-    if (ip_->is_ipv4())
+    if (cidr >= width - 1)
     {
-        if (cidr_ >= 31)
-        {
-            return cidr_ == 31 ? 2 : 1;
-        }
-        return (1ULL << (32 - cidr_)) - 2;
+        return cidr == width - 1 ? 2 : 1;
     }
-    else
-    {
-        if (cidr_ >= 127)
-        {
-            return cidr_ == 127 ? 2 : 1;
-        }
+    // 2^(width - cidr) - 2 without needing 2^128 for ::/0.
+    return (kUint128Max >> (128 - width + cidr)) - 1;
+}
 
-        if (cidr_ <= 64)
-        {
-            return std::numeric_limits<uint64_t>::max();
-        }
-        else
-        {
-            return 1ULL << (128 - cidr_);
-        }
-    }
+uint128 IPAnalyzer::get_num_hosts() const
+{
+    return host_count(cidr_, ip_.is_ipv4() ? 32 : 128);
 }
 
 bool IPAnalyzer::is_private() const
 {
-    return ip_->is_private();
+    return has_class(classify(ip_), AddressClass::kPrivate);
 }
 
 uint8_t IPAnalyzer::get_cidr() const
@@ -328,28 +463,19 @@ uint8_t IPAnalyzer::get_cidr() const
     return cidr_;
 }
 
-IPv4Address::IPv4Address(std::string_view address)
+IPv4Address::IPv4Address(std::string_view address) : IPv4Address(ValueOrThrow(parse(address)))
 {
-    std::istringstream iss(address.data());
-    std::string octet;
-    int i = 0;
-    while (std::getline(iss, octet, '.'))
-    {
-        if (i >= 4)
-        {
-            throw std::invalid_argument("Invalid IPv4 address format");
-        }
-        int value = std::stoi(octet);
-        if (value < 0 || value > 255)
-        {
-            throw std::invalid_argument("Invalid octet value");
-        }
-        octets_[i++] = static_cast<uint8_t>(value);
-    }
-    if (i != 4)
+}
+
+std::expected<IPv4Address, ParseError> IPv4Address::parse(std::string_view address)
+{
+    uint32_t value = 0;
+    const ParseError error = ParseWholeIPv4(address, value);
+    if (error != ParseError::kNone)
     {
-        throw std::invalid_argument("Invalid IPv4 address format");
+        return std::unexpected(error);
     }
+    return IPv4Address(value);
 }
 
 IPv4Address::IPv4Address(unsigned int address)
@@ -371,28 +497,19 @@ uint32_t IPv4Address::to_uint32() const
 
 std::string IPv4Address::to_string() const
 {
-    std::ostringstream oss;
-    oss << static_cast<int>(octets_[0]) << '.'
-        << static_cast<int>(octets_[1]) << '.'
-        << static_cast<int>(octets_[2]) << '.'
-        << static_cast<int>(octets_[3]);
-    return oss.str();
+    char text[kIPv4TextMaxLength];
+    const auto result = format_address(text, IPv4Value{to_uint32()});
+    return std::string(text, result.ptr);
 }
 
 std::string IPv4Address::to_binary_string() const
 {
-    std::ostringstream oss;
-    for (int i = 0; i < 4; ++i)
-    {
-        oss << std::bitset<8>(octets_[i]).to_string();
-    }
-    return oss.str();
+    char text[kIPv4BinaryLength];
+    const auto result = format_binary(text, IPv4Value{to_uint32()});
+    return std::string(text, result.ptr);
 }
 
 bool IPv4Address::is_private() const
 {
-    uint32_t ip = to_uint32();
-    return (ip & 0xFF000000) == 0x0A000000 ||
-           (ip & 0xFFF00000) == 0xAC100000 ||
-           (ip & 0xFFFF0000) == 0xC0A80000;
+    return has_class(classify(IPv4Value{to_uint32()}), AddressClass::kPrivate);
 }
\ No newline at end of file
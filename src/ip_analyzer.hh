@@ -6,11 +6,128 @@
 
 #pragma once
 
+#include "uint128.hh"
 #include <array>
+#include <bit>
+#include <cstddef>
 #include <cstdint>
+#include <expected>
 #include <string>
 #include <string_view>
 #include <memory>
+#include <type_traits>
+#include <utility>
+
+enum class ParseError : uint8_t
+{
+    kNone,
+    kEmpty,
+    kInvalidCharacter,
+    kInvalidFormat,
+    kOctetOutOfRange,
+    kGroupOutOfRange,
+    kInvalidCidr,
+    kCidrOutOfRange,
+};
+
+constexpr size_t kParseErrorCount = 8;
+
+// Result of the non-throwing parsers, modelled after std::from_chars_result:
+// ptr points one past the last character that was consumed.
+struct ParseResult
+{
+    const char *ptr;
+    ParseError error;
+
+    constexpr explicit operator bool() const { return error == ParseError::kNone; }
+};
+
+ParseResult parse_ipv4(std::string_view text, uint32_t &value);
+ParseResult parse_ipv6(std::string_view text, std::array<uint8_t, 16> &bytes);
+const char *parse_error_message(ParseError error);
+
+enum class Family : uint8_t
+{
+    kIPv4,
+    kIPv6,
+};
+
+struct IPv4Value
+{
+    uint32_t value;
+
+    constexpr auto operator<=>(const IPv4Value &) const = default;
+};
+
+struct IPv6Value
+{
+    std::array<uint8_t, 16> bytes;
+
+    constexpr auto operator<=>(const IPv6Value &) const = default;
+};
+
+// Addresses are stored in network byte order; on little-endian hosts the
+// conversion is two 64 bit byte swaps.
+constexpr uint128 to_uint128(const IPv6Value &address)
+{
+    auto words = std::bit_cast<std::array<uint64_t, 2>>(address.bytes);
+    if constexpr (std::endian::native == std::endian::little)
+    {
+        words = {std::byteswap(words[0]), std::byteswap(words[1])};
+    }
+    return make_uint128(words[0], words[1]);
+}
+
+constexpr IPv6Value to_ipv6_value(uint128 value)
+{
+    std::array<uint64_t, 2> words = {uint128_high(value), uint128_low(value)};
+    if constexpr (std::endian::native == std::endian::little)
+    {
+        words = {std::byteswap(words[0]), std::byteswap(words[1])};
+    }
+    return IPv6Value{std::bit_cast<std::array<uint8_t, 16>>(words)};
+}
+
+// Trivially copyable tagged address: 16 address bytes plus the family. IPv4
+// addresses occupy the first four bytes in network order, the rest is zero.
+class IPValue
+{
+public:
+    constexpr IPValue() : bytes_{}, family_(Family::kIPv4) {}
+
+    constexpr IPValue(IPv4Value v4) : bytes_{}, family_(Family::kIPv4)
+    {
+        bytes_[0] = static_cast<uint8_t>(v4.value >> 24);
+        bytes_[1] = static_cast<uint8_t>(v4.value >> 16);
+        bytes_[2] = static_cast<uint8_t>(v4.value >> 8);
+        bytes_[3] = static_cast<uint8_t>(v4.value);
+    }
+
+    constexpr IPValue(IPv6Value v6) : bytes_(v6.bytes), family_(Family::kIPv6) {}
+
+    constexpr Family family() const { return family_; }
+    constexpr bool is_ipv4() const { return family_ == Family::kIPv4; }
+    constexpr bool is_ipv6() const { return family_ == Family::kIPv6; }
+
+    constexpr IPv4Value v4() const
+    {
+        return IPv4Value{(static_cast<uint32_t>(bytes_[0]) << 24) |
+                         (static_cast<uint32_t>(bytes_[1]) << 16) |
+                         (static_cast<uint32_t>(bytes_[2]) << 8) |
+                         static_cast<uint32_t>(bytes_[3])};
+    }
+
+    constexpr IPv6Value v6() const { return IPv6Value{bytes_}; }
+
+    constexpr bool operator==(const IPValue &) const = default;
+
+private:
+    std::array<uint8_t, 16> bytes_;
+    Family family_;
+};
+
+static_assert(sizeof(IPValue) == 17);
+static_assert(std::is_trivially_copyable_v<IPValue>);
 
 class IPAddress
 {
@@ -29,6 +146,8 @@ public:
     IPv4Address(std::string_view address);
     explicit IPv4Address(uint32_t address);
 
+    static std::expected<IPv4Address, ParseError> parse(std::string_view address);
+
     std::string to_string() const override;
     std::string to_binary_string() const override;
     bool is_private() const override;
@@ -47,6 +166,8 @@ public:
     IPv6Address(std::string_view address);
     explicit IPv6Address(const std::array<uint8_t, 16> &bytes);
 
+    static std::expected<IPv6Address, ParseError> parse(std::string_view address);
+
     std::string to_string() const override;
     std::string to_binary_string() const override;
     bool is_private() const override;
@@ -56,24 +177,51 @@ public:
 
 private:
     std::array<uint8_t, 16> bytes_;
-    static std::string expand_ipv6_address(std::string_view address);
 };
 
+std::shared_ptr<IPAddress> make_ip_address(const IPValue &value);
+
+// Parses a complete IPv4 or IPv6 address; trailing characters are an error.
+std::expected<IPValue, ParseError> parse_address(std::string_view text);
+
+// Usable hosts of a /`cidr` in a `width`-bit address family, counted as by
+// IPAnalyzer::get_num_hosts. `cidr` must not exceed `width`.
+uint128 host_count(uint8_t cidr, uint8_t width);
+
 class IPAnalyzer
 {
 public:
+    // The constructors throw std::invalid_argument; parse() and make() report
+    // the same errors as a ParseError without throwing.
     IPAnalyzer(std::string_view ip_cidr);
+    IPAnalyzer(const IPValue &ip, uint8_t cidr);
+
+    static std::expected<IPAnalyzer, ParseError> parse(std::string_view ip_cidr);
+    static std::expected<IPAnalyzer, ParseError> make(const IPValue &ip, uint8_t cidr);
+
+    IPValue ip_value() const { return ip_; }
+    IPValue network_value() const;
+    IPValue netmask_value() const;
+    IPValue broadcast_value() const;
+    std::pair<IPValue, IPValue> host_range_value() const;
 
     std::shared_ptr<IPAddress> get_ip() const;
     std::shared_ptr<IPAddress> get_network() const;
     std::shared_ptr<IPAddress> get_netmask() const;
     std::shared_ptr<IPAddress> get_broadcast() const;
     std::pair<std::shared_ptr<IPAddress>, std::shared_ptr<IPAddress>> get_host_range() const;
-    uint64_t get_num_hosts() const;
+    // Exact number of usable hosts, i.e. the size of host_range_value().
+    uint128 get_num_hosts() const;
     bool is_private() const;
     uint8_t get_cidr() const;
 
 private:
-    std::shared_ptr<IPAddress> ip_;
+    struct Unchecked
+    {
+    };
+
+    constexpr IPAnalyzer(Unchecked, const IPValue &ip, uint8_t cidr) : ip_(ip), cidr_(cidr) {}
+
+    IPValue ip_;
     uint8_t cidr_;
 };
\ No newline at end of file
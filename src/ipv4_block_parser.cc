@@ -0,0 +1,244 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/ipv4_block_parser.cc
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#include "ipv4_block_parser.hh"
+#include "cpu_features.hh"
+#include "ip_analyzer.hh"
+#include "mapped_input.hh"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
+#if defined(IP_ANALYZER_X86_DISPATCH)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+    // `p` points just past the address. Parses an optional "/len" of one or
+    // two digits and the line ending; returns the start of the next line, or
+    // nullptr when the rest of the line needs the full parser.
+    inline const char *ParseTail(const char *p, const char *end, uint8_t &cidr)
+    {
+        cidr = 32;
+        if (p != end && *p == '/')
+        {
+            ++p;
+            if (p == end || static_cast<unsigned char>(*p - '0') > 9)
+            {
+                return nullptr;
+            }
+            unsigned value = static_cast<unsigned>(*p++ - '0');
+            if (p != end && static_cast<unsigned char>(*p - '0') <= 9)
+            {
+                value = value * 10 + static_cast<unsigned>(*p++ - '0');
+            }
+            if (value > 32)
+            {
+                return nullptr;
+            }
+            cidr = static_cast<uint8_t>(value);
+        }
+        if (p != end && *p == '\r')
+        {
+            ++p;
+        }
+        if (p == end)
+        {
+            return end;
+        }
+        return *p == '\n' ? p + 1 : nullptr;
+    }
+
+    const char *ParseLinesScalar(const char *p, const char *end, uint32_t *addresses, uint8_t *cidrs, size_t capacity,
+                                 size_t &count)
+    {
+        while (count < capacity && p != end)
+        {
+            uint32_t value;
+            const auto [tail, error] = parse_ipv4(std::string_view(p, end - p), value);
+            uint8_t cidr;
+            const char *next = error == ParseError::kNone ? ParseTail(tail, end, cidr) : nullptr;
+            if (next == nullptr)
+            {
+                break;
+            }
+            addresses[count] = value;
+            cidrs[count++] = cidr;
+            p = next;
+        }
+        return p;
+    }
+
+    // Bytes the shuffle path loads at the start of a line.
+    constexpr size_t kShuffleLoad = 16;
+
+#if defined(IP_ANALYZER_X86_DISPATCH)
+
+    // For every combination of octet lengths (1 to 3 digits each, read as a
+    // base 3 number with the first octet most significant), a pshufb control
+    // that moves the digits of octet k, right-aligned, into bytes 4k..4k+2 of
+    // its 32-bit lane and zeroes the rest.
+    constexpr std::array<std::array<uint8_t, 16>, 81> MakeOctetShuffles()
+    {
+        constexpr int kWeights[] = {27, 9, 3, 1};
+        std::array<std::array<uint8_t, 16>, 81> shuffles{};
+        for (int index = 0; index < 81; ++index)
+        {
+            auto &shuffle = shuffles[index];
+            shuffle.fill(0x80);
+            int start = 0;
+            for (int octet = 0; octet < 4; ++octet)
+            {
+                const int length = index / kWeights[octet] % 3 + 1;
+                for (int digit = 0; digit < length; ++digit)
+                {
+                    shuffle[4 * octet + 3 - length + digit] = static_cast<uint8_t>(start + digit);
+                }
+                start += length + 1;
+            }
+        }
+        return shuffles;
+    }
+
+    alignas(16) constexpr auto kOctetShuffles = MakeOctetShuffles();
+
+    // Parses the dotted quad at the start of the 16 bytes at `p`. Returns the
+    // end of the address, or nullptr for anything but four dot-separated
+    // octets of 1 to 3 digits each with values up to 255.
+    IP_ANALYZER_TARGET_AVX2 inline const char *ParseAddressShuffle(const char *p, uint32_t &value)
+    {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        const __m128i digits = _mm_sub_epi8(bytes, _mm_set1_epi8('0'));
+        const __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+        const __m128i is_dot = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('.'));
+        const auto digit_mask = static_cast<uint32_t>(_mm_movemask_epi8(is_digit));
+        const auto dot_mask = static_cast<uint32_t>(_mm_movemask_epi8(is_dot));
+
+        // The longest address has 15 characters, so the terminator must be
+        // within the load.
+        const int length = std::countr_zero(~(digit_mask | dot_mask));
+        uint32_t dots = dot_mask & ((uint32_t{1} << length) - 1);
+        if (length > 15 || std::popcount(dots) != 3)
+        {
+            return nullptr;
+        }
+        const int first_dot = std::countr_zero(dots);
+        dots &= dots - 1;
+        const int second_dot = std::countr_zero(dots);
+        dots &= dots - 1;
+        const int third_dot = std::countr_zero(dots);
+
+        // Octet lengths less one; an empty octet wraps around and fails the
+        // range check.
+        const auto l0 = static_cast<unsigned>(first_dot - 1);
+        const auto l1 = static_cast<unsigned>(second_dot - first_dot - 2);
+        const auto l2 = static_cast<unsigned>(third_dot - second_dot - 2);
+        const auto l3 = static_cast<unsigned>(length - third_dot - 2);
+        if (std::max({l0, l1, l2, l3}) > 2)
+        {
+            return nullptr;
+        }
+
+        const __m128i shuffle =
+            _mm_load_si128(reinterpret_cast<const __m128i *>(kOctetShuffles[((l0 * 3 + l1) * 3 + l2) * 3 + l3].data()));
+        const __m128i spread = _mm_shuffle_epi8(digits, shuffle);
+        // Hundreds and tens, then ones, summed per 16 bits, then per octet.
+        const __m128i pairs = _mm_maddubs_epi16(spread, _mm_setr_epi8(100, 10, 1, 0, 100, 10, 1, 0, 100, 10, 1, 0, 100, 10, 1, 0));
+        const __m128i octets = _mm_madd_epi16(pairs, _mm_set1_epi16(1));
+        if (_mm_movemask_epi8(_mm_cmpgt_epi32(octets, _mm_set1_epi32(255))) != 0)
+        {
+            return nullptr;
+        }
+        const __m128i packed = _mm_shuffle_epi8(octets, _mm_setr_epi8(12, 8, 4, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+        value = static_cast<uint32_t>(_mm_cvtsi128_si32(packed));
+        return p + length;
+    }
+
+    IP_ANALYZER_TARGET_AVX2 const char *ParseLinesShuffle(const char *p, const char *end, uint32_t *addresses,
+                                                          uint8_t *cidrs, size_t capacity, size_t &count)
+    {
+        while (count < capacity && static_cast<size_t>(end - p) >= kShuffleLoad)
+        {
+            uint32_t value;
+            const char *tail = ParseAddressShuffle(p, value);
+            uint8_t cidr;
+            const char *next = tail != nullptr ? ParseTail(tail, end, cidr) : nullptr;
+            if (next == nullptr)
+            {
+                break;
+            }
+            addresses[count] = value;
+            cidrs[count++] = cidr;
+            p = next;
+        }
+        return p;
+    }
+
+#endif
+
+}
+
+IPv4BlockResult IPv4BlockParser::next(std::span<uint32_t> addresses, std::span<uint8_t> cidrs)
+{
+    const size_t capacity = std::min(addresses.size(), cidrs.size());
+    const char *p = data_ + position_;
+    const char *const end = data_ + size_;
+    size_t count = 0;
+
+#if defined(IP_ANALYZER_X86_DISPATCH)
+    const SimdLevel level = simd_level();
+    const bool shuffle = level == SimdLevel::kAvx2 || level == SimdLevel::kAvx512;
+#else
+    constexpr bool shuffle = false;
+#endif
+
+    while (count < capacity && p != end)
+    {
+#if defined(IP_ANALYZER_X86_DISPATCH)
+        if (shuffle)
+        {
+            p = ParseLinesShuffle(p, end, addresses.data(), cidrs.data(), capacity, count);
+        }
+#endif
+        // The shuffle path leaves lines within kShuffleLoad bytes of the end
+        // of the region to the scalar one.
+        if (!shuffle || static_cast<size_t>(end - p) < kShuffleLoad)
+        {
+            p = ParseLinesScalar(p, end, addresses.data(), cidrs.data(), capacity, count);
+        }
+        if (count == capacity || p == end)
+        {
+            break;
+        }
+
+        const auto *newline = static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        const std::string_view line = trim_line(std::string_view(p, newline != nullptr ? newline : end));
+        p = newline != nullptr ? newline + 1 : end;
+        if (line.empty())
+        {
+            continue;
+        }
+        // IPv6 prefixes are handed back unparsed; the caller parses them.
+        if (line.find(':') == std::string_view::npos)
+        {
+            const auto prefix = IPAnalyzer::parse(line);
+            if (prefix && prefix->ip_value().is_ipv4())
+            {
+                addresses[count] = prefix->ip_value().v4().value;
+                cidrs[count++] = prefix->get_cidr();
+                continue;
+            }
+        }
+        position_ = static_cast<size_t>(p - data_);
+        return {count, line};
+    }
+
+    position_ = static_cast<size_t>(p - data_);
+    return {count, {}};
+}
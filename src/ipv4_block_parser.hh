@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/ipv4_block_parser.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+struct IPv4BlockResult
+{
+    // Prefixes written to the output columns.
+    size_t count;
+    // Trimmed line that stopped the call because it is not an IPv4 prefix;
+    // empty when the columns are full or the region is exhausted.
+    std::string_view rejected;
+};
+
+// Parses a region of newline-separated IPv4 prefixes ("a.b.c.d" or
+// "a.b.c.d/len") into address and prefix length columns, the layout
+// PrefixColumn::append_v4 and the range kernels take. A missing length
+// means /32.
+//
+// Lines of the plain form "a.b.c.d[/len][\r]\n" take a fast path: with AVX2
+// available the address is parsed with one 16 byte load, a shuffle that
+// spreads the digits of each octet into its own lane and two multiply-adds.
+// Every other line goes to IPAnalyzer::parse after the surrounding
+// whitespace is trimmed, so the accepted syntax and values are exactly those
+// of the scalar parser; blank lines are skipped.
+class IPv4BlockParser
+{
+public:
+    explicit IPv4BlockParser(std::string_view region) : data_(region.data()), size_(region.size()) {}
+
+    // Fills the columns up to the shorter of the two. Returns early, after
+    // the prefixes preceding it, at a line that is not a valid IPv4 prefix
+    // (IPv6 prefixes included); the next call resumes after that line.
+    IPv4BlockResult next(std::span<uint32_t> addresses, std::span<uint8_t> cidrs);
+
+    bool done() const { return position_ >= size_; }
+
+private:
+    const char *data_;
+    size_t size_;
+    size_t position_ = 0;
+};
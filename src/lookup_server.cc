@@ -0,0 +1,759 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/lookup_server.cc
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#include "lookup_server.hh"
+#include "address_class.hh"
+#include "range_kernels.hh"
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+
+    uint32_t Load32(const char *data)
+    {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return std::endian::native == std::endian::little ? value : std::byteswap(value);
+    }
+
+    void Store32(char *data, uint32_t value)
+    {
+        value = std::endian::native == std::endian::little ? value : std::byteswap(value);
+        std::memcpy(data, &value, sizeof(value));
+    }
+
+    uint32_t LoadBigEndian32(const char *data)
+    {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return std::endian::native == std::endian::big ? value : std::byteswap(value);
+    }
+
+    void Store64(char *data, uint64_t value)
+    {
+        value = std::endian::native == std::endian::little ? value : std::byteswap(value);
+        std::memcpy(data, &value, sizeof(value));
+    }
+
+    void Store128(char *data, uint128 value)
+    {
+        Store64(data, uint128_low(value));
+        Store64(data + 8, uint128_high(value));
+    }
+
+    void StoreBigEndian32(char *data, uint32_t value)
+    {
+        value = std::endian::native == std::endian::big ? value : std::byteswap(value);
+        std::memcpy(data, &value, sizeof(value));
+    }
+
+    // Looks every address up and writes kAnalyze items for the matching
+    // prefixes. `items` is zeroed.
+    void AnalyzeV4(const PrefixTable &table, const char *addresses, uint32_t count, char *items)
+    {
+        thread_local std::vector<uint32_t> v4, indices, network, broadcast, first, last;
+        thread_local std::vector<uint8_t> cidrs;
+        thread_local std::vector<AddressClassMask> classes;
+        for (auto *column : {&v4, &indices, &network, &broadcast, &first, &last, &classes})
+        {
+            column->resize(count);
+        }
+        cidrs.resize(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            v4[i] = LoadBigEndian32(addresses + 4 * i);
+            indices[i] = table.lookup(IPv4Value{v4[i]});
+            cidrs[i] = indices[i] == PrefixTable::kNoMatch ? 0 : table.prefix_length(indices[i]);
+        }
+        compute_ranges_v4(v4, cidrs, {network, broadcast, first, last});
+        classify_batch(v4, classes);
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            char *item = items + lookup_protocol::kAnalyzeItemSizeV4 * i;
+            Store32(item, indices[i]);
+            Store32(item + 4, cidrs[i]);
+            if (indices[i] != PrefixTable::kNoMatch)
+            {
+                StoreBigEndian32(item + 8, network[i]);
+                StoreBigEndian32(item + 12, first[i]);
+                StoreBigEndian32(item + 16, last[i]);
+                Store128(item + 20, host_count(cidrs[i], 32));
+            }
+            Store32(item + 36, classes[i]);
+        }
+    }
+
+    void AnalyzeV6(const PrefixTable &table, const char *addresses, uint32_t count, char *items)
+    {
+        thread_local std::vector<IPv6Value> v6, network, broadcast, first, last;
+        thread_local std::vector<uint32_t> indices;
+        thread_local std::vector<uint8_t> cidrs;
+        for (auto *column : {&v6, &network, &broadcast, &first, &last})
+        {
+            column->resize(count);
+        }
+        indices.resize(count);
+        cidrs.resize(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            std::memcpy(v6[i].bytes.data(), addresses + 16 * i, 16);
+            indices[i] = table.lookup(v6[i]);
+            cidrs[i] = indices[i] == PrefixTable::kNoMatch ? 0 : table.prefix_length(indices[i]);
+        }
+        compute_ranges_v6(v6, cidrs, {network, broadcast, first, last});
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            char *item = items + lookup_protocol::kAnalyzeItemSizeV6 * i;
+            Store32(item, indices[i]);
+            Store32(item + 4, cidrs[i]);
+            if (indices[i] != PrefixTable::kNoMatch)
+            {
+                std::memcpy(item + 8, network[i].bytes.data(), 16);
+                std::memcpy(item + 24, first[i].bytes.data(), 16);
+                std::memcpy(item + 40, last[i].bytes.data(), 16);
+                Store128(item + 56, host_count(cidrs[i], 128));
+            }
+            Store32(item + 72, classify(v6[i]));
+        }
+    }
+
+    [[noreturn]] void ThrowSystemError(const std::string &what)
+    {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    int BindUnix(const std::string &path)
+    {
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            throw std::system_error(ENAMETOOLONG, std::generic_category(), "cannot bind '" + path + "'");
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+        // A socket file left behind by a previous run would make bind fail.
+        struct stat st;
+        if (::stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        {
+            ::unlink(path.c_str());
+        }
+
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            ThrowSystemError("cannot create socket");
+        }
+        if (::bind(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            const int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "cannot bind '" + path + "'");
+        }
+        return fd;
+    }
+
+    int BindTcp(const std::string &address)
+    {
+        const auto colon = address.rfind(':');
+        if (colon == std::string::npos)
+        {
+            throw std::system_error(EINVAL, std::generic_category(), "expected HOST:PORT or a socket path, got '" + address + "'");
+        }
+        std::string host = address.substr(0, colon);
+        const std::string port = address.substr(colon + 1);
+        if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+        {
+            host = host.substr(1, host.size() - 2);
+        }
+
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo *results = nullptr;
+        const int status = ::getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &results);
+        if (status != 0)
+        {
+            throw std::system_error(EINVAL, std::generic_category(), "cannot resolve '" + address + "': " + ::gai_strerror(status));
+        }
+
+        int error = EADDRNOTAVAIL;
+        int fd = -1;
+        for (const addrinfo *result = results; result != nullptr && fd < 0; result = result->ai_next)
+        {
+            fd = ::socket(result->ai_family, result->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, result->ai_protocol);
+            if (fd < 0)
+            {
+                error = errno;
+                continue;
+            }
+            const int one = 1;
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (::bind(fd, result->ai_addr, result->ai_addrlen) != 0)
+            {
+                error = errno;
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        ::freeaddrinfo(results);
+        if (fd < 0)
+        {
+            throw std::system_error(error, std::generic_category(), "cannot bind '" + address + "'");
+        }
+        return fd;
+    }
+
+    uint16_t BoundPort(int fd)
+    {
+        sockaddr_storage address{};
+        socklen_t size = sizeof(address);
+        if (::getsockname(fd, reinterpret_cast<sockaddr *>(&address), &size) != 0)
+        {
+            return 0;
+        }
+        if (address.ss_family == AF_INET)
+        {
+            return ntohs(reinterpret_cast<const sockaddr_in &>(address).sin_port);
+        }
+        if (address.ss_family == AF_INET6)
+        {
+            return ntohs(reinterpret_cast<const sockaddr_in6 &>(address).sin6_port);
+        }
+        return 0;
+    }
+
+}
+
+void lookup_protocol::answer(const PrefixTable &table, std::string_view request, std::vector<char> &out)
+{
+    const size_t frame = out.size();
+    out.resize(frame + kLengthSize + kResponseHeaderSize);
+
+    Status status = Status::kBadRequest;
+    uint32_t count = 0;
+    if (request.size() >= kRequestHeaderSize)
+    {
+        const auto op = static_cast<Op>(request[0]);
+        const auto family = static_cast<uint8_t>(request[1]);
+        const size_t address_size = family == 4 ? 4 : family == 6 ? 16 : 0;
+        count = Load32(request.data() + 4);
+        const char *addresses = request.data() + kRequestHeaderSize;
+
+        if (address_size == 0 || request.size() - kRequestHeaderSize != count * address_size)
+        {
+            count = 0;
+        }
+        else if (op == Op::kLookup)
+        {
+            status = Status::kOk;
+            out.resize(out.size() + count * kLookupItemSize);
+            char *item = out.data() + frame + kLengthSize + kResponseHeaderSize;
+            for (uint32_t i = 0; i < count; ++i, item += kLookupItemSize)
+            {
+                uint32_t index;
+                if (family == 4)
+                {
+                    index = table.lookup(IPv4Value{LoadBigEndian32(addresses + 4 * i)});
+                }
+                else
+                {
+                    IPv6Value address;
+                    std::memcpy(address.bytes.data(), addresses + 16 * i, 16);
+                    index = table.lookup(address);
+                }
+                Store32(item, index);
+                Store32(item + 4, index == PrefixTable::kNoMatch ? 0 : table.prefix_length(index));
+            }
+        }
+        else if (op == Op::kClassify)
+        {
+            status = Status::kOk;
+            thread_local std::vector<uint32_t> v4;
+            thread_local std::vector<AddressClassMask> classes;
+            classes.resize(count);
+            if (family == 4)
+            {
+                v4.resize(count);
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    v4[i] = LoadBigEndian32(addresses + 4 * i);
+                }
+                classify_batch(v4, classes);
+            }
+            else
+            {
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    IPv6Value address;
+                    std::memcpy(address.bytes.data(), addresses + 16 * i, 16);
+                    classes[i] = classify(address);
+                }
+            }
+            out.resize(out.size() + count * kClassifyItemSize);
+            char *item = out.data() + frame + kLengthSize + kResponseHeaderSize;
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                Store32(item + kClassifyItemSize * i, classes[i]);
+            }
+        }
+        else if (op == Op::kAnalyze)
+        {
+            status = Status::kOk;
+            const size_t item_size = family == 4 ? kAnalyzeItemSizeV4 : kAnalyzeItemSizeV6;
+            out.resize(out.size() + count * item_size);
+            char *items = out.data() + frame + kLengthSize + kResponseHeaderSize;
+            if (family == 4)
+            {
+                AnalyzeV4(table, addresses, count, items);
+            }
+            else
+            {
+                AnalyzeV6(table, addresses, count, items);
+            }
+        }
+        else
+        {
+            status = Status::kUnsupported;
+            count = 0;
+        }
+    }
+
+    char *header = out.data() + frame;
+    Store32(header, static_cast<uint32_t>(out.size() - frame - kLengthSize));
+    header[kLengthSize] = static_cast<char>(status);
+    header[kLengthSize + 1] = header[kLengthSize + 2] = header[kLengthSize + 3] = 0;
+    Store32(header + kLengthSize + 4, count);
+}
+
+LookupServer::LookupServer(PrefixTable table, const std::string &address, const std::string &metrics_address)
+    : table_(std::move(table))
+{
+    try
+    {
+        if (address.starts_with("unix:"))
+        {
+            unix_path_ = address.substr(5);
+        }
+        else if (address.find('/') != std::string::npos)
+        {
+            unix_path_ = address;
+        }
+        listen_fd_ = unix_path_.empty() ? BindTcp(address) : BindUnix(unix_path_);
+        if (::listen(listen_fd_, SOMAXCONN) != 0)
+        {
+            ThrowSystemError("cannot listen on '" + address + "'");
+        }
+        if (!metrics_address.empty())
+        {
+            metrics_fd_ = BindTcp(metrics_address);
+            if (::listen(metrics_fd_, SOMAXCONN) != 0)
+            {
+                ThrowSystemError("cannot listen on '" + metrics_address + "'");
+            }
+        }
+
+        epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+        stop_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        spare_fd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (epoll_fd_ < 0 || stop_fd_ < 0 || spare_fd_ < 0)
+        {
+            ThrowSystemError("cannot create event loop");
+        }
+        for (const int fd : {listen_fd_, metrics_fd_, stop_fd_})
+        {
+            if (fd < 0)
+            {
+                continue;
+            }
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0)
+            {
+                ThrowSystemError("cannot create event loop");
+            }
+        }
+    }
+    catch (...)
+    {
+        close_all();
+        throw;
+    }
+}
+
+LookupServer::~LookupServer()
+{
+    close_all();
+}
+
+void LookupServer::close_all()
+{
+    for (const auto &[fd, connection] : connections_)
+    {
+        ::close(fd);
+    }
+    connections_.clear();
+    metrics_.open_connections = 0;
+    for (int *fd : {&listen_fd_, &metrics_fd_, &epoll_fd_, &stop_fd_, &spare_fd_})
+    {
+        if (*fd >= 0)
+        {
+            ::close(std::exchange(*fd, -1));
+        }
+    }
+    if (!unix_path_.empty())
+    {
+        ::unlink(unix_path_.c_str());
+        unix_path_.clear();
+    }
+}
+
+void LookupServer::run()
+{
+    epoll_event events[64];
+    for (;;)
+    {
+        const int ready = ::epoll_wait(epoll_fd_, events, static_cast<int>(std::size(events)), -1);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            ThrowSystemError("epoll_wait failed");
+        }
+
+        for (int i = 0; i < ready; ++i)
+        {
+            const int fd = events[i].data.fd;
+            if (fd == stop_fd_)
+            {
+                uint64_t count;
+                while (::read(stop_fd_, &count, sizeof(count)) > 0)
+                {
+                }
+                return;
+            }
+            if (fd == listen_fd_ || fd == metrics_fd_)
+            {
+                accept_connections(fd, fd == metrics_fd_);
+                continue;
+            }
+
+            const auto it = connections_.find(fd);
+            if (it == connections_.end())
+            {
+                continue;
+            }
+            Connection &connection = it->second;
+            bool ok = !(events[i].events & EPOLLERR);
+            if (ok && (events[i].events & (EPOLLIN | EPOLLHUP)) && !connection.eof)
+            {
+                ok = read_input(fd, connection);
+            }
+            ok = ok && answer_input(connection) && write_output(fd, connection);
+            if (ok && !connection.in.empty())
+            {
+                // Output that drained below the limit lets buffered frames
+                // proceed.
+                ok = answer_input(connection) && write_output(fd, connection);
+            }
+
+            const bool drained = connection.out_offset == connection.out.size();
+            if (!ok || (connection.eof && drained))
+            {
+                close_connection(fd);
+            }
+            else
+            {
+                update_events(fd, connection);
+            }
+        }
+    }
+}
+
+void LookupServer::stop()
+{
+    const uint64_t one = 1;
+    if (::write(stop_fd_, &one, sizeof(one)) < 0)
+    {
+        // The counter is already non-zero; run() will stop either way.
+    }
+}
+
+uint16_t LookupServer::port() const
+{
+    return unix_path_.empty() ? BoundPort(listen_fd_) : 0;
+}
+
+uint16_t LookupServer::metrics_port() const
+{
+    return metrics_fd_ < 0 ? 0 : BoundPort(metrics_fd_);
+}
+
+void LookupServer::write_metrics(fmt::memory_buffer &out) const
+{
+    PrometheusText text(out);
+    text.family("ip_analyzer_connections_total", "counter", "Accepted lookup connections.");
+    text.sample("ip_analyzer_connections_total", metrics_.connections);
+    text.family("ip_analyzer_open_connections", "gauge", "Currently open lookup connections.");
+    text.sample("ip_analyzer_open_connections", metrics_.open_connections);
+    text.family("ip_analyzer_received_bytes_total", "counter", "Bytes read from lookup connections.");
+    text.sample("ip_analyzer_received_bytes_total", metrics_.bytes_received);
+    text.family("ip_analyzer_sent_bytes_total", "counter", "Bytes written to lookup connections.");
+    text.sample("ip_analyzer_sent_bytes_total", metrics_.bytes_sent);
+
+    constexpr std::array<std::string_view, 3> kStatusNames = {"ok", "bad_request", "unsupported"};
+    text.family("ip_analyzer_requests_total", "counter", "Answered requests by response status.");
+    for (size_t i = 0; i < kStatusNames.size(); ++i)
+    {
+        text.sample("ip_analyzer_requests_total", metrics_.requests[i], fmt::format("status=\"{}\"", kStatusNames[i]));
+    }
+    text.family("ip_analyzer_addresses_total", "counter", "Addresses answered in successful requests.");
+    text.sample("ip_analyzer_addresses_total", metrics_.addresses);
+    text.histogram("ip_analyzer_request_duration_seconds", "Time to answer one request.", metrics_.answer_time);
+    text.family("ip_analyzer_index_prefixes", "gauge", "Prefixes in the served index.");
+    text.sample("ip_analyzer_index_prefixes", table_.size());
+}
+
+void LookupServer::accept_connections(int listen_fd, bool http)
+{
+    for (;;)
+    {
+        const int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            // Out of descriptors, the pending connection would keep the
+            // level-triggered listener ready and the loop spinning. The spare
+            // descriptor makes room to accept it and close it right away.
+            if ((errno == EMFILE || errno == ENFILE) && spare_fd_ >= 0)
+            {
+                ::close(std::exchange(spare_fd_, -1));
+                const int rejected = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (rejected >= 0)
+                {
+                    ::close(rejected);
+                }
+                spare_fd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+                if (rejected >= 0)
+                {
+                    continue;
+                }
+            }
+            // EAGAIN ends the backlog; other errors are retried on the next
+            // readiness event.
+            return;
+        }
+        if (unix_path_.empty() || http)
+        {
+            const int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            ::close(fd);
+            continue;
+        }
+        Connection &connection = connections_[fd];
+        connection.events = EPOLLIN;
+        connection.http = http;
+        if (!http)
+        {
+            ++metrics_.connections;
+            ++metrics_.open_connections;
+        }
+    }
+}
+
+bool LookupServer::read_input(int fd, Connection &connection)
+{
+    for (;;)
+    {
+        const ssize_t read = ::read(fd, read_buffer_.data(), read_buffer_.size());
+        if (read == 0)
+        {
+            connection.eof = true;
+            return true;
+        }
+        if (read < 0)
+        {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        if (!connection.http)
+        {
+            metrics_.bytes_received += static_cast<size_t>(read);
+        }
+        connection.in.insert(connection.in.end(), read_buffer_.data(), read_buffer_.data() + read);
+        if (static_cast<size_t>(read) < read_buffer_.size())
+        {
+            return true;
+        }
+    }
+}
+
+bool LookupServer::answer_input(Connection &connection)
+{
+    return connection.http ? answer_http(connection) : answer_frames(connection);
+}
+
+bool LookupServer::answer_frames(Connection &connection)
+{
+    using namespace lookup_protocol;
+
+    size_t offset = 0;
+    while (connection.out.size() - connection.out_offset < kMaxPendingOutput && connection.in.size() - offset >= kLengthSize)
+    {
+        const uint32_t length = Load32(connection.in.data() + offset);
+        if (length > kMaxFrameSize)
+        {
+            return false;
+        }
+        if (connection.in.size() - offset - kLengthSize < length)
+        {
+            break;
+        }
+        const size_t frame = connection.out.size();
+        const uint64_t start = monotonic_nanos();
+        answer(table_, std::string_view(connection.in.data() + offset + kLengthSize, length), connection.out);
+        metrics_.answer_time.record(monotonic_nanos() - start);
+        const auto status = static_cast<size_t>(static_cast<uint8_t>(connection.out[frame + kLengthSize]));
+        ++metrics_.requests[std::min(status, metrics_.requests.size() - 1)];
+        metrics_.addresses += Load32(connection.out.data() + frame + kLengthSize + 4);
+        offset += kLengthSize + length;
+    }
+    connection.in.erase(connection.in.begin(), connection.in.begin() + static_cast<std::ptrdiff_t>(offset));
+    return true;
+}
+
+// Answers one request and closes the connection, which is all a metrics
+// scraper needs.
+bool LookupServer::answer_http(Connection &connection)
+{
+    const std::string_view request(connection.in.data(), connection.in.size());
+    if (request.find("\r\n\r\n") == std::string_view::npos)
+    {
+        return request.size() < kMaxHttpRequestSize;
+    }
+
+    const bool found = request.starts_with("GET /metrics ") || request.starts_with("GET /metrics?");
+    fmt::memory_buffer body;
+    if (found)
+    {
+        write_metrics(body);
+    }
+    else
+    {
+        body.append(std::string_view("not found\n"));
+    }
+
+    fmt::memory_buffer response;
+    fmt::format_to(std::back_inserter(response),
+                   "HTTP/1.1 {}\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                   "Content-Length: {}\r\nConnection: close\r\n\r\n",
+                   found ? "200 OK" : "404 Not Found", body.size());
+    connection.out.insert(connection.out.end(), response.data(), response.data() + response.size());
+    connection.out.insert(connection.out.end(), body.data(), body.data() + body.size());
+    connection.in.clear();
+    connection.eof = true;
+    return true;
+}
+
+bool LookupServer::write_output(int fd, Connection &connection)
+{
+    while (connection.out_offset < connection.out.size())
+    {
+        const ssize_t written = ::send(fd, connection.out.data() + connection.out_offset,
+                                       connection.out.size() - connection.out_offset, MSG_NOSIGNAL);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                return false;
+            }
+            break;
+        }
+        connection.out_offset += static_cast<size_t>(written);
+        if (!connection.http)
+        {
+            metrics_.bytes_sent += static_cast<size_t>(written);
+        }
+    }
+
+    if (connection.out_offset == connection.out.size())
+    {
+        connection.out.clear();
+        connection.out_offset = 0;
+    }
+    else if (connection.out_offset >= kReadSize)
+    {
+        connection.out.erase(connection.out.begin(), connection.out.begin() + static_cast<std::ptrdiff_t>(connection.out_offset));
+        connection.out_offset = 0;
+    }
+    return true;
+}
+
+void LookupServer::update_events(int fd, Connection &connection)
+{
+    const size_t pending = connection.out.size() - connection.out_offset;
+    uint32_t events = 0;
+    if (!connection.eof && pending < kMaxPendingOutput)
+    {
+        events |= EPOLLIN;
+    }
+    if (pending != 0)
+    {
+        events |= EPOLLOUT;
+    }
+    if (events == connection.events)
+    {
+        return;
+    }
+
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = fd;
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event);
+    connection.events = events;
+}
+
+void LookupServer::close_connection(int fd)
+{
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    const auto it = connections_.find(fd);
+    if (it != connections_.end() && !it->second.http)
+    {
+        --metrics_.open_connections;
+    }
+    connections_.erase(fd);
+}
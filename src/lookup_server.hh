@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/lookup_server.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include "metrics.hh"
+#include "prefix_table.hh"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Wire protocol of the lookup server. Every message is a frame: a uint32
+// payload length followed by the payload. All integers are little endian,
+// addresses are raw bytes in network order.
+//
+//   request   op:u8 family:u8 reserved:u16 count:u32 address[count]
+//   response  status:u8 reserved:u8[3] count:u32 item[count]
+//
+// family is 4 (4 byte addresses) or 6 (16 byte addresses). Items are
+//
+//   kLookup    index:u32 cidr:u8 reserved:u8[3]   index into the prefix list
+//                                                 the table was built from,
+//                                                 kNoMatch without a match
+//   kClassify  classes:u32                        AddressClassMask
+//   kAnalyze   index:u32 cidr:u8 reserved:u8[3]   as for kLookup, then the
+//              network:addr first:addr last:addr  matching prefix's range,
+//              hosts:u128 classes:u32             exact usable hosts (low
+//                                                 word first) and the
+//                                                 address's AddressClassMask
+//
+// where addr has the size of a request address. Without a match the range
+// and host count of a kAnalyze item are zero.
+// A request that cannot be answered gets a response with an error status
+// and no items; the connection stays usable. Frames longer than
+// kMaxFrameSize close the connection.
+namespace lookup_protocol
+{
+
+    enum class Op : uint8_t
+    {
+        kLookup = 1,
+        kClassify = 2,
+        kAnalyze = 3,
+    };
+
+    enum class Status : uint8_t
+    {
+        kOk = 0,
+        kBadRequest = 1,
+        kUnsupported = 2,
+    };
+
+    constexpr size_t kLengthSize = 4;
+    constexpr size_t kRequestHeaderSize = 8;
+    constexpr size_t kResponseHeaderSize = 8;
+    constexpr size_t kLookupItemSize = 8;
+    constexpr size_t kClassifyItemSize = 4;
+    constexpr size_t kAnalyzeItemSizeV4 = 40;
+    constexpr size_t kAnalyzeItemSizeV6 = 76;
+    constexpr uint32_t kMaxFrameSize = 64 << 20;
+
+    // Appends the framed response to `request` (a payload without its
+    // length prefix) to `out`.
+    void answer(const PrefixTable &table, std::string_view request, std::vector<char> &out);
+
+}
+
+struct LookupServerMetrics
+{
+    uint64_t connections = 0;
+    uint64_t open_connections = 0;
+    uint64_t bytes_received = 0;
+    uint64_t bytes_sent = 0;
+    // Answered requests by lookup_protocol::Status.
+    std::array<uint64_t, 3> requests{};
+    uint64_t addresses = 0;
+    // Time to answer one request, from a complete frame to its response.
+    LatencyHistogram answer_time;
+};
+
+// Single threaded epoll server answering lookup_protocol requests from a
+// PrefixTable. `address` is a Unix socket path (anything containing a '/',
+// optionally prefixed with "unix:") or HOST:PORT for TCP; port 0 picks a
+// free port. Clients may pipeline any number of frames.
+//
+// With a `metrics_address` the same loop also serves the metrics in the
+// Prometheus text format to HTTP GET /metrics requests on that address.
+class LookupServer
+{
+public:
+    // Throws std::system_error when an address cannot be bound.
+    LookupServer(PrefixTable table, const std::string &address, const std::string &metrics_address = "");
+    ~LookupServer();
+
+    LookupServer(const LookupServer &) = delete;
+    LookupServer &operator=(const LookupServer &) = delete;
+
+    // Serves until stop() is called.
+    void run();
+    // Safe to call from other threads and from signal handlers.
+    void stop();
+
+    // Bound TCP port, 0 for a Unix socket.
+    uint16_t port() const;
+    uint16_t metrics_port() const;
+
+    // Not synchronized with run(); read them from the serving thread or
+    // after run() returns.
+    const LookupServerMetrics &metrics() const { return metrics_; }
+    void write_metrics(fmt::memory_buffer &out) const;
+
+private:
+    static constexpr size_t kReadSize = 64 << 10;
+    // Reading pauses while a client has this much unsent output.
+    static constexpr size_t kMaxPendingOutput = 16 << 20;
+    static constexpr size_t kMaxHttpRequestSize = 16 << 10;
+
+    struct Connection
+    {
+        std::vector<char> in;
+        std::vector<char> out;
+        size_t out_offset = 0;
+        uint32_t events = 0;
+        // The peer shut down its side; the connection closes once the
+        // answers to its last frames are written.
+        bool eof = false;
+        // A metrics scrape rather than a lookup_protocol client.
+        bool http = false;
+    };
+
+    void accept_connections(int listen_fd, bool http);
+    // Each returns false when the connection has to be closed.
+    bool read_input(int fd, Connection &connection);
+    bool answer_input(Connection &connection);
+    bool answer_frames(Connection &connection);
+    bool answer_http(Connection &connection);
+    bool write_output(int fd, Connection &connection);
+    void update_events(int fd, Connection &connection);
+    void close_connection(int fd);
+    void close_all();
+
+    PrefixTable table_;
+    std::string unix_path_;
+    int listen_fd_ = -1;
+    int metrics_fd_ = -1;
+    int epoll_fd_ = -1;
+    int stop_fd_ = -1;
+    // Descriptor kept open so that a connection can still be accepted and
+    // closed when the process runs out of descriptors.
+    int spare_fd_ = -1;
+    std::unordered_map<int, Connection> connections_;
+    std::vector<char> read_buffer_ = std::vector<char>(kReadSize);
+    LookupServerMetrics metrics_;
+};
@@ -4,17 +4,48 @@
 // Author: Volker Schwaberow <volker@schwaberow.de>
 // Copyright (c) 2024 Volker Schwaberow
 
+#include "address_class.hh"
+#include "address_format.hh"
+#include "arrow_ipc.hh"
+#include "batch_processor.hh"
+#include "geo_database.hh"
 #include "ip_analyzer.hh"
+#include "ipv4_block_parser.hh"
+#include "lookup_server.hh"
+#include "mapped_input.hh"
+#include "metrics.hh"
+#include "prefix_aggregator.hh"
+#include "prefix_column.hh"
+#include "prefix_table.hh"
+#include "record_writer.hh"
+#include "subnet_range.hh"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <csignal>
+#include <cstdio>
 #include <fmt/color.h>
 #include <fmt/core.h>
 #include <iostream>
+#include <iterator>
+#include <memory_resource>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <utility>
 #include <vector>
 
 namespace
 {
 
     constexpr int kWidth = 80;
+    constexpr size_t kOutputFlushThreshold = 1 << 20;
+    constexpr size_t kReportArenaSize = 2048;
+    constexpr size_t kPrefixChunk = 4096;
 
     struct OutputColors
     {
@@ -26,49 +57,301 @@ namespace
         static constexpr auto kError = fg(fmt::color::red) | fmt::emphasis::bold;
     };
 
-    void PrintCopperBar()
+    // Report rendering appends to one buffer that is written with a single
+    // call; styles are skipped when stdout is not a terminal.
+    class Report
     {
-        const auto copper_gradient = [](int i)
+    public:
+        explicit Report(bool color) : color_(color) {}
+
+        template <typename... Args>
+        void Print(fmt::text_style style, fmt::format_string<Args...> format, Args &&...args)
+        {
+            if (color_)
+            {
+                fmt::format_to(std::back_inserter(buffer_), style, fmt::string_view(format), std::forward<Args>(args)...);
+            }
+            else
+            {
+                fmt::format_to(std::back_inserter(buffer_), format, std::forward<Args>(args)...);
+            }
+        }
+
+        void CopperBar()
+        {
+            if (!color_)
+            {
+                buffer_.append(std::string(kWidth, '='));
+                buffer_.push_back('\n');
+                return;
+            }
+
+            const auto copper_gradient = [](int i)
+            {
+                constexpr int kMaxColor = 255;
+                const int r = std::min(kMaxColor, i * kMaxColor / kWidth);
+                const int g = std::min(kMaxColor, (kWidth - i) * kMaxColor / kWidth);
+                const int b = std::min(kMaxColor, std::abs(kWidth / 2 - i) * 2 * kMaxColor / kWidth);
+                return fmt::rgb(r, g, b);
+            };
+
+            for (int i = 0; i < kWidth; ++i)
+            {
+                Print(fg(copper_gradient(i)), "█");
+            }
+            buffer_.push_back('\n');
+        }
+
+        void Header(std::string_view text)
         {
-            constexpr int kMaxColor = 255;
-            const int r = std::min(kMaxColor, i * kMaxColor / kWidth);
-            const int g = std::min(kMaxColor, (kWidth - i) * kMaxColor / kWidth);
-            const int b = std::min(kMaxColor, std::abs(kWidth / 2 - i) * 2 * kMaxColor / kWidth);
-            return fmt::rgb(r, g, b);
-        };
+            CopperBar();
+            Print(OutputColors::kHeader, "{:^{}}\n", text, kWidth);
+            CopperBar();
+        }
 
-        for (int i = 0; i < kWidth; ++i)
+        void Row(std::string_view label, std::string_view value, std::string_view binary = {})
         {
-            fmt::print(fg(copper_gradient(i)), "█");
+            Print(OutputColors::kLabel, "{:<20}", label);
+            if (binary.empty())
+            {
+                Print(OutputColors::kValue, "{}\n", value);
+            }
+            else
+            {
+                Print(OutputColors::kValue, "{:<20}", value);
+                Print(OutputColors::kBinary, "{}\n", binary);
+            }
         }
-        fmt::print("\n");
+
+        void Write(std::FILE *out)
+        {
+            std::fwrite(buffer_.data(), 1, buffer_.size(), out);
+            std::fflush(out);
+            buffer_.clear();
+        }
+
+    private:
+        bool color_;
+        fmt::memory_buffer buffer_;
+    };
+
+    // Report text is built in a per-report arena; see PrintResults.
+    std::pmr::string AddressText(const IPValue &address, std::pmr::memory_resource *arena)
+    {
+        fmt::memory_buffer buffer;
+        format_address_expanded(buffer, address);
+        return std::pmr::string(buffer.data(), buffer.size(), arena);
     }
 
-    void PrintHeader(const std::string &text)
+    std::pmr::string BinaryText(const IPValue &address, std::pmr::memory_resource *arena)
     {
-        PrintCopperBar();
-        fmt::print(OutputColors::kHeader, "{:^{}}\n", text, kWidth);
-        PrintCopperBar();
+        fmt::memory_buffer buffer;
+        format_binary(buffer, address);
+        return std::pmr::string(buffer.data(), buffer.size(), arena);
     }
 
-    void PrintRow(const std::string &label, const std::string &value, const std::string &binary = "")
+    std::pmr::string SpecialUseText(const IPValue &address, std::pmr::memory_resource *arena)
+    {
+        const AddressClassMask classes = classify(address);
+        if (classes == 0)
+        {
+            return std::pmr::string("None", arena);
+        }
+        std::pmr::string names(arena);
+        address_class_names(classes, names);
+        return names;
+    }
+
+    std::pmr::string CountText(uint128 count, std::pmr::memory_resource *arena)
+    {
+        char text[kUint128DecimalLength];
+        return std::pmr::string(text, uint128_to_chars(text, text + sizeof(text), count).ptr, arena);
+    }
+
+    enum class Mode
+    {
+        kNone,
+        kBatch,
+        kAggregate,
+        kSplit,
+        kHosts,
+        kBuildIndex,
+        kServe,
+        kArrow
+    };
+
+    struct Options
     {
-        fmt::print(OutputColors::kLabel, "{:<20}", label);
-        if (binary.empty())
+        Mode mode = Mode::kNone;
+        std::string_view input = "-";
+        std::string_view prefix;
+        unsigned split_cidr = 0;
+        unsigned threads = 0;
+        std::optional<OutputFormat> format;
+        std::string_view index;
+        std::string_view output;
+        std::string_view listen;
+        std::string_view metrics;
+        std::vector<std::string_view> geoip;
+        bool stats = false;
+    };
+
+    bool ParseNumber(std::string_view text, unsigned &value)
+    {
+        const auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return ec == std::errc() && ptr == text.data() + text.size();
+    }
+
+    std::optional<Options> ParseOptions(const std::vector<std::string_view> &args)
+    {
+        Options options;
+
+        for (size_t i = 0; i < args.size(); ++i)
+        {
+            const std::string_view arg = args[i];
+            const bool batch = arg == "-b" || arg == "--batch";
+            const bool aggregate = arg == "-a" || arg == "--aggregate";
+            if (batch || aggregate)
+            {
+                if (options.mode != Mode::kNone)
+                {
+                    return std::nullopt;
+                }
+                options.mode = batch ? Mode::kBatch : Mode::kAggregate;
+                if (i + 1 < args.size() && (args[i + 1] == "-" || !args[i + 1].starts_with('-')))
+                {
+                    options.input = args[++i];
+                }
+            }
+            else if ((arg == "-s" || arg == "--split") && i + 2 < args.size() && options.mode == Mode::kNone)
+            {
+                options.mode = Mode::kSplit;
+                options.prefix = args[++i];
+                if (!ParseNumber(args[++i], options.split_cidr))
+                {
+                    return std::nullopt;
+                }
+            }
+            else if (arg == "--hosts" && i + 1 < args.size() && options.mode == Mode::kNone)
+            {
+                options.mode = Mode::kHosts;
+                options.prefix = args[++i];
+            }
+            else if (arg == "--build-index" && i + 2 < args.size() && options.mode == Mode::kNone)
+            {
+                options.mode = Mode::kBuildIndex;
+                options.input = args[++i];
+                options.index = args[++i];
+            }
+            else if (arg == "--arrow" && i + 2 < args.size() && options.mode == Mode::kNone)
+            {
+                options.mode = Mode::kArrow;
+                options.input = args[++i];
+                options.output = args[++i];
+            }
+            else if (arg == "--serve" && i + 1 < args.size() && options.mode == Mode::kNone)
+            {
+                options.mode = Mode::kServe;
+                options.listen = args[++i];
+            }
+            else if (arg == "--index" && i + 1 < args.size() && options.index.empty())
+            {
+                options.index = args[++i];
+            }
+            else if (arg == "--metrics" && i + 1 < args.size())
+            {
+                options.metrics = args[++i];
+            }
+            else if (arg == "--geoip" && i + 1 < args.size())
+            {
+                options.geoip.push_back(args[++i]);
+            }
+            else if (arg == "--stats")
+            {
+                options.stats = true;
+            }
+            else if ((arg == "-j" || arg == "--threads") && i + 1 < args.size())
+            {
+                if (!ParseNumber(args[++i], options.threads))
+                {
+                    return std::nullopt;
+                }
+            }
+            else if ((arg == "-f" || arg == "--format") && i + 1 < args.size())
+            {
+                options.format = parse_output_format(args[++i]);
+                if (!options.format)
+                {
+                    return std::nullopt;
+                }
+            }
+            else
+            {
+                return std::nullopt;
+            }
+        }
+
+        const bool needs_index = options.mode == Mode::kServe || options.mode == Mode::kBuildIndex;
+        const bool batch_only = options.format || options.stats || !options.geoip.empty();
+        if (options.mode == Mode::kNone || (batch_only && options.mode != Mode::kBatch) || needs_index == options.index.empty() ||
+            (!options.metrics.empty() && options.mode != Mode::kServe))
         {
-            fmt::print(OutputColors::kValue, "{}\n", value);
+            return std::nullopt;
         }
-        else
+        return options;
+    }
+
+    LookupServer *g_server = nullptr;
+
+    void StopServer(int)
+    {
+        if (g_server != nullptr)
         {
-            fmt::print(OutputColors::kValue, "{:<20}", value);
-            fmt::print(OutputColors::kBinary, "{}\n", binary);
+            g_server->stop();
         }
     }
 
     class IPAnalyzerApp
     {
     public:
-        int Run()
+        int Run(const std::vector<std::string_view> &args)
+        {
+            if (args.empty())
+            {
+                return RunInteractive();
+            }
+
+            if (args[0] == "-h" || args[0] == "--help")
+            {
+                PrintUsage();
+                return 0;
+            }
+
+            const auto options = ParseOptions(args);
+            if (!options)
+            {
+                PrintUsage();
+                return 1;
+            }
+            switch (options->mode)
+            {
+            case Mode::kBatch:
+                return RunBatch(*options);
+            case Mode::kAggregate:
+                return RunAggregate(*options);
+            case Mode::kBuildIndex:
+                return RunBuildIndex(*options);
+            case Mode::kServe:
+                return RunServe(*options);
+            case Mode::kArrow:
+                return RunArrow(*options);
+            default:
+                return RunEnumerate(*options);
+            }
+        }
+
+    private:
+        int RunInteractive()
         {
             PrintPrompt();
             std::string input;
@@ -77,81 +360,444 @@ namespace
                 return 1;
             }
 
+            const auto analyzer = IPAnalyzer::parse(input);
+            if (!analyzer)
+            {
+                PrintError(parse_error_message(analyzer.error()));
+                return 1;
+            }
+
+            PrintResults(*analyzer);
+            return 0;
+        }
+
+        std::FILE *OpenInput(std::string_view input) const
+        {
+            if (input == "-")
+            {
+                return stdin;
+            }
+            std::FILE *in = std::fopen(std::string(input).c_str(), "rb");
+            if (in == nullptr)
+            {
+                fmt::print(stderr, "ip-analyzer: cannot open '{}'\n", input);
+            }
+            return in;
+        }
+
+        int RunBatch(const Options &options)
+        {
+            std::optional<GeoEnricher> geo;
+            if (!options.geoip.empty())
+            {
+                std::vector<GeoDatabase> databases;
+                try
+                {
+                    for (const std::string_view path : options.geoip)
+                    {
+                        databases.push_back(GeoDatabase::open(std::string(path)));
+                    }
+                }
+                catch (const std::exception &e)
+                {
+                    fmt::print(stderr, "ip-analyzer: {}\n", e.what());
+                    return 1;
+                }
+                geo.emplace(std::move(databases));
+            }
+
+            std::FILE *in = OpenInput(options.input);
+            if (in == nullptr)
+            {
+                return 1;
+            }
+
+            const unsigned threads = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+            BatchProcessor processor(stdout, threads, options.format.value_or(OutputFormat::kText), geo ? &*geo : nullptr);
+            const uint64_t start = monotonic_nanos();
+            bool ok = false;
             try
             {
-                IPAnalyzer analyzer(input);
-                PrintResults(analyzer);
+                if (MappedFile::can_map(fileno(in)))
+                {
+                    const MappedFile mapped(fileno(in));
+                    ok = processor.process_region(mapped.view());
+                }
+                else
+                {
+                    ok = processor.process_stream(in);
+                }
             }
             catch (const std::exception &e)
             {
-                PrintError(e.what());
+                fmt::print(stderr, "ip-analyzer: {}\n", e.what());
+            }
+
+            if (in != stdin)
+            {
+                std::fclose(in);
+            }
+
+            if (!ok)
+            {
+                fmt::print(stderr, "ip-analyzer: I/O error during batch processing\n");
                 return 1;
             }
+            PrintFailureSummary(processor.stats());
+            if (options.stats)
+            {
+                PrintStats(processor.stats(), monotonic_nanos() - start);
+            }
+            return processor.stats().failures == 0 ? 0 : 2;
+        }
+
+        void PrintStats(const BatchStats &stats, uint64_t elapsed) const
+        {
+            const double seconds = static_cast<double>(std::max<uint64_t>(elapsed, 1)) * 1e-9;
+            fmt::print(stderr, "ip-analyzer: {} lines ({} IPv4, {} IPv6, {} failed), {} bytes in {:.3f} s\n", stats.lines,
+                       stats.ipv4, stats.ipv6, stats.failures, stats.bytes, seconds);
+            fmt::print(stderr, "  throughput: {:.0f} lines/s, {:.1f} MB/s\n", static_cast<double>(stats.lines) / seconds,
+                       static_cast<double>(stats.bytes) / seconds / 1e6);
+            for (const auto &[stage, histogram] : {std::pair{"parse", &stats.parse_time}, std::pair{"format", &stats.format_time}})
+            {
+                fmt::print(stderr, "  {} latency: p50 < {} ns, p99 < {} ns, max < {} ns ({} sampled lines)\n", stage,
+                           histogram->quantile(0.5), histogram->quantile(0.99), histogram->quantile(1.0), histogram->count());
+            }
+        }
+
+        void PrintFailureSummary(const BatchStats &stats) const
+        {
+            if (stats.failures == 0)
+            {
+                return;
+            }
+            fmt::print(stderr, "ip-analyzer: {} of {} lines failed\n", stats.failures, stats.lines);
+            for (size_t i = 1; i < kParseErrorCount; ++i)
+            {
+                const auto error = static_cast<ParseError>(i);
+                if (stats.error_count(error) != 0)
+                {
+                    fmt::print(stderr, "  {}: {}\n", parse_error_message(error), stats.error_count(error));
+                }
+            }
+        }
+
+        // Reads one CIDR per line; malformed lines are reported on stderr and
+        // counted in `failures`. Returns false if the input cannot be read.
+        bool ReadPrefixes(std::string_view input, PrefixColumn &prefixes, uint64_t &failures) const
+        {
+            std::FILE *in = OpenInput(input);
+            if (in == nullptr)
+            {
+                return false;
+            }
 
+            bool ok = true;
+            try
+            {
+                const InputRegion region(in);
+                IPv4BlockParser parser(region.view());
+                std::vector<uint32_t> addresses(kPrefixChunk);
+                std::vector<uint8_t> cidrs(kPrefixChunk);
+                while (!parser.done())
+                {
+                    const auto [count, rejected] = parser.next(addresses, cidrs);
+                    prefixes.append_v4(std::span(addresses).first(count), std::span(cidrs).first(count));
+                    if (rejected.empty())
+                    {
+                        continue;
+                    }
+                    const auto prefix = IPAnalyzer::parse(rejected);
+                    if (!prefix)
+                    {
+                        ++failures;
+                        fmt::print(stderr, "ip-analyzer: {}: {}\n", rejected, parse_error_message(prefix.error()));
+                        continue;
+                    }
+                    prefixes.push_back(*prefix);
+                }
+                prefixes.shrink_to_fit();
+            }
+            catch (const std::exception &e)
+            {
+                fmt::print(stderr, "ip-analyzer: {}\n", e.what());
+                ok = false;
+            }
+
+            if (in != stdin)
+            {
+                std::fclose(in);
+            }
+            return ok;
+        }
+
+        int RunAggregate(const Options &options)
+        {
+            PrefixColumn prefixes;
+            uint64_t failures = 0;
+            if (!ReadPrefixes(options.input, prefixes, failures))
+            {
+                return 1;
+            }
+
+            fmt::memory_buffer buffer;
+            for (const IPAnalyzer &prefix : aggregate_prefixes(prefixes))
+            {
+                format_address(buffer, prefix.ip_value());
+                fmt::format_to(std::back_inserter(buffer), "/{}\n", prefix.get_cidr());
+            }
+            if (std::fwrite(buffer.data(), 1, buffer.size(), stdout) != buffer.size() || std::fflush(stdout) != 0)
+            {
+                fmt::print(stderr, "ip-analyzer: I/O error during aggregation\n");
+                return 1;
+            }
+            return failures == 0 ? 0 : 2;
+        }
+
+        int RunBuildIndex(const Options &options)
+        {
+            PrefixColumn prefixes;
+            uint64_t failures = 0;
+            if (!ReadPrefixes(options.input, prefixes, failures))
+            {
+                return 1;
+            }
+
+            try
+            {
+                PrefixTable(prefixes).save(std::string(options.index));
+            }
+            catch (const std::exception &e)
+            {
+                fmt::print(stderr, "ip-analyzer: {}\n", e.what());
+                return 1;
+            }
+            return failures == 0 ? 0 : 2;
+        }
+
+        int RunArrow(const Options &options)
+        {
+            try
+            {
+                ArrowPrefixReader reader{std::string(options.input)};
+                ArrowAnalysisWriter writer(std::string(options.output), reader.ipv4_only());
+                PrefixColumn prefixes;
+                while (reader.next(prefixes))
+                {
+                    writer.write(prefixes);
+                }
+                writer.finish();
+            }
+            catch (const std::exception &e)
+            {
+                fmt::print(stderr, "ip-analyzer: {}\n", e.what());
+                return 1;
+            }
             return 0;
         }
 
-    private:
-        void PrintPrompt() const
+        int RunServe(const Options &options)
+        {
+            try
+            {
+                LookupServer server(PrefixTable::load(std::string(options.index)), std::string(options.listen),
+                                    std::string(options.metrics));
+                g_server = &server;
+                std::signal(SIGINT, StopServer);
+                std::signal(SIGTERM, StopServer);
+                fmt::print(stderr, "ip-analyzer: serving {} on {}\n", options.index, options.listen);
+                if (!options.metrics.empty())
+                {
+                    fmt::print(stderr, "ip-analyzer: metrics on http://{}/metrics\n", options.metrics);
+                }
+                server.run();
+                g_server = nullptr;
+            }
+            catch (const std::exception &e)
+            {
+                g_server = nullptr;
+                fmt::print(stderr, "ip-analyzer: {}\n", e.what());
+                return 1;
+            }
+            return 0;
+        }
+
+        // Streams every child prefix or host address of a prefix. The ranges
+        // are lazy, so memory use does not depend on the size of the prefix.
+        int RunEnumerate(const Options &options)
+        {
+            const auto prefix = IPAnalyzer::parse(options.prefix);
+            if (!prefix)
+            {
+                fmt::print(stderr, "ip-analyzer: {}: {}\n", options.prefix, parse_error_message(prefix.error()));
+                return 1;
+            }
+            if (options.mode == Mode::kSplit && options.split_cidr > 128)
+            {
+                fmt::print(stderr, "ip-analyzer: Invalid subnet prefix length\n");
+                return 1;
+            }
+
+            fmt::memory_buffer buffer;
+            bool ok = true;
+            const auto flush = [&]
+            {
+                ok = ok && std::fwrite(buffer.data(), 1, buffer.size(), stdout) == buffer.size();
+                buffer.clear();
+            };
+
+            try
+            {
+                if (options.mode == Mode::kSplit)
+                {
+                    const std::string suffix = fmt::format("/{}\n", options.split_cidr);
+                    for (const IPAnalyzer &subnet : SubnetRange(*prefix, static_cast<uint8_t>(options.split_cidr)))
+                    {
+                        format_address(buffer, subnet.ip_value());
+                        buffer.append(suffix);
+                        if (buffer.size() >= kOutputFlushThreshold)
+                        {
+                            flush();
+                        }
+                    }
+                }
+                else
+                {
+                    for (const IPValue &host : HostRange(*prefix))
+                    {
+                        format_address(buffer, host);
+                        buffer.push_back('\n');
+                        if (buffer.size() >= kOutputFlushThreshold)
+                        {
+                            flush();
+                        }
+                    }
+                }
+            }
+            catch (const std::invalid_argument &e)
+            {
+                fmt::print(stderr, "ip-analyzer: {}: {}\n", options.prefix, e.what());
+                return 1;
+            }
+
+            flush();
+            if (!ok || std::fflush(stdout) != 0)
+            {
+                fmt::print(stderr, "ip-analyzer: I/O error while writing output\n");
+                return 1;
+            }
+            return 0;
+        }
+
+        void PrintUsage() const
         {
-            fmt::print(OutputColors::kPrompt, "Enter IP address with CIDR (e.g., 192.168.0.1/24): ");
+            fmt::print("Usage: ip-analyzer [--batch [FILE] [--format FORMAT] [--geoip MMDB]... [--stats] | --aggregate [FILE] | --split CIDR N |\n"
+                       "                    --hosts CIDR | --build-index FILE INDEX | --serve ADDRESS --index INDEX [--metrics HOST:PORT] |\n"
+                       "                    --arrow INPUT OUTPUT]\n"
+                       "                   [--threads N]\n"
+                       "  (no arguments)         analyze a single CIDR read from stdin\n"
+                       "  -b, --batch [FILE]     analyze one CIDR per line from FILE or stdin ('-')\n"
+                       "  -a, --aggregate [FILE] merge the CIDRs in FILE into a minimal covering list\n"
+                       "  -s, --split CIDR N     list every /N subnet of CIDR\n"
+                       "      --hosts CIDR       list every usable host address of CIDR\n"
+                       "      --build-index FILE INDEX  compile the CIDRs in FILE into a prefix index file\n"
+                       "      --serve ADDRESS    answer lookups from --index INDEX on a socket path or HOST:PORT\n"
+                       "      --arrow INPUT OUTPUT  analyze the prefixes of an Arrow IPC file into Arrow columns\n"
+                       "      --metrics HOST:PORT  with --serve, expose Prometheus metrics at http://HOST:PORT/metrics\n"
+                       "  -f, --format FORMAT    batch output: text (default), ndjson, csv or binary\n"
+                       "      --geoip MMDB       add ASN, country and organization from a MaxMind DB to batch records;\n"
+                       "                         may be repeated, e.g. for an ASN and a country database\n"
+                       "      --stats            after a batch, print line counts, throughput and stage latencies to stderr\n"
+                       "  -j, --threads N        batch worker threads (default: number of cores)\n");
         }
 
-        void PrintResults(const IPAnalyzer &analyzer) const
+        void PrintPrompt()
         {
-            PrintHeader("IP Analysis Results");
+            report_.Print(OutputColors::kPrompt, "Enter IP address with CIDR (e.g., 192.168.0.1/24): ");
+            report_.Write(stdout);
+        }
+
+        void PrintResults(const IPAnalyzer &analyzer)
+        {
+            report_.Header("IP Analysis Results");
 
-            const auto ip = analyzer.get_ip();
-            const auto [first, last] = analyzer.get_host_range();
+            const IPValue ip = analyzer.ip_value();
+            const IPValue network = analyzer.network_value();
+            const IPValue netmask = analyzer.netmask_value();
+            const auto [first, last] = analyzer.host_range_value();
 
-            std::vector<std::tuple<std::string, std::string, std::string>> rows = {
-                {"IP Address", ip->to_string(), ip->to_binary_string()},
-                {"Network Address", analyzer.get_network()->to_string(), analyzer.get_network()->to_binary_string()},
-                {"Netmask", analyzer.get_netmask()->to_string(), analyzer.get_netmask()->to_binary_string()},
-                {"CIDR Notation", "/" + std::to_string(analyzer.get_cidr()), ""},
-                {"Subnet Range", fmt::format("{} - {}", first->to_string(), last->to_string()), ""},
-                {"Number of Hosts", fmt::format("{}", analyzer.get_num_hosts()), ""},
-                {"Private IP", analyzer.is_private() ? "Yes" : "No", ""}};
+            // Every row string lives in one arena that is released when the
+            // report is done; a report fits the inline block.
+            std::array<std::byte, kReportArenaSize> storage;
+            std::pmr::monotonic_buffer_resource arena(storage.data(), storage.size());
+            const std::pmr::string none(&arena);
+            std::pmr::vector<std::tuple<std::pmr::string, std::pmr::string, std::pmr::string>> rows(&arena);
+            rows.reserve(9);
 
-            if (ip->is_ipv6())
+            const auto add = [&](std::string_view label, std::pmr::string value, std::pmr::string binary)
+            { rows.emplace_back(std::pmr::string(label, &arena), std::move(value), std::move(binary)); };
+            const auto text = [&]<typename... Args>(fmt::format_string<Args...> format, Args &&...args)
             {
-                rows.emplace_back("IPv6 Scope", GetIPv6Scope(ip), "");
+                std::pmr::string value(&arena);
+                fmt::format_to(std::back_inserter(value), format, std::forward<Args>(args)...);
+                return value;
+            };
+
+            add("IP Address", AddressText(ip, &arena), BinaryText(ip, &arena));
+            add("Network Address", AddressText(network, &arena), BinaryText(network, &arena));
+            add("Netmask", AddressText(netmask, &arena), BinaryText(netmask, &arena));
+            add("CIDR Notation", text("/{}", analyzer.get_cidr()), none);
+            add("Subnet Range", text("{} - {}", AddressText(first, &arena), AddressText(last, &arena)), none);
+            add("Number of Hosts", CountText(analyzer.get_num_hosts(), &arena), none);
+            add("Private IP", text("{}", analyzer.is_private() ? "Yes" : "No"), none);
+            add("Special Use", SpecialUseText(ip, &arena), none);
+
+            if (ip.is_ipv6())
+            {
+                add("IPv6 Scope", text("{}", GetIPv6Scope(ip.v6())), none);
             }
             else
             {
-                rows.emplace_back("Broadcast Address", analyzer.get_broadcast()->to_string(), "");
+                add("Broadcast Address", AddressText(analyzer.broadcast_value(), &arena), none);
             }
 
             for (const auto &[label, value, binary] : rows)
             {
-                PrintRow(label, value, binary);
+                report_.Row(label, value, binary);
             }
 
-            PrintCopperBar();
+            report_.CopperBar();
+            report_.Write(stdout);
         }
 
-        std::string GetIPv6Scope(const std::shared_ptr<IPAddress> &ip) const
+        std::string_view GetIPv6Scope(const IPv6Value &ip) const
         {
-            auto ipv6 = std::dynamic_pointer_cast<IPv6Address>(ip);
-            auto bytes = ipv6->to_bytes();
-            if (bytes[0] == 0xfe && (bytes[1] & 0xc0) == 0x80)
+            const AddressClassMask classes = classify(ip);
+            if (has_class(classes, AddressClass::kLoopback))
+                return "Loopback";
+            if (has_class(classes, AddressClass::kLinkLocal))
                 return "Link-Local";
-            if (bytes[0] == 0xfd || bytes[0] == 0xfc)
+            if (has_class(classes, AddressClass::kSiteLocal))
+                return "Site-Local";
+            if (has_class(classes, AddressClass::kPrivate))
                 return "Unique Local";
-            if (bytes[0] == 0xff)
+            if (has_class(classes, AddressClass::kMulticast))
                 return "Multicast";
             return "Global";
         }
 
-        void PrintError(const std::string &message) const
+        void PrintError(const std::string &message)
         {
-            fmt::print(OutputColors::kError, "Error: {}\n", message);
+            report_.Print(OutputColors::kError, "Error: {}\n", message);
+            report_.Write(stdout);
         }
+
+        Report report_{isatty(fileno(stdout)) != 0};
     };
 
 }
 
-int main()
+int main(int argc, char **argv)
 {
-    return IPAnalyzerApp().Run();
+    return IPAnalyzerApp().Run(std::vector<std::string_view>(argv + 1, argv + argc));
 }
\ No newline at end of file
@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/mapped_input.cc
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#include "mapped_input.hh"
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+MappedFile::MappedFile(const std::string &path, Access access)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "cannot open '" + path + "'");
+    }
+
+    try
+    {
+        map(fd, access);
+    }
+    catch (...)
+    {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+}
+
+MappedFile::MappedFile(int fd, Access access)
+{
+    map(fd, access);
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0))
+{
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other)
+    {
+        unmap();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+bool MappedFile::can_map(int fd)
+{
+    struct stat st;
+    return ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+void MappedFile::map(int fd, Access access)
+{
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "cannot stat input");
+    }
+    if (!S_ISREG(st.st_mode))
+    {
+        throw std::system_error(EINVAL, std::generic_category(), "input is not a regular file");
+    }
+
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ == 0)
+    {
+        return;
+    }
+
+    void *data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        size_ = 0;
+        throw std::system_error(errno, std::generic_category(), "cannot map input");
+    }
+    ::madvise(data, size_, access == Access::kSequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    data_ = static_cast<const char *>(data);
+}
+
+void MappedFile::unmap()
+{
+    if (data_ != nullptr)
+    {
+        ::munmap(const_cast<char *>(data_), size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+}
+
+InputRegion::InputRegion(std::FILE *in)
+{
+    if (MappedFile::can_map(fileno(in)))
+    {
+        mapped_.emplace(fileno(in));
+        return;
+    }
+
+    constexpr size_t kChunkSize = 1 << 20;
+    size_t size = 0;
+    for (;;)
+    {
+        buffer_.resize(size + kChunkSize);
+        const size_t read = std::fread(buffer_.data() + size, 1, kChunkSize, in);
+        size += read;
+        if (read == 0)
+        {
+            break;
+        }
+    }
+    buffer_.resize(size);
+    if (std::ferror(in))
+    {
+        throw std::system_error(errno, std::generic_category(), "cannot read input");
+    }
+}
+
+uint64_t LineScanner::newline_mask(size_t offset) const
+{
+    if (offset >= size_)
+    {
+        return 0;
+    }
+
+    const char *block = data_ + offset;
+    char padded[kBlockSize];
+    if (size_ - offset < kBlockSize)
+    {
+        std::memset(padded, 0, sizeof(padded));
+        std::memcpy(padded, block, size_ - offset);
+        block = padded;
+    }
+
+#if defined(__AVX2__)
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const auto low = static_cast<uint32_t>(_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(block)), newline)));
+    const auto high = static_cast<uint32_t>(_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + 32)), newline)));
+    return (static_cast<uint64_t>(high) << 32) | low;
+#elif defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    uint64_t mask = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16 * i));
+        mask |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)))) << (16 * i);
+    }
+    return mask;
+#elif defined(__ARM_NEON)
+    const uint8x16_t newline = vdupq_n_u8('\n');
+    const uint8x16_t bits = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint64_t mask = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        const uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t *>(block + 16 * i));
+        const uint8x16_t hits = vandq_u8(vceqq_u8(bytes, newline), bits);
+        uint8x8_t sum = vpadd_u8(vget_low_u8(hits), vget_high_u8(hits));
+        sum = vpadd_u8(sum, sum);
+        sum = vpadd_u8(sum, sum);
+        const uint16_t lane = static_cast<uint16_t>(vget_lane_u8(sum, 0) | (vget_lane_u8(sum, 1) << 8));
+        mask |= static_cast<uint64_t>(lane) << (16 * i);
+    }
+    return mask;
+#else
+    uint64_t mask = 0;
+    for (size_t i = 0; i < kBlockSize; ++i)
+    {
+        mask |= static_cast<uint64_t>(block[i] == '\n') << i;
+    }
+    return mask;
+#endif
+}
@@ -0,0 +1,128 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/mapped_input.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Read-only memory mapping of a whole file, exposed as one string_view.
+class MappedFile
+{
+public:
+    // Readahead hint passed to madvise.
+    enum class Access
+    {
+        kSequential,
+        kRandom
+    };
+
+    explicit MappedFile(const std::string &path, Access access = Access::kSequential);
+    explicit MappedFile(int fd, Access access = Access::kSequential);
+    ~MappedFile();
+
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    std::string_view view() const { return {data_, size_}; }
+
+    // Only regular files can be mapped; pipes and terminals must be streamed.
+    static bool can_map(int fd);
+
+private:
+    void map(int fd, Access access);
+    void unmap();
+
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Whole contents of an input stream: mapped when it is a regular file, read
+// into memory otherwise.
+class InputRegion
+{
+public:
+    explicit InputRegion(std::FILE *in);
+
+    std::string_view view() const
+    {
+        return mapped_ ? mapped_->view() : std::string_view(buffer_.data(), buffer_.size());
+    }
+
+private:
+    std::optional<MappedFile> mapped_;
+    std::vector<char> buffer_;
+};
+
+// Splits a region into lines without copying. Newlines are located 64 bytes
+// at a time with SIMD compares; the resulting bitmask is then consumed one
+// line at a time. The last line does not need a trailing newline.
+class LineScanner
+{
+public:
+    explicit LineScanner(std::string_view region)
+        : data_(region.data()), size_(region.size()), mask_(newline_mask(0))
+    {
+    }
+
+    bool next(std::string_view &line)
+    {
+        if (position_ >= size_)
+        {
+            return false;
+        }
+
+        while (mask_ == 0)
+        {
+            block_ += kBlockSize;
+            if (block_ >= size_)
+            {
+                line = std::string_view(data_ + position_, size_ - position_);
+                position_ = size_;
+                return true;
+            }
+            mask_ = newline_mask(block_);
+        }
+
+        const size_t end = block_ + static_cast<size_t>(std::countr_zero(mask_));
+        mask_ &= mask_ - 1;
+        line = std::string_view(data_ + position_, end - position_);
+        position_ = end + 1;
+        return true;
+    }
+
+private:
+    static constexpr size_t kBlockSize = 64;
+
+    uint64_t newline_mask(size_t offset) const;
+
+    const char *data_;
+    size_t size_;
+    size_t position_ = 0;
+    size_t block_ = 0;
+    uint64_t mask_;
+};
+
+// Strips the spaces, tabs and line endings around a scanned line.
+inline std::string_view trim_line(std::string_view line)
+{
+    constexpr std::string_view kWhitespace = " \t\r\n";
+    const auto first = line.find_first_not_of(kWhitespace);
+    if (first == std::string_view::npos)
+    {
+        return {};
+    }
+    const auto last = line.find_last_not_of(kWhitespace);
+    return line.substr(first, last - first + 1);
+}
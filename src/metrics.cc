@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/metrics.cc
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#include "metrics.hh"
+#include <iterator>
+#include <string>
+
+uint64_t LatencyHistogram::quantile(double q) const
+{
+    if (count_ == 0)
+    {
+        return 0;
+    }
+    const auto rank = static_cast<uint64_t>(q * static_cast<double>(count_ - 1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount; ++i)
+    {
+        seen += buckets_[i];
+        if (seen > rank)
+        {
+            return bucket_bound(i);
+        }
+    }
+    return bucket_bound(kBucketCount - 1);
+}
+
+LatencyHistogram &LatencyHistogram::operator+=(const LatencyHistogram &other)
+{
+    for (size_t i = 0; i < kBucketCount; ++i)
+    {
+        buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    return *this;
+}
+
+void PrometheusText::family(std::string_view name, std::string_view type, std::string_view help)
+{
+    fmt::format_to(std::back_inserter(out_), "# HELP {} {}\n# TYPE {} {}\n", name, help, name, type);
+}
+
+void PrometheusText::sample(std::string_view name, uint64_t value, std::string_view labels)
+{
+    if (labels.empty())
+    {
+        fmt::format_to(std::back_inserter(out_), "{} {}\n", name, value);
+    }
+    else
+    {
+        fmt::format_to(std::back_inserter(out_), "{}{{{}}} {}\n", name, labels, value);
+    }
+}
+
+void PrometheusText::histogram(std::string_view name, std::string_view help, const LatencyHistogram &histogram)
+{
+    family(name, "histogram", help);
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i + 1 < LatencyHistogram::kBucketCount; ++i)
+    {
+        cumulative += histogram.bucket(i);
+        fmt::format_to(std::back_inserter(out_), "{}_bucket{{le=\"{}\"}} {}\n", name,
+                       static_cast<double>(LatencyHistogram::bucket_bound(i)) * 1e-9, cumulative);
+    }
+    fmt::format_to(std::back_inserter(out_), "{}_bucket{{le=\"+Inf\"}} {}\n", name, histogram.count());
+    fmt::format_to(std::back_inserter(out_), "{}_sum {}\n", name, static_cast<double>(histogram.sum()) * 1e-9);
+    fmt::format_to(std::back_inserter(out_), "{}_count {}\n", name, histogram.count());
+}
+
+std::string PrometheusText::label_value(std::string_view value)
+{
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (const char c : value)
+    {
+        if (c == '\\' || c == '"')
+        {
+            escaped.push_back('\\');
+            escaped.push_back(c);
+        }
+        else if (c == '\n')
+        {
+            escaped += "\\n";
+        }
+        else
+        {
+            escaped.push_back(c);
+        }
+    }
+    return escaped;
+}
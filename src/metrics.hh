@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/metrics.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <fmt/format.h>
+
+// Counters that are updated by different threads are aligned to this so
+// that they never share a cache line.
+constexpr size_t kCacheLineSize = 64;
+
+inline uint64_t monotonic_nanos()
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Latency histogram with power of two buckets: bucket i counts samples
+// below 2^i ns that do not fit an earlier bucket. The last bucket also takes
+// everything longer. Recording is a handful of instructions and histograms
+// merge by addition, so each thread keeps its own and they are summed when
+// read.
+class LatencyHistogram
+{
+public:
+    static constexpr size_t kBucketCount = 40;
+
+    void record(uint64_t nanos)
+    {
+        ++buckets_[std::min<size_t>(std::bit_width(nanos), kBucketCount - 1)];
+        ++count_;
+        sum_ += nanos;
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t sum() const { return sum_; }
+    uint64_t bucket(size_t index) const { return buckets_[index]; }
+    // Exclusive upper bound of a bucket in nanoseconds; the last bucket has
+    // none.
+    static uint64_t bucket_bound(size_t index) { return uint64_t{1} << index; }
+
+    // Upper bound of the bucket holding the `q` quantile, 0 when empty.
+    uint64_t quantile(double q) const;
+
+    LatencyHistogram &operator+=(const LatencyHistogram &other);
+
+private:
+    std::array<uint64_t, kBucketCount> buckets_{};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+};
+
+// Renders metrics in the Prometheus text exposition format. `labels` are
+// preformatted `name="value"` pairs; use label_value() for the values.
+class PrometheusText
+{
+public:
+    explicit PrometheusText(fmt::memory_buffer &out) : out_(out) {}
+
+    void family(std::string_view name, std::string_view type, std::string_view help);
+    void sample(std::string_view name, uint64_t value, std::string_view labels = {});
+    // A histogram family in seconds, from a nanosecond LatencyHistogram.
+    void histogram(std::string_view name, std::string_view help, const LatencyHistogram &histogram);
+
+    static std::string label_value(std::string_view value);
+
+private:
+    fmt::memory_buffer &out_;
+};
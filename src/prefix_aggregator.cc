@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/prefix_aggregator.cc
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#include "prefix_aggregator.hh"
+#include "prefix_set.hh"
+
+std::vector<IPAnalyzer> aggregate_prefixes(std::span<const IPAnalyzer> prefixes)
+{
+    return PrefixSet(prefixes).to_prefixes();
+}
+
+std::vector<IPAnalyzer> aggregate_prefixes(const PrefixColumn &prefixes)
+{
+    return PrefixSet(prefixes).to_prefixes();
+}
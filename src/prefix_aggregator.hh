@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/prefix_aggregator.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include "ip_analyzer.hh"
+#include "prefix_column.hh"
+#include <span>
+#include <vector>
+
+// Collapses prefixes into the smallest set of CIDR blocks that covers exactly
+// the same addresses (see PrefixSet). The result holds the IPv4 blocks
+// followed by the IPv6 blocks, each in ascending address order.
+std::vector<IPAnalyzer> aggregate_prefixes(std::span<const IPAnalyzer> prefixes);
+std::vector<IPAnalyzer> aggregate_prefixes(const PrefixColumn &prefixes);
@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/prefix_column.cc
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#include "prefix_column.hh"
+#include <algorithm>
+#include <stdexcept>
+
+PrefixColumn::PrefixColumn(std::span<const IPAnalyzer> prefixes)
+{
+    reserve(prefixes.size());
+    for (const IPAnalyzer &prefix : prefixes)
+    {
+        push_back(prefix);
+    }
+    shrink_to_fit();
+}
+
+void PrefixColumn::reserve(size_t v4, size_t v6)
+{
+    v4_addresses_.reserve(v4);
+    v4_cidrs_.reserve(v4);
+    v6_addresses_.reserve(v6);
+    v6_cidrs_.reserve(v6);
+    v4_bits_.reserve((v4 + v6 + 63) / 64);
+    v4_ranks_.reserve((v4 + v6 + 63) / 64);
+}
+
+void PrefixColumn::push_back(const IPAnalyzer &prefix)
+{
+    const IPValue address = prefix.ip_value();
+    if (address.is_ipv4())
+    {
+        push_back(address.v4(), prefix.get_cidr());
+    }
+    else
+    {
+        push_back(address.v6(), prefix.get_cidr());
+    }
+}
+
+void PrefixColumn::push_back(IPv4Value address, uint8_t cidr)
+{
+    if (cidr > 32)
+    {
+        throw std::invalid_argument(parse_error_message(ParseError::kCidrOutOfRange));
+    }
+    push_family(true, v4_addresses_.size());
+    v4_addresses_.push_back(address.value);
+    v4_cidrs_.push_back(cidr);
+}
+
+void PrefixColumn::push_back(const IPv6Value &address, uint8_t cidr)
+{
+    if (cidr > 128)
+    {
+        throw std::invalid_argument(parse_error_message(ParseError::kCidrOutOfRange));
+    }
+    push_family(false, v4_addresses_.size());
+    v6_addresses_.push_back(address);
+    v6_cidrs_.push_back(cidr);
+}
+
+void PrefixColumn::append_v4(std::span<const uint32_t> addresses, std::span<const uint8_t> cidrs)
+{
+    if (addresses.size() != cidrs.size())
+    {
+        throw std::invalid_argument("PrefixColumn::append_v4 columns differ in length");
+    }
+    if (std::any_of(cidrs.begin(), cidrs.end(), [](uint8_t cidr)
+                    { return cidr > 32; }))
+    {
+        throw std::invalid_argument(parse_error_message(ParseError::kCidrOutOfRange));
+    }
+    const size_t v4_before = v4_addresses_.size();
+    for (size_t i = 0; i < addresses.size(); ++i)
+    {
+        push_family(true, v4_before + i);
+    }
+    v4_addresses_.insert(v4_addresses_.end(), addresses.begin(), addresses.end());
+    v4_cidrs_.insert(v4_cidrs_.end(), cidrs.begin(), cidrs.end());
+}
+
+void PrefixColumn::push_family(bool v4, size_t v4_before)
+{
+    if (size_ % 64 == 0)
+    {
+        v4_ranks_.push_back(v4_before);
+        v4_bits_.push_back(0);
+    }
+    v4_bits_.back() |= static_cast<uint64_t>(v4) << (size_ % 64);
+    ++size_;
+}
+
+void PrefixColumn::clear()
+{
+    v4_addresses_.clear();
+    v4_cidrs_.clear();
+    v6_addresses_.clear();
+    v6_cidrs_.clear();
+    v4_bits_.clear();
+    v4_ranks_.clear();
+    size_ = 0;
+}
+
+void PrefixColumn::shrink_to_fit()
+{
+    v4_addresses_.shrink_to_fit();
+    v4_cidrs_.shrink_to_fit();
+    v6_addresses_.shrink_to_fit();
+    v6_cidrs_.shrink_to_fit();
+    v4_bits_.shrink_to_fit();
+    v4_ranks_.shrink_to_fit();
+}
+
+IPAnalyzer PrefixColumn::operator[](size_t index) const
+{
+    if (index >= size_)
+    {
+        throw std::out_of_range("PrefixColumn index out of range");
+    }
+    const size_t position = family_index(index);
+    if (is_ipv4(index))
+    {
+        return IPAnalyzer(IPValue(IPv4Value{v4_addresses_[position]}), v4_cidrs_[position]);
+    }
+    return IPAnalyzer(IPValue(v6_addresses_[position]), v6_cidrs_[position]);
+}
+
+size_t PrefixColumn::memory_usage() const
+{
+    return v4_addresses_.capacity() * sizeof(uint32_t) + v4_cidrs_.capacity() + v6_addresses_.capacity() * sizeof(IPv6Value) +
+           v6_cidrs_.capacity() + (v4_bits_.capacity() + v4_ranks_.capacity()) * sizeof(uint64_t);
+}
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/prefix_column.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include "ip_analyzer.hh"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Compact prefix list stored as columns: IPv4 entries as a uint32_t address
+// column plus a prefix length column (5 bytes each), IPv6 entries as 16 byte
+// address and length columns, and a bitmap recording the family of every
+// entry so the original order is kept. Addresses are stored as given, host
+// bits included, like IPAnalyzer::ip_value().
+//
+// The family columns have the layout the bulk kernels take, so they feed
+// compute_ranges_v4/v6 and classify_batch directly; PrefixTable, PrefixSet
+// and aggregate_prefixes accept a column in place of a list of IPAnalyzer.
+class PrefixColumn
+{
+public:
+    PrefixColumn() = default;
+    explicit PrefixColumn(std::span<const IPAnalyzer> prefixes);
+
+    void reserve(size_t v4, size_t v6 = 0);
+    void push_back(const IPAnalyzer &prefix);
+    // Throw std::invalid_argument when `cidr` is too large for the family.
+    void push_back(IPv4Value address, uint8_t cidr);
+    void push_back(const IPv6Value &address, uint8_t cidr);
+    // Appends IPv4 prefixes from parallel address and length columns.
+    void append_v4(std::span<const uint32_t> addresses, std::span<const uint8_t> cidrs);
+    void clear();
+    void shrink_to_fit();
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    bool is_ipv4(size_t index) const { return (v4_bits_[index / 64] >> (index % 64)) & 1; }
+
+    // Position of entry `index` within the columns of its family.
+    size_t family_index(size_t index) const
+    {
+        const size_t word = index / 64;
+        const uint64_t before = v4_bits_[word] & ((uint64_t{1} << (index % 64)) - 1);
+        const size_t v4_before = v4_ranks_[word] + static_cast<size_t>(std::popcount(before));
+        return is_ipv4(index) ? v4_before : index - v4_before;
+    }
+
+    IPAnalyzer operator[](size_t index) const;
+
+    std::span<const uint32_t> v4_addresses() const { return v4_addresses_; }
+    std::span<const uint8_t> v4_cidrs() const { return v4_cidrs_; }
+    std::span<const IPv6Value> v6_addresses() const { return v6_addresses_; }
+    std::span<const uint8_t> v6_cidrs() const { return v6_cidrs_; }
+
+    size_t memory_usage() const;
+
+    friend bool operator==(const PrefixColumn &, const PrefixColumn &) = default;
+
+private:
+    // `v4_before` counts the IPv4 entries preceding the new one.
+    void push_family(bool v4, size_t v4_before);
+
+    std::vector<uint32_t> v4_addresses_;
+    std::vector<uint8_t> v4_cidrs_;
+    // operator new aligns the column to 16 bytes.
+    std::vector<IPv6Value> v6_addresses_;
+    std::vector<uint8_t> v6_cidrs_;
+    // Bit i % 64 of word i / 64 is set when entry i is IPv4; v4_ranks_[w]
+    // counts the IPv4 entries in the words before w.
+    std::vector<uint64_t> v4_bits_;
+    std::vector<uint64_t> v4_ranks_;
+    size_t size_ = 0;
+};
@@ -0,0 +1,331 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/prefix_set.cc
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#include "prefix_set.hh"
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+
+    struct PackedIPv6
+    {
+        uint64_t high;
+        uint64_t low;
+        uint8_t cidr;
+    };
+
+    constexpr int kRadixBits = 16;
+    constexpr size_t kRadixSize = size_t{1} << kRadixBits;
+
+    // LSD radix sort over 16 bit digits. Passes where every key has the same
+    // digit (e.g. the host bits of IPv6 networks) are skipped.
+    template <typename T, typename DigitFn>
+    void RadixSort(std::vector<T> &items, int passes, DigitFn digit)
+    {
+        if (items.size() < 2)
+        {
+            return;
+        }
+
+        std::vector<T> scratch(items.size());
+        std::vector<size_t> offsets(kRadixSize);
+        for (int pass = 0; pass < passes; ++pass)
+        {
+            std::fill(offsets.begin(), offsets.end(), 0);
+            for (const T &item : items)
+            {
+                ++offsets[digit(item, pass)];
+            }
+            if (offsets[digit(items.front(), pass)] == items.size())
+            {
+                continue;
+            }
+
+            size_t sum = 0;
+            for (auto &offset : offsets)
+            {
+                sum += std::exchange(offset, sum);
+            }
+            for (const T &item : items)
+            {
+                scratch[offsets[digit(item, pass)]++] = item;
+            }
+            items.swap(scratch);
+        }
+    }
+
+    template <typename Int>
+    constexpr Int kMaxAddress = static_cast<Int>(~Int{0});
+
+    // Appends a range whose first address is not below that of the last
+    // range, merging it into the last range when they overlap or touch.
+    template <typename Int>
+    void AppendRange(std::vector<AddressRange<Int>> &ranges, Int first, Int last)
+    {
+        if (!ranges.empty())
+        {
+            AddressRange<Int> &back = ranges.back();
+            if (back.last == kMaxAddress<Int> || first <= back.last + 1)
+            {
+                back.last = std::max(back.last, last);
+                return;
+            }
+        }
+        ranges.push_back({first, last});
+    }
+
+    template <typename Int>
+    std::vector<AddressRange<Int>> Normalize(std::vector<AddressRange<Int>> ranges)
+    {
+        std::sort(ranges.begin(), ranges.end(), [](const auto &a, const auto &b)
+                  { return a.first < b.first; });
+        std::vector<AddressRange<Int>> result;
+        result.reserve(ranges.size());
+        for (const auto &range : ranges)
+        {
+            AppendRange(result, range.first, range.last);
+        }
+        return result;
+    }
+
+    template <typename Int>
+    std::vector<AddressRange<Int>> Unite(const std::vector<AddressRange<Int>> &a, const std::vector<AddressRange<Int>> &b)
+    {
+        std::vector<AddressRange<Int>> result;
+        result.reserve(a.size() + b.size());
+        size_t i = 0;
+        size_t j = 0;
+        while (i < a.size() || j < b.size())
+        {
+            const bool take_a = j == b.size() || (i < a.size() && a[i].first <= b[j].first);
+            const AddressRange<Int> &range = take_a ? a[i++] : b[j++];
+            AppendRange(result, range.first, range.last);
+        }
+        return result;
+    }
+
+    template <typename Int>
+    std::vector<AddressRange<Int>> Intersect(const std::vector<AddressRange<Int>> &a, const std::vector<AddressRange<Int>> &b)
+    {
+        std::vector<AddressRange<Int>> result;
+        size_t i = 0;
+        size_t j = 0;
+        while (i < a.size() && j < b.size())
+        {
+            const Int first = std::max(a[i].first, b[j].first);
+            const Int last = std::min(a[i].last, b[j].last);
+            if (first <= last)
+            {
+                result.push_back({first, last});
+            }
+            if (a[i].last < b[j].last)
+            {
+                ++i;
+            }
+            else
+            {
+                ++j;
+            }
+        }
+        return result;
+    }
+
+    template <typename Int>
+    std::vector<AddressRange<Int>> Subtract(const std::vector<AddressRange<Int>> &a, const std::vector<AddressRange<Int>> &b)
+    {
+        std::vector<AddressRange<Int>> result;
+        result.reserve(a.size());
+        size_t j = 0;
+        for (const auto &range : a)
+        {
+            while (j < b.size() && b[j].last < range.first)
+            {
+                ++j;
+            }
+
+            Int first = range.first;
+            bool remaining = true;
+            for (size_t k = j; k < b.size() && b[k].first <= range.last; ++k)
+            {
+                if (b[k].first > first)
+                {
+                    result.push_back({first, b[k].first - 1});
+                }
+                if (b[k].last >= range.last)
+                {
+                    remaining = false;
+                    break;
+                }
+                first = b[k].last + 1;
+            }
+            if (remaining)
+            {
+                result.push_back({first, range.last});
+            }
+        }
+        return result;
+    }
+
+    int CountrZero(uint32_t value) { return std::countr_zero(value); }
+    int CountrZero(uint128 value) { return countr_zero_128(value); }
+    int BitWidth(uint32_t value) { return std::bit_width(value); }
+    int BitWidth(uint128 value) { return bit_width_128(value); }
+
+    // Splits [first, last] into the fewest aligned CIDR blocks.
+    template <typename Int, int Width, typename Emit>
+    void EmitBlocks(Int first, Int last, Emit emit)
+    {
+        for (;;)
+        {
+            const Int span = last - first;
+            const int limit = span == kMaxAddress<Int> ? Width : BitWidth(static_cast<Int>(span + 1)) - 1;
+            const int host_bits = std::min(first == 0 ? Width : CountrZero(first), limit);
+            emit(first, static_cast<uint8_t>(Width - host_bits));
+
+            if (host_bits == Width)
+            {
+                return;
+            }
+            const Int block_last = first + ((Int{1} << host_bits) - 1);
+            if (block_last == last)
+            {
+                return;
+            }
+            first = block_last + 1;
+        }
+    }
+
+    // Prefixes are packed into integer keys and radix sorted by network
+    // address so that building the ranges is a single merge pass.
+    void BuildRanges(std::vector<uint64_t> v4, std::vector<PackedIPv6> v6, std::vector<IPv4Range> &v4_ranges,
+                     std::vector<IPv6Range> &v6_ranges)
+    {
+        RadixSort(v4, 2, [](uint64_t key, int pass)
+                  { return static_cast<size_t>((key >> (8 + kRadixBits * pass)) & (kRadixSize - 1)); });
+        RadixSort(v6, 8, [](const PackedIPv6 &key, int pass)
+                  {
+                      const uint64_t word = pass < 4 ? key.low : key.high;
+                      return static_cast<size_t>((word >> (kRadixBits * (pass % 4))) & (kRadixSize - 1)); });
+
+        v4_ranges.reserve(v4.size());
+        for (uint64_t key : v4)
+        {
+            const auto first = static_cast<uint32_t>(key >> 8);
+            const auto cidr = static_cast<uint8_t>(key);
+            const uint32_t host_mask = cidr == 0 ? 0xFFFFFFFF : (uint32_t{1} << (32 - cidr)) - 1;
+            AppendRange(v4_ranges, first, first | host_mask);
+        }
+
+        v6_ranges.reserve(v6.size());
+        for (const PackedIPv6 &key : v6)
+        {
+            const uint128 first = make_uint128(key.high, key.low);
+            const uint128 host_mask = key.cidr == 0 ? kUint128Max : (uint128{1} << (128 - key.cidr)) - 1;
+            AppendRange(v6_ranges, first, first | host_mask);
+        }
+    }
+
+}
+
+PrefixSet::PrefixSet(std::span<const IPAnalyzer> prefixes)
+{
+    std::vector<uint64_t> v4;
+    std::vector<PackedIPv6> v6;
+    for (const IPAnalyzer &prefix : prefixes)
+    {
+        const IPValue network = prefix.network_value();
+        if (network.is_ipv4())
+        {
+            v4.push_back((static_cast<uint64_t>(network.v4().value) << 8) | prefix.get_cidr());
+        }
+        else
+        {
+            const uint128 value = to_uint128(network.v6());
+            v6.push_back({uint128_high(value), uint128_low(value), prefix.get_cidr()});
+        }
+    }
+    BuildRanges(std::move(v4), std::move(v6), v4_, v6_);
+}
+
+PrefixSet::PrefixSet(const PrefixColumn &prefixes)
+{
+    const auto v4_addresses = prefixes.v4_addresses();
+    const auto v4_cidrs = prefixes.v4_cidrs();
+    std::vector<uint64_t> v4(v4_addresses.size());
+    for (size_t i = 0; i < v4.size(); ++i)
+    {
+        const uint8_t cidr = v4_cidrs[i];
+        const uint32_t mask = cidr == 0 ? 0 : ~uint32_t{0} << (32 - cidr);
+        v4[i] = (static_cast<uint64_t>(v4_addresses[i] & mask) << 8) | cidr;
+    }
+
+    const auto v6_addresses = prefixes.v6_addresses();
+    const auto v6_cidrs = prefixes.v6_cidrs();
+    std::vector<PackedIPv6> v6(v6_addresses.size());
+    for (size_t i = 0; i < v6.size(); ++i)
+    {
+        const uint8_t cidr = v6_cidrs[i];
+        const uint128 value = to_uint128(v6_addresses[i]) & ipv6_mask(cidr);
+        v6[i] = {uint128_high(value), uint128_low(value), cidr};
+    }
+    BuildRanges(std::move(v4), std::move(v6), v4_, v6_);
+}
+
+PrefixSet::PrefixSet(std::vector<IPv4Range> v4, std::vector<IPv6Range> v6)
+{
+    const auto inverted = [](const auto &range)
+    { return range.first > range.last; };
+    if (std::any_of(v4.begin(), v4.end(), inverted) || std::any_of(v6.begin(), v6.end(), inverted))
+    {
+        throw std::invalid_argument("Range ends before it starts");
+    }
+    v4_ = Normalize(std::move(v4));
+    v6_ = Normalize(std::move(v6));
+}
+
+PrefixSet PrefixSet::unite(const PrefixSet &other) const
+{
+    PrefixSet result;
+    result.v4_ = Unite(v4_, other.v4_);
+    result.v6_ = Unite(v6_, other.v6_);
+    return result;
+}
+
+PrefixSet PrefixSet::intersect(const PrefixSet &other) const
+{
+    PrefixSet result;
+    result.v4_ = Intersect(v4_, other.v4_);
+    result.v6_ = Intersect(v6_, other.v6_);
+    return result;
+}
+
+PrefixSet PrefixSet::subtract(const PrefixSet &other) const
+{
+    PrefixSet result;
+    result.v4_ = Subtract(v4_, other.v4_);
+    result.v6_ = Subtract(v6_, other.v6_);
+    return result;
+}
+
+std::vector<IPAnalyzer> PrefixSet::to_prefixes() const
+{
+    std::vector<IPAnalyzer> result;
+    result.reserve(v4_.size() + v6_.size());
+    for (const IPv4Range &range : v4_)
+    {
+        EmitBlocks<uint32_t, 32>(range.first, range.last, [&](uint32_t first, uint8_t cidr)
+                                 { result.emplace_back(IPValue(IPv4Value{first}), cidr); });
+    }
+    for (const IPv6Range &range : v6_)
+    {
+        EmitBlocks<uint128, 128>(range.first, range.last, [&](uint128 first, uint8_t cidr)
+                                 { result.emplace_back(IPValue(to_ipv6_value(first)), cidr); });
+    }
+    return result;
+}
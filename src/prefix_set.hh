@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/prefix_set.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include "ip_analyzer.hh"
+#include "prefix_column.hh"
+#include "uint128.hh"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Inclusive range of addresses in host byte order.
+template <typename Int>
+struct AddressRange
+{
+    Int first;
+    Int last;
+
+    friend bool operator==(const AddressRange &, const AddressRange &) = default;
+};
+
+using IPv4Range = AddressRange<uint32_t>;
+using IPv6Range = AddressRange<uint128>;
+
+// Set of addresses stored as sorted, non-overlapping, non-adjacent ranges in
+// two flat arrays, one per family. Set operations are linear merges of the
+// range arrays; membership is a branchless binary search.
+class PrefixSet
+{
+public:
+    PrefixSet() = default;
+    explicit PrefixSet(std::span<const IPAnalyzer> prefixes);
+    explicit PrefixSet(const PrefixColumn &prefixes);
+    PrefixSet(std::vector<IPv4Range> v4, std::vector<IPv6Range> v6);
+
+    bool contains(IPv4Value address) const { return contains(v4_, address.value); }
+    bool contains(const IPv6Value &address) const { return contains(v6_, to_uint128(address)); }
+    bool contains(const IPValue &address) const
+    {
+        return address.is_ipv4() ? contains(address.v4()) : contains(address.v6());
+    }
+
+    PrefixSet unite(const PrefixSet &other) const;
+    PrefixSet intersect(const PrefixSet &other) const;
+    PrefixSet subtract(const PrefixSet &other) const;
+
+    // Minimal list of CIDR blocks covering the set, IPv4 first.
+    std::vector<IPAnalyzer> to_prefixes() const;
+
+    std::span<const IPv4Range> v4_ranges() const { return v4_; }
+    std::span<const IPv6Range> v6_ranges() const { return v6_; }
+    bool empty() const { return v4_.empty() && v6_.empty(); }
+
+    friend bool operator==(const PrefixSet &, const PrefixSet &) = default;
+
+private:
+    template <typename Int>
+    static bool contains(const std::vector<AddressRange<Int>> &ranges, Int address)
+    {
+        if (ranges.empty() || address < ranges.front().first)
+        {
+            return false;
+        }
+        const AddressRange<Int> *base = ranges.data();
+        size_t length = ranges.size();
+        while (length > 1)
+        {
+            const size_t half = length / 2;
+            base = base[half].first <= address ? base + half : base;
+            length -= half;
+        }
+        return address <= base->last;
+    }
+
+    std::vector<IPv4Range> v4_;
+    std::vector<IPv6Range> v6_;
+};
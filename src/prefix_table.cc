@@ -0,0 +1,1023 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/prefix_table.cc
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#include "prefix_table.hh"
+#include "mapped_input.hh"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+// Index file layout, native little endian:
+//
+//   IndexHeader (128 bytes)
+//   source prefixes   StoredPrefix[prefix_count]
+//   IPv4 root         uint32_t[0 or 2^24]
+//   IPv4 groups       uint32_t[256 * groups]
+//   IPv6 root         uint32_t[0 or 2^16]
+//   IPv6 groups       uint32_t[256 * groups]
+//
+// Every section starts on a 64 byte boundary and is zero padded to the next
+// one. payload_checksum is XXH64 (seed 0) over everything after the header.
+
+namespace
+{
+
+    constexpr char kIndexMagic[8] = {'I', 'P', 'A', 'P', 'F', 'X', 'T', '\0'};
+    constexpr uint32_t kIndexVersion = 1;
+    constexpr uint32_t kByteOrderMark = 0x01020304;
+    constexpr size_t kSectionAlignment = 64;
+
+    enum Section
+    {
+        kPrefixSection,
+        kV4RootSection,
+        kV4GroupSection,
+        kV6RootSection,
+        kV6GroupSection,
+        kSectionCount
+    };
+
+    struct IndexSection
+    {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct IndexHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint64_t file_size;
+        uint64_t prefix_count;
+        uint64_t source_checksum;
+        uint64_t payload_checksum;
+        IndexSection sections[kSectionCount];
+    };
+
+    static_assert(sizeof(IndexHeader) == 128);
+    static_assert(sizeof(IndexHeader) % kSectionAlignment == 0);
+
+    constexpr uint64_t AlignUp(uint64_t value)
+    {
+        return (value + kSectionAlignment - 1) & ~uint64_t{kSectionAlignment - 1};
+    }
+
+    // XXH64 with seed 0, fed in 32 byte stripes so that the sections of an
+    // index can be hashed without first copying them together.
+    class Xxh64
+    {
+    public:
+        // `size` must be a multiple of the stripe size.
+        void update(const unsigned char *data, size_t size)
+        {
+            for (size_t i = 0; i < size; i += kStripe)
+            {
+                for (size_t lane = 0; lane < 4; ++lane)
+                {
+                    lanes_[lane] = Round(lanes_[lane], Read64(data + i + 8 * lane));
+                }
+            }
+            total_ += size;
+        }
+
+        uint64_t finish(const unsigned char *tail, size_t size) const
+        {
+            uint64_t hash = kPrime5;
+            if (total_ != 0)
+            {
+                hash = std::rotl(lanes_[0], 1) + std::rotl(lanes_[1], 7) + std::rotl(lanes_[2], 12) + std::rotl(lanes_[3], 18);
+                for (const uint64_t lane : lanes_)
+                {
+                    hash = (hash ^ Round(0, lane)) * kPrime1 + kPrime4;
+                }
+            }
+            hash += total_ + size;
+
+            size_t i = 0;
+            for (; i + 8 <= size; i += 8)
+            {
+                hash = std::rotl(hash ^ Round(0, Read64(tail + i)), 27) * kPrime1 + kPrime4;
+            }
+            if (i + 4 <= size)
+            {
+                hash = std::rotl(hash ^ (Read32(tail + i) * kPrime1), 23) * kPrime2 + kPrime3;
+                i += 4;
+            }
+            for (; i < size; ++i)
+            {
+                hash = std::rotl(hash ^ (tail[i] * kPrime5), 11) * kPrime1;
+            }
+
+            hash ^= hash >> 33;
+            hash *= kPrime2;
+            hash ^= hash >> 29;
+            hash *= kPrime3;
+            hash ^= hash >> 32;
+            return hash;
+        }
+
+        static constexpr size_t kStripe = 32;
+
+    private:
+        static constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87;
+        static constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4F;
+        static constexpr uint64_t kPrime3 = 0x165667B19E3779F9;
+        static constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63;
+        static constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5;
+
+        static uint64_t Round(uint64_t accumulator, uint64_t input)
+        {
+            return std::rotl(accumulator + input * kPrime2, 31) * kPrime1;
+        }
+
+        static uint64_t Read64(const unsigned char *data)
+        {
+            uint64_t value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+        static uint64_t Read32(const unsigned char *data)
+        {
+            uint32_t value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+        uint64_t lanes_[4] = {kPrime1 + kPrime2, kPrime2, 0, 0 - kPrime1};
+        uint64_t total_ = 0;
+    };
+
+    uint64_t Checksum(std::span<const std::byte> data)
+    {
+        const auto *bytes = reinterpret_cast<const unsigned char *>(data.data());
+        const size_t bulk = data.size() - data.size() % Xxh64::kStripe;
+        Xxh64 hash;
+        hash.update(bytes, bulk);
+        return hash.finish(bytes + bulk, data.size() - bulk);
+    }
+
+    [[noreturn]] void ThrowInvalidIndex(const std::string &path, const char *reason)
+    {
+        throw std::runtime_error("Invalid prefix index '" + path + "': " + reason);
+    }
+
+    template <typename T>
+    std::span<const T> SectionView(std::string_view data, const IndexSection &section)
+    {
+        return {reinterpret_cast<const T *>(data.data() + section.offset), static_cast<size_t>(section.size / sizeof(T))};
+    }
+
+    // Network and length identifying a prefix for remove().
+    struct PrefixKey
+    {
+        std::array<uint8_t, 16> network;
+        uint8_t cidr;
+        uint8_t family;
+
+        bool operator==(const PrefixKey &) const = default;
+    };
+
+    struct PrefixKeyHash
+    {
+        size_t operator()(const PrefixKey &key) const
+        {
+            uint64_t words[2];
+            std::memcpy(words, key.network.data(), sizeof(words));
+            const uint64_t hash = (words[0] * 0x9E3779B185EBCA87) ^ std::rotl(words[1] * 0xC2B2AE3D27D4EB4F, 29) ^
+                                  (uint64_t{key.cidr} << 8 | key.family);
+            return static_cast<size_t>(hash ^ (hash >> 32));
+        }
+    };
+
+    PrefixKey MakeKey(const std::array<uint8_t, 16> &address, uint8_t cidr, uint8_t family)
+    {
+        PrefixKey key{address, cidr, family};
+        for (size_t byte = 0; byte < key.network.size(); ++byte)
+        {
+            const int bits = std::clamp(static_cast<int>(cidr) - static_cast<int>(8 * byte), 0, 8);
+            key.network[byte] &= static_cast<uint8_t>(0xFF00 >> bits);
+        }
+        return key;
+    }
+
+    // Family of a removed entry in the prefix list.
+    constexpr uint8_t kRemovedFamily = 0;
+
+    // How long LivePrefixTable waits for readers to leave the retired copy
+    // before copying the published one instead.
+    constexpr std::chrono::milliseconds kGracePeriod{2};
+
+    // Leaf entry every slot of a group holds, or `child_flag` when they
+    // differ or one is a child.
+    uint32_t UniformEntry(std::span<const uint32_t> group, uint32_t child_flag)
+    {
+        const uint32_t entry = group[0];
+        if ((entry & child_flag) || !std::all_of(group.begin() + 1, group.end(), [entry](uint32_t other)
+                                                 { return other == entry; }))
+        {
+            return child_flag;
+        }
+        return entry;
+    }
+
+}
+
+struct PrefixTable::Storage
+{
+    Trie v4;
+    Trie v6;
+    std::vector<StoredPrefix> prefixes;
+
+    // Bookkeeping for add() and remove(), set up by the first update: the
+    // newest index per prefix, for every index the older entry it shadows
+    // (kNoMatch if none), and the removed indices as a min-heap.
+    bool indexed = false;
+    std::unordered_map<PrefixKey, uint32_t, PrefixKeyHash> newest;
+    std::vector<uint32_t> shadowed;
+    std::vector<uint32_t> free_indices;
+
+    void index()
+    {
+        shadowed.assign(prefixes.size(), kNoMatch);
+        for (uint32_t i = 0; i < prefixes.size(); ++i)
+        {
+            const StoredPrefix &prefix = prefixes[i];
+            if (prefix.family == kRemovedFamily)
+            {
+                free_indices.push_back(i);
+                continue;
+            }
+            const auto [it, inserted] = newest.try_emplace(MakeKey(prefix.address, prefix.cidr, prefix.family), i);
+            if (!inserted)
+            {
+                shadowed[i] = std::exchange(it->second, i);
+            }
+        }
+        std::make_heap(free_indices.begin(), free_indices.end(), std::greater<>());
+        indexed = true;
+    }
+};
+
+PrefixTable::PrefixTable(std::span<const IPAnalyzer> prefixes)
+{
+    build(store_all(prefixes));
+}
+
+PrefixTable::PrefixTable(const PrefixColumn &prefixes)
+{
+    build(store_all(prefixes));
+}
+
+template <typename Prefixes>
+std::vector<PrefixTable::StoredPrefix> PrefixTable::store_all(const Prefixes &prefixes)
+{
+    std::vector<StoredPrefix> stored;
+    stored.reserve(prefixes.size());
+    if constexpr (std::is_same_v<Prefixes, PrefixColumn>)
+    {
+        // Walks the family columns in order instead of indexing entries.
+        size_t v4 = 0;
+        size_t v6 = 0;
+        for (size_t i = 0; i < prefixes.size(); ++i)
+        {
+            StoredPrefix prefix{};
+            if (prefixes.is_ipv4(i))
+            {
+                const uint32_t address = prefixes.v4_addresses()[v4];
+                for (size_t byte = 0; byte < 4; ++byte)
+                {
+                    prefix.address[byte] = static_cast<uint8_t>(address >> (24 - 8 * byte));
+                }
+                prefix.cidr = prefixes.v4_cidrs()[v4++];
+                prefix.family = 4;
+            }
+            else
+            {
+                prefix.address = prefixes.v6_addresses()[v6].bytes;
+                prefix.cidr = prefixes.v6_cidrs()[v6++];
+                prefix.family = 6;
+            }
+            stored.push_back(prefix);
+        }
+    }
+    else
+    {
+        for (const IPAnalyzer &prefix : prefixes)
+        {
+            stored.push_back(store(prefix));
+        }
+    }
+    return stored;
+}
+
+void PrefixTable::build(std::vector<StoredPrefix> prefixes)
+{
+    if (prefixes.size() >= kIndexMask)
+    {
+        throw std::length_error("Too many prefixes for PrefixTable");
+    }
+
+    // Painting shorter prefixes first lets longer ones simply overwrite the
+    // entries they cover. The counting sort is stable, so later duplicates
+    // keep winning.
+    std::array<uint32_t, 130> starts{};
+    for (const StoredPrefix &prefix : prefixes)
+    {
+        ++starts[prefix.cidr + 1];
+    }
+    std::partial_sum(starts.begin(), starts.end(), starts.begin());
+    std::vector<uint32_t> order(prefixes.size());
+    for (uint32_t index = 0; index < prefixes.size(); ++index)
+    {
+        order[starts[prefixes[index].cidr]++] = index;
+    }
+
+    auto storage = std::make_shared<Storage>();
+    Trie &v4 = storage->v4;
+    Trie &v6 = storage->v6;
+    for (uint32_t index : order)
+    {
+        const StoredPrefix &prefix = prefixes[index];
+        if (prefix.family == 4)
+        {
+            if (v4.root.empty())
+            {
+                v4.root.assign(size_t{1} << 24, 0);
+            }
+            uint32_t address = 0;
+            for (size_t byte = 0; byte < 4; ++byte)
+            {
+                address = (address << 8) | prefix.address[byte];
+            }
+            const uint32_t mask = prefix.cidr == 0 ? 0 : ~uint32_t{0} << (32 - prefix.cidr);
+            insert_v4(v4, address & mask, prefix.cidr, index + 1);
+        }
+        else
+        {
+            if (v6.root.empty())
+            {
+                v6.root.assign(size_t{1} << 16, 0);
+            }
+            const IPValue network = IPAnalyzer(IPValue(IPv6Value{prefix.address}), prefix.cidr).network_value();
+            insert_v6(v6, network.v6().bytes, prefix.cidr, index + 1);
+        }
+    }
+
+    storage->prefixes = std::move(prefixes);
+    built_ = storage.get();
+    storage_ = std::move(storage);
+    set_views();
+    source_checksum_ = Checksum(std::as_bytes(prefixes_));
+}
+
+void PrefixTable::set_views()
+{
+    v4_ = {built_->v4.root, built_->v4.groups};
+    v6_ = {built_->v6.root, built_->v6.groups};
+    prefixes_ = built_->prefixes;
+}
+
+PrefixTable::Storage &PrefixTable::writable()
+{
+    if (built_ == nullptr || storage_.use_count() != 1)
+    {
+        std::shared_ptr<Storage> storage;
+        if (built_ != nullptr)
+        {
+            storage = std::make_shared<Storage>(*built_);
+        }
+        else
+        {
+            storage = std::make_shared<Storage>();
+            storage->v4.root.assign(v4_.root.begin(), v4_.root.end());
+            storage->v4.groups.assign(v4_.groups.begin(), v4_.groups.end());
+            storage->v6.root.assign(v6_.root.begin(), v6_.root.end());
+            storage->v6.groups.assign(v6_.groups.begin(), v6_.groups.end());
+            storage->prefixes.assign(prefixes_.begin(), prefixes_.end());
+        }
+        built_ = storage.get();
+        storage_ = std::move(storage);
+        set_views();
+    }
+    if (!built_->indexed)
+    {
+        built_->index();
+    }
+    return *built_;
+}
+
+uint32_t PrefixTable::add(const IPAnalyzer &prefix)
+{
+    Storage &storage = writable();
+    const StoredPrefix stored = store(prefix);
+
+    uint32_t index;
+    if (!storage.free_indices.empty())
+    {
+        std::pop_heap(storage.free_indices.begin(), storage.free_indices.end(), std::greater<>());
+        index = storage.free_indices.back();
+        storage.free_indices.pop_back();
+        storage.prefixes[index] = stored;
+    }
+    else
+    {
+        if (storage.prefixes.size() + 1 >= kIndexMask)
+        {
+            throw std::length_error("Too many prefixes for PrefixTable");
+        }
+        index = static_cast<uint32_t>(storage.prefixes.size());
+        storage.prefixes.push_back(stored);
+        storage.shadowed.push_back(kNoMatch);
+    }
+    const auto [it, inserted] = storage.newest.try_emplace(MakeKey(stored.address, stored.cidr, stored.family), index);
+    storage.shadowed[index] = inserted ? kNoMatch : std::exchange(it->second, index);
+
+    // The new prefix wins wherever the current match is no longer than it.
+    Trie &trie = stored.family == 4 ? storage.v4 : storage.v6;
+    if (trie.root.empty())
+    {
+        trie.root.assign(size_t{1} << (stored.family == 4 ? 24 : 16), 0);
+    }
+    const auto &prefixes = storage.prefixes;
+    update_prefix(trie, stored, [&](uint32_t entry)
+                  { return entry == 0 || prefixes[entry - 1].cidr <= stored.cidr ? index + 1 : entry; });
+
+    set_views();
+    checksum_stale_ = true;
+    return index;
+}
+
+bool PrefixTable::remove(const IPAnalyzer &prefix)
+{
+    Storage &storage = writable();
+    const StoredPrefix stored = store(prefix);
+    const PrefixKey key = MakeKey(stored.address, stored.cidr, stored.family);
+    const auto it = storage.newest.find(key);
+    if (it == storage.newest.end())
+    {
+        return false;
+    }
+
+    const uint32_t index = it->second;
+    if (storage.shadowed[index] == kNoMatch)
+    {
+        storage.newest.erase(it);
+    }
+    else
+    {
+        it->second = storage.shadowed[index];
+    }
+
+    // Every slot the removed prefix won falls back to the best remaining
+    // prefix covering all of it: a shadowed duplicate or the longest
+    // shorter one.
+    uint32_t fallback = 0;
+    for (int cidr = stored.cidr; cidr >= 0 && fallback == 0; --cidr)
+    {
+        const auto covering = storage.newest.find(MakeKey(stored.address, static_cast<uint8_t>(cidr), stored.family));
+        if (covering != storage.newest.end())
+        {
+            fallback = covering->second + 1;
+        }
+    }
+    update_prefix(stored.family == 4 ? storage.v4 : storage.v6, stored, [&](uint32_t entry)
+                  { return entry == index + 1 ? fallback : entry; });
+
+    storage.prefixes[index] = StoredPrefix{};
+    storage.prefixes[index].family = kRemovedFamily;
+    storage.shadowed[index] = kNoMatch;
+    storage.free_indices.push_back(index);
+    std::push_heap(storage.free_indices.begin(), storage.free_indices.end(), std::greater<>());
+
+    set_views();
+    checksum_stale_ = true;
+    return true;
+}
+
+bool PrefixTable::contains(const IPAnalyzer &prefix) const
+{
+    const StoredPrefix stored = store(prefix);
+    if (built_ != nullptr && built_->indexed)
+    {
+        return built_->newest.contains(MakeKey(stored.address, stored.cidr, stored.family));
+    }
+    return std::any_of(prefixes_.begin(), prefixes_.end(), [&](const StoredPrefix &entry)
+                       { return entry.family == stored.family && entry.cidr == stored.cidr && entry.address == stored.address; });
+}
+
+IPAnalyzer PrefixTable::prefix(uint32_t index) const
+{
+    if (index >= prefixes_.size())
+    {
+        throw std::out_of_range("PrefixTable index out of range");
+    }
+    const StoredPrefix &stored = prefixes_[index];
+    if (stored.family == kRemovedFamily)
+    {
+        throw std::out_of_range("PrefixTable index refers to a removed prefix");
+    }
+    if (stored.family == 4)
+    {
+        uint32_t value = 0;
+        for (size_t i = 0; i < 4; ++i)
+        {
+            value = (value << 8) | stored.address[i];
+        }
+        return IPAnalyzer(IPValue(IPv4Value{value}), stored.cidr);
+    }
+    return IPAnalyzer(IPValue(IPv6Value{stored.address}), stored.cidr);
+}
+
+size_t PrefixTable::memory_usage() const
+{
+    return (v4_.root.size() + v4_.groups.size() + v6_.root.size() + v6_.groups.size()) * sizeof(uint32_t) +
+           prefixes_.size_bytes();
+}
+
+uint64_t PrefixTable::source_checksum() const
+{
+    return checksum_stale_ ? Checksum(std::as_bytes(prefixes_)) : source_checksum_;
+}
+
+uint64_t PrefixTable::source_checksum(std::span<const IPAnalyzer> prefixes)
+{
+    const auto stored = store_all(prefixes);
+    return Checksum(std::as_bytes(std::span(stored)));
+}
+
+PrefixTable::StoredPrefix PrefixTable::store(const IPAnalyzer &prefix)
+{
+    const IPValue address = prefix.ip_value();
+    StoredPrefix stored{};
+    stored.address = address.v6().bytes;
+    stored.cidr = prefix.get_cidr();
+    stored.family = address.is_ipv4() ? 4 : 6;
+    return stored;
+}
+
+void PrefixTable::save(const std::string &path) const
+{
+    const std::array<std::span<const std::byte>, kSectionCount> sections = {
+        std::as_bytes(prefixes_), std::as_bytes(v4_.root), std::as_bytes(v4_.groups),
+        std::as_bytes(v6_.root), std::as_bytes(v6_.groups)};
+
+    IndexHeader header{};
+    std::memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+    header.version = kIndexVersion;
+    header.byte_order = kByteOrderMark;
+    header.prefix_count = prefixes_.size();
+    header.source_checksum = source_checksum();
+
+    // Sections are hashed with their zero padding, exactly as they sit in
+    // the file.
+    const unsigned char zeros[kSectionAlignment] = {};
+    Xxh64 hash;
+    uint64_t offset = sizeof(IndexHeader);
+    for (size_t i = 0; i < sections.size(); ++i)
+    {
+        const auto *bytes = reinterpret_cast<const unsigned char *>(sections[i].data());
+        const size_t size = sections[i].size();
+        const size_t bulk = size - size % kSectionAlignment;
+        hash.update(bytes, bulk);
+        if (bulk != size)
+        {
+            unsigned char last[kSectionAlignment] = {};
+            std::memcpy(last, bytes + bulk, size - bulk);
+            hash.update(last, sizeof(last));
+        }
+        header.sections[i] = {offset, size};
+        offset = AlignUp(offset + size);
+    }
+    header.file_size = offset;
+    header.payload_checksum = hash.finish(nullptr, 0);
+
+    const std::string temporary = path + ".tmp";
+    std::FILE *out = std::fopen(temporary.c_str(), "wb");
+    if (out == nullptr)
+    {
+        throw std::system_error(errno, std::generic_category(), "cannot create '" + temporary + "'");
+    }
+
+    bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1;
+    for (size_t i = 0; ok && i < sections.size(); ++i)
+    {
+        const size_t size = sections[i].size();
+        if (size == 0)
+        {
+            continue;
+        }
+        const size_t padding = AlignUp(size) - size;
+        ok = std::fwrite(sections[i].data(), 1, size, out) == size && std::fwrite(zeros, 1, padding, out) == padding;
+    }
+    const int error = errno;
+    ok = std::fclose(out) == 0 && ok;
+    if (!ok || std::rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        const int code = ok ? errno : error;
+        std::remove(temporary.c_str());
+        throw std::system_error(code, std::generic_category(), "cannot write '" + path + "'");
+    }
+}
+
+PrefixTable PrefixTable::load(const std::string &path, IndexCheck check)
+{
+    auto mapping = std::make_shared<const MappedFile>(path, MappedFile::Access::kRandom);
+    const std::string_view data = mapping->view();
+
+    IndexHeader header;
+    if (data.size() < sizeof(header))
+    {
+        ThrowInvalidIndex(path, "file too small");
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) != 0)
+    {
+        ThrowInvalidIndex(path, "bad magic");
+    }
+    if (header.byte_order != kByteOrderMark)
+    {
+        ThrowInvalidIndex(path, "byte order mismatch");
+    }
+    if (header.version != kIndexVersion)
+    {
+        ThrowInvalidIndex(path, "unsupported version");
+    }
+    if (header.file_size != data.size())
+    {
+        ThrowInvalidIndex(path, "truncated file");
+    }
+
+    constexpr size_t kElementSize[kSectionCount] = {sizeof(StoredPrefix), 4, 4, 4, 4};
+    for (size_t i = 0; i < kSectionCount; ++i)
+    {
+        const IndexSection &section = header.sections[i];
+        if (section.offset % kSectionAlignment != 0 || section.offset < sizeof(header) ||
+            section.offset > data.size() || section.size > data.size() - section.offset || section.size % kElementSize[i] != 0)
+        {
+            ThrowInvalidIndex(path, "section out of bounds");
+        }
+    }
+
+    PrefixTable table;
+    table.storage_.reset();
+    table.built_ = nullptr;
+    table.prefixes_ = SectionView<StoredPrefix>(data, header.sections[kPrefixSection]);
+    table.v4_ = {SectionView<uint32_t>(data, header.sections[kV4RootSection]), SectionView<uint32_t>(data, header.sections[kV4GroupSection])};
+    table.v6_ = {SectionView<uint32_t>(data, header.sections[kV6RootSection]), SectionView<uint32_t>(data, header.sections[kV6GroupSection])};
+    table.source_checksum_ = header.source_checksum;
+
+    const auto valid_root = [](const TrieView &trie, size_t size)
+    {
+        return (trie.root.empty() || trie.root.size() == size) && trie.groups.size() % kGroupSize == 0;
+    };
+    if (table.prefixes_.size() != header.prefix_count || header.prefix_count >= kIndexMask ||
+        !valid_root(table.v4_, size_t{1} << 24) || !valid_root(table.v6_, size_t{1} << 16))
+    {
+        ThrowInvalidIndex(path, "inconsistent section sizes");
+    }
+
+    if (check == IndexCheck::kChecksum)
+    {
+        if (Checksum(std::as_bytes(std::span(data.data(), data.size())).subspan(sizeof(header))) != header.payload_checksum)
+        {
+            ThrowInvalidIndex(path, "checksum mismatch");
+        }
+        if (!table.valid_entries())
+        {
+            ThrowInvalidIndex(path, "entry out of range");
+        }
+    }
+
+    table.storage_ = std::move(mapping);
+    return table;
+}
+
+// Every leaf must name a stored prefix and every group must be referenced
+// exactly once, from a depth at which lookups can still descend.
+bool PrefixTable::valid_entries() const
+{
+    const auto valid_leaf = [&](uint32_t entry)
+    {
+        return entry <= prefixes_.size();
+    };
+
+    const size_t v4_groups = v4_.groups.size() / kGroupSize;
+    for (const uint32_t entry : v4_.root)
+    {
+        if ((entry & kChildFlag) ? (entry & kIndexMask) >= v4_groups : !valid_leaf(entry))
+        {
+            return false;
+        }
+    }
+    if (!std::all_of(v4_.groups.begin(), v4_.groups.end(), [&](uint32_t entry)
+                     { return !(entry & kChildFlag) && valid_leaf(entry); }))
+    {
+        return false;
+    }
+
+    // IPv6 groups hang off the root at address byte 2 and the deepest ones
+    // at byte 15. The walk is iterative; the visited marks bound it.
+    const size_t v6_groups = v6_.groups.size() / kGroupSize;
+    std::vector<bool> visited(v6_groups);
+    std::vector<std::pair<std::span<const uint32_t>, size_t>> pending = {{v6_.root, 1}};
+    while (!pending.empty())
+    {
+        const auto [entries, byte] = pending.back();
+        pending.pop_back();
+        for (const uint32_t entry : entries)
+        {
+            if (!(entry & kChildFlag))
+            {
+                if (!valid_leaf(entry))
+                {
+                    return false;
+                }
+                continue;
+            }
+            const size_t group = entry & kIndexMask;
+            if (byte == 15 || group >= v6_groups || visited[group])
+            {
+                return false;
+            }
+            visited[group] = true;
+            pending.emplace_back(v6_.groups.subspan(group * kGroupSize, kGroupSize), byte + 1);
+        }
+    }
+    return true;
+}
+
+uint32_t PrefixTable::ensure_child(Trie &trie, std::vector<uint32_t> &table, size_t slot)
+{
+    const uint32_t entry = table[slot];
+    if (entry & kChildFlag)
+    {
+        return entry & kIndexMask;
+    }
+
+    if (!trie.free_groups.empty())
+    {
+        const uint32_t group = trie.free_groups.back();
+        trie.free_groups.pop_back();
+        std::fill_n(trie.groups.begin() + static_cast<size_t>(group) * kGroupSize, kGroupSize, entry);
+        table[slot] = kChildFlag | group;
+        return group;
+    }
+
+    const size_t group = trie.groups.size() / kGroupSize;
+    if (group >= kIndexMask)
+    {
+        throw std::length_error("PrefixTable group limit exceeded");
+    }
+    trie.groups.resize(trie.groups.size() + kGroupSize, entry);
+    table[slot] = kChildFlag | static_cast<uint32_t>(group);
+    return static_cast<uint32_t>(group);
+}
+
+// Applies `update` to the leaves under slots [first, first + count) of
+// `table`, descending into child groups. Groups left holding a single leaf
+// value are folded back into their parent slot and released.
+template <typename Update>
+void PrefixTable::update_leaves(Trie &trie, std::vector<uint32_t> &table, size_t first, size_t count, const Update &update)
+{
+    for (size_t slot = first; slot < first + count; ++slot)
+    {
+        const uint32_t entry = table[slot];
+        if (!(entry & kChildFlag))
+        {
+            table[slot] = update(entry);
+            continue;
+        }
+        const uint32_t group = entry & kIndexMask;
+        const size_t base = static_cast<size_t>(group) * kGroupSize;
+        update_leaves(trie, trie.groups, base, kGroupSize, update);
+        const uint32_t uniform = UniformEntry(std::span(trie.groups).subspan(base, kGroupSize), kChildFlag);
+        if (uniform != kChildFlag)
+        {
+            table[slot] = uniform;
+            trie.free_groups.push_back(group);
+        }
+    }
+}
+
+// Runs update_leaves over the slots `prefix` covers, creating the child
+// groups on its path first, and folds groups on the path that end up
+// uniform.
+template <typename Update>
+void PrefixTable::update_prefix(Trie &trie, const StoredPrefix &prefix, const Update &update)
+{
+    const int root_bits = prefix.family == 4 ? 24 : 16;
+    const PrefixKey key = MakeKey(prefix.address, prefix.cidr, prefix.family);
+    const auto &network = key.network;
+
+    size_t slot = 0;
+    for (int byte = 0; byte < root_bits / 8; ++byte)
+    {
+        slot = (slot << 8) | network[byte];
+    }
+    if (prefix.cidr <= root_bits)
+    {
+        update_leaves(trie, trie.root, slot, size_t{1} << (root_bits - prefix.cidr), update);
+        return;
+    }
+
+    // Parent slots of the groups on the path; the first one is in the root.
+    std::array<size_t, 16> path;
+    size_t depth = 0;
+    path[depth++] = slot;
+    uint32_t group = ensure_child(trie, trie.root, slot);
+    for (int bits = root_bits;; bits += 8)
+    {
+        slot = (static_cast<size_t>(group) << 8) | network[bits / 8];
+        if (prefix.cidr <= bits + 8)
+        {
+            update_leaves(trie, trie.groups, slot, size_t{1} << (bits + 8 - prefix.cidr), update);
+            break;
+        }
+        path[depth++] = slot;
+        group = ensure_child(trie, trie.groups, slot);
+    }
+
+    while (depth > 0)
+    {
+        --depth;
+        std::vector<uint32_t> &table = depth == 0 ? trie.root : trie.groups;
+        const uint32_t child = table[path[depth]] & kIndexMask;
+        const uint32_t uniform =
+            UniformEntry(std::span(trie.groups).subspan(static_cast<size_t>(child) * kGroupSize, kGroupSize), kChildFlag);
+        if (uniform == kChildFlag)
+        {
+            break;
+        }
+        table[path[depth]] = uniform;
+        trie.free_groups.push_back(child);
+    }
+}
+
+void PrefixTable::insert_v4(Trie &trie, uint32_t network, uint8_t cidr, uint32_t entry)
+{
+    if (cidr <= 24)
+    {
+        const size_t first = network >> 8;
+        std::fill_n(trie.root.begin() + first, size_t{1} << (24 - cidr), entry);
+        return;
+    }
+
+    const uint32_t group = ensure_child(trie, trie.root, network >> 8);
+    const size_t first = (static_cast<size_t>(group) << 8) | (network & 0xFF);
+    std::fill_n(trie.groups.begin() + first, size_t{1} << (32 - cidr), entry);
+}
+
+void PrefixTable::insert_v6(Trie &trie, const std::array<uint8_t, 16> &network, uint8_t cidr, uint32_t entry)
+{
+    const size_t root_slot = (static_cast<size_t>(network[0]) << 8) | network[1];
+    if (cidr <= 16)
+    {
+        std::fill_n(trie.root.begin() + root_slot, size_t{1} << (16 - cidr), entry);
+        return;
+    }
+
+    uint32_t group = ensure_child(trie, trie.root, root_slot);
+    int depth = 16;
+    for (size_t i = 2;; ++i)
+    {
+        const size_t slot = (static_cast<size_t>(group) << 8) | network[i];
+        if (cidr <= depth + 8)
+        {
+            std::fill_n(trie.groups.begin() + slot, size_t{1} << (depth + 8 - cidr), entry);
+            return;
+        }
+        group = ensure_child(trie, trie.groups, slot);
+        depth += 8;
+    }
+}
+
+LivePrefixTable::LivePrefixTable(PrefixTable table) : published_(std::make_unique<PrefixTable>(std::move(table)))
+{
+    current_.store(published_.get(), std::memory_order_seq_cst);
+}
+
+LivePrefixTable::ReaderSlot &LivePrefixTable::claim_reader()
+{
+    for (ReaderSlot &slot : readers_)
+    {
+        bool expected = false;
+        if (slot.claimed.compare_exchange_strong(expected, true, std::memory_order_acquire))
+        {
+            return slot;
+        }
+    }
+    throw std::length_error("Too many LivePrefixTable readers");
+}
+
+// A reader that pins after the scan read its slot stores its epoch and
+// loads the pointer after the scan in the seq_cst order, hence after the
+// pointer swap that preceded it, and cannot see the retired copy.
+bool LivePrefixTable::quiescent(uint64_t epoch) const
+{
+    return std::all_of(readers_.begin(), readers_.end(), [epoch](const ReaderSlot &slot)
+                       {
+                           const uint64_t pinned = slot.epoch.load(std::memory_order_seq_cst);
+                           return pinned == 0 || pinned >= epoch;
+                       });
+}
+
+PrefixTable &LivePrefixTable::next()
+{
+    if (next_ != nullptr)
+    {
+        return *next_;
+    }
+
+    // Readers pin for a batch of lookups, so waiting briefly for them to
+    // move on is far cheaper than copying the table.
+    bool reusable = retired_ != nullptr && quiescent(retired_epoch_);
+    if (retired_ != nullptr && !reusable)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + kGracePeriod;
+        while (!reusable && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::yield();
+            reusable = quiescent(retired_epoch_);
+        }
+    }
+
+    if (reusable)
+    {
+        for (const Update &update : replay_)
+        {
+            if (update.add)
+            {
+                retired_->add(update.prefix);
+            }
+            else
+            {
+                retired_->remove(update.prefix);
+            }
+        }
+        next_ = std::move(retired_);
+    }
+    else
+    {
+        if (retired_ != nullptr)
+        {
+            expired_.emplace_back(std::move(retired_), retired_epoch_);
+        }
+        next_ = std::make_unique<PrefixTable>(*published_);
+    }
+    replay_.clear();
+    return *next_;
+}
+
+uint32_t LivePrefixTable::add(const IPAnalyzer &prefix)
+{
+    const uint32_t index = next().add(prefix);
+    pending_.push_back({prefix, true});
+    return index;
+}
+
+bool LivePrefixTable::remove(const IPAnalyzer &prefix)
+{
+    // Checked first so that removing a missing prefix never copies the
+    // table.
+    const PrefixTable &table = next_ != nullptr ? *next_ : *published_;
+    if (!table.contains(prefix))
+    {
+        return false;
+    }
+    next().remove(prefix);
+    pending_.push_back({prefix, false});
+    return true;
+}
+
+void LivePrefixTable::publish()
+{
+    if (next_ == nullptr)
+    {
+        return;
+    }
+    // Readers that see the incremented epoch see the new pointer too.
+    current_.store(next_.get(), std::memory_order_seq_cst);
+    retired_epoch_ = epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+    retired_ = std::exchange(published_, std::move(next_));
+    replay_ = std::move(pending_);
+    pending_.clear();
+
+    std::erase_if(expired_, [this](const auto &expired)
+                  { return quiescent(expired.second); });
+}
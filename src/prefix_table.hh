@@ -0,0 +1,299 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/prefix_table.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include "ip_analyzer.hh"
+#include "prefix_column.hh"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+// How much of an index file load() verifies. kHeader checks the magic,
+// version, byte order and section bounds, which touches a single page, and
+// trusts the payload; kChecksum also hashes the payload and bounds-checks
+// every table entry.
+enum class IndexCheck
+{
+    kHeader,
+    kChecksum
+};
+
+// Longest-prefix-match table compiled from a list of prefixes. IPv4 uses a
+// DIR-24-8 layout (one 2^24 entry table plus 256 entry groups for prefixes
+// longer than /24), IPv6 a multibit trie with a 16 bit root stride followed
+// by 8 bit strides. Lookups return the index of the matching prefix in the
+// list the table was built from, or kNoMatch.
+//
+// A compiled table can be saved to an index file and loaded again with
+// mmap; the loaded table is used in place, without deserialization, and its
+// pages are shared by every process that maps the same file. Copies share
+// their storage until one of them is updated with add() or remove().
+class PrefixTable
+{
+public:
+    static constexpr uint32_t kNoMatch = UINT32_MAX;
+
+    PrefixTable() : PrefixTable(std::span<const IPAnalyzer>()) {}
+    explicit PrefixTable(std::span<const IPAnalyzer> prefixes);
+    explicit PrefixTable(const PrefixColumn &prefixes);
+
+    // Throws std::system_error on I/O failure. save() writes to a temporary
+    // file and renames it, so readers never see a partial index.
+    void save(const std::string &path) const;
+    // Throws std::system_error on I/O failure and std::runtime_error when the
+    // file is not a valid index.
+    static PrefixTable load(const std::string &path, IndexCheck check = IndexCheck::kHeader);
+
+    uint32_t lookup(IPv4Value address) const
+    {
+        if (v4_.root.empty())
+        {
+            return kNoMatch;
+        }
+        uint32_t entry = v4_.root[address.value >> 8];
+        if (entry & kChildFlag)
+        {
+            entry = v4_.groups[((entry & kIndexMask) << 8) | (address.value & 0xFF)];
+        }
+        return entry - 1;
+    }
+
+    uint32_t lookup(const IPv6Value &address) const
+    {
+        if (v6_.root.empty())
+        {
+            return kNoMatch;
+        }
+        const auto &bytes = address.bytes;
+        uint32_t entry = v6_.root[(static_cast<uint32_t>(bytes[0]) << 8) | bytes[1]];
+        for (size_t i = 2; entry & kChildFlag; ++i)
+        {
+            entry = v6_.groups[((entry & kIndexMask) << 8) | bytes[i]];
+        }
+        return entry - 1;
+    }
+
+    uint32_t lookup(const IPValue &address) const
+    {
+        return address.is_ipv4() ? lookup(address.v4()) : lookup(address.v6());
+    }
+
+    // Incremental updates, touching only the entries the prefix covers.
+    // add() stores `prefix` under the lowest index freed by remove(), or at
+    // the end of the list, and returns that index; a prefix with the network
+    // and length of one already present shadows it until removed, like a
+    // later duplicate in the constructor. remove() drops the newest entry
+    // with the network and length of `prefix`; returns false when there is
+    // none. The first update of a table whose storage is shared with a copy
+    // or mapped from a file copies the storage. Updates must not run while
+    // other threads look up in the same table; see LivePrefixTable.
+    uint32_t add(const IPAnalyzer &prefix);
+    bool remove(const IPAnalyzer &prefix);
+    // True when remove() would find an entry for `prefix`. Never copies the
+    // storage; tables not yet updated are searched linearly.
+    bool contains(const IPAnalyzer &prefix) const;
+
+    // The source prefix a lookup result refers to. Throws std::out_of_range
+    // for indices past the end and for removed prefixes.
+    IPAnalyzer prefix(uint32_t index) const;
+    // Its prefix length alone; `index` must be a valid lookup result.
+    uint8_t prefix_length(uint32_t index) const { return prefixes_[index].cidr; }
+
+    size_t size() const { return prefixes_.size(); }
+    size_t memory_usage() const;
+
+    // Checksum of the source prefix list, stored in the index so a loaded
+    // table can be compared against the list it is supposed to reflect.
+    // Rehashes the list when it was updated since the table was built.
+    uint64_t source_checksum() const;
+    static uint64_t source_checksum(std::span<const IPAnalyzer> prefixes);
+
+private:
+    // Entries hold either (prefix index + 1), 0 meaning no match, or the
+    // index of a child group when kChildFlag is set.
+    static constexpr uint32_t kChildFlag = 0x80000000;
+    static constexpr uint32_t kIndexMask = 0x7FFFFFFF;
+    static constexpr size_t kGroupSize = 256;
+
+    // Source prefix as stored in an index file.
+    struct StoredPrefix
+    {
+        std::array<uint8_t, 16> address;
+        uint8_t cidr;
+        uint8_t family;
+        uint8_t reserved[2];
+    };
+
+    struct Trie
+    {
+        std::vector<uint32_t> root;
+        std::vector<uint32_t> groups;
+        // Groups released by remove(), reused before the vector grows.
+        std::vector<uint32_t> free_groups;
+    };
+
+    struct TrieView
+    {
+        std::span<const uint32_t> root;
+        std::span<const uint32_t> groups;
+    };
+
+    struct Storage;
+
+    static void insert_v4(Trie &trie, uint32_t network, uint8_t cidr, uint32_t entry);
+    static void insert_v6(Trie &trie, const std::array<uint8_t, 16> &network, uint8_t cidr, uint32_t entry);
+    static uint32_t ensure_child(Trie &trie, std::vector<uint32_t> &table, size_t slot);
+    template <typename Update>
+    static void update_leaves(Trie &trie, std::vector<uint32_t> &table, size_t first, size_t count, const Update &update);
+    template <typename Update>
+    static void update_prefix(Trie &trie, const StoredPrefix &prefix, const Update &update);
+    static StoredPrefix store(const IPAnalyzer &prefix);
+    template <typename Prefixes>
+    static std::vector<StoredPrefix> store_all(const Prefixes &prefixes);
+    void build(std::vector<StoredPrefix> prefixes);
+    bool valid_entries() const;
+    // Storage this table may update in place, copied first when shared.
+    Storage &writable();
+    void set_views();
+
+    TrieView v4_;
+    TrieView v6_;
+    std::span<const StoredPrefix> prefixes_;
+    uint64_t source_checksum_ = 0;
+    bool checksum_stale_ = false;
+    // Owns the memory the views point into: the built tables or the mapping.
+    std::shared_ptr<const void> storage_;
+    // The built tables inside storage_, null for a mapped index.
+    Storage *built_ = nullptr;
+};
+
+// PrefixTable that takes updates while other threads look up prefixes in
+// it. A single writer applies add() and remove() to a second copy of the
+// table; publish() makes that copy current by swapping the pointer readers
+// load, RCU style. The retired copy is brought up to date by replaying the
+// same updates once no reader can still be using it, so an update costs
+// only the entries it touches, twice. When a reader is still inside the
+// retired copy at the next update, the current one is copied instead.
+//
+// Readers register once per thread and pin the current table for a batch
+// of lookups. Pinning is wait-free: the reader publishes the global epoch
+// in a slot of its own cache line and loads the table pointer; releasing
+// the pin clears the slot. Nothing is shared between readers and nothing
+// but the slot is written, so lookups scale with the number of threads.
+// The writer reuses or frees a retired copy only when every pinned slot
+// shows an epoch after its retirement.
+class LivePrefixTable
+{
+    static constexpr size_t kCacheLine = 64;
+
+    struct alignas(kCacheLine) ReaderSlot
+    {
+        // Global epoch at the time of pinning, 0 while unpinned.
+        std::atomic<uint64_t> epoch{0};
+        std::atomic<bool> claimed{false};
+    };
+
+public:
+    static constexpr size_t kMaxReaders = 256;
+
+    // A pinned table; the reader's pin is released on destruction.
+    class Snapshot
+    {
+    public:
+        Snapshot(Snapshot &&other) noexcept : slot_(std::exchange(other.slot_, nullptr)), table_(other.table_) {}
+        Snapshot &operator=(Snapshot &&) = delete;
+        ~Snapshot()
+        {
+            if (slot_ != nullptr)
+            {
+                slot_->epoch.store(0, std::memory_order_release);
+            }
+        }
+
+        const PrefixTable &operator*() const { return *table_; }
+        const PrefixTable *operator->() const { return table_; }
+
+    private:
+        friend class LivePrefixTable;
+
+        Snapshot(ReaderSlot *slot, const PrefixTable *table) : slot_(slot), table_(table) {}
+
+        ReaderSlot *slot_;
+        const PrefixTable *table_;
+    };
+
+    // Registration of one reader thread. Throws std::length_error when
+    // kMaxReaders readers are registered.
+    class Reader
+    {
+    public:
+        explicit Reader(LivePrefixTable &table) : table_(table), slot_(table.claim_reader()) {}
+        ~Reader() { slot_.claimed.store(false, std::memory_order_release); }
+
+        Reader(const Reader &) = delete;
+        Reader &operator=(const Reader &) = delete;
+
+        // At most one snapshot per reader may be alive at a time.
+        Snapshot snapshot()
+        {
+            slot_.epoch.store(table_.epoch_.load(std::memory_order_acquire), std::memory_order_seq_cst);
+            return Snapshot(&slot_, table_.current_.load(std::memory_order_seq_cst));
+        }
+
+    private:
+        LivePrefixTable &table_;
+        ReaderSlot &slot_;
+    };
+
+    explicit LivePrefixTable(PrefixTable table);
+
+    LivePrefixTable(const LivePrefixTable &) = delete;
+    LivePrefixTable &operator=(const LivePrefixTable &) = delete;
+
+    // Writer side; calls must not overlap. Updates become visible to new
+    // snapshots at the next publish().
+    uint32_t add(const IPAnalyzer &prefix);
+    bool remove(const IPAnalyzer &prefix);
+    void publish();
+
+    // Updates not yet published.
+    size_t pending() const { return pending_.size(); }
+
+private:
+    struct Update
+    {
+        IPAnalyzer prefix;
+        bool add;
+    };
+
+    ReaderSlot &claim_reader();
+    PrefixTable &next();
+    // No reader pinned a table before `epoch`.
+    bool quiescent(uint64_t epoch) const;
+
+    alignas(kCacheLine) std::atomic<const PrefixTable *> current_;
+    alignas(kCacheLine) std::atomic<uint64_t> epoch_{1};
+    std::array<ReaderSlot, kMaxReaders> readers_;
+
+    // Writer-owned copies: the published table, the copy taking updates
+    // and the retired copy, which lacks the updates in `replay_` and may be
+    // pinned by readers up to `retired_epoch_`.
+    std::unique_ptr<PrefixTable> published_;
+    std::unique_ptr<PrefixTable> next_;
+    std::unique_ptr<PrefixTable> retired_;
+    uint64_t retired_epoch_ = 0;
+    // Older retired copies, freed once quiescent.
+    std::vector<std::pair<std::unique_ptr<PrefixTable>, uint64_t>> expired_;
+    std::vector<Update> pending_;
+    std::vector<Update> replay_;
+};
@@ -0,0 +1,512 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/range_kernels.cc
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#include "range_kernels.hh"
+#include "cpu_features.hh"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#if defined(IP_ANALYZER_X86_DISPATCH)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+
+    // The network address of any prefix shorter than /31 (/127) has its
+    // lowest bit clear and the broadcast address has it set, so the first
+    // and last host are one bit flip away and never need carry propagation.
+    //
+    // Each vector kernel handles the leading part of a batch that fills
+    // whole registers and returns where it stopped; the scalar loops finish
+    // the rest.
+
+    constexpr std::array<std::array<uint8_t, 16>, 129> MakeIPv6Masks()
+    {
+        std::array<std::array<uint8_t, 16>, 129> masks{};
+        for (int cidr = 0; cidr <= 128; ++cidr)
+        {
+            for (int bit = 0; bit < cidr; ++bit)
+            {
+                masks[cidr][bit / 8] |= static_cast<uint8_t>(0x80 >> (bit % 8));
+            }
+        }
+        return masks;
+    }
+
+    constexpr auto kIPv6Masks = MakeIPv6Masks();
+
+    void ComputeRangesV4Scalar(const uint32_t *addresses, const uint8_t *cidrs, size_t begin, size_t end,
+                               const IPv4RangeOutput &out)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const uint8_t cidr = cidrs[i];
+            const uint32_t mask = cidr == 0 ? 0 : 0xFFFFFFFF << (32 - cidr);
+            const uint32_t host_bit = cidr < 31 ? 1 : 0;
+            const uint32_t network = addresses[i] & mask;
+            const uint32_t broadcast = addresses[i] | ~mask;
+            out.network[i] = network;
+            out.broadcast[i] = broadcast;
+            out.first_host[i] = network | host_bit;
+            out.last_host[i] = broadcast & ~host_bit;
+        }
+    }
+
+    void ComputeRangesV6Scalar(const IPv6Value *addresses, const uint8_t *cidrs, size_t begin, size_t end,
+                               const IPv6RangeOutput &out)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const uint128 mask = ipv6_mask(cidrs[i]);
+            const uint128 address = to_uint128(addresses[i]);
+            const uint128 host_bit = cidrs[i] < 127 ? 1 : 0;
+            out.network[i] = to_ipv6_value(address & mask);
+            out.broadcast[i] = to_ipv6_value(address | ~mask);
+            out.first_host[i] = to_ipv6_value((address & mask) | host_bit);
+            out.last_host[i] = to_ipv6_value((address | ~mask) & ~host_bit);
+        }
+    }
+
+#if defined(IP_ANALYZER_X86_DISPATCH)
+    IP_ANALYZER_TARGET_AVX512 size_t ComputeRangesV4Avx512(const uint32_t *addresses, const uint8_t *cidrs, size_t n,
+                                                           const IPv4RangeOutput &out)
+    {
+        const __m512i ones = _mm512_set1_epi32(-1);
+        const __m512i width = _mm512_set1_epi32(32);
+        const __m512i host_limit = _mm512_set1_epi32(31);
+        const __m512i host_bit = _mm512_set1_epi32(1);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            const __m512i address = _mm512_loadu_si512(addresses + i);
+            const __m512i cidr = _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(cidrs + i)));
+            const __m512i mask = _mm512_sllv_epi32(ones, _mm512_sub_epi32(width, cidr));
+            const __m512i network = _mm512_and_si512(address, mask);
+            const __m512i broadcast = _mm512_or_si512(address, _mm512_andnot_si512(mask, ones));
+            const __m512i adjust = _mm512_maskz_mov_epi32(_mm512_cmplt_epu32_mask(cidr, host_limit), host_bit);
+            _mm512_storeu_si512(out.network.data() + i, network);
+            _mm512_storeu_si512(out.broadcast.data() + i, broadcast);
+            _mm512_storeu_si512(out.first_host.data() + i, _mm512_or_si512(network, adjust));
+            _mm512_storeu_si512(out.last_host.data() + i, _mm512_andnot_si512(adjust, broadcast));
+        }
+        return i;
+    }
+
+    IP_ANALYZER_TARGET_AVX2 size_t ComputeRangesV4Avx2(const uint32_t *addresses, const uint8_t *cidrs, size_t n,
+                                                       const IPv4RangeOutput &out)
+    {
+        const __m256i ones = _mm256_set1_epi32(-1);
+        const __m256i width = _mm256_set1_epi32(32);
+        const __m256i host_limit = _mm256_set1_epi32(31);
+        const __m256i host_bit = _mm256_set1_epi32(1);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m256i address = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(addresses + i));
+            const __m256i cidr = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(cidrs + i)));
+            const __m256i mask = _mm256_sllv_epi32(ones, _mm256_sub_epi32(width, cidr));
+            const __m256i network = _mm256_and_si256(address, mask);
+            const __m256i broadcast = _mm256_or_si256(address, _mm256_andnot_si256(mask, ones));
+            const __m256i adjust = _mm256_and_si256(_mm256_cmpgt_epi32(host_limit, cidr), host_bit);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out.network.data() + i), network);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out.broadcast.data() + i), broadcast);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out.first_host.data() + i), _mm256_or_si256(network, adjust));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out.last_host.data() + i), _mm256_andnot_si256(adjust, broadcast));
+        }
+        return i;
+    }
+
+    size_t ComputeRangesV6Sse2(const IPv6Value *addresses, const uint8_t *cidrs, size_t n, const IPv6RangeOutput &out)
+    {
+        const __m128i ones = _mm_set1_epi32(-1);
+        const __m128i host_bit = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1);
+        const __m128i zero = _mm_setzero_si128();
+        for (size_t i = 0; i < n; ++i)
+        {
+            const uint8_t cidr = cidrs[i];
+            const __m128i address = _mm_loadu_si128(reinterpret_cast<const __m128i *>(addresses[i].bytes.data()));
+            const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i *>(kIPv6Masks[cidr].data()));
+            const __m128i network = _mm_and_si128(address, mask);
+            const __m128i broadcast = _mm_or_si128(address, _mm_andnot_si128(mask, ones));
+            const __m128i adjust = cidr < 127 ? host_bit : zero;
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out.network[i].bytes.data()), network);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out.broadcast[i].bytes.data()), broadcast);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out.first_host[i].bytes.data()), _mm_or_si128(network, adjust));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out.last_host[i].bytes.data()), _mm_andnot_si128(adjust, broadcast));
+        }
+        return n;
+    }
+#elif defined(__ARM_NEON)
+    size_t ComputeRangesV4Neon(const uint32_t *addresses, const uint8_t *cidrs, size_t n, const IPv4RangeOutput &out)
+    {
+        const uint32x4_t ones = vdupq_n_u32(0xFFFFFFFF);
+        const uint32x4_t width = vdupq_n_u32(32);
+        const uint32x4_t host_limit = vdupq_n_u32(31);
+        const uint32x4_t host_bit = vdupq_n_u32(1);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            uint32_t packed_cidrs;
+            std::memcpy(&packed_cidrs, cidrs + i, sizeof(packed_cidrs));
+            const uint32x4_t address = vld1q_u32(addresses + i);
+            const uint32x4_t cidr = vmovl_u16(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(packed_cidrs)))));
+            const uint32x4_t mask = vshlq_u32(ones, vreinterpretq_s32_u32(vsubq_u32(width, cidr)));
+            const uint32x4_t network = vandq_u32(address, mask);
+            const uint32x4_t broadcast = vornq_u32(address, mask);
+            const uint32x4_t adjust = vandq_u32(vcltq_u32(cidr, host_limit), host_bit);
+            vst1q_u32(out.network.data() + i, network);
+            vst1q_u32(out.broadcast.data() + i, broadcast);
+            vst1q_u32(out.first_host.data() + i, vorrq_u32(network, adjust));
+            vst1q_u32(out.last_host.data() + i, vbicq_u32(broadcast, adjust));
+        }
+        return i;
+    }
+
+    size_t ComputeRangesV6Neon(const IPv6Value *addresses, const uint8_t *cidrs, size_t n, const IPv6RangeOutput &out)
+    {
+        const uint8x16_t host_bit = vsetq_lane_u8(1, vdupq_n_u8(0), 15);
+        const uint8x16_t zero = vdupq_n_u8(0);
+        for (size_t i = 0; i < n; ++i)
+        {
+            const uint8_t cidr = cidrs[i];
+            const uint8x16_t address = vld1q_u8(addresses[i].bytes.data());
+            const uint8x16_t mask = vld1q_u8(kIPv6Masks[cidr].data());
+            const uint8x16_t network = vandq_u8(address, mask);
+            const uint8x16_t broadcast = vornq_u8(address, mask);
+            const uint8x16_t adjust = cidr < 127 ? host_bit : zero;
+            vst1q_u8(out.network[i].bytes.data(), network);
+            vst1q_u8(out.broadcast[i].bytes.data(), broadcast);
+            vst1q_u8(out.first_host[i].bytes.data(), vorrq_u8(network, adjust));
+            vst1q_u8(out.last_host[i].bytes.data(), vbicq_u8(broadcast, adjust));
+        }
+        return n;
+    }
+#endif
+
+    void CheckSizes(size_t addresses, size_t cidrs, size_t network, size_t broadcast, size_t first, size_t last)
+    {
+        if (cidrs != addresses || network != addresses || broadcast != addresses ||
+            first != addresses || last != addresses)
+        {
+            throw std::invalid_argument("Range kernel input and output sizes differ");
+        }
+    }
+
+    // Kernels for one prefix length. With the mask and the host bit as
+    // constants there are no shifts or compares per element, which also
+    // gives plain SSE2 a vector loop.
+#if defined(IP_ANALYZER_X86_DISPATCH)
+    template <uint32_t Mask, uint32_t HostBit>
+    IP_ANALYZER_TARGET_AVX512 size_t FixedRangesV4Avx512(const uint32_t *addresses, size_t n, const IPv4RangeOutput &out)
+    {
+        const __m512i mask = _mm512_set1_epi32(static_cast<int>(Mask));
+        const __m512i inverse = _mm512_set1_epi32(static_cast<int>(~Mask));
+        const __m512i host_bit = _mm512_set1_epi32(static_cast<int>(HostBit));
+        const __m512i keep = _mm512_set1_epi32(static_cast<int>(~HostBit));
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            const __m512i address = _mm512_loadu_si512(addresses + i);
+            const __m512i network = _mm512_and_si512(address, mask);
+            const __m512i broadcast = _mm512_or_si512(address, inverse);
+            _mm512_storeu_si512(out.network.data() + i, network);
+            _mm512_storeu_si512(out.broadcast.data() + i, broadcast);
+            _mm512_storeu_si512(out.first_host.data() + i, _mm512_or_si512(network, host_bit));
+            _mm512_storeu_si512(out.last_host.data() + i, _mm512_and_si512(broadcast, keep));
+        }
+        return i;
+    }
+
+    template <uint32_t Mask, uint32_t HostBit>
+    IP_ANALYZER_TARGET_AVX2 size_t FixedRangesV4Avx2(const uint32_t *addresses, size_t n, const IPv4RangeOutput &out)
+    {
+        const __m256i mask = _mm256_set1_epi32(static_cast<int>(Mask));
+        const __m256i inverse = _mm256_set1_epi32(static_cast<int>(~Mask));
+        const __m256i host_bit = _mm256_set1_epi32(static_cast<int>(HostBit));
+        const __m256i keep = _mm256_set1_epi32(static_cast<int>(~HostBit));
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m256i address = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(addresses + i));
+            const __m256i network = _mm256_and_si256(address, mask);
+            const __m256i broadcast = _mm256_or_si256(address, inverse);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out.network.data() + i), network);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out.broadcast.data() + i), broadcast);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out.first_host.data() + i), _mm256_or_si256(network, host_bit));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out.last_host.data() + i), _mm256_and_si256(broadcast, keep));
+        }
+        return i;
+    }
+
+    template <uint32_t Mask, uint32_t HostBit>
+    size_t FixedRangesV4Sse2(const uint32_t *addresses, size_t n, const IPv4RangeOutput &out)
+    {
+        const __m128i mask = _mm_set1_epi32(static_cast<int>(Mask));
+        const __m128i inverse = _mm_set1_epi32(static_cast<int>(~Mask));
+        const __m128i host_bit = _mm_set1_epi32(static_cast<int>(HostBit));
+        const __m128i keep = _mm_set1_epi32(static_cast<int>(~HostBit));
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            const __m128i address = _mm_loadu_si128(reinterpret_cast<const __m128i *>(addresses + i));
+            const __m128i network = _mm_and_si128(address, mask);
+            const __m128i broadcast = _mm_or_si128(address, inverse);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out.network.data() + i), network);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out.broadcast.data() + i), broadcast);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out.first_host.data() + i), _mm_or_si128(network, host_bit));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out.last_host.data() + i), _mm_and_si128(broadcast, keep));
+        }
+        return i;
+    }
+
+    template <uint32_t Mask, uint32_t HostBit>
+    size_t FixedRangesV4Vector(const uint32_t *addresses, size_t n, const IPv4RangeOutput &out, SimdLevel level)
+    {
+        switch (level)
+        {
+        case SimdLevel::kAvx512:
+            return FixedRangesV4Avx512<Mask, HostBit>(addresses, n, out);
+        case SimdLevel::kAvx2:
+            return FixedRangesV4Avx2<Mask, HostBit>(addresses, n, out);
+        case SimdLevel::kSse2:
+            return FixedRangesV4Sse2<Mask, HostBit>(addresses, n, out);
+        default:
+            return 0;
+        }
+    }
+#elif defined(__ARM_NEON)
+    template <uint32_t Mask, uint32_t HostBit>
+    size_t FixedRangesV4Vector(const uint32_t *addresses, size_t n, const IPv4RangeOutput &out, SimdLevel level)
+    {
+        if (level != SimdLevel::kNeon)
+        {
+            return 0;
+        }
+        const uint32x4_t mask = vdupq_n_u32(Mask);
+        const uint32x4_t inverse = vdupq_n_u32(~Mask);
+        const uint32x4_t host_bit = vdupq_n_u32(HostBit);
+        const uint32x4_t keep = vdupq_n_u32(~HostBit);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            const uint32x4_t address = vld1q_u32(addresses + i);
+            const uint32x4_t network = vandq_u32(address, mask);
+            const uint32x4_t broadcast = vorrq_u32(address, inverse);
+            vst1q_u32(out.network.data() + i, network);
+            vst1q_u32(out.broadcast.data() + i, broadcast);
+            vst1q_u32(out.first_host.data() + i, vorrq_u32(network, host_bit));
+            vst1q_u32(out.last_host.data() + i, vandq_u32(broadcast, keep));
+        }
+        return i;
+    }
+#else
+    template <uint32_t Mask, uint32_t HostBit>
+    size_t FixedRangesV4Vector(const uint32_t *, size_t, const IPv4RangeOutput &, SimdLevel)
+    {
+        return 0;
+    }
+#endif
+
+    template <uint8_t Cidr>
+    void FixedRangesV4(const uint32_t *addresses, size_t n, const IPv4RangeOutput &out)
+    {
+        constexpr uint32_t kMask = Cidr == 0 ? 0 : 0xFFFFFFFF << (32 - Cidr);
+        constexpr uint32_t kHostBit = Cidr < 31 ? 1 : 0;
+        for (size_t i = FixedRangesV4Vector<kMask, kHostBit>(addresses, n, out, simd_level()); i < n; ++i)
+        {
+            out.network[i] = addresses[i] & kMask;
+            out.broadcast[i] = addresses[i] | ~kMask;
+            out.first_host[i] = (addresses[i] & kMask) | kHostBit;
+            out.last_host[i] = (addresses[i] | ~kMask) & ~kHostBit;
+        }
+    }
+
+    template <uint8_t Cidr>
+    void FixedRangesV6(const IPv6Value *addresses, size_t n, const IPv6RangeOutput &out)
+    {
+        static constexpr IPv6Value kMask = to_ipv6_value(ipv6_mask(Cidr));
+        static constexpr IPv6Value kHostBit = to_ipv6_value(Cidr < 127 ? 1 : 0);
+        size_t i = 0;
+
+#if defined(IP_ANALYZER_X86_DISPATCH)
+        if (simd_level() != SimdLevel::kScalar)
+        {
+            const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i *>(kMask.bytes.data()));
+            const __m128i inverse = _mm_xor_si128(mask, _mm_set1_epi32(-1));
+            const __m128i host_bit = _mm_loadu_si128(reinterpret_cast<const __m128i *>(kHostBit.bytes.data()));
+            for (; i < n; ++i)
+            {
+                const __m128i address = _mm_loadu_si128(reinterpret_cast<const __m128i *>(addresses[i].bytes.data()));
+                const __m128i network = _mm_and_si128(address, mask);
+                const __m128i broadcast = _mm_or_si128(address, inverse);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out.network[i].bytes.data()), network);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out.broadcast[i].bytes.data()), broadcast);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out.first_host[i].bytes.data()), _mm_or_si128(network, host_bit));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out.last_host[i].bytes.data()), _mm_andnot_si128(host_bit, broadcast));
+            }
+        }
+#elif defined(__ARM_NEON)
+        if (simd_level() == SimdLevel::kNeon)
+        {
+            const uint8x16_t mask = vld1q_u8(kMask.bytes.data());
+            const uint8x16_t inverse = vmvnq_u8(mask);
+            const uint8x16_t host_bit = vld1q_u8(kHostBit.bytes.data());
+            for (; i < n; ++i)
+            {
+                const uint8x16_t address = vld1q_u8(addresses[i].bytes.data());
+                const uint8x16_t network = vandq_u8(address, mask);
+                const uint8x16_t broadcast = vorrq_u8(address, inverse);
+                vst1q_u8(out.network[i].bytes.data(), network);
+                vst1q_u8(out.broadcast[i].bytes.data(), broadcast);
+                vst1q_u8(out.first_host[i].bytes.data(), vorrq_u8(network, host_bit));
+                vst1q_u8(out.last_host[i].bytes.data(), vbicq_u8(broadcast, host_bit));
+            }
+        }
+#endif
+
+        for (; i < n; ++i)
+        {
+            for (size_t b = 0; b < 16; ++b)
+            {
+                const uint8_t network = addresses[i].bytes[b] & kMask.bytes[b];
+                const uint8_t broadcast = addresses[i].bytes[b] | static_cast<uint8_t>(~kMask.bytes[b]);
+                out.network[i].bytes[b] = network;
+                out.broadcast[i].bytes[b] = broadcast;
+                out.first_host[i].bytes[b] = network | kHostBit.bytes[b];
+                out.last_host[i].bytes[b] = broadcast & static_cast<uint8_t>(~kHostBit.bytes[b]);
+            }
+        }
+    }
+
+    template <size_t... Cidrs>
+    constexpr auto FixedV4Kernels(std::index_sequence<Cidrs...>)
+    {
+        return std::array{&FixedRangesV4<Cidrs>...};
+    }
+
+    template <size_t... Cidrs>
+    constexpr auto FixedV6Kernels(std::index_sequence<Cidrs...>)
+    {
+        return std::array{&FixedRangesV6<Cidrs>...};
+    }
+
+    constexpr auto kFixedV4Kernels = FixedV4Kernels(std::make_index_sequence<33>());
+    constexpr auto kFixedV6Kernels = FixedV6Kernels(std::make_index_sequence<129>());
+
+    // Shorter batches are not worth the extra pass over the lengths.
+    constexpr size_t kUniformMinimum = 64;
+
+    // Compares eight lengths at a time against the first.
+    bool IsUniform(std::span<const uint8_t> cidrs)
+    {
+        if (cidrs.size() < kUniformMinimum)
+        {
+            return false;
+        }
+        const uint64_t pattern = cidrs[0] * uint64_t{0x0101010101010101};
+        size_t i = 0;
+        for (; i + 8 <= cidrs.size(); i += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, cidrs.data() + i, sizeof(word));
+            if (word != pattern)
+            {
+                return false;
+            }
+        }
+        return std::all_of(cidrs.begin() + static_cast<ptrdiff_t>(i), cidrs.end(), [first = cidrs[0]](uint8_t cidr)
+                           { return cidr == first; });
+    }
+
+}
+
+void compute_ranges_v4(std::span<const uint32_t> addresses, uint8_t cidr, const IPv4RangeOutput &out)
+{
+    if (cidr > 32)
+    {
+        throw std::invalid_argument(parse_error_message(ParseError::kCidrOutOfRange));
+    }
+    CheckSizes(addresses.size(), addresses.size(), out.network.size(), out.broadcast.size(),
+               out.first_host.size(), out.last_host.size());
+    kFixedV4Kernels[cidr](addresses.data(), addresses.size(), out);
+}
+
+void compute_ranges_v6(std::span<const IPv6Value> addresses, uint8_t cidr, const IPv6RangeOutput &out)
+{
+    if (cidr > 128)
+    {
+        throw std::invalid_argument(parse_error_message(ParseError::kCidrOutOfRange));
+    }
+    CheckSizes(addresses.size(), addresses.size(), out.network.size(), out.broadcast.size(),
+               out.first_host.size(), out.last_host.size());
+    kFixedV6Kernels[cidr](addresses.data(), addresses.size(), out);
+}
+
+void compute_ranges_v4(std::span<const uint32_t> addresses, std::span<const uint8_t> cidrs, const IPv4RangeOutput &out)
+{
+    CheckSizes(addresses.size(), cidrs.size(), out.network.size(), out.broadcast.size(),
+               out.first_host.size(), out.last_host.size());
+    if (IsUniform(cidrs) && cidrs[0] <= 32)
+    {
+        kFixedV4Kernels[cidrs[0]](addresses.data(), addresses.size(), out);
+        return;
+    }
+
+    const size_t n = addresses.size();
+    size_t i = 0;
+    switch (simd_level())
+    {
+#if defined(IP_ANALYZER_X86_DISPATCH)
+    case SimdLevel::kAvx512:
+        i = ComputeRangesV4Avx512(addresses.data(), cidrs.data(), n, out);
+        break;
+    case SimdLevel::kAvx2:
+        i = ComputeRangesV4Avx2(addresses.data(), cidrs.data(), n, out);
+        break;
+#elif defined(__ARM_NEON)
+    case SimdLevel::kNeon:
+        i = ComputeRangesV4Neon(addresses.data(), cidrs.data(), n, out);
+        break;
+#endif
+    default:
+        break;
+    }
+    ComputeRangesV4Scalar(addresses.data(), cidrs.data(), i, n, out);
+}
+
+void compute_ranges_v6(std::span<const IPv6Value> addresses, std::span<const uint8_t> cidrs, const IPv6RangeOutput &out)
+{
+    CheckSizes(addresses.size(), cidrs.size(), out.network.size(), out.broadcast.size(),
+               out.first_host.size(), out.last_host.size());
+    if (IsUniform(cidrs) && cidrs[0] <= 128)
+    {
+        kFixedV6Kernels[cidrs[0]](addresses.data(), addresses.size(), out);
+        return;
+    }
+
+    const size_t n = addresses.size();
+    size_t i = 0;
+    if (simd_level() != SimdLevel::kScalar)
+    {
+#if defined(IP_ANALYZER_X86_DISPATCH)
+        i = ComputeRangesV6Sse2(addresses.data(), cidrs.data(), n, out);
+#elif defined(__ARM_NEON)
+        i = ComputeRangesV6Neon(addresses.data(), cidrs.data(), n, out);
+#endif
+    }
+    ComputeRangesV6Scalar(addresses.data(), cidrs.data(), i, n, out);
+}
+
+const char *range_kernels_isa()
+{
+    return simd_level_name(simd_level());
+}
@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/range_kernels.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include "ip_analyzer.hh"
+#include <cstdint>
+#include <span>
+
+// Batch versions of IPAnalyzer's network/broadcast/host range math over
+// struct-of-arrays inputs. Every output span must be as long as the input
+// and prefix lengths must be valid for the address family.
+struct IPv4RangeOutput
+{
+    std::span<uint32_t> network;
+    std::span<uint32_t> broadcast;
+    std::span<uint32_t> first_host;
+    std::span<uint32_t> last_host;
+};
+
+struct IPv6RangeOutput
+{
+    std::span<IPv6Value> network;
+    std::span<IPv6Value> broadcast;
+    std::span<IPv6Value> first_host;
+    std::span<IPv6Value> last_host;
+};
+
+// Batches in which every prefix has the same length take the fixed-length
+// kernels.
+void compute_ranges_v4(std::span<const uint32_t> addresses, std::span<const uint8_t> cidrs, const IPv4RangeOutput &out);
+void compute_ranges_v6(std::span<const IPv6Value> addresses, std::span<const uint8_t> cidrs, const IPv6RangeOutput &out);
+
+// Every address of the batch has prefix length `cidr`. These dispatch once
+// to a kernel instantiated for that length, with the mask and host bit
+// adjustment as constants. Throw std::invalid_argument when `cidr` is too
+// large for the family.
+void compute_ranges_v4(std::span<const uint32_t> addresses, uint8_t cidr, const IPv4RangeOutput &out);
+void compute_ranges_v6(std::span<const IPv6Value> addresses, uint8_t cidr, const IPv6RangeOutput &out);
+
+// Name of the instruction set the kernels dispatch to; see simd_level().
+const char *range_kernels_isa();
@@ -0,0 +1,355 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/record_writer.cc
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#include "record_writer.hh"
+#include "address_class.hh"
+#include "address_format.hh"
+#include "geo_database.hh"
+#include <array>
+#include <charconv>
+
+namespace
+{
+
+    void AppendCount(fmt::memory_buffer &out, uint128 count)
+    {
+        char text[kUint128DecimalLength];
+        out.append(text, uint128_to_chars(text, text + sizeof(text), count).ptr);
+    }
+
+    void AppendCidr(fmt::memory_buffer &out, uint8_t cidr)
+    {
+        char text[4];
+        out.push_back('/');
+        out.append(text, std::to_chars(text, text + sizeof(text), cidr).ptr);
+    }
+
+    // The fields shared by the text and CSV formats: network/cidr, netmask,
+    // first host, last host and host count, separated by `separator`.
+    void AppendFields(fmt::memory_buffer &out, const IPAnalyzer &analyzer, char separator)
+    {
+        const auto [first, last] = analyzer.host_range_value();
+        format_address(out, analyzer.network_value());
+        AppendCidr(out, analyzer.get_cidr());
+        out.push_back(separator);
+        format_address(out, analyzer.netmask_value());
+        out.push_back(separator);
+        format_address(out, first);
+        out.push_back(separator);
+        format_address(out, last);
+        out.push_back(separator);
+        AppendCount(out, analyzer.get_num_hosts());
+    }
+
+    void AppendAsn(fmt::memory_buffer &out, uint32_t asn)
+    {
+        char text[10];
+        out.append(text, std::to_chars(text, text + sizeof(text), asn).ptr);
+    }
+
+    class TextWriter : public RecordWriter
+    {
+    public:
+        explicit TextWriter(const GeoEnricher *geo) : geo_(geo) {}
+
+        void write_record(fmt::memory_buffer &out, std::string_view input, const IPAnalyzer &analyzer) const override
+        {
+            out.append(input);
+            out.push_back('\t');
+            AppendFields(out, analyzer, '\t');
+            out.append(analyzer.is_private() ? std::string_view("\t1") : std::string_view("\t0"));
+            if (geo_ != nullptr)
+            {
+                // Unknown fields stay empty.
+                const GeoRecord geo = geo_->lookup(analyzer.ip_value());
+                out.push_back('\t');
+                if (geo.asn != 0)
+                {
+                    AppendAsn(out, geo.asn);
+                }
+                out.push_back('\t');
+                out.append(geo.country);
+                out.push_back('\t');
+                out.append(geo.org);
+            }
+            out.push_back('\n');
+        }
+
+        void write_error(fmt::memory_buffer &out, std::string_view input, ParseError error) const override
+        {
+            out.append(input);
+            out.append(std::string_view("\terror\t"));
+            out.append(std::string_view(parse_error_message(error)));
+            out.push_back('\n');
+        }
+
+    private:
+        const GeoEnricher *geo_;
+    };
+
+    void AppendJsonString(fmt::memory_buffer &out, std::string_view text)
+    {
+        constexpr char kHex[] = "0123456789abcdef";
+        out.push_back('"');
+        for (const char c : text)
+        {
+            const auto byte = static_cast<unsigned char>(c);
+            if (c == '"' || c == '\\')
+            {
+                out.push_back('\\');
+                out.push_back(c);
+            }
+            else if (byte < 0x20)
+            {
+                const char escape[] = {'\\', 'u', '0', '0', kHex[byte >> 4], kHex[byte & 0xF]};
+                out.append(escape, escape + sizeof(escape));
+            }
+            else
+            {
+                out.push_back(c);
+            }
+        }
+        out.push_back('"');
+    }
+
+    void AppendJsonOptional(fmt::memory_buffer &out, std::string_view text)
+    {
+        if (text.empty())
+        {
+            out.append(std::string_view("null"));
+        }
+        else
+        {
+            AppendJsonString(out, text);
+        }
+    }
+
+    class NdjsonWriter : public RecordWriter
+    {
+    public:
+        explicit NdjsonWriter(const GeoEnricher *geo) : geo_(geo) {}
+
+        void write_record(fmt::memory_buffer &out, std::string_view input, const IPAnalyzer &analyzer) const override
+        {
+            const auto [first, last] = analyzer.host_range_value();
+            out.append(std::string_view("{\"input\":"));
+            AppendJsonString(out, input);
+            out.append(std::string_view(",\"network\":\""));
+            format_address(out, analyzer.network_value());
+            AppendCidr(out, analyzer.get_cidr());
+            out.append(std::string_view("\",\"netmask\":\""));
+            format_address(out, analyzer.netmask_value());
+            out.append(std::string_view("\",\"first\":\""));
+            format_address(out, first);
+            out.append(std::string_view("\",\"last\":\""));
+            format_address(out, last);
+            out.append(std::string_view("\",\"hosts\":"));
+            AppendCount(out, analyzer.get_num_hosts());
+            out.append(analyzer.is_private() ? std::string_view(",\"private\":true") : std::string_view(",\"private\":false"));
+            if (geo_ != nullptr)
+            {
+                // Unknown fields are null.
+                const GeoRecord geo = geo_->lookup(analyzer.ip_value());
+                out.append(std::string_view(",\"asn\":"));
+                if (geo.asn != 0)
+                {
+                    AppendAsn(out, geo.asn);
+                }
+                else
+                {
+                    out.append(std::string_view("null"));
+                }
+                out.append(std::string_view(",\"country\":"));
+                AppendJsonOptional(out, geo.country);
+                out.append(std::string_view(",\"org\":"));
+                AppendJsonOptional(out, geo.org);
+            }
+            out.append(std::string_view("}\n"));
+        }
+
+        void write_error(fmt::memory_buffer &out, std::string_view input, ParseError error) const override
+        {
+            out.append(std::string_view("{\"input\":"));
+            AppendJsonString(out, input);
+            out.append(std::string_view(",\"error\":"));
+            AppendJsonString(out, parse_error_message(error));
+            out.append(std::string_view("}\n"));
+        }
+
+    private:
+        const GeoEnricher *geo_;
+    };
+
+    // RFC 4180: quote a field only when it contains a separator or a quote.
+    void AppendCsvField(fmt::memory_buffer &out, std::string_view text)
+    {
+        if (text.find_first_of(",\"\r\n") == std::string_view::npos)
+        {
+            out.append(text);
+            return;
+        }
+        out.push_back('"');
+        for (const char c : text)
+        {
+            if (c == '"')
+            {
+                out.push_back('"');
+            }
+            out.push_back(c);
+        }
+        out.push_back('"');
+    }
+
+    class CsvWriter : public RecordWriter
+    {
+    public:
+        explicit CsvWriter(const GeoEnricher *geo) : geo_(geo) {}
+
+        void write_header(fmt::memory_buffer &out) const override
+        {
+            out.append(geo_ != nullptr ? std::string_view("input,network,netmask,first,last,hosts,private,asn,country,org,error\n")
+                                       : std::string_view("input,network,netmask,first,last,hosts,private,error\n"));
+        }
+
+        void write_record(fmt::memory_buffer &out, std::string_view input, const IPAnalyzer &analyzer) const override
+        {
+            AppendCsvField(out, input);
+            out.push_back(',');
+            AppendFields(out, analyzer, ',');
+            out.append(analyzer.is_private() ? std::string_view(",1,") : std::string_view(",0,"));
+            if (geo_ != nullptr)
+            {
+                const GeoRecord geo = geo_->lookup(analyzer.ip_value());
+                if (geo.asn != 0)
+                {
+                    AppendAsn(out, geo.asn);
+                }
+                out.push_back(',');
+                AppendCsvField(out, geo.country);
+                out.push_back(',');
+                AppendCsvField(out, geo.org);
+                out.push_back(',');
+            }
+            out.push_back('\n');
+        }
+
+        void write_error(fmt::memory_buffer &out, std::string_view input, ParseError error) const override
+        {
+            AppendCsvField(out, input);
+            out.append(geo_ != nullptr ? std::string_view(",,,,,,,,,,") : std::string_view(",,,,,,,"));
+            AppendCsvField(out, parse_error_message(error));
+            out.push_back('\n');
+        }
+
+    private:
+        const GeoEnricher *geo_;
+    };
+
+    class BinaryWriter : public RecordWriter
+    {
+    public:
+        explicit BinaryWriter(const GeoEnricher *geo) : geo_(geo) {}
+
+        void write_record(fmt::memory_buffer &out, std::string_view, const IPAnalyzer &analyzer) const override
+        {
+            const IPValue network = analyzer.network_value();
+            Append(out, network.v6().bytes, analyzer.get_cidr(), network.is_ipv4() ? 4 : 6, ParseError::kNone,
+                   classify(analyzer.ip_value()));
+            if (geo_ != nullptr)
+            {
+                AppendGeo(out, geo_->lookup(analyzer.ip_value()));
+            }
+        }
+
+        void write_error(fmt::memory_buffer &out, std::string_view, ParseError error) const override
+        {
+            Append(out, {}, 0, 0, error, 0);
+            if (geo_ != nullptr)
+            {
+                AppendGeo(out, {});
+            }
+        }
+
+    private:
+        // The enrichment suffix of kGeoBinaryRecordSize records.
+        static void AppendGeo(fmt::memory_buffer &out, const GeoRecord &geo)
+        {
+            std::array<char, kGeoBinaryRecordSize - kBinaryRecordSize> suffix{};
+            for (size_t i = 0; i < 4; ++i)
+            {
+                suffix[i] = static_cast<char>(geo.asn >> (8 * i));
+            }
+            if (geo.country.size() == 2)
+            {
+                suffix[4] = geo.country[0];
+                suffix[5] = geo.country[1];
+            }
+            out.append(suffix.data(), suffix.data() + suffix.size());
+        }
+
+        static void Append(fmt::memory_buffer &out, const std::array<uint8_t, 16> &address, uint8_t cidr, uint8_t family,
+                           ParseError error, AddressClassMask classes)
+        {
+            std::array<char, kBinaryRecordSize> record{};
+            for (size_t i = 0; i < address.size(); ++i)
+            {
+                record[i] = static_cast<char>(address[i]);
+            }
+            record[16] = static_cast<char>(cidr);
+            record[17] = static_cast<char>(family);
+            record[18] = static_cast<char>(error);
+            for (size_t i = 0; i < 4; ++i)
+            {
+                record[20 + i] = static_cast<char>(classes >> (8 * i));
+            }
+            out.append(record.data(), record.data() + record.size());
+        }
+
+        const GeoEnricher *geo_;
+    };
+
+}
+
+std::optional<OutputFormat> parse_output_format(std::string_view name)
+{
+    if (name == "text")
+    {
+        return OutputFormat::kText;
+    }
+    if (name == "ndjson")
+    {
+        return OutputFormat::kNdjson;
+    }
+    if (name == "csv")
+    {
+        return OutputFormat::kCsv;
+    }
+    if (name == "binary")
+    {
+        return OutputFormat::kBinary;
+    }
+    return std::nullopt;
+}
+
+void RecordWriter::write_header(fmt::memory_buffer &) const
+{
+}
+
+std::unique_ptr<RecordWriter> make_record_writer(OutputFormat format, const GeoEnricher *geo)
+{
+    switch (format)
+    {
+    case OutputFormat::kNdjson:
+        return std::make_unique<NdjsonWriter>(geo);
+    case OutputFormat::kCsv:
+        return std::make_unique<CsvWriter>(geo);
+    case OutputFormat::kBinary:
+        return std::make_unique<BinaryWriter>(geo);
+    case OutputFormat::kText:
+        break;
+    }
+    return std::make_unique<TextWriter>(geo);
+}
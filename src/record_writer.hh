@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/record_writer.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include "ip_analyzer.hh"
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <fmt/format.h>
+
+class GeoEnricher;
+
+enum class OutputFormat
+{
+    kText,
+    kNdjson,
+    kCsv,
+    kBinary
+};
+
+// Accepts "text", "ndjson", "csv" and "binary".
+std::optional<OutputFormat> parse_output_format(std::string_view name);
+
+// Renders one batch result per call straight into an output buffer. Writers
+// hold no mutable state, so one instance can be shared by every batch worker.
+// With a GeoEnricher, records also carry the ASN, country and organization
+// of the input address.
+class RecordWriter
+{
+public:
+    virtual ~RecordWriter() = default;
+
+    // Written once at the start of the output, e.g. the CSV column names.
+    virtual void write_header(fmt::memory_buffer &out) const;
+    virtual void write_record(fmt::memory_buffer &out, std::string_view input, const IPAnalyzer &analyzer) const = 0;
+    virtual void write_error(fmt::memory_buffer &out, std::string_view input, ParseError error) const = 0;
+};
+
+// `geo`, when given, must outlive the writer.
+std::unique_ptr<RecordWriter> make_record_writer(OutputFormat format, const GeoEnricher *geo = nullptr);
+
+// Fixed 24 byte record of the binary format, all integers little endian.
+// The layout reads directly as ClickHouse RowBinary of
+// (FixedString(16), UInt8, UInt8, UInt8, UInt8, UInt32).
+//
+//   0  network   16 bytes, network byte order; IPv4 uses the first 4
+//  16  cidr      prefix length
+//  17  family    4 or 6, 0 for a line that failed to parse
+//  18  error     ParseError of a failed line, otherwise 0
+//  19  reserved  0
+//  20  classes   AddressClassMask of the input address
+constexpr size_t kBinaryRecordSize = 24;
+
+// Binary record with enrichment: the 24 bytes above followed by
+//
+//  24  asn       autonomous system number, 0 when unknown
+//  28  country   ISO 3166-1 alpha-2 code, zero bytes when unknown
+//  30  reserved  0
+//
+// i.e. RowBinary of (..., UInt32, FixedString(2), UInt16).
+constexpr size_t kGeoBinaryRecordSize = 32;
@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/subnet_range.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include "ip_analyzer.hh"
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <ranges>
+#include <stdexcept>
+
+// Position in an arithmetic sequence of addresses, first, first + step, ...
+// up to and including last. Both families count in 128 bits so that ::/0
+// needs no special case.
+class AddressCursor
+{
+public:
+    constexpr AddressCursor() = default;
+    constexpr AddressCursor(uint128 first, uint128 last, uint128 step) : current_(first), last_(last), step_(step) {}
+
+    constexpr uint128 current() const { return current_; }
+    constexpr bool done() const { return done_; }
+
+    constexpr void advance()
+    {
+        if (current_ == last_)
+        {
+            done_ = true;
+        }
+        else
+        {
+            current_ += step_;
+        }
+    }
+
+private:
+    uint128 current_ = 0;
+    uint128 last_ = 0;
+    uint128 step_ = 1;
+    bool done_ = false;
+};
+
+constexpr uint128 address_bits(const IPValue &address)
+{
+    return address.is_ipv4() ? uint128(address.v4().value) : to_uint128(address.v6());
+}
+
+constexpr IPValue address_from_bits(Family family, uint128 bits)
+{
+    return family == Family::kIPv4 ? IPValue(IPv4Value{static_cast<uint32_t>(bits)}) : IPValue(to_ipv6_value(bits));
+}
+
+// Lazy view over the child prefixes of length `cidr` inside a prefix, in
+// address order. Nothing is allocated; iteration costs one add per child.
+class SubnetRange : public std::ranges::view_interface<SubnetRange>
+{
+public:
+    class iterator
+    {
+    public:
+        using value_type = IPAnalyzer;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        iterator(const AddressCursor &cursor, Family family, uint8_t cidr) : cursor_(cursor), family_(family), cidr_(cidr) {}
+
+        IPAnalyzer operator*() const { return IPAnalyzer(address_from_bits(family_, cursor_.current()), cidr_); }
+
+        iterator &operator++()
+        {
+            cursor_.advance();
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+        friend bool operator==(const iterator &it, std::default_sentinel_t) { return it.cursor_.done(); }
+
+    private:
+        AddressCursor cursor_;
+        Family family_ = Family::kIPv4;
+        uint8_t cidr_ = 0;
+    };
+
+    SubnetRange(const IPAnalyzer &prefix, uint8_t cidr) : family_(prefix.ip_value().family()), cidr_(cidr)
+    {
+        const int width = family_ == Family::kIPv4 ? 32 : 128;
+        if (cidr < prefix.get_cidr() || cidr > width)
+        {
+            throw std::invalid_argument("Invalid subnet prefix length");
+        }
+
+        // Splitting ::/0 at length 0 leaves no bit for the step; the one
+        // child starts and ends the sequence, so the wrapped step is unused.
+        const int host_bits = width - cidr;
+        const uint128 host_mask = host_bits == 128 ? ~uint128(0) : (uint128(1) << host_bits) - 1;
+        const uint128 first = address_bits(prefix.network_value());
+        const uint128 broadcast = address_bits(prefix.broadcast_value());
+        cursor_ = AddressCursor(first, broadcast - host_mask, host_mask + 1);
+    }
+
+    iterator begin() const { return iterator(cursor_, family_, cidr_); }
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    AddressCursor cursor_;
+    Family family_;
+    uint8_t cidr_;
+};
+
+// Lazy view over the usable host addresses of a prefix, the same span as
+// IPAnalyzer::host_range_value().
+class HostRange : public std::ranges::view_interface<HostRange>
+{
+public:
+    class iterator
+    {
+    public:
+        using value_type = IPValue;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        iterator(const AddressCursor &cursor, Family family) : cursor_(cursor), family_(family) {}
+
+        IPValue operator*() const { return address_from_bits(family_, cursor_.current()); }
+
+        iterator &operator++()
+        {
+            cursor_.advance();
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+        friend bool operator==(const iterator &it, std::default_sentinel_t) { return it.cursor_.done(); }
+
+    private:
+        AddressCursor cursor_;
+        Family family_ = Family::kIPv4;
+    };
+
+    explicit HostRange(const IPAnalyzer &prefix) : family_(prefix.ip_value().family())
+    {
+        const auto [first, last] = prefix.host_range_value();
+        cursor_ = AddressCursor(address_bits(first), address_bits(last), 1);
+    }
+
+    iterator begin() const { return iterator(cursor_, family_); }
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    AddressCursor cursor_;
+    Family family_;
+};
+
+static_assert(std::ranges::view<SubnetRange> && std::ranges::input_range<SubnetRange>);
+static_assert(std::ranges::view<HostRange> && std::ranges::input_range<HostRange>);
@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: MIT
+// Project: ip-analyzer
+// File: src/uint128.hh
+// Author: Volker Schwaberow <volker@schwaberow.de>
+// Copyright (c) 2024 Volker Schwaberow
+
+#pragma once
+
+#include <array>
+#include <bit>
+#include <charconv>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__SIZEOF_INT128__) && !defined(IP_ANALYZER_PORTABLE_UINT128)
+
+using uint128 = unsigned __int128;
+
+constexpr uint64_t uint128_high(uint128 value) { return static_cast<uint64_t>(value >> 64); }
+constexpr uint64_t uint128_low(uint128 value) { return static_cast<uint64_t>(value); }
+
+#else
+
+// Two word fallback for compilers without a native 128 bit integer. Only the
+// operations the address math needs are provided.
+class uint128
+{
+public:
+    constexpr uint128(uint64_t low = 0) : high_(0), low_(low) {}
+    constexpr uint128(uint64_t high, uint64_t low) : high_(high), low_(low) {}
+
+    template <typename T>
+        requires std::is_integral_v<T>
+    explicit constexpr operator T() const
+    {
+        return static_cast<T>(low_);
+    }
+
+    friend constexpr uint64_t uint128_high(const uint128 &value) { return value.high_; }
+    friend constexpr uint64_t uint128_low(const uint128 &value) { return value.low_; }
+
+    friend constexpr bool operator==(const uint128 &, const uint128 &) = default;
+    friend constexpr std::strong_ordering operator<=>(const uint128 &, const uint128 &) = default;
+
+    friend constexpr uint128 operator~(const uint128 &value) { return {~value.high_, ~value.low_}; }
+    friend constexpr uint128 operator&(const uint128 &a, const uint128 &b) { return {a.high_ & b.high_, a.low_ & b.low_}; }
+    friend constexpr uint128 operator|(const uint128 &a, const uint128 &b) { return {a.high_ | b.high_, a.low_ | b.low_}; }
+    friend constexpr uint128 operator^(const uint128 &a, const uint128 &b) { return {a.high_ ^ b.high_, a.low_ ^ b.low_}; }
+
+    friend constexpr uint128 operator+(const uint128 &a, const uint128 &b)
+    {
+        const uint64_t low = a.low_ + b.low_;
+        return {a.high_ + b.high_ + (low < a.low_ ? 1 : 0), low};
+    }
+
+    friend constexpr uint128 operator-(const uint128 &a, const uint128 &b)
+    {
+        return {a.high_ - b.high_ - (a.low_ < b.low_ ? 1 : 0), a.low_ - b.low_};
+    }
+
+    friend constexpr uint128 operator<<(const uint128 &value, int shift)
+    {
+        if (shift >= 64)
+        {
+            return {value.low_ << (shift - 64), 0};
+        }
+        if (shift == 0)
+        {
+            return value;
+        }
+        return {(value.high_ << shift) | (value.low_ >> (64 - shift)), value.low_ << shift};
+    }
+
+    friend constexpr uint128 operator>>(const uint128 &value, int shift)
+    {
+        if (shift >= 64)
+        {
+            return {0, value.high_ >> (shift - 64)};
+        }
+        if (shift == 0)
+        {
+            return value;
+        }
+        return {value.high_ >> shift, (value.low_ >> shift) | (value.high_ << (64 - shift))};
+    }
+
+    constexpr uint128 &operator&=(const uint128 &other) { return *this = *this & other; }
+    constexpr uint128 &operator|=(const uint128 &other) { return *this = *this | other; }
+    constexpr uint128 &operator^=(const uint128 &other) { return *this = *this ^ other; }
+    constexpr uint128 &operator+=(const uint128 &other) { return *this = *this + other; }
+    constexpr uint128 &operator-=(const uint128 &other) { return *this = *this - other; }
+    constexpr uint128 &operator<<=(int shift) { return *this = *this << shift; }
+    constexpr uint128 &operator>>=(int shift) { return *this = *this >> shift; }
+
+private:
+    uint64_t high_;
+    uint64_t low_;
+};
+
+#endif
+
+constexpr uint128 make_uint128(uint64_t high, uint64_t low)
+{
+    return (uint128(high) << 64) | uint128(low);
+}
+
+constexpr uint128 kUint128Max = ~uint128(0);
+
+// Network mask of an IPv6 prefix length; valid for 0..128.
+constexpr uint128 ipv6_mask(uint8_t cidr)
+{
+    return cidr == 0 ? uint128(0) : kUint128Max << (128 - cidr);
+}
+
+constexpr int countr_zero_128(uint128 value)
+{
+    const uint64_t low = uint128_low(value);
+    return low != 0 ? std::countr_zero(low) : 64 + std::countr_zero(uint128_high(value));
+}
+
+constexpr int bit_width_128(uint128 value)
+{
+    const uint64_t high = uint128_high(value);
+    return high != 0 ? 64 + std::bit_width(high) : std::bit_width(uint128_low(value));
+}
+
+// Longest decimal representation of a uint128 (2^128 - 1).
+constexpr size_t kUint128DecimalLength = 39;
+
+// Decimal formatting; std::to_chars does not accept 128 bit integers.
+inline std::to_chars_result uint128_to_chars(char *first, char *last, uint128 value)
+{
+    constexpr uint64_t kLimbBase = 1000000000;
+    constexpr size_t kLimbDigits = 9;
+
+    // Peel off base 10^9 limbs with 32 bit long division until the rest
+    // fits in 64 bits.
+    uint32_t limbs[3];
+    int count = 0;
+    while (uint128_high(value) != 0)
+    {
+        uint64_t remainder = 0;
+        uint128 quotient = 0;
+        for (int shift = 96; shift >= 0; shift -= 32)
+        {
+            const uint64_t part = (remainder << 32) | static_cast<uint32_t>(uint128_low(value >> shift));
+            quotient |= uint128(part / kLimbBase) << shift;
+            remainder = part % kLimbBase;
+        }
+        limbs[count++] = static_cast<uint32_t>(remainder);
+        value = quotient;
+    }
+
+    auto result = std::to_chars(first, last, uint128_low(value));
+    while (count > 0 && result.ec == std::errc())
+    {
+        if (static_cast<size_t>(last - result.ptr) < kLimbDigits)
+        {
+            return {last, std::errc::value_too_large};
+        }
+        uint32_t limb = limbs[--count];
+        for (size_t i = kLimbDigits; i > 0; --i)
+        {
+            result.ptr[i - 1] = static_cast<char>('0' + limb % 10);
+            limb /= 10;
+        }
+        result.ptr += kLimbDigits;
+    }
+    return result;
+}
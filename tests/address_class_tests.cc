@@ -0,0 +1,140 @@
+#include <catch2/catch_all.hpp>
+#include "address_class.hh"
+#include <array>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+    template <typename Int, int Width, size_t N>
+    AddressClassMask LinearClassify(const std::array<SpecialRange<Int>, N> &ranges, Int address)
+    {
+        AddressClassMask result = 0;
+        for (const auto &range : ranges)
+        {
+            const Int mask = static_cast<Int>(~Int{0} << (Width - range.cidr));
+            if ((address & mask) == range.network)
+            {
+                result |= static_cast<AddressClassMask>(range.address_class);
+            }
+        }
+        return result;
+    }
+
+    AddressClassMask Classify(std::string_view ip)
+    {
+        return classify(IPAnalyzer(ip).ip_value());
+    }
+
+    constexpr auto kPrivate = static_cast<AddressClassMask>(AddressClass::kPrivate);
+
+    static_assert(classify(IPv4Value{0x0A010203}) == kPrivate);
+    static_assert(classify(IPv4Value{0x08080808}) == 0);
+
+}
+
+TEST_CASE("classify IPv4 special-purpose ranges", "[addressclass]")
+{
+    REQUIRE(Classify("10.1.2.3") == kPrivate);
+    REQUIRE(Classify("172.31.255.255") == kPrivate);
+    REQUIRE(Classify("172.32.0.0") == 0);
+    REQUIRE(Classify("192.168.7.1") == kPrivate);
+    REQUIRE(has_class(Classify("100.64.0.1"), AddressClass::kSharedAddress));
+    REQUIRE(Classify("100.128.0.1") == 0);
+    REQUIRE(has_class(Classify("127.0.0.1"), AddressClass::kLoopback));
+    REQUIRE(has_class(Classify("169.254.1.1"), AddressClass::kLinkLocal));
+    REQUIRE(has_class(Classify("192.0.2.55"), AddressClass::kDocumentation));
+    REQUIRE(has_class(Classify("198.51.100.1"), AddressClass::kDocumentation));
+    REQUIRE(has_class(Classify("203.0.113.9"), AddressClass::kDocumentation));
+    REQUIRE(has_class(Classify("198.19.255.255"), AddressClass::kBenchmarking));
+    REQUIRE(has_class(Classify("192.88.99.1"), AddressClass::k6to4));
+    REQUIRE(has_class(Classify("239.255.255.250"), AddressClass::kMulticast));
+    REQUIRE(Classify("255.255.255.255") ==
+            (static_cast<AddressClassMask>(AddressClass::kReserved) | static_cast<AddressClassMask>(AddressClass::kBroadcast)));
+    REQUIRE(Classify("8.8.8.8") == 0);
+}
+
+TEST_CASE("classify IPv6 special-purpose ranges", "[addressclass]")
+{
+    REQUIRE(has_class(Classify("::"), AddressClass::kUnspecified));
+    REQUIRE(has_class(Classify("::1"), AddressClass::kLoopback));
+    REQUIRE(has_class(Classify("::ffff:192.0.2.1"), AddressClass::kIPv4Mapped));
+    REQUIRE(has_class(Classify("64:ff9b::1"), AddressClass::kTranslation));
+    REQUIRE(has_class(Classify("100::1"), AddressClass::kDiscardOnly));
+    REQUIRE(Classify("2001:0:4136:e378::1") ==
+            (static_cast<AddressClassMask>(AddressClass::kProtocolAssignments) | static_cast<AddressClassMask>(AddressClass::kTeredo)));
+    REQUIRE(has_class(Classify("2001:db8::1"), AddressClass::kDocumentation));
+    REQUIRE(has_class(Classify("2002:c000:204::1"), AddressClass::k6to4));
+    REQUIRE(Classify("fd12:3456::1") == kPrivate);
+    REQUIRE(has_class(Classify("fe80::1"), AddressClass::kLinkLocal));
+    REQUIRE(has_class(Classify("febf::1"), AddressClass::kLinkLocal));
+    REQUIRE(has_class(Classify("fec0::1"), AddressClass::kSiteLocal));
+    REQUIRE(has_class(Classify("ff02::1"), AddressClass::kMulticast));
+    REQUIRE(Classify("2606:4700::1111") == 0);
+}
+
+TEST_CASE("classify and classify_batch agree with the table", "[addressclass]")
+{
+    std::mt19937 rng(3);
+    std::vector<uint32_t> v4;
+    std::vector<IPv6Value> v6;
+    for (const auto &range : kSpecialRangesV4)
+    {
+        const uint32_t size_mask = range.cidr == 32 ? 0 : 0xFFFFFFFFu >> range.cidr;
+        v4.push_back(range.network);
+        v4.push_back(range.network | size_mask);
+        v4.push_back(range.network - 1);
+        v4.push_back((range.network | size_mask) + 1);
+    }
+    for (const auto &range : kSpecialRangesV6)
+    {
+        const uint128 size_mask = range.cidr == 128 ? 0 : kUint128Max >> range.cidr;
+        v6.push_back(to_ipv6_value(range.network));
+        v6.push_back(to_ipv6_value(range.network | size_mask));
+        v6.push_back(to_ipv6_value(range.network - 1));
+        v6.push_back(to_ipv6_value((range.network | size_mask) + 1));
+    }
+    for (int i = 0; i < 5000; ++i)
+    {
+        v4.push_back(static_cast<uint32_t>(rng()));
+        const auto &range = kSpecialRangesV6[rng() % kSpecialRangesV6.size()];
+        v6.push_back(to_ipv6_value(range.network ^ (uint128{rng()} << (rng() % 120))));
+    }
+
+    std::vector<AddressClassMask> batch(v4.size());
+    classify_batch(v4, batch);
+    for (size_t i = 0; i < v4.size(); ++i)
+    {
+        const auto expected = LinearClassify<uint32_t, 32>(kSpecialRangesV4, v4[i]);
+        REQUIRE(classify(IPv4Value{v4[i]}) == expected);
+        REQUIRE(batch[i] == expected);
+    }
+
+    batch.resize(v6.size());
+    classify_batch(v6, batch);
+    for (size_t i = 0; i < v6.size(); ++i)
+    {
+        const auto expected = LinearClassify<uint128, 128>(kSpecialRangesV6, to_uint128(v6[i]));
+        REQUIRE(classify(v6[i]) == expected);
+        REQUIRE(batch[i] == expected);
+    }
+
+    std::vector<AddressClassMask> short_output(1);
+    REQUIRE_THROWS_AS(classify_batch(v4, short_output), std::invalid_argument);
+}
+
+TEST_CASE("address class names", "[addressclass]")
+{
+    REQUIRE(std::string(address_class_name(AddressClass::kSharedAddress)) == "Shared Address Space");
+    REQUIRE(address_class_names(0).empty());
+    REQUIRE(address_class_names(Classify("2001::1")) == "IETF Protocol Assignments, Teredo");
+
+    std::array<std::byte, 256> storage;
+    std::pmr::monotonic_buffer_resource arena(storage.data(), storage.size());
+    std::pmr::string names("Classes: ", &arena);
+    address_class_names(Classify("2001::1"), names);
+    REQUIRE(names == "Classes: IETF Protocol Assignments, Teredo");
+}
@@ -0,0 +1,69 @@
+#include <catch2/catch_all.hpp>
+#include "address_format.hh"
+#include <string>
+
+namespace
+{
+
+    template <typename Address>
+    std::string Format(const Address &address)
+    {
+        char text[kIPv6TextMaxLength];
+        const auto result = format_address(text, address);
+        REQUIRE(result.ec == std::errc());
+        return std::string(text, result.ptr);
+    }
+
+    std::string Compressed(std::string_view text)
+    {
+        return Format(IPAnalyzer(text).ip_value());
+    }
+
+}
+
+TEST_CASE("format_address for IPv4", "[format]")
+{
+    REQUIRE(Format(IPv4Value{0}) == "0.0.0.0");
+    REQUIRE(Format(IPv4Value{0xFFFFFFFF}) == "255.255.255.255");
+    REQUIRE(Format(IPv4Value{0xC0A8000A}) == "192.168.0.10");
+    REQUIRE(Format(IPv4Value{0x0A6400FF}) == "10.100.0.255");
+
+    SECTION("Buffer too small")
+    {
+        char text[6];
+        REQUIRE(format_address(text, IPv4Value{0xC0A8000A}).ec == std::errc::value_too_large);
+    }
+}
+
+TEST_CASE("format_address produces RFC 5952 text for IPv6", "[format]")
+{
+    REQUIRE(Compressed("::") == "::");
+    REQUIRE(Compressed("::1") == "::1");
+    REQUIRE(Compressed("fe80::") == "fe80::");
+    REQUIRE(Compressed("2001:0DB8:0000:0000:0000:0000:0000:0001") == "2001:db8::1");
+    REQUIRE(Compressed("2001:db8:0:1:1:1:1:1") == "2001:db8:0:1:1:1:1:1");
+    REQUIRE(Compressed("2001:db8:0:0:1:0:0:1") == "2001:db8::1:0:0:1");
+    REQUIRE(Compressed("2001:0:0:1:0:0:0:1") == "2001:0:0:1::1");
+    REQUIRE(Compressed("1:2:3:4:5:6:7:8") == "1:2:3:4:5:6:7:8");
+    REQUIRE(Compressed("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff") == "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff");
+    REQUIRE(Compressed("::ffff:192.0.2.128") == "::ffff:c000:280");
+}
+
+TEST_CASE("format_binary and memory_buffer overloads", "[format]")
+{
+    char bits[kIPv4BinaryLength];
+    const auto result = format_binary(bits, IPv4Value{0xC0A80001});
+    REQUIRE(std::string(bits, result.ptr) == "11000000101010000000000000000001");
+
+    fmt::memory_buffer buffer;
+    format_address(buffer, IPAnalyzer("2001:db8::1").ip_value());
+    buffer.push_back(' ');
+    format_address_expanded(buffer, IPAnalyzer("2001:db8::1").ip_value());
+    buffer.push_back(' ');
+    format_address(buffer, IPValue(IPv4Value{0x7F000001}));
+    REQUIRE(fmt::to_string(buffer) == "2001:db8::1 2001:0db8:0000:0000:0000:0000:0000:0001 127.0.0.1");
+
+    buffer.clear();
+    format_binary(buffer, IPAnalyzer("ff00::").ip_value());
+    REQUIRE(fmt::to_string(buffer) == "11111111" + std::string(120, '0'));
+}
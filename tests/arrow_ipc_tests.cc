@@ -0,0 +1,355 @@
+#include <catch2/catch_all.hpp>
+#include "arrow_ipc.hh"
+#include "address_class.hh"
+#include "ip_analyzer.hh"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+
+    template <typename T>
+    std::span<const std::byte> Bytes(const std::vector<T> &values)
+    {
+        return std::as_bytes(std::span(values));
+    }
+
+    std::string ReadFile(const std::string &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), {});
+    }
+
+    void WriteFile(const std::string &path, const std::string &data)
+    {
+        std::ofstream(path, std::ios::binary) << data;
+    }
+
+    template <typename T>
+    std::vector<T> Values(const ArrowColumn &column)
+    {
+        std::vector<T> values(column.values.size() / sizeof(T));
+        std::memcpy(values.data(), column.values.data(), column.values.size());
+        return values;
+    }
+
+    IPv6Value LittleEndian128(uint128 value)
+    {
+        IPv6Value bytes;
+        for (size_t i = 0; i < 16; ++i)
+        {
+            bytes.bytes[i] = static_cast<uint8_t>(uint128_low(value >> (8 * i)));
+        }
+        return bytes;
+    }
+
+    bool SamePrefix(const IPAnalyzer &a, const IPAnalyzer &b)
+    {
+        return a.ip_value() == b.ip_value() && a.get_cidr() == b.get_cidr();
+    }
+
+    IPv6Value Mapped(uint32_t address)
+    {
+        IPv6Value mapped{};
+        mapped.bytes[10] = 0xFF;
+        mapped.bytes[11] = 0xFF;
+        for (int i = 0; i < 4; ++i)
+        {
+            mapped.bytes[12 + i] = static_cast<uint8_t>(address >> (24 - 8 * i));
+        }
+        return mapped;
+    }
+
+}
+
+TEST_CASE("Arrow IPC files round trip", "[arrow]")
+{
+    const std::string path = "arrow_ipc_tests.arrow";
+    const std::vector<ArrowField> schema = {{"small", ArrowType::kUint8},
+                                            {"word", ArrowType::kUint32},
+                                            {"wide", ArrowType::kUint64},
+                                            {"bytes", ArrowType::kFixedSizeBinary16}};
+    const std::vector<uint8_t> small = {1, 2, 3};
+    const std::vector<uint32_t> word = {10, 20, 30};
+    const std::vector<uint64_t> wide = {UINT64_MAX, 0, 42};
+    const std::vector<IPv6Value> bytes = {IPv6Value{}, Mapped(0x0A000001), IPv6Value{{0x20, 0x01, 0x0d, 0xb8}}};
+    {
+        ArrowWriter writer(path, schema);
+        const std::span<const std::byte> first[] = {Bytes(small), Bytes(word), Bytes(wide), Bytes(bytes)};
+        writer.write_batch(3, first);
+        const std::span<const std::byte> empty[] = {{}, {}, {}, {}};
+        writer.write_batch(0, empty);
+        const std::span<const std::byte> last[] = {Bytes(small).first(1), Bytes(word).first(4), Bytes(wide).first(8),
+                                                   Bytes(bytes).first(16)};
+        writer.write_batch(1, last);
+        REQUIRE(ReadFile(path).empty());
+        writer.finish();
+    }
+
+    SECTION("The file has the Arrow framing")
+    {
+        const std::string data = ReadFile(path);
+        REQUIRE(data.size() % 8 == 2);
+        REQUIRE(data.substr(0, 8) == std::string("ARROW1\0\0", 8));
+        REQUIRE(data.substr(8, 4) == "\xFF\xFF\xFF\xFF");
+        REQUIRE(data.substr(data.size() - 6) == "ARROW1");
+    }
+
+    SECTION("Schema and batches are read back")
+    {
+        ArrowReader reader(path);
+        REQUIRE(reader.schema().size() == schema.size());
+        for (size_t i = 0; i < schema.size(); ++i)
+        {
+            REQUIRE(reader.schema()[i].name == schema[i].name);
+            REQUIRE(reader.schema()[i].type == schema[i].type);
+        }
+        REQUIRE(reader.find("wide") == 2);
+        REQUIRE_FALSE(reader.find("missing"));
+
+        REQUIRE(reader.next_batch());
+        REQUIRE(reader.rows() == 3);
+        REQUIRE(Values<uint8_t>(reader.column(0)) == small);
+        REQUIRE(Values<uint32_t>(reader.column(1)) == word);
+        REQUIRE(Values<uint64_t>(reader.column(2)) == wide);
+        REQUIRE(Values<IPv6Value>(reader.column(3)) == bytes);
+        REQUIRE(reader.column(3).null_count == 0);
+
+        REQUIRE(reader.next_batch());
+        REQUIRE(reader.rows() == 0);
+        REQUIRE(reader.next_batch());
+        REQUIRE(reader.rows() == 1);
+        REQUIRE(Values<uint64_t>(reader.column(2)) == std::vector<uint64_t>{UINT64_MAX});
+        REQUIRE_FALSE(reader.next_batch());
+    }
+
+    SECTION("The stream format is read as well")
+    {
+        // A file minus its magic bytes and footer is a valid stream.
+        const std::string data = ReadFile(path);
+        int32_t footer_size;
+        std::memcpy(&footer_size, data.data() + data.size() - 10, sizeof(footer_size));
+        const std::string stream_path = path + ".stream";
+        WriteFile(stream_path, data.substr(8, data.size() - 18 - static_cast<size_t>(footer_size)));
+
+        ArrowReader reader(stream_path);
+        size_t rows = 0;
+        while (reader.next_batch())
+        {
+            rows += reader.rows();
+        }
+        REQUIRE(rows == 4);
+        std::remove(stream_path.c_str());
+    }
+
+    SECTION("Damaged files are rejected")
+    {
+        const std::string data = ReadFile(path);
+        const std::string bad_path = path + ".bad";
+        WriteFile(bad_path, data.substr(0, data.size() / 2));
+        REQUIRE_THROWS_AS(ArrowReader(bad_path), std::runtime_error);
+        WriteFile(bad_path, "not an arrow file");
+        REQUIRE_THROWS_AS(ArrowReader(bad_path), std::runtime_error);
+        std::remove(bad_path.c_str());
+        REQUIRE_THROWS_AS(ArrowReader(path + ".missing"), std::system_error);
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("ArrowWriter rejects mismatched batches", "[arrow]")
+{
+    const std::string path = "arrow_ipc_writer_tests.arrow";
+    REQUIRE_THROWS_AS(ArrowWriter(path, {{"other", ArrowType::kOther}}), std::invalid_argument);
+    {
+        ArrowWriter writer(path, {{"word", ArrowType::kUint32}});
+        const std::vector<uint32_t> word = {1, 2};
+        const std::span<const std::byte> columns[] = {Bytes(word)};
+        REQUIRE_THROWS_AS(writer.write_batch(3, columns), std::invalid_argument);
+        REQUIRE_THROWS_AS(writer.write_batch(2, {}), std::invalid_argument);
+    }
+    // An unfinished writer leaves no file behind.
+    REQUIRE_THROWS_AS(ArrowReader(path), std::system_error);
+}
+
+TEST_CASE("ArrowPrefixReader maps address columns into a PrefixColumn", "[arrow]")
+{
+    const std::string path = "arrow_ipc_prefix_tests.arrow";
+
+    SECTION("uint32 addresses with prefix lengths")
+    {
+        const std::vector<uint32_t> ids = {7, 8, 9};
+        const std::vector<uint32_t> addresses = {0xC0A80101, 0x0A000000, 0x08080808};
+        const std::vector<uint8_t> cidrs = {24, 8, 32};
+        {
+            ArrowWriter writer(path, {{"id", ArrowType::kUint32}, {"address", ArrowType::kUint32}, {"cidr", ArrowType::kUint8}});
+            const std::span<const std::byte> columns[] = {Bytes(ids), Bytes(addresses), Bytes(cidrs)};
+            writer.write_batch(3, columns);
+            writer.finish();
+        }
+        ArrowPrefixReader reader(path);
+        REQUIRE(reader.ipv4_only());
+        PrefixColumn prefixes;
+        REQUIRE(reader.next(prefixes));
+        REQUIRE(prefixes.size() == 3);
+        REQUIRE(SamePrefix(prefixes[0], IPAnalyzer("192.168.1.1/24")));
+        REQUIRE(SamePrefix(prefixes[1], IPAnalyzer("10.0.0.0/8")));
+        REQUIRE(SamePrefix(prefixes[2], IPAnalyzer("8.8.8.8/32")));
+        REQUIRE_FALSE(reader.next(prefixes));
+    }
+
+    SECTION("16 byte addresses without lengths are hosts")
+    {
+        const std::vector<IPv6Value> addresses = {IPAnalyzer("2001:db8::1/128").ip_value().v6(), Mapped(0xC0000201)};
+        {
+            ArrowWriter writer(path, {{"ip", ArrowType::kFixedSizeBinary16}});
+            const std::span<const std::byte> columns[] = {Bytes(addresses)};
+            writer.write_batch(2, columns);
+            writer.finish();
+        }
+        ArrowPrefixReader reader(path);
+        REQUIRE_FALSE(reader.ipv4_only());
+        PrefixColumn prefixes;
+        REQUIRE(reader.next(prefixes));
+        REQUIRE(SamePrefix(prefixes[0], IPAnalyzer("2001:db8::1/128")));
+        REQUIRE(SamePrefix(prefixes[1], IPAnalyzer("192.0.2.1/32")));
+    }
+
+    SECTION("Unusable columns are rejected")
+    {
+        const std::vector<uint64_t> wide = {1};
+        {
+            ArrowWriter writer(path, {{"address", ArrowType::kUint64}});
+            const std::span<const std::byte> columns[] = {Bytes(wide)};
+            writer.write_batch(1, columns);
+            writer.finish();
+        }
+        REQUIRE_THROWS_AS(ArrowPrefixReader(path), std::runtime_error);
+
+        const std::vector<uint32_t> addresses = {1};
+        const std::vector<uint8_t> cidrs = {33};
+        {
+            ArrowWriter writer(path, {{"address", ArrowType::kUint32}, {"cidr", ArrowType::kUint8}});
+            const std::span<const std::byte> columns[] = {Bytes(addresses), Bytes(cidrs)};
+            writer.write_batch(1, columns);
+            writer.finish();
+        }
+        ArrowPrefixReader reader(path);
+        PrefixColumn prefixes;
+        REQUIRE_THROWS_AS(reader.next(prefixes), std::invalid_argument);
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("ArrowAnalysisWriter matches IPAnalyzer", "[arrow]")
+{
+    const std::string path = "arrow_ipc_analysis_tests.arrow";
+    const std::vector<IPAnalyzer> v4 = {IPAnalyzer("192.168.1.77/24"), IPAnalyzer("10.0.0.1/31"), IPAnalyzer("8.8.8.8/32"),
+                                        IPAnalyzer("0.0.0.0/0")};
+
+    SECTION("IPv4-only output")
+    {
+        {
+            ArrowAnalysisWriter writer(path, true);
+            writer.write(PrefixColumn(v4));
+            writer.finish();
+        }
+        ArrowReader reader(path);
+        REQUIRE(reader.schema().size() == 7);
+        REQUIRE(reader.next_batch());
+        REQUIRE(reader.rows() == v4.size());
+        const auto network = Values<uint32_t>(reader.column(*reader.find("network")));
+        const auto cidr = Values<uint8_t>(reader.column(*reader.find("cidr")));
+        const auto broadcast = Values<uint32_t>(reader.column(*reader.find("broadcast")));
+        const auto first = Values<uint32_t>(reader.column(*reader.find("first")));
+        const auto last = Values<uint32_t>(reader.column(*reader.find("last")));
+        const auto hosts = Values<uint64_t>(reader.column(*reader.find("hosts")));
+        const auto classes = Values<uint32_t>(reader.column(*reader.find("classes")));
+        for (size_t i = 0; i < v4.size(); ++i)
+        {
+            const auto [low, high] = v4[i].host_range_value();
+            REQUIRE(network[i] == v4[i].network_value().v4().value);
+            REQUIRE(cidr[i] == v4[i].get_cidr());
+            REQUIRE(broadcast[i] == v4[i].broadcast_value().v4().value);
+            REQUIRE(first[i] == low.v4().value);
+            REQUIRE(last[i] == high.v4().value);
+            REQUIRE(hosts[i] == static_cast<uint64_t>(v4[i].get_num_hosts()));
+            REQUIRE(classes[i] == classify(v4[i].ip_value()));
+        }
+        REQUIRE_FALSE(reader.next_batch());
+    }
+
+    SECTION("Mixed output stores IPv4 mapped")
+    {
+        std::vector<IPAnalyzer> mixed = v4;
+        mixed.insert(mixed.begin() + 1, IPAnalyzer("2001:db8::1/64"));
+        mixed.push_back(IPAnalyzer("::/0"));
+        mixed.push_back(IPAnalyzer("fe80::1/127"));
+        {
+            ArrowAnalysisWriter writer(path, false);
+            writer.write(PrefixColumn(mixed));
+            writer.finish();
+        }
+        ArrowReader reader(path);
+        REQUIRE(reader.next_batch());
+        const auto family = Values<uint8_t>(reader.column(*reader.find("family")));
+        const auto network = Values<IPv6Value>(reader.column(*reader.find("network")));
+        const auto cidr = Values<uint8_t>(reader.column(*reader.find("cidr")));
+        const auto last = Values<IPv6Value>(reader.column(*reader.find("last")));
+        const auto hosts = Values<IPv6Value>(reader.column(*reader.find("hosts")));
+        const auto classes = Values<uint32_t>(reader.column(*reader.find("classes")));
+        REQUIRE(family == std::vector<uint8_t>{4, 6, 4, 4, 4, 6, 6});
+        REQUIRE(network[0] == Mapped(0xC0A80100));
+        REQUIRE(network[1] == IPAnalyzer("2001:db8::/64").ip_value().v6());
+        REQUIRE(last[1] == mixed[1].host_range_value().second.v6());
+        REQUIRE(cidr == std::vector<uint8_t>{120, 64, 127, 128, 96, 0, 127});
+        const std::vector<uint128> expected_hosts = {254, UINT64_MAX - 1, 2, 1, 4294967294, kUint128Max - 1, 2};
+        for (size_t i = 0; i < mixed.size(); ++i)
+        {
+            REQUIRE(hosts[i] == LittleEndian128(expected_hosts[i]));
+            REQUIRE(expected_hosts[i] == mixed[i].get_num_hosts());
+        }
+        for (size_t i = 0; i < mixed.size(); ++i)
+        {
+            REQUIRE(classes[i] == classify(mixed[i].ip_value()));
+        }
+    }
+
+    SECTION("Mixed output reads back as the input networks")
+    {
+        const std::vector<IPAnalyzer> mixed = {IPAnalyzer("192.168.1.77/24"), IPAnalyzer("2001:db8::1/64"),
+                                               IPAnalyzer("0.0.0.0/0"), IPAnalyzer("::/0"),
+                                               IPAnalyzer("::ffff:10.0.0.1/128"), IPAnalyzer("8.8.8.8/32")};
+        {
+            ArrowAnalysisWriter writer(path, false);
+            writer.write(PrefixColumn(mixed));
+            writer.finish();
+        }
+        ArrowPrefixReader reader(path);
+        PrefixColumn prefixes;
+        REQUIRE(reader.next(prefixes));
+        REQUIRE(prefixes.size() == mixed.size());
+        REQUIRE(SamePrefix(prefixes[0], IPAnalyzer("192.168.1.0/24")));
+        REQUIRE(SamePrefix(prefixes[1], IPAnalyzer("2001:db8::/64")));
+        REQUIRE(SamePrefix(prefixes[2], IPAnalyzer("0.0.0.0/0")));
+        REQUIRE(SamePrefix(prefixes[3], IPAnalyzer("::/0")));
+        REQUIRE(SamePrefix(prefixes[4], IPAnalyzer("10.0.0.1/32")));
+        REQUIRE(SamePrefix(prefixes[5], IPAnalyzer("8.8.8.8/32")));
+        REQUIRE_FALSE(reader.next(prefixes));
+    }
+
+    SECTION("IPv4-only output rejects IPv6")
+    {
+        ArrowAnalysisWriter writer(path, true);
+        REQUIRE_THROWS_AS(writer.write(PrefixColumn(std::vector<IPAnalyzer>{IPAnalyzer("::1/128")})), std::invalid_argument);
+    }
+
+    std::remove(path.c_str());
+}
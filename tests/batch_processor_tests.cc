@@ -0,0 +1,209 @@
+#include <catch2/catch_all.hpp>
+#include "batch_processor.hh"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace
+{
+
+    std::string RunBatch(const std::string &input, BatchStats *stats = nullptr, unsigned threads = 1,
+                         OutputFormat format = OutputFormat::kText)
+    {
+        char *output = nullptr;
+        size_t output_size = 0;
+        std::FILE *out = open_memstream(&output, &output_size);
+        std::FILE *in = fmemopen(const_cast<char *>(input.data()), input.size(), "r");
+        {
+            BatchProcessor processor(out, threads, format);
+            REQUIRE(processor.process_stream(in));
+            if (stats != nullptr)
+            {
+                *stats = processor.stats();
+            }
+        }
+        std::fclose(in);
+        std::fclose(out);
+        std::string result(output, output_size);
+        std::free(output);
+        return result;
+    }
+
+    std::string RunRegion(std::string_view region, unsigned threads, BatchStats &stats)
+    {
+        char *output = nullptr;
+        size_t output_size = 0;
+        std::FILE *out = open_memstream(&output, &output_size);
+        {
+            BatchProcessor processor(out, threads);
+            REQUIRE(processor.process_region(region));
+            stats = processor.stats();
+        }
+        std::fclose(out);
+        std::string result(output, output_size);
+        std::free(output);
+        return result;
+    }
+
+    std::string MixedInput(size_t min_size)
+    {
+        const char *const samples[] = {"10.1.2.3/8", "2001:db8::1/48", "bogus", "192.168.7.9/30", "::1", "1.2.3.4/33"};
+        std::string input;
+        for (size_t i = 0; input.size() < min_size; ++i)
+        {
+            input += samples[i % std::size(samples)];
+            input += '\n';
+        }
+        return input;
+    }
+
+}
+
+TEST_CASE("BatchProcessor emits one compact line per input", "[batch]")
+{
+    BatchStats stats;
+    const auto output = RunBatch("192.168.0.1/24\n10.0.0.1/8\r\n\n8.8.8.8", &stats);
+
+    REQUIRE(output ==
+            "192.168.0.1/24\t192.168.0.0/24\t255.255.255.0\t192.168.0.1\t192.168.0.254\t254\t1\n"
+            "10.0.0.1/8\t10.0.0.0/8\t255.0.0.0\t10.0.0.1\t10.255.255.254\t16777214\t1\n"
+            "8.8.8.8\t8.8.8.8/32\t255.255.255.255\t8.8.8.8\t8.8.8.8\t1\t0\n");
+    REQUIRE(stats.lines == 3);
+    REQUIRE(stats.failures == 0);
+}
+
+TEST_CASE("BatchProcessor reports malformed lines and continues", "[batch]")
+{
+    BatchStats stats;
+    const auto output = RunBatch("300.1.1.1/24\n192.168.0.1/24\n", &stats);
+
+    REQUIRE(output.starts_with("300.1.1.1/24\terror\t"));
+    REQUIRE(output.ends_with("192.168.0.1/24\t192.168.0.0/24\t255.255.255.0\t192.168.0.1\t192.168.0.254\t254\t1\n"));
+    REQUIRE(stats.lines == 2);
+    REQUIRE(stats.failures == 1);
+}
+
+TEST_CASE("BatchProcessor counts failures by kind", "[batch]")
+{
+    BatchStats stats;
+    const auto output = RunBatch("300.1.1.1/24\n1.2.3.4/33\n::/200\nbogus\n1.2.3.4/x\n10.0.0.0/8\n", &stats);
+
+    REQUIRE(output.starts_with("300.1.1.1/24\terror\tInvalid octet value\n"
+                               "1.2.3.4/33\terror\tCIDR value too large for the address family\n"));
+    REQUIRE(stats.lines == 6);
+    REQUIRE(stats.failures == 5);
+    REQUIRE(stats.error_count(ParseError::kOctetOutOfRange) == 1);
+    REQUIRE(stats.error_count(ParseError::kCidrOutOfRange) == 2);
+    REQUIRE(stats.error_count(ParseError::kInvalidCharacter) == 1);
+    REQUIRE(stats.error_count(ParseError::kInvalidCidr) == 1);
+    REQUIRE(stats.error_count(ParseError::kNone) == 0);
+}
+
+TEST_CASE("BatchProcessor counts families, bytes and sampled latencies", "[batch]")
+{
+    std::string input;
+    for (uint64_t i = 0; i < 2 * BatchStats::kTimingSampleInterval; ++i)
+    {
+        input += i % 2 == 0 ? "10.0.0.1/8\n" : "2001:db8::/32\n";
+    }
+    input += "bogus\n";
+
+    BatchStats stats;
+    RunBatch(input, &stats);
+    REQUIRE(stats.ipv4 == BatchStats::kTimingSampleInterval);
+    REQUIRE(stats.ipv6 == BatchStats::kTimingSampleInterval);
+    REQUIRE(stats.failures == 1);
+    REQUIRE(stats.bytes == input.size());
+    REQUIRE(stats.parse_time.count() == 2);
+    REQUIRE(stats.format_time.count() == 2);
+}
+
+TEST_CASE("BatchProcessor handles lines spanning read chunks", "[batch]")
+{
+    std::string input;
+    size_t expected_lines = 0;
+    while (input.size() < 3 * BatchProcessor::kReadChunkSize)
+    {
+        input += "172.16.5.4/20\n";
+        ++expected_lines;
+    }
+
+    BatchStats stats;
+    const auto output = RunBatch(input, &stats);
+
+    REQUIRE(stats.lines == expected_lines);
+    REQUIRE(stats.failures == 0);
+    REQUIRE(output.size() == expected_lines * std::string("172.16.5.4/20\t172.16.0.0/20\t255.255.240.0\t172.16.0.1\t172.16.15.254\t4094\t1\n").size());
+}
+
+TEST_CASE("BatchProcessor processes a region in place", "[batch]")
+{
+    char *output = nullptr;
+    size_t output_size = 0;
+    std::FILE *out = open_memstream(&output, &output_size);
+    {
+        BatchProcessor processor(out);
+        REQUIRE(processor.process_region("10.0.0.1/8\n2001:db8::1/64"));
+        REQUIRE(processor.stats().lines == 2);
+    }
+    std::fclose(out);
+    const std::string result(output, output_size);
+    std::free(output);
+
+    REQUIRE(result ==
+            "10.0.0.1/8\t10.0.0.0/8\t255.0.0.0\t10.0.0.1\t10.255.255.254\t16777214\t1\n"
+            "2001:db8::1/64\t2001:db8::/64\tffff:ffff:ffff:ffff::\t2001:db8::1\t2001:db8::ffff:ffff:ffff:fffe\t18446744073709551614\t0\n");
+}
+
+TEST_CASE("Sharded batch processing preserves input order", "[batch]")
+{
+    const std::string input = MixedInput(3 * BatchProcessor::kShardSize + 12345);
+
+    BatchStats serial_stats;
+    const auto serial = RunBatch(input, &serial_stats);
+
+    SECTION("Stream input")
+    {
+        BatchStats stats;
+        REQUIRE(RunBatch(input, &stats, 4) == serial);
+        REQUIRE(stats.lines == serial_stats.lines);
+        REQUIRE(stats.failures == serial_stats.failures);
+        REQUIRE(stats.errors == serial_stats.errors);
+        REQUIRE(stats.ipv4 == serial_stats.ipv4);
+        REQUIRE(stats.ipv6 == serial_stats.ipv6);
+        REQUIRE(stats.bytes == input.size());
+    }
+
+    SECTION("Region input")
+    {
+        BatchStats stats;
+        REQUIRE(RunRegion(input, 3, stats) == serial);
+        REQUIRE(stats.lines == serial_stats.lines);
+        REQUIRE(stats.failures == serial_stats.failures);
+    }
+
+    SECTION("Output formats")
+    {
+        for (const OutputFormat format : {OutputFormat::kNdjson, OutputFormat::kCsv, OutputFormat::kBinary})
+        {
+            REQUIRE(RunBatch(input, nullptr, 4, format) == RunBatch(input, nullptr, 1, format));
+        }
+    }
+
+    SECTION("Region without trailing newline")
+    {
+        const std::string trimmed = input.substr(0, input.size() - 1);
+        BatchStats stats;
+        REQUIRE(RunRegion(trimmed, 5, stats) == serial);
+    }
+}
+
+TEST_CASE("BatchProcessor writes the CSV header once", "[batch]")
+{
+    const auto output = RunBatch("10.0.0.1/8\nbogus\n", nullptr, 1, OutputFormat::kCsv);
+
+    REQUIRE(output ==
+            "input,network,netmask,first,last,hosts,private,error\n"
+            "10.0.0.1/8,10.0.0.0/8,255.0.0.0,10.0.0.1,10.255.255.254,16777214,1,\n"
+            "bogus,,,,,,,Invalid character in address\n");
+}
@@ -0,0 +1,118 @@
+#include <catch2/catch_all.hpp>
+#include "address_class.hh"
+#include "cpu_features.hh"
+#include "range_kernels.hh"
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+
+    constexpr SimdLevel kLevels[] = {SimdLevel::kScalar, SimdLevel::kSse2, SimdLevel::kAvx2, SimdLevel::kAvx512,
+                                     SimdLevel::kNeon};
+
+    struct Results
+    {
+        std::vector<uint32_t> network, broadcast, first, last;
+        std::vector<IPv6Value> network6, broadcast6, first6, last6;
+        std::vector<AddressClassMask> classes;
+
+        bool operator==(const Results &) const = default;
+    };
+
+    // Runs every dispatched kernel over mixed and uniform batches.
+    Results RunKernels(const std::vector<uint32_t> &v4, const std::vector<IPv6Value> &v6, const std::vector<uint8_t> &cidrs)
+    {
+        const size_t n = v4.size();
+        Results results;
+        for (auto *column : {&results.network, &results.broadcast, &results.first, &results.last})
+        {
+            column->resize(2 * n);
+        }
+        for (auto *column : {&results.network6, &results.broadcast6, &results.first6, &results.last6})
+        {
+            column->resize(2 * n);
+        }
+        results.classes.resize(n);
+
+        const auto half = [n](auto &column, size_t part)
+        { return std::span(column).subspan(part * n, n); };
+        std::vector<uint8_t> cidrs4(n), cidrs6(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            cidrs4[i] = cidrs[i] % 33;
+            cidrs6[i] = cidrs[i] % 129;
+        }
+        compute_ranges_v4(v4, cidrs4, {half(results.network, 0), half(results.broadcast, 0), half(results.first, 0), half(results.last, 0)});
+        compute_ranges_v4(v4, uint8_t{20}, {half(results.network, 1), half(results.broadcast, 1), half(results.first, 1), half(results.last, 1)});
+        compute_ranges_v6(v6, cidrs6, {half(results.network6, 0), half(results.broadcast6, 0), half(results.first6, 0), half(results.last6, 0)});
+        compute_ranges_v6(v6, uint8_t{56}, {half(results.network6, 1), half(results.broadcast6, 1), half(results.first6, 1), half(results.last6, 1)});
+        classify_batch(v4, results.classes);
+        return results;
+    }
+
+}
+
+TEST_CASE("SIMD level names round trip", "[cpufeatures]")
+{
+    for (const SimdLevel level : kLevels)
+    {
+        REQUIRE(parse_simd_level(simd_level_name(level)) == level);
+    }
+    REQUIRE_FALSE(parse_simd_level("sse9"));
+}
+
+TEST_CASE("SIMD levels can be lowered but not raised", "[cpufeatures]")
+{
+    const SimdLevel active = simd_level();
+    REQUIRE(simd_level_supported(detected_simd_level()));
+    REQUIRE(simd_level_supported(SimdLevel::kScalar));
+    REQUIRE(simd_level_supported(active));
+
+    set_simd_level(SimdLevel::kScalar);
+    REQUIRE(simd_level() == SimdLevel::kScalar);
+    REQUIRE(std::string(range_kernels_isa()) == "scalar");
+    for (const SimdLevel level : kLevels)
+    {
+        if (!simd_level_supported(level))
+        {
+            REQUIRE_THROWS_AS(set_simd_level(level), std::invalid_argument);
+        }
+    }
+    set_simd_level(active);
+}
+
+TEST_CASE("Every supported SIMD level gives the scalar results", "[cpufeatures]")
+{
+    std::mt19937 rng(21);
+    // Not a multiple of any vector width, so every kernel has a tail.
+    constexpr size_t kCount = 1000 + 13;
+    std::vector<uint32_t> v4(kCount);
+    std::vector<IPv6Value> v6(kCount);
+    std::vector<uint8_t> cidrs(kCount);
+    for (size_t i = 0; i < kCount; ++i)
+    {
+        // Every seventh address falls into a /8 with longer special ranges.
+        v4[i] = i % 7 == 0 ? (0xC0000000 | (rng() & 0x00FFFFFF)) : rng();
+        for (auto &byte : v6[i].bytes)
+        {
+            byte = static_cast<uint8_t>(rng());
+        }
+        cidrs[i] = static_cast<uint8_t>(rng());
+    }
+
+    const SimdLevel active = simd_level();
+    set_simd_level(SimdLevel::kScalar);
+    const Results expected = RunKernels(v4, v6, cidrs);
+    for (const SimdLevel level : kLevels)
+    {
+        if (simd_level_supported(level))
+        {
+            INFO(simd_level_name(level));
+            set_simd_level(level);
+            REQUIRE(RunKernels(v4, v6, cidrs) == expected);
+        }
+    }
+    set_simd_level(active);
+}
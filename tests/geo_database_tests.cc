@@ -0,0 +1,424 @@
+#include <catch2/catch_all.hpp>
+#include "batch_processor.hh"
+#include "geo_database.hh"
+#include "record_writer.hh"
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+
+    // Encoders of the MMDB data section format.
+    std::string Control(uint8_t type, uint32_t size)
+    {
+        std::string out(1, static_cast<char>(type <= 7 ? type << 5 : 0));
+        std::string size_bytes;
+        if (size < 29)
+        {
+            out[0] = static_cast<char>(out[0] | size);
+        }
+        else if (size < 285)
+        {
+            out[0] = static_cast<char>(out[0] | 29);
+            size_bytes = {static_cast<char>(size - 29)};
+        }
+        else
+        {
+            out[0] = static_cast<char>(out[0] | 30);
+            size_bytes = {static_cast<char>((size - 285) >> 8), static_cast<char>(size - 285)};
+        }
+        if (type > 7)
+        {
+            out.push_back(static_cast<char>(type - 7));
+        }
+        return out + size_bytes;
+    }
+
+    std::string String(std::string_view text) { return Control(2, static_cast<uint32_t>(text.size())) + std::string(text); }
+
+    std::string Unsigned(uint8_t type, uint64_t value)
+    {
+        std::string bytes;
+        for (; value != 0; value >>= 8)
+        {
+            bytes.insert(bytes.begin(), static_cast<char>(value));
+        }
+        return Control(type, static_cast<uint32_t>(bytes.size())) + bytes;
+    }
+
+    std::string Map(uint32_t entries) { return Control(7, entries); }
+
+    std::string Pointer(uint32_t offset)
+    {
+        if (offset < 2048)
+        {
+            return {static_cast<char>(0x20 | offset >> 8), static_cast<char>(offset)};
+        }
+        offset -= 2048;
+        return {static_cast<char>(0x28 | offset >> 16), static_cast<char>(offset >> 8), static_cast<char>(offset)};
+    }
+
+    // Writes a search tree over the inserted networks. Networks must be
+    // inserted before any network they contain.
+    class MmdbBuilder
+    {
+    public:
+        MmdbBuilder(unsigned ip_version, unsigned record_size) : ip_version_(ip_version), record_size_(record_size) {}
+
+        // Appends a data section value and returns its offset.
+        uint32_t add_data(const std::string &value)
+        {
+            const auto offset = static_cast<uint32_t>(data_.size());
+            data_ += value;
+            return offset;
+        }
+
+        void insert(std::string_view cidr, uint32_t offset)
+        {
+            const IPAnalyzer prefix(cidr);
+            const IPValue network = prefix.network_value();
+            std::array<uint8_t, 16> bytes = network.v6().bytes;
+            unsigned length = prefix.get_cidr();
+            if (network.is_ipv4() && ip_version_ == 6)
+            {
+                bytes = {};
+                for (size_t i = 0; i < 4; ++i)
+                {
+                    bytes[12 + i] = network.v6().bytes[i];
+                }
+                length += 96;
+            }
+
+            size_t node = 0;
+            for (unsigned depth = 0; depth < length; ++depth)
+            {
+                const unsigned bit = (bytes[depth / 8] >> (7 - depth % 8)) & 1;
+                Record &record = nodes_[node][bit];
+                if (depth + 1 == length)
+                {
+                    REQUIRE(record.kind != Record::kNode);
+                    record = {Record::kData, offset};
+                    return;
+                }
+                if (record.kind != Record::kNode)
+                {
+                    const Record pushed = record;
+                    nodes_.push_back({pushed, pushed});
+                    nodes_[node][bit] = {Record::kNode, static_cast<uint32_t>(nodes_.size() - 1)};
+                }
+                node = nodes_[node][bit].value;
+            }
+        }
+
+        std::string build() const
+        {
+            const auto node_count = static_cast<uint32_t>(nodes_.size());
+            const auto value = [node_count](const Record &record)
+            {
+                switch (record.kind)
+                {
+                case Record::kNode:
+                    return record.value;
+                case Record::kData:
+                    return node_count + 16 + record.value;
+                default:
+                    return node_count;
+                }
+            };
+
+            std::string file;
+            for (const auto &node : nodes_)
+            {
+                const uint32_t left = value(node[0]);
+                const uint32_t right = value(node[1]);
+                const auto put = [&file](uint32_t word, int bytes)
+                {
+                    for (int i = bytes - 1; i >= 0; --i)
+                    {
+                        file.push_back(static_cast<char>(word >> (8 * i)));
+                    }
+                };
+                if (record_size_ == 28)
+                {
+                    put(left & 0xFFFFFF, 3);
+                    file.push_back(static_cast<char>((left >> 24) << 4 | right >> 24));
+                    put(right & 0xFFFFFF, 3);
+                }
+                else
+                {
+                    put(left, static_cast<int>(record_size_ / 8));
+                    put(right, static_cast<int>(record_size_ / 8));
+                }
+            }
+            file += std::string(16, '\0');
+            file += data_;
+            file += "\xAB\xCD\xEFMaxMind.com";
+            file += Map(9) + String("binary_format_major_version") + Unsigned(5, 2) + String("binary_format_minor_version") +
+                    Unsigned(5, 0) + String("build_epoch") + Unsigned(9, 1700000000) + String("database_type") +
+                    String("Test-ASN-Country") + String("description") + Map(1) + String("en") + String("test database") +
+                    String("languages") + Control(11, 1) + String("en") + String("ip_version") + Unsigned(5, ip_version_) +
+                    String("node_count") + Unsigned(6, node_count) + String("record_size") + Unsigned(5, record_size_);
+            return file;
+        }
+
+    private:
+        struct Record
+        {
+            enum Kind
+            {
+                kEmpty,
+                kNode,
+                kData
+            } kind = kEmpty;
+            uint32_t value = 0;
+        };
+
+        unsigned ip_version_;
+        unsigned record_size_;
+        std::vector<std::array<Record, 2>> nodes_ = {{}};
+        std::string data_;
+    };
+
+    void WriteFile(const std::string &path, const std::string &contents)
+    {
+        std::ofstream(path, std::ios::binary) << contents;
+    }
+
+    // ASN and country entries in the shapes of GeoLite2-ASN and
+    // GeoLite2-Country, with shared values behind pointers.
+    std::string TestDatabase(unsigned ip_version, unsigned record_size)
+    {
+        MmdbBuilder builder(ip_version, record_size);
+        const uint32_t us = builder.add_data(Map(2) + String("iso_code") + String("US") + String("names") + Map(1) + String("en") +
+                                             String("United States"));
+        const uint32_t org_key = builder.add_data(String("autonomous_system_organization"));
+
+        builder.insert("10.0.0.0/8", builder.add_data(Map(4) + String("flag") + Control(14, 1) + String("score") + Control(3, 8) +
+                                                       std::string(8, '\x40') + String("tags") + Control(11, 2) + String("a") +
+                                                       String(std::string(300, 'x')) + String("autonomous_system_number") +
+                                                       Unsigned(6, 64512)));
+        builder.insert("1.0.0.0/24", builder.add_data(Map(2) + String("autonomous_system_number") + Unsigned(6, 13335) +
+                                                      Pointer(org_key) + String("Cloudflare, Inc.")));
+        builder.insert("8.8.8.0/24", builder.add_data(Map(3) + String("autonomous_system_number") + Unsigned(6, 15169) +
+                                                      Pointer(org_key) + String("Google LLC") + String("country") + Pointer(us)));
+        builder.insert("81.2.69.0/25", builder.add_data(Map(1) + String("country") + Map(1) + String("iso_code") + String("GB")));
+        builder.insert("81.2.69.128/25", builder.add_data(Map(2) + String("registered_country") + Pointer(us) +
+                                                          String("organization") + String("Example Hosting")));
+        if (ip_version == 6)
+        {
+            builder.insert("2001:db8::/32", builder.add_data(Map(2) + String("autonomous_system_number") + Unsigned(6, 64496) +
+                                                             String("country") + Map(1) + String("iso_code") + String("NL")));
+        }
+        return builder.build();
+    }
+
+    GeoRecord Lookup(const GeoDatabase &database, std::string_view address, unsigned &length)
+    {
+        GeoRecord record;
+        length = database.lookup(IPAnalyzer(address).ip_value(), record);
+        return record;
+    }
+
+}
+
+TEST_CASE("GeoDatabase reads MMDB files", "[geo]")
+{
+    const std::string path = "geo_database_tests.mmdb";
+    for (const unsigned ip_version : {4u, 6u})
+    {
+        for (const unsigned record_size : {24u, 28u, 32u})
+        {
+            INFO("IPv" << ip_version << ", " << record_size << " bit records");
+            WriteFile(path, TestDatabase(ip_version, record_size));
+            const GeoDatabase database = GeoDatabase::open(path);
+            REQUIRE(database.ip_version() == ip_version);
+            REQUIRE(database.database_type() == "Test-ASN-Country");
+
+            unsigned length;
+            REQUIRE(Lookup(database, "1.0.0.77", length) == GeoRecord{13335, "", "Cloudflare, Inc."});
+            REQUIRE(length == 24);
+            REQUIRE(Lookup(database, "8.8.8.8", length) == GeoRecord{15169, "US", "Google LLC"});
+            REQUIRE(Lookup(database, "81.2.69.1", length) == GeoRecord{0, "GB", ""});
+            REQUIRE(length == 25);
+            REQUIRE(Lookup(database, "81.2.69.200", length) == GeoRecord{0, "US", "Example Hosting"});
+            REQUIRE(Lookup(database, "10.200.1.1", length) == GeoRecord{64512, "", ""});
+            REQUIRE(length == 8);
+            REQUIRE(Lookup(database, "9.9.9.9", length) == GeoRecord{});
+            REQUIRE(length <= 8);
+            REQUIRE(Lookup(database, "255.255.255.255", length) == GeoRecord{});
+
+            if (ip_version == 6)
+            {
+                REQUIRE(Lookup(database, "2001:db8:1::1", length) == GeoRecord{64496, "NL", ""});
+                REQUIRE(length == 32);
+                REQUIRE(Lookup(database, "2001:db9::1", length) == GeoRecord{});
+            }
+            else
+            {
+                REQUIRE(Lookup(database, "2001:db8:1::1", length) == GeoRecord{});
+                REQUIRE(length == 0);
+            }
+        }
+    }
+
+    SECTION("Fields already set are kept")
+    {
+        const GeoDatabase database = GeoDatabase::open(path);
+        GeoRecord record{1, "FR", "Other"};
+        database.lookup(IPAnalyzer("8.8.8.8").ip_value(), record);
+        REQUIRE(record == GeoRecord{1, "FR", "Other"});
+    }
+    std::remove(path.c_str());
+}
+
+TEST_CASE("GeoDatabase rejects invalid files", "[geo]")
+{
+    const std::string path = "geo_database_invalid.mmdb";
+    REQUIRE_THROWS_AS(GeoDatabase::open("geo_database_missing.mmdb"), std::system_error);
+
+    WriteFile(path, std::string(4096, '\x5A'));
+    REQUIRE_THROWS_AS(GeoDatabase::open(path), std::runtime_error);
+
+    // The metadata claims more nodes than the file holds.
+    std::string database = TestDatabase(6, 24);
+    const size_t count = database.rfind("node_count") + 10;
+    database.replace(count, 1 + (database[count] & 0x1F), Unsigned(6, 0xFFFFFF));
+    WriteFile(path, database);
+    REQUIRE_THROWS_AS(GeoDatabase::open(path), std::runtime_error);
+
+    // A corrupt record loses its fields but does not fail lookups.
+    database = TestDatabase(4, 32);
+    const size_t pointer = database.find(String("Google LLC") + String("country")) + 19;
+    database.replace(pointer, 2, std::string(2, '\0'));
+    WriteFile(path, database);
+    const GeoDatabase corrupt = GeoDatabase::open(path);
+    unsigned length;
+    REQUIRE(Lookup(corrupt, "8.8.8.8", length) == GeoRecord{});
+    REQUIRE(Lookup(corrupt, "1.0.0.1", length).asn == 13335);
+    std::remove(path.c_str());
+}
+
+TEST_CASE("GeoEnricher joins databases and caches per block", "[geo]")
+{
+    const std::string asn_path = "geo_database_asn.mmdb";
+    const std::string country_path = "geo_database_country.mmdb";
+    WriteFile(asn_path, TestDatabase(6, 28));
+    MmdbBuilder country(6, 24);
+    country.insert("0.0.0.0/1", country.add_data(Map(2) + String("country") + Map(1) + String("iso_code") + String("AU") +
+                                                 String("autonomous_system_number") + Unsigned(6, 1)));
+    country.insert("2000::/3", country.add_data(Map(1) + String("country") + Map(1) + String("iso_code") + String("ZZ")));
+    WriteFile(country_path, country.build());
+
+    std::vector<GeoDatabase> databases;
+    databases.push_back(GeoDatabase::open(asn_path));
+    databases.push_back(GeoDatabase::open(country_path));
+    const GeoEnricher enricher(std::move(databases));
+
+    REQUIRE(enricher.lookup(IPAnalyzer("1.0.0.1").ip_value()) == GeoRecord{13335, "AU", "Cloudflare, Inc."});
+    REQUIRE(enricher.lookup(IPAnalyzer("8.8.8.8").ip_value()) == GeoRecord{15169, "US", "Google LLC"});
+    REQUIRE(enricher.lookup(IPAnalyzer("2001:db8::1").ip_value()) == GeoRecord{64496, "NL", ""});
+    REQUIRE(enricher.lookup(IPAnalyzer("2a00::1").ip_value()) == GeoRecord{0, "ZZ", ""});
+    REQUIRE(enricher.lookup(IPAnalyzer("200.1.1.1").ip_value()) == GeoRecord{});
+
+    // The /25s split a cache block, so they are never served from the cache.
+    std::mt19937 rng(29);
+    const char *const kBlocks[] = {"1.0.0.", "8.8.8.", "81.2.69.", "10.1.1.", "9.9.9."};
+    for (int i = 0; i < 2000; ++i)
+    {
+        const IPValue address =
+            IPAnalyzer(std::string(kBlocks[rng() % std::size(kBlocks)]) + std::to_string(rng() % 256)).ip_value();
+        REQUIRE(enricher.lookup(address) == enricher.lookup_uncached(address));
+    }
+
+    const GeoEnricher asn_only(std::vector<GeoDatabase>{GeoDatabase::open(asn_path)});
+    REQUIRE(enricher.lookup(IPAnalyzer("1.0.0.1").ip_value()).country == "AU");
+    REQUIRE(asn_only.lookup(IPAnalyzer("1.0.0.1").ip_value()).country.empty());
+    REQUIRE(enricher.lookup(IPAnalyzer("1.0.0.1").ip_value()).country == "AU");
+    std::remove(asn_path.c_str());
+    std::remove(country_path.c_str());
+}
+
+TEST_CASE("Record writers append enrichment fields", "[geo][writer]")
+{
+    const std::string path = "geo_database_writer.mmdb";
+    WriteFile(path, TestDatabase(6, 24));
+    const GeoEnricher enricher(std::vector<GeoDatabase>{GeoDatabase::open(path)});
+    const auto record = [&enricher](OutputFormat format, std::string_view input)
+    {
+        const auto writer = make_record_writer(format, &enricher);
+        fmt::memory_buffer out;
+        writer->write_header(out);
+        const auto parsed = IPAnalyzer::parse(input);
+        if (parsed)
+        {
+            writer->write_record(out, input, *parsed);
+        }
+        else
+        {
+            writer->write_error(out, input, parsed.error());
+        }
+        return fmt::to_string(out);
+    };
+
+    REQUIRE(record(OutputFormat::kText, "8.8.8.8/24") ==
+            "8.8.8.8/24\t8.8.8.0/24\t255.255.255.0\t8.8.8.1\t8.8.8.254\t254\t0\t15169\tUS\tGoogle LLC\n");
+    REQUIRE(record(OutputFormat::kText, "192.168.1.1/24") ==
+            "192.168.1.1/24\t192.168.1.0/24\t255.255.255.0\t192.168.1.1\t192.168.1.254\t254\t1\t\t\t\n");
+    REQUIRE(record(OutputFormat::kText, "bogus") == "bogus\terror\tInvalid character in address\n");
+    REQUIRE(record(OutputFormat::kNdjson, "1.0.0.1/24") ==
+            "{\"input\":\"1.0.0.1/24\",\"network\":\"1.0.0.0/24\",\"netmask\":\"255.255.255.0\",\"first\":\"1.0.0.1\","
+            "\"last\":\"1.0.0.254\",\"hosts\":254,\"private\":false,\"asn\":13335,\"country\":null,\"org\":\"Cloudflare, Inc.\"}\n");
+    REQUIRE(record(OutputFormat::kCsv, "1.0.0.1/24") ==
+            "input,network,netmask,first,last,hosts,private,asn,country,org,error\n"
+            "1.0.0.1/24,1.0.0.0/24,255.255.255.0,1.0.0.1,1.0.0.254,254,0,13335,,\"Cloudflare, Inc.\",\n");
+    REQUIRE(record(OutputFormat::kCsv, "bogus") ==
+            "input,network,netmask,first,last,hosts,private,asn,country,org,error\nbogus,,,,,,,,,,Invalid character in address\n");
+
+    const std::string binary = record(OutputFormat::kBinary, "8.8.8.8");
+    REQUIRE(binary.size() == kGeoBinaryRecordSize);
+    REQUIRE(binary.substr(24, 8) == std::string("\x41\x3B\x00\x00US\x00\x00", 8));
+    REQUIRE(record(OutputFormat::kBinary, "bogus").substr(24) == std::string(8, '\0'));
+    std::remove(path.c_str());
+}
+
+TEST_CASE("Enriched batches match across threads", "[geo][batch]")
+{
+    const std::string path = "geo_database_batch.mmdb";
+    WriteFile(path, TestDatabase(6, 32));
+    const GeoEnricher enricher(std::vector<GeoDatabase>{GeoDatabase::open(path)});
+
+    std::string input;
+    std::mt19937 rng(30);
+    while (input.size() < 3 * BatchProcessor::kShardSize)
+    {
+        input += std::to_string(rng() % 3 == 0 ? 8 : 81) + ".2.69." + std::to_string(rng() % 256) + "\n2001:db8::1\nbogus\n";
+    }
+
+    const auto run = [&](unsigned threads)
+    {
+        char *output = nullptr;
+        size_t output_size = 0;
+        std::FILE *out = open_memstream(&output, &output_size);
+        {
+            BatchProcessor processor(out, threads, OutputFormat::kNdjson, &enricher);
+            REQUIRE(processor.process_region(input));
+        }
+        std::fclose(out);
+        std::string result(output, output_size);
+        std::free(output);
+        return result;
+    };
+
+    const std::string serial = run(1);
+    REQUIRE(serial.find("\"asn\":64496,\"country\":\"NL\"") != std::string::npos);
+    REQUIRE(serial.find("\"country\":\"GB\"") != std::string::npos);
+    REQUIRE(run(4) == serial);
+    std::remove(path.c_str());
+}
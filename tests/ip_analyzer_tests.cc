@@ -15,14 +15,14 @@ TEST_CASE("IPAnalyzer functionality", "[ipanalyzer]")
 {
     IPAnalyzer analyzer("192.168.0.1/24");
 
-    REQUIRE(analyzer.get_ip().to_string() == "192.168.0.1");
-    REQUIRE(analyzer.get_network().to_string() == "192.168.0.0");
-    REQUIRE(analyzer.get_netmask().to_string() == "255.255.255.0");
-    REQUIRE(analyzer.get_broadcast().to_string() == "192.168.0.255");
+    REQUIRE(analyzer.get_ip()->to_string() == "192.168.0.1");
+    REQUIRE(analyzer.get_network()->to_string() == "192.168.0.0");
+    REQUIRE(analyzer.get_netmask()->to_string() == "255.255.255.0");
+    REQUIRE(analyzer.get_broadcast()->to_string() == "192.168.0.255");
 
     auto [first, last] = analyzer.get_host_range();
-    REQUIRE(first.to_string() == "192.168.0.1");
-    REQUIRE(last.to_string() == "192.168.0.254");
+    REQUIRE(first->to_string() == "192.168.0.1");
+    REQUIRE(last->to_string() == "192.168.0.254");
 
     REQUIRE(analyzer.get_num_hosts() == 254);
     REQUIRE(analyzer.is_private() == true);
@@ -59,21 +59,21 @@ TEST_CASE("Edge cases for IPAnalyzer", "[ipanalyzer]")
     SECTION("Minimum CIDR")
     {
         IPAnalyzer analyzer("192.168.0.1/0");
-        REQUIRE(analyzer.get_network().to_string() == "0.0.0.0");
-        REQUIRE(analyzer.get_broadcast().to_string() == "255.255.255.255");
+        REQUIRE(analyzer.get_network()->to_string() == "0.0.0.0");
+        REQUIRE(analyzer.get_broadcast()->to_string() == "255.255.255.255");
         REQUIRE(analyzer.get_num_hosts() == 4294967294);
     }
 
     SECTION("Maximum CIDR")
     {
         IPAnalyzer analyzer("192.168.0.1/32");
-        REQUIRE(analyzer.get_network().to_string() == "192.168.0.1");
-        REQUIRE(analyzer.get_broadcast().to_string() == "192.168.0.1");
+        REQUIRE(analyzer.get_network()->to_string() == "192.168.0.1");
+        REQUIRE(analyzer.get_broadcast()->to_string() == "192.168.0.1");
         REQUIRE(analyzer.get_num_hosts() == 1); // Changed from 0 to 1
 
         auto [first, last] = analyzer.get_host_range();
-        REQUIRE(first.to_string() == "192.168.0.1");
-        REQUIRE(last.to_string() == "192.168.0.1");
+        REQUIRE(first->to_string() == "192.168.0.1");
+        REQUIRE(last->to_string() == "192.168.0.1");
     }
 
     SECTION("Invalid CIDR values")
@@ -92,8 +92,210 @@ TEST_CASE("Edge cases for IPAnalyzer", "[ipanalyzer]")
 
     SECTION("Class A, B, C network boundaries")
     {
-        REQUIRE(IPAnalyzer("127.255.255.255/8").get_network().to_string() == "127.0.0.0");
-        REQUIRE(IPAnalyzer("128.0.0.0/16").get_network().to_string() == "128.0.0.0");
-        REQUIRE(IPAnalyzer("192.0.0.0/24").get_network().to_string() == "192.0.0.0");
+        REQUIRE(IPAnalyzer("127.255.255.255/8").get_network()->to_string() == "127.0.0.0");
+        REQUIRE(IPAnalyzer("128.0.0.0/16").get_network()->to_string() == "128.0.0.0");
+        REQUIRE(IPAnalyzer("192.0.0.0/24").get_network()->to_string() == "192.0.0.0");
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("parse_ipv4 without exceptions", "[ipv4address][parse]")
+{
+    SECTION("Valid addresses")
+    {
+        uint32_t value = 0;
+        const std::string_view text = "10.20.30.40";
+        const auto result = parse_ipv4(text, value);
+        REQUIRE(result);
+        REQUIRE(result.ptr == text.data() + text.size());
+        REQUIRE(value == 0x0A141E28);
+    }
+
+    SECTION("Parsing stops at the end of the address")
+    {
+        uint32_t value = 0;
+        const std::string_view text = "192.168.0.1/24";
+        const auto result = parse_ipv4(text, value);
+        REQUIRE(result);
+        REQUIRE(*result.ptr == '/');
+        REQUIRE(value == 0xC0A80001);
+    }
+
+    SECTION("Only the view is read")
+    {
+        const std::string_view buffer = "1.2.3.45";
+        REQUIRE(IPv4Address(buffer.substr(0, 7)).to_string() == "1.2.3.4");
+    }
+
+    SECTION("Errors")
+    {
+        uint32_t value = 0;
+        REQUIRE(parse_ipv4("", value).error == ParseError::kEmpty);
+        REQUIRE(parse_ipv4("256.0.0.1", value).error == ParseError::kOctetOutOfRange);
+        REQUIRE(parse_ipv4("1000.0.0.1", value).error == ParseError::kOctetOutOfRange);
+        REQUIRE(parse_ipv4("192.168.0", value).error == ParseError::kInvalidFormat);
+        REQUIRE(parse_ipv4("192.168..1", value).error == ParseError::kInvalidCharacter);
+        REQUIRE(parse_ipv4("abc.1.2.3", value).error == ParseError::kInvalidCharacter);
+        REQUIRE(parse_ipv4("-1.2.3.4", value).error == ParseError::kInvalidCharacter);
+    }
+}
+
+TEST_CASE("parse_ipv6 handles compression and IPv4 tails", "[ipv6address][parse]")
+{
+    using Bytes = std::array<uint8_t, 16>;
+
+    SECTION("Full and compressed notation")
+    {
+        REQUIRE(IPv6Address("2001:0db8:85a3:0000:0000:8a2e:0370:7334").to_string() == "2001:0db8:85a3:0000:0000:8a2e:0370:7334");
+        REQUIRE(IPv6Address("2001:db8:85a3::8a2e:370:7334").to_string() == "2001:0db8:85a3:0000:0000:8a2e:0370:7334");
+        REQUIRE(IPv6Address("::").to_bytes() == Bytes{});
+        REQUIRE(IPv6Address("::1").to_string() == "0000:0000:0000:0000:0000:0000:0000:0001");
+        REQUIRE(IPv6Address("fe80::").to_string() == "fe80:0000:0000:0000:0000:0000:0000:0000");
+        REQUIRE(IPv6Address("1:2:3:4:5:6:7::").to_string() == "0001:0002:0003:0004:0005:0006:0007:0000");
+        REQUIRE(IPv6Address("FE80::ABCD").to_string() == "fe80:0000:0000:0000:0000:0000:0000:abcd");
+    }
+
+    SECTION("Embedded IPv4")
+    {
+        REQUIRE(IPv6Address("::ffff:192.0.2.128").to_string() == "0000:0000:0000:0000:0000:ffff:c000:0280");
+        REQUIRE(IPv6Address("64:ff9b::1.2.3.4").to_string() == "0064:ff9b:0000:0000:0000:0000:0102:0304");
+        REQUIRE(IPv6Address("1:2:3:4:5:6:1.2.3.4").to_string() == "0001:0002:0003:0004:0005:0006:0102:0304");
+    }
+
+    SECTION("Parsing stops at the prefix length")
+    {
+        Bytes bytes{};
+        const std::string_view text = "2001:db8::/32";
+        const auto result = parse_ipv6(text, bytes);
+        REQUIRE(result);
+        REQUIRE(*result.ptr == '/');
+        REQUIRE(bytes[0] == 0x20);
+        REQUIRE(bytes[1] == 0x01);
+    }
+
+    SECTION("Errors")
+    {
+        Bytes bytes{};
+        REQUIRE(parse_ipv6("", bytes).error == ParseError::kEmpty);
+        REQUIRE(parse_ipv6(":1::", bytes).error == ParseError::kInvalidFormat);
+        REQUIRE(parse_ipv6("1::2::3", bytes).error == ParseError::kInvalidFormat);
+        REQUIRE(parse_ipv6("1:2:3:4:5:6:7", bytes).error == ParseError::kInvalidFormat);
+        REQUIRE(parse_ipv6("1:2:3:4:5:6:7:8:9", bytes).error == ParseError::kInvalidFormat);
+        REQUIRE(parse_ipv6("1:2:3:4:5:6:7:8::", bytes).error == ParseError::kInvalidFormat);
+        REQUIRE(parse_ipv6("1:", bytes).error == ParseError::kInvalidFormat);
+        REQUIRE(parse_ipv6("12345::", bytes).error == ParseError::kGroupOutOfRange);
+        REQUIRE(parse_ipv6("::ffff:300.1.1.1", bytes).error == ParseError::kOctetOutOfRange);
+        REQUIRE(parse_ipv6("1:2:3:4:5:6:7:1.2.3.4", bytes).error == ParseError::kInvalidFormat);
+        REQUIRE_THROWS_AS(IPv6Address("2001:db8::g"), std::invalid_argument);
+        REQUIRE_THROWS_AS(IPv6Address("::ffff:1.2.3.4:5"), std::invalid_argument);
+    }
+}
+
+TEST_CASE("IPAnalyzer value API", "[ipanalyzer][value]")
+{
+    SECTION("IPv4")
+    {
+        IPAnalyzer analyzer("192.168.17.42/20");
+        REQUIRE(analyzer.ip_value() == IPValue(IPv4Value{0xC0A8112A}));
+        REQUIRE(analyzer.network_value() == IPValue(IPv4Value{0xC0A81000}));
+        REQUIRE(analyzer.netmask_value() == IPValue(IPv4Value{0xFFFFF000}));
+        REQUIRE(analyzer.broadcast_value() == IPValue(IPv4Value{0xC0A81FFF}));
+
+        const auto [first, last] = analyzer.host_range_value();
+        REQUIRE(first.v4().value == 0xC0A81001);
+        REQUIRE(last.v4().value == 0xC0A81FFE);
+        REQUIRE(first.is_ipv4());
+    }
+
+    SECTION("IPv6")
+    {
+        IPAnalyzer analyzer("2001:db8::1234/64");
+        REQUIRE(analyzer.ip_value().is_ipv6());
+        REQUIRE(make_ip_address(analyzer.network_value())->to_string() == "2001:0db8:0000:0000:0000:0000:0000:0000");
+        REQUIRE(make_ip_address(analyzer.netmask_value())->to_string() == "ffff:ffff:ffff:ffff:0000:0000:0000:0000");
+        REQUIRE(make_ip_address(analyzer.broadcast_value())->to_string() == "2001:0db8:0000:0000:ffff:ffff:ffff:ffff");
+
+        const auto [first, last] = analyzer.host_range_value();
+        REQUIRE(make_ip_address(first)->to_string() == "2001:0db8:0000:0000:0000:0000:0000:0001");
+        REQUIRE(make_ip_address(last)->to_string() == "2001:0db8:0000:0000:ffff:ffff:ffff:fffe");
+    }
+
+    SECTION("Compatibility getters match the value API")
+    {
+        IPAnalyzer analyzer("fd00::1/127");
+        const auto [first, last] = analyzer.get_host_range();
+        REQUIRE(first->to_string() == "fd00:0000:0000:0000:0000:0000:0000:0000");
+        REQUIRE(last->to_string() == "fd00:0000:0000:0000:0000:0000:0000:0001");
+        REQUIRE(analyzer.get_ip()->is_ipv6());
+        REQUIRE(analyzer.is_private());
+    }
+
+    STATIC_REQUIRE(std::is_trivially_copyable_v<IPAnalyzer>);
+}
+
+TEST_CASE("IPv6 host counts are exact", "[ipanalyzer][value]")
+{
+    const auto count = [](std::string_view cidr)
+    {
+        const uint128 hosts = IPAnalyzer(cidr).get_num_hosts();
+        char text[kUint128DecimalLength];
+        return std::string(text, uint128_to_chars(text, text + sizeof(text), hosts).ptr);
+    };
+
+    REQUIRE(count("2001:db8::/128") == "1");
+    REQUIRE(count("2001:db8::/127") == "2");
+    REQUIRE(count("2001:db8::/120") == "254");
+    REQUIRE(count("2001:db8::/64") == "18446744073709551614");
+    REQUIRE(count("2001:db8::/48") == "1208925819614629174706174");
+    REQUIRE(count("::/0") == "340282366920938463463374607431768211454");
+    REQUIRE(count("10.0.0.0/8") == "16777214");
+    REQUIRE(host_count(48, 128) == IPAnalyzer("2001:db8::/48").get_num_hosts());
+    REQUIRE(host_count(0, 32) == 4294967294);
+
+    const IPAnalyzer analyzer("2001:db8:ffff:ffff::/33");
+    const auto [first, last] = analyzer.host_range_value();
+    REQUIRE(to_uint128(last.v6()) - to_uint128(first.v6()) + 1 == analyzer.get_num_hosts());
+    REQUIRE(make_ip_address(analyzer.network_value())->to_string() == "2001:0db8:8000:0000:0000:0000:0000:0000");
+}
+
+TEST_CASE("parse reports errors without throwing", "[ipanalyzer][parse]")
+{
+    SECTION("Valid input")
+    {
+        const auto v4 = IPAnalyzer::parse("192.168.1.7/24");
+        REQUIRE(v4.has_value());
+        REQUIRE(v4->get_cidr() == 24);
+        REQUIRE(v4->network_value() == IPValue(IPv4Value{0xC0A80100}));
+
+        const auto v6 = IPAnalyzer::parse("2001:db8::1");
+        REQUIRE(v6.has_value());
+        REQUIRE(v6->get_cidr() == 128);
+
+        REQUIRE(IPv4Address::parse("10.0.0.1")->to_uint32() == 0x0A000001);
+        REQUIRE(IPv6Address::parse("::1")->to_string() == "0000:0000:0000:0000:0000:0000:0000:0001");
+        REQUIRE(parse_address("::ffff:1.2.3.4")->is_ipv6());
+    }
+
+    SECTION("Error kinds")
+    {
+        REQUIRE(IPAnalyzer::parse("").error() == ParseError::kEmpty);
+        REQUIRE(IPAnalyzer::parse("/24").error() == ParseError::kEmpty);
+        REQUIRE(IPAnalyzer::parse("300.1.1.1/24").error() == ParseError::kOctetOutOfRange);
+        REQUIRE(IPAnalyzer::parse("1.2.3.x").error() == ParseError::kInvalidCharacter);
+        REQUIRE(IPAnalyzer::parse("1.2.3").error() == ParseError::kInvalidFormat);
+        REQUIRE(IPAnalyzer::parse("1.2.3.4/").error() == ParseError::kInvalidCidr);
+        REQUIRE(IPAnalyzer::parse("1.2.3.4/2x").error() == ParseError::kInvalidCidr);
+        REQUIRE(IPAnalyzer::parse("1.2.3.4/-1").error() == ParseError::kInvalidCidr);
+        REQUIRE(IPAnalyzer::parse("1.2.3.4/33").error() == ParseError::kCidrOutOfRange);
+        REQUIRE(IPAnalyzer::parse("::/129").error() == ParseError::kCidrOutOfRange);
+        REQUIRE(IPAnalyzer::make(IPValue(IPv4Value{0}), 33).error() == ParseError::kCidrOutOfRange);
+        REQUIRE(IPv4Address::parse("1.2.3.4 ").error() == ParseError::kInvalidFormat);
+        REQUIRE(IPv6Address::parse("2001:db8::g").error() != ParseError::kNone);
+    }
+
+    SECTION("Constructors throw the same message")
+    {
+        REQUIRE_THROWS_WITH(IPAnalyzer("1.2.3.4/33"), parse_error_message(ParseError::kCidrOutOfRange));
+        REQUIRE_THROWS_WITH(IPAnalyzer("1.2.3.4/x"), parse_error_message(ParseError::kInvalidCidr));
+        REQUIRE_THROWS_WITH(IPv4Address("256.0.0.1"), parse_error_message(ParseError::kOctetOutOfRange));
+    }
+}
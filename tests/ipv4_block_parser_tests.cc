@@ -0,0 +1,179 @@
+#include <catch2/catch_all.hpp>
+#include "cpu_features.hh"
+#include "ip_analyzer.hh"
+#include "ipv4_block_parser.hh"
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+    constexpr SimdLevel kLevels[] = {SimdLevel::kScalar, SimdLevel::kSse2, SimdLevel::kAvx2, SimdLevel::kAvx512,
+                                     SimdLevel::kNeon};
+
+    // One entry per prefix or rejected line, in input order.
+    std::vector<std::string> ParseBlock(std::string_view region, size_t chunk)
+    {
+        std::vector<std::string> entries;
+        IPv4BlockParser parser(region);
+        std::vector<uint32_t> addresses(chunk);
+        std::vector<uint8_t> cidrs(chunk);
+        while (!parser.done())
+        {
+            const auto [count, rejected] = parser.next(addresses, cidrs);
+            REQUIRE(count <= chunk);
+            for (size_t i = 0; i < count; ++i)
+            {
+                entries.push_back(std::to_string(addresses[i]) + "/" + std::to_string(cidrs[i]));
+            }
+            if (!rejected.empty())
+            {
+                entries.push_back("rejected " + std::string(rejected));
+            }
+        }
+        return entries;
+    }
+
+    std::vector<std::string> ParseLines(std::string_view region)
+    {
+        std::vector<std::string> entries;
+        while (!region.empty())
+        {
+            const auto newline = region.find('\n');
+            std::string_view line = region.substr(0, newline);
+            region.remove_prefix(newline == std::string_view::npos ? region.size() : newline + 1);
+
+            const auto first = line.find_first_not_of(" \t\r");
+            if (first == std::string_view::npos)
+            {
+                continue;
+            }
+            line = line.substr(first, line.find_last_not_of(" \t\r") - first + 1);
+            const auto prefix = IPAnalyzer::parse(line);
+            if (prefix && prefix->ip_value().is_ipv4())
+            {
+                entries.push_back(std::to_string(prefix->ip_value().v4().value) + "/" + std::to_string(prefix->get_cidr()));
+            }
+            else
+            {
+                entries.push_back("rejected " + std::string(line));
+            }
+        }
+        return entries;
+    }
+
+    std::string RandomLine(std::mt19937 &rng)
+    {
+        const auto octet = [&rng]
+        {
+            switch (rng() % 8)
+            {
+            case 0:
+                return std::to_string(rng() % 10);
+            case 1:
+                return std::to_string(250 + rng() % 10);
+            case 2:
+                return "0" + std::to_string(rng() % 100);
+            default:
+                return std::to_string(rng() % 256);
+            }
+        };
+        std::string line = octet() + "." + octet() + "." + octet() + "." + octet();
+        switch (rng() % 12)
+        {
+        case 0:
+            line += "/" + std::to_string(rng() % 40);
+            break;
+        case 1:
+            line = " " + line + "\t";
+            break;
+        case 2:
+            line += "\r";
+            break;
+        case 3:
+            line = "2001:db8::" + std::to_string(rng() % 100) + "/64";
+            break;
+        case 4:
+            line.insert(rng() % line.size(), 1, "./x:0 "[rng() % 6]);
+            break;
+        case 5:
+            line.erase(rng() % line.size(), 1);
+            break;
+        case 6:
+            line = rng() % 2 ? "" : "  ";
+            break;
+        case 7:
+            line += "/0" + std::to_string(rng() % 40);
+            break;
+        default:
+            line += "/" + std::to_string(rng() % 33);
+            break;
+        }
+        return line;
+    }
+
+}
+
+TEST_CASE("IPv4BlockParser parses IPv4 prefixes", "[ipv4blockparser]")
+{
+    REQUIRE(ParseBlock("", 8).empty());
+    REQUIRE(ParseBlock("\n\n  \r\n", 8).empty());
+    REQUIRE(ParseBlock("10.0.0.1/8\n192.168.178.10\n", 8) == std::vector<std::string>{"167772161/8", "3232281098/32"});
+    REQUIRE(ParseBlock("10.0.0.1/8", 8) == std::vector<std::string>{"167772161/8"});
+    REQUIRE(ParseBlock("1.2.3.4\r\n255.255.255.255/32\r\n", 8) == std::vector<std::string>{"16909060/32", "4294967295/32"});
+    REQUIRE(ParseBlock("001.002.003.004/024\n", 8) == std::vector<std::string>{"16909060/24"});
+    REQUIRE(ParseBlock("1.2.3.4\n::1\n256.0.0.1\n5.6.7.8/33\n", 8) ==
+            std::vector<std::string>{"16909060/32", "rejected ::1", "rejected 256.0.0.1", "rejected 5.6.7.8/33"});
+}
+
+TEST_CASE("IPv4BlockParser handles every octet length", "[ipv4blockparser]")
+{
+    const char *const kOctets[] = {"7", "42", "199"};
+    std::string region;
+    for (int index = 0; index < 81; ++index)
+    {
+        region += std::string(kOctets[index / 27 % 3]) + "." + kOctets[index / 9 % 3] + "." + kOctets[index / 3 % 3] + "." +
+                  kOctets[index % 3] + "/" + std::to_string(index % 33) + "\n";
+    }
+
+    const SimdLevel active = simd_level();
+    for (const SimdLevel level : kLevels)
+    {
+        if (simd_level_supported(level))
+        {
+            INFO(simd_level_name(level));
+            set_simd_level(level);
+            REQUIRE(ParseBlock(region, 100) == ParseLines(region));
+        }
+    }
+    set_simd_level(active);
+}
+
+TEST_CASE("IPv4BlockParser agrees with IPAnalyzer::parse", "[ipv4blockparser]")
+{
+    std::mt19937 rng(26);
+    std::string region;
+    for (int i = 0; i < 5000; ++i)
+    {
+        region += RandomLine(rng);
+        region += '\n';
+    }
+    region += RandomLine(rng);
+
+    const auto expected = ParseLines(region);
+    const SimdLevel active = simd_level();
+    for (const SimdLevel level : kLevels)
+    {
+        if (simd_level_supported(level))
+        {
+            INFO(simd_level_name(level));
+            set_simd_level(level);
+            for (const size_t chunk : {1, 7, 4096})
+            {
+                REQUIRE(ParseBlock(region, chunk) == expected);
+            }
+        }
+    }
+    set_simd_level(active);
+}
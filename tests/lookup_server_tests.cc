@@ -0,0 +1,325 @@
+#include <catch2/catch_all.hpp>
+#include "address_class.hh"
+#include "lookup_server.hh"
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+
+    using namespace lookup_protocol;
+
+    void Append32(std::string &out, uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            out.push_back(static_cast<char>(value >> (8 * i)));
+        }
+    }
+
+    uint32_t Read32(std::string_view data, size_t offset)
+    {
+        uint32_t value = 0;
+        for (size_t i = 0; i < 4; ++i)
+        {
+            value |= static_cast<uint32_t>(static_cast<uint8_t>(data[offset + i])) << (8 * i);
+        }
+        return value;
+    }
+
+    uint64_t Read64(std::string_view data, size_t offset)
+    {
+        return Read32(data, offset) | static_cast<uint64_t>(Read32(data, offset + 4)) << 32;
+    }
+
+    std::string Bytes(const IPValue &address)
+    {
+        const auto bytes = address.v6().bytes;
+        return address.is_ipv4() ? std::string(reinterpret_cast<const char *>(bytes.data()), 4)
+                                 : std::string(reinterpret_cast<const char *>(bytes.data()), 16);
+    }
+
+    int ConnectUnix(const std::string &path)
+    {
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strcpy(address.sun_path, path.c_str());
+        if (::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    std::string Request(Op op, const std::vector<IPValue> &addresses)
+    {
+        std::string payload;
+        payload.push_back(static_cast<char>(op));
+        payload.push_back(addresses.empty() || addresses[0].is_ipv4() ? 4 : 6);
+        payload.append(2, '\0');
+        Append32(payload, static_cast<uint32_t>(addresses.size()));
+        for (const IPValue &address : addresses)
+        {
+            const auto bytes = address.v6().bytes;
+            payload.append(reinterpret_cast<const char *>(bytes.data()), address.is_ipv4() ? 4 : 16);
+        }
+        std::string frame;
+        Append32(frame, static_cast<uint32_t>(payload.size()));
+        return frame + payload;
+    }
+
+    std::string Answer(const PrefixTable &table, const std::string &frame)
+    {
+        std::vector<char> out;
+        answer(table, std::string_view(frame).substr(kLengthSize), out);
+        return std::string(out.data(), out.size());
+    }
+
+    IPValue Address(std::string_view text)
+    {
+        return IPAnalyzer(text).ip_value();
+    }
+
+    const PrefixTable &Table()
+    {
+        static const std::vector<IPAnalyzer> prefixes = {
+            IPAnalyzer("10.0.0.0/8"),
+            IPAnalyzer("10.1.0.0/16"),
+            IPAnalyzer("2001:db8::/32"),
+        };
+        static const PrefixTable table(prefixes);
+        return table;
+    }
+
+}
+
+TEST_CASE("Lookup requests return prefix indices and lengths", "[server]")
+{
+    const std::string response = Answer(Table(), Request(Op::kLookup, {Address("10.1.2.3"), Address("10.2.0.1"), Address("8.8.8.8")}));
+
+    REQUIRE(response.size() == kLengthSize + kResponseHeaderSize + 3 * kLookupItemSize);
+    REQUIRE(Read32(response, 0) == response.size() - kLengthSize);
+    REQUIRE(response[4] == static_cast<char>(Status::kOk));
+    REQUIRE(Read32(response, 8) == 3);
+    REQUIRE(Read32(response, 12) == 1);
+    REQUIRE(Read32(response, 16) == 16);
+    REQUIRE(Read32(response, 20) == 0);
+    REQUIRE(Read32(response, 24) == 8);
+    REQUIRE(Read32(response, 28) == PrefixTable::kNoMatch);
+    REQUIRE(Read32(response, 32) == 0);
+
+    const std::string v6 = Answer(Table(), Request(Op::kLookup, {Address("2001:db8::1")}));
+    REQUIRE(Read32(v6, 12) == 2);
+    REQUIRE(Read32(v6, 16) == 32);
+}
+
+TEST_CASE("Classify requests return class masks", "[server]")
+{
+    std::vector<IPValue> addresses;
+    for (int i = 0; i < 20; ++i)
+    {
+        addresses.push_back(Address(i % 2 == 0 ? "192.168.1.1" : "8.8.8.8"));
+    }
+    const std::string response = Answer(Table(), Request(Op::kClassify, addresses));
+
+    REQUIRE(Read32(response, 8) == addresses.size());
+    for (size_t i = 0; i < addresses.size(); ++i)
+    {
+        REQUIRE(Read32(response, 12 + 4 * i) == classify(addresses[i]));
+    }
+}
+
+TEST_CASE("Analyze requests return the matching prefix ranges", "[server]")
+{
+    const std::string response = Answer(Table(), Request(Op::kAnalyze, {Address("10.1.2.3"), Address("8.8.8.8")}));
+    REQUIRE(response.size() == kLengthSize + kResponseHeaderSize + 2 * kAnalyzeItemSizeV4);
+    REQUIRE(response[4] == static_cast<char>(Status::kOk));
+    REQUIRE(Read32(response, 8) == 2);
+
+    const std::string_view matched = std::string_view(response).substr(12, kAnalyzeItemSizeV4);
+    REQUIRE(Read32(matched, 0) == 1);
+    REQUIRE(Read32(matched, 4) == 16);
+    REQUIRE(matched.substr(8, 4) == Bytes(Address("10.1.0.0")));
+    REQUIRE(matched.substr(12, 4) == Bytes(Address("10.1.0.1")));
+    REQUIRE(matched.substr(16, 4) == Bytes(Address("10.1.255.254")));
+    REQUIRE(Read64(matched, 20) == 65534);
+    REQUIRE(Read64(matched, 28) == 0);
+    REQUIRE(Read32(matched, 36) == classify(Address("10.1.2.3")));
+
+    const std::string_view unmatched = std::string_view(response).substr(12 + kAnalyzeItemSizeV4);
+    REQUIRE(Read32(unmatched, 0) == PrefixTable::kNoMatch);
+    REQUIRE(unmatched.substr(4, 32) == std::string(32, '\0'));
+    REQUIRE(Read32(unmatched, 36) == classify(Address("8.8.8.8")));
+
+    // Host counts are exact u128 values, low word first.
+    const PrefixTable sites(std::vector<IPAnalyzer>{IPAnalyzer("2001:db8:1::/48")});
+    const std::string v6 = Answer(sites, Request(Op::kAnalyze, {Address("2001:db8:1::1")}));
+    REQUIRE(v6.size() == kLengthSize + kResponseHeaderSize + kAnalyzeItemSizeV6);
+    const std::string_view item = std::string_view(v6).substr(12);
+    const auto [first, last] = IPAnalyzer("2001:db8:1::/48").host_range_value();
+    REQUIRE(Read32(item, 0) == 0);
+    REQUIRE(Read32(item, 4) == 48);
+    REQUIRE(item.substr(8, 16) == Bytes(Address("2001:db8:1::")));
+    REQUIRE(item.substr(24, 16) == Bytes(first));
+    REQUIRE(item.substr(40, 16) == Bytes(last));
+    // 2^80 - 2 = 1208925819614629174706174
+    REQUIRE(Read64(item, 56) == UINT64_MAX - 1);
+    REQUIRE(Read64(item, 64) == 0xFFFF);
+    REQUIRE(Read32(item, 72) == classify(Address("2001:db8:1::1")));
+}
+
+TEST_CASE("Malformed requests get an error status", "[server]")
+{
+    std::string truncated = Request(Op::kLookup, {Address("10.0.0.1")});
+    truncated.pop_back();
+    const std::string bad = Answer(Table(), truncated);
+    REQUIRE(bad.size() == kLengthSize + kResponseHeaderSize);
+    REQUIRE(bad[4] == static_cast<char>(Status::kBadRequest));
+    REQUIRE(Read32(bad, 8) == 0);
+
+    std::string unknown = Request(Op::kLookup, {});
+    unknown[4] = 9;
+    REQUIRE(Answer(Table(), unknown)[4] == static_cast<char>(Status::kUnsupported));
+}
+
+TEST_CASE("LookupServer answers pipelined frames over a Unix socket", "[server]")
+{
+    const std::string path = "lookup_server_tests.sock";
+    LookupServer server(Table(), "unix:" + path);
+    std::thread loop([&] { server.run(); });
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path.c_str());
+    REQUIRE(::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0);
+
+    std::vector<IPValue> batch(1000, Address("10.1.2.3"));
+    const std::string first = Request(Op::kLookup, batch);
+    const std::string second = Request(Op::kClassify, {Address("127.0.0.1")});
+    const std::string requests = first + second;
+    REQUIRE(::send(fd, requests.data(), requests.size(), 0) == static_cast<ssize_t>(requests.size()));
+    ::shutdown(fd, SHUT_WR);
+
+    std::string received;
+    char buffer[4096];
+    for (ssize_t n; (n = ::read(fd, buffer, sizeof(buffer))) > 0;)
+    {
+        received.append(buffer, static_cast<size_t>(n));
+    }
+    ::close(fd);
+    server.stop();
+    loop.join();
+
+    REQUIRE(received == Answer(Table(), first) + Answer(Table(), second));
+
+    const LookupServerMetrics &metrics = server.metrics();
+    REQUIRE(metrics.connections == 1);
+    REQUIRE(metrics.open_connections == 0);
+    REQUIRE(metrics.requests[static_cast<size_t>(Status::kOk)] == 2);
+    REQUIRE(metrics.addresses == 1001);
+    REQUIRE(metrics.bytes_received == requests.size());
+    REQUIRE(metrics.bytes_sent == received.size());
+    REQUIRE(metrics.answer_time.count() == 2);
+}
+
+TEST_CASE("LookupServer serves Prometheus metrics over HTTP", "[server]")
+{
+    LookupServer server(Table(), "unix:lookup_server_metrics_tests.sock", "127.0.0.1:0");
+    REQUIRE(server.metrics_port() != 0);
+    std::thread loop([&] { server.run(); });
+
+    const auto get = [&](const std::string &path)
+    {
+        const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(server.metrics_port());
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        REQUIRE(::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0);
+        const std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        REQUIRE(::send(fd, request.data(), request.size(), 0) == static_cast<ssize_t>(request.size()));
+
+        std::string response;
+        char buffer[4096];
+        for (ssize_t n; (n = ::read(fd, buffer, sizeof(buffer))) > 0;)
+        {
+            response.append(buffer, static_cast<size_t>(n));
+        }
+        ::close(fd);
+        return response;
+    };
+
+    const std::string metrics = get("/metrics");
+    const std::string missing = get("/");
+    server.stop();
+    loop.join();
+
+    REQUIRE(metrics.starts_with("HTTP/1.1 200 OK\r\n"));
+    REQUIRE(metrics.find("\r\n\r\n# HELP ip_analyzer_connections_total ") != std::string::npos);
+    REQUIRE(metrics.find("ip_analyzer_requests_total{status=\"ok\"} 0\n") != std::string::npos);
+    REQUIRE(metrics.find("ip_analyzer_request_duration_seconds_count 0\n") != std::string::npos);
+    REQUIRE(metrics.ends_with("ip_analyzer_index_prefixes 3\n"));
+    REQUIRE(missing.starts_with("HTTP/1.1 404 Not Found\r\n"));
+}
+
+TEST_CASE("LookupServer drops connections it has no descriptor for", "[server]")
+{
+    const std::string path = "lookup_server_emfile_tests.sock";
+    LookupServer server(Table(), "unix:" + path);
+    std::thread loop([&] { server.run(); });
+
+    // With the limit at the lowest free descriptor the server cannot accept
+    // the connection made afterwards.
+    const int rejected = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    const int lowest = ::dup(0);
+    ::close(lowest);
+    rlimit limit;
+    REQUIRE(::getrlimit(RLIMIT_NOFILE, &limit) == 0);
+    const rlimit lowered = {static_cast<rlim_t>(lowest), limit.rlim_max};
+    REQUIRE(::setrlimit(RLIMIT_NOFILE, &lowered) == 0);
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path.c_str());
+    const bool connected = ::connect(rejected, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0;
+    pollfd closed = {rejected, POLLIN, 0};
+    const int ready = ::poll(&closed, 1, 5000);
+    char byte;
+    const ssize_t read = ::recv(rejected, &byte, 1, MSG_DONTWAIT);
+    REQUIRE(::setrlimit(RLIMIT_NOFILE, &limit) == 0);
+    ::close(rejected);
+    REQUIRE(connected);
+    REQUIRE(ready == 1);
+    REQUIRE(read == 0);
+
+    // The server keeps answering once descriptors are available again.
+    const int fd = ConnectUnix(path);
+    REQUIRE(fd >= 0);
+    const std::string request = Request(Op::kClassify, {Address("127.0.0.1")});
+    REQUIRE(::send(fd, request.data(), request.size(), 0) == static_cast<ssize_t>(request.size()));
+    ::shutdown(fd, SHUT_WR);
+    std::string received;
+    char buffer[256];
+    for (ssize_t n; (n = ::read(fd, buffer, sizeof(buffer))) > 0;)
+    {
+        received.append(buffer, static_cast<size_t>(n));
+    }
+    ::close(fd);
+    server.stop();
+    loop.join();
+
+    REQUIRE(received == Answer(Table(), request));
+    REQUIRE(server.metrics().connections == 1);
+}
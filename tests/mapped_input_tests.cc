@@ -0,0 +1,87 @@
+#include <catch2/catch_all.hpp>
+#include "mapped_input.hh"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <unistd.h>
+
+namespace
+{
+
+    std::vector<std::string> ScanAll(std::string_view region)
+    {
+        std::vector<std::string> lines;
+        LineScanner scanner(region);
+        std::string_view line;
+        while (scanner.next(line))
+        {
+            lines.emplace_back(line);
+        }
+        return lines;
+    }
+
+}
+
+TEST_CASE("LineScanner splits regions into lines", "[mappedinput]")
+{
+    REQUIRE(ScanAll("").empty());
+    REQUIRE(ScanAll("\n") == std::vector<std::string>{""});
+    REQUIRE(ScanAll("a\nb") == std::vector<std::string>{"a", "b"});
+    REQUIRE(ScanAll("a\nb\n") == std::vector<std::string>{"a", "b"});
+    REQUIRE(ScanAll("a\n\nb\r\n") == std::vector<std::string>{"a", "", "b\r"});
+
+    SECTION("Lines crossing 64 byte blocks")
+    {
+        std::string region;
+        std::vector<std::string> expected;
+        for (int i = 0; i < 300; ++i)
+        {
+            expected.push_back(std::string(static_cast<size_t>(i % 97), 'x'));
+            region += expected.back() + "\n";
+        }
+        expected.push_back("tail");
+        region += "tail";
+        REQUIRE(ScanAll(region) == expected);
+    }
+}
+
+TEST_CASE("trim_line strips surrounding whitespace", "[mappedinput]")
+{
+    REQUIRE(trim_line("").empty());
+    REQUIRE(trim_line(" \t\r\n").empty());
+    REQUIRE(trim_line("10.0.0.1/8\r") == "10.0.0.1/8");
+    REQUIRE(trim_line("\t 10.0.0.1 /8  ") == "10.0.0.1 /8");
+}
+
+TEST_CASE("MappedFile maps regular files", "[mappedinput]")
+{
+    char path[] = "/tmp/ip_analyzer_mapped_XXXXXX";
+    const int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    const std::string contents = "10.0.0.0/8\n192.168.0.0/16\n";
+    REQUIRE(write(fd, contents.data(), contents.size()) == static_cast<ssize_t>(contents.size()));
+
+    {
+        const MappedFile by_path{std::string(path)};
+        REQUIRE(by_path.view() == contents);
+
+        MappedFile by_fd(fd);
+        MappedFile moved(std::move(by_fd));
+        REQUIRE(moved.view() == contents);
+        REQUIRE(by_fd.view().empty());
+        REQUIRE(MappedFile::can_map(fd));
+    }
+
+    close(fd);
+    unlink(path);
+
+    REQUIRE_THROWS_AS(MappedFile(std::string("/nonexistent/ip-analyzer-input")), std::system_error);
+
+    int pipe_fds[2];
+    REQUIRE(pipe(pipe_fds) == 0);
+    REQUIRE_FALSE(MappedFile::can_map(pipe_fds[0]));
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+}
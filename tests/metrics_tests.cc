@@ -0,0 +1,62 @@
+#include <catch2/catch_all.hpp>
+#include "metrics.hh"
+#include <string>
+
+TEST_CASE("LatencyHistogram buckets by powers of two", "[metrics]")
+{
+    LatencyHistogram histogram;
+    REQUIRE(histogram.quantile(0.5) == 0);
+
+    histogram.record(0);
+    histogram.record(100);
+    histogram.record(127);
+    histogram.record(128);
+    histogram.record(UINT64_MAX);
+    REQUIRE(histogram.count() == 5);
+    REQUIRE(histogram.bucket(0) == 1);
+    REQUIRE(histogram.bucket(7) == 2);
+    REQUIRE(histogram.bucket(8) == 1);
+    REQUIRE(histogram.bucket(LatencyHistogram::kBucketCount - 1) == 1);
+
+    REQUIRE(histogram.quantile(0.0) == 1);
+    REQUIRE(histogram.quantile(0.5) == 128);
+    REQUIRE(histogram.quantile(0.75) == 256);
+    REQUIRE(histogram.quantile(1.0) == LatencyHistogram::bucket_bound(LatencyHistogram::kBucketCount - 1));
+}
+
+TEST_CASE("LatencyHistogram merges by addition", "[metrics]")
+{
+    LatencyHistogram a;
+    LatencyHistogram b;
+    a.record(10);
+    b.record(10);
+    b.record(1000);
+    a += b;
+    REQUIRE(a.count() == 3);
+    REQUIRE(a.sum() == 1020);
+    REQUIRE(a.bucket(4) == 2);
+    REQUIRE(a.bucket(10) == 1);
+}
+
+TEST_CASE("PrometheusText renders the exposition format", "[metrics]")
+{
+    fmt::memory_buffer out;
+    PrometheusText text(out);
+    text.family("lines_total", "counter", "Lines read.");
+    text.sample("lines_total", 42);
+    text.sample("lines_total", 7, "kind=\"" + PrometheusText::label_value("a \"b\"\\") + "\"");
+
+    LatencyHistogram histogram;
+    histogram.record(3);
+    histogram.record(1500);
+    text.histogram("latency_seconds", "Latency.", histogram);
+
+    const std::string result = fmt::to_string(out);
+    REQUIRE(result.starts_with("# HELP lines_total Lines read.\n# TYPE lines_total counter\nlines_total 42\n"
+                               "lines_total{kind=\"a \\\"b\\\"\\\\\"} 7\n"
+                               "# HELP latency_seconds Latency.\n# TYPE latency_seconds histogram\n"));
+    REQUIRE(result.find("latency_seconds_bucket{le=\"4e-09\"} 1\n") != std::string::npos);
+    REQUIRE(result.find("latency_seconds_bucket{le=\"1.024e-06\"} 1\n") != std::string::npos);
+    REQUIRE(result.find("latency_seconds_bucket{le=\"2.048e-06\"} 2\n") != std::string::npos);
+    REQUIRE(result.ends_with("latency_seconds_bucket{le=\"+Inf\"} 2\nlatency_seconds_sum 1.503e-06\nlatency_seconds_count 2\n"));
+}
@@ -0,0 +1,101 @@
+#include <catch2/catch_all.hpp>
+#include "address_format.hh"
+#include "prefix_aggregator.hh"
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+    std::vector<std::string> Aggregate(const std::vector<std::string> &input)
+    {
+        std::vector<IPAnalyzer> prefixes;
+        for (const auto &text : input)
+        {
+            prefixes.emplace_back(text);
+        }
+
+        std::vector<std::string> result;
+        for (const IPAnalyzer &prefix : aggregate_prefixes(prefixes))
+        {
+            fmt::memory_buffer buffer;
+            format_address(buffer, prefix.ip_value());
+            result.push_back(fmt::to_string(buffer) + "/" + std::to_string(prefix.get_cidr()));
+        }
+        return result;
+    }
+
+}
+
+TEST_CASE("aggregate_prefixes merges IPv4 prefixes", "[aggregate]")
+{
+    using Strings = std::vector<std::string>;
+
+    REQUIRE(Aggregate({}).empty());
+    REQUIRE(Aggregate({"10.0.0.5/24"}) == Strings{"10.0.0.0/24"});
+    REQUIRE(Aggregate({"10.0.1.0/24", "10.0.0.0/24"}) == Strings{"10.0.0.0/23"});
+    REQUIRE(Aggregate({"10.0.0.0/8", "10.1.2.0/24", "10.255.0.0/16"}) == Strings{"10.0.0.0/8"});
+    REQUIRE(Aggregate({"10.0.1.0/24", "10.0.2.0/24"}) == Strings{"10.0.1.0/24", "10.0.2.0/24"});
+    REQUIRE(Aggregate({"10.0.1.0/24", "10.0.2.0/23"}) == Strings{"10.0.1.0/24", "10.0.2.0/23"});
+    REQUIRE(Aggregate({"192.168.0.0/24", "192.168.1.0/24", "192.168.2.0/24"}) ==
+            Strings{"192.168.0.0/23", "192.168.2.0/24"});
+    REQUIRE(Aggregate({"0.0.0.0/1", "128.0.0.0/1"}) == Strings{"0.0.0.0/0"});
+    REQUIRE(Aggregate({"255.255.255.255/32", "255.255.255.254/32"}) == Strings{"255.255.255.254/31"});
+    REQUIRE(Aggregate({"0.0.0.0/0", "1.2.3.4/32"}) == Strings{"0.0.0.0/0"});
+}
+
+TEST_CASE("aggregate_prefixes merges IPv6 prefixes", "[aggregate]")
+{
+    using Strings = std::vector<std::string>;
+
+    REQUIRE(Aggregate({"2001:db8::/33", "2001:db8:8000::/33"}) == Strings{"2001:db8::/32"});
+    REQUIRE(Aggregate({"2001:db8::1/128", "2001:db8::/127"}) == Strings{"2001:db8::/127"});
+    REQUIRE(Aggregate({"::/1", "8000::/1"}) == Strings{"::/0"});
+    REQUIRE(Aggregate({"ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff/128", "ffff:ffff:ffff:ffff:ffff:ffff:ffff:fffe/128"}) ==
+            Strings{"ffff:ffff:ffff:ffff:ffff:ffff:ffff:fffe/127"});
+    REQUIRE(Aggregate({"2001:db8:0:1::/64", "2001:db8:0:2::/63", "2001:db8::/64"}) == Strings{"2001:db8::/62"});
+    REQUIRE(Aggregate({"2001:db8::/64", "10.0.0.0/8"}) == Strings{"10.0.0.0/8", "2001:db8::/64"});
+}
+
+TEST_CASE("aggregate_prefixes output is minimal and covers the input", "[aggregate]")
+{
+    std::mt19937 rng(7);
+    std::vector<IPAnalyzer> prefixes;
+    std::vector<bool> covered(1 << 16);
+    for (int i = 0; i < 400; ++i)
+    {
+        const auto host = static_cast<uint32_t>(rng() & 0xFFFF);
+        const auto cidr = static_cast<uint8_t>(20 + rng() % 13);
+        prefixes.emplace_back(IPValue(IPv4Value{0x0A000000 | host}), cidr);
+        const IPAnalyzer &prefix = prefixes.back();
+        const uint32_t first = prefix.network_value().v4().value & 0xFFFF;
+        const uint32_t size = uint32_t{1} << (32 - cidr);
+        for (uint32_t j = 0; j < size; ++j)
+        {
+            covered[first + j] = true;
+        }
+    }
+
+    const auto result = aggregate_prefixes(prefixes);
+    std::vector<bool> produced(1 << 16);
+    for (size_t i = 0; i < result.size(); ++i)
+    {
+        const IPAnalyzer &prefix = result[i];
+        const uint32_t first = prefix.network_value().v4().value;
+        const uint32_t last = prefix.broadcast_value().v4().value;
+        if (i > 0)
+        {
+            const IPAnalyzer &previous = result[i - 1];
+            REQUIRE(previous.broadcast_value().v4().value < first);
+            const bool siblings = previous.get_cidr() == prefix.get_cidr() &&
+                                  (previous.network_value().v4().value ^ first) == (last - first + 1);
+            REQUIRE_FALSE(siblings);
+        }
+        for (uint32_t address = first; address <= last; ++address)
+        {
+            produced[address & 0xFFFF] = true;
+        }
+    }
+    REQUIRE(produced == covered);
+}
@@ -0,0 +1,171 @@
+#include <catch2/catch_all.hpp>
+#include "address_class.hh"
+#include "prefix_aggregator.hh"
+#include "prefix_column.hh"
+#include "prefix_set.hh"
+#include "prefix_table.hh"
+#include "range_kernels.hh"
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+
+    // Mostly IPv4 with IPv6 runs, so that family ranks cross bitmap words.
+    std::vector<IPAnalyzer> MixedPrefixes(size_t count)
+    {
+        std::mt19937 rng(3);
+        std::vector<IPAnalyzer> prefixes;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (i % 7 < 2)
+            {
+                IPv6Value address{};
+                address.bytes[0] = 0x20;
+                address.bytes[1] = 0x01;
+                for (size_t byte = 2; byte < 16; ++byte)
+                {
+                    address.bytes[byte] = static_cast<uint8_t>(rng());
+                }
+                prefixes.emplace_back(IPValue(address), static_cast<uint8_t>(16 + rng() % 113));
+            }
+            else
+            {
+                prefixes.emplace_back(IPValue(IPv4Value{static_cast<uint32_t>(rng())}), static_cast<uint8_t>(8 + rng() % 25));
+            }
+        }
+        return prefixes;
+    }
+
+}
+
+TEST_CASE("PrefixColumn keeps entries in order across families", "[prefixcolumn]")
+{
+    const auto prefixes = MixedPrefixes(1000);
+    const PrefixColumn column(prefixes);
+
+    REQUIRE(column.size() == prefixes.size());
+    REQUIRE(column.v4_addresses().size() + column.v6_addresses().size() == prefixes.size());
+    REQUIRE(column.v4_cidrs().size() == column.v4_addresses().size());
+    size_t v4 = 0;
+    size_t v6 = 0;
+    for (size_t i = 0; i < prefixes.size(); ++i)
+    {
+        const IPAnalyzer prefix = column[i];
+        REQUIRE(prefix.ip_value() == prefixes[i].ip_value());
+        REQUIRE(prefix.get_cidr() == prefixes[i].get_cidr());
+        REQUIRE(column.is_ipv4(i) == prefixes[i].ip_value().is_ipv4());
+        REQUIRE(column.family_index(i) == (column.is_ipv4(i) ? v4++ : v6++));
+    }
+    REQUIRE_THROWS_AS(column[prefixes.size()], std::out_of_range);
+}
+
+TEST_CASE("PrefixColumn validates prefix lengths", "[prefixcolumn]")
+{
+    PrefixColumn column;
+    REQUIRE_THROWS_AS(column.push_back(IPv4Value{0}, 33), std::invalid_argument);
+    REQUIRE_THROWS_AS(column.push_back(IPv6Value{}, 129), std::invalid_argument);
+    column.push_back(IPv4Value{0x0A000001}, 32);
+    column.push_back(IPv6Value{}, 128);
+    REQUIRE(column.size() == 2);
+    column.clear();
+    REQUIRE(column.empty());
+}
+
+TEST_CASE("PrefixColumn is much smaller than a list of IPAnalyzer", "[prefixcolumn]")
+{
+    PrefixColumn column;
+    for (uint32_t i = 0; i < 100000; ++i)
+    {
+        column.push_back(IPv4Value{i << 8}, 24);
+    }
+    column.shrink_to_fit();
+    REQUIRE(column.memory_usage() < 100000 * 6);
+    REQUIRE(column.memory_usage() * 3 < 100000 * sizeof(IPAnalyzer));
+}
+
+TEST_CASE("Bulk operations accept a PrefixColumn", "[prefixcolumn]")
+{
+    const auto prefixes = MixedPrefixes(5000);
+    const PrefixColumn column(prefixes);
+
+    SECTION("PrefixTable")
+    {
+        const PrefixTable from_list(prefixes);
+        const PrefixTable from_column(column);
+        REQUIRE(from_column.source_checksum() == from_list.source_checksum());
+        REQUIRE(from_column.source_checksum() == PrefixTable::source_checksum(prefixes));
+        std::mt19937 rng(9);
+        for (int i = 0; i < 10000; ++i)
+        {
+            const IPv4Value address{static_cast<uint32_t>(rng())};
+            REQUIRE(from_column.lookup(address) == from_list.lookup(address));
+        }
+        for (const IPAnalyzer &prefix : prefixes)
+        {
+            REQUIRE(from_column.lookup(prefix.ip_value()) == from_list.lookup(prefix.ip_value()));
+        }
+    }
+
+    SECTION("PrefixSet and aggregation")
+    {
+        REQUIRE(PrefixSet(column) == PrefixSet(prefixes));
+        const auto from_column = aggregate_prefixes(column);
+        const auto from_list = aggregate_prefixes(prefixes);
+        REQUIRE(from_column.size() == from_list.size());
+        for (size_t i = 0; i < from_list.size(); ++i)
+        {
+            REQUIRE(from_column[i].ip_value() == from_list[i].ip_value());
+            REQUIRE(from_column[i].get_cidr() == from_list[i].get_cidr());
+        }
+    }
+
+    SECTION("Range and classification kernels")
+    {
+        const size_t n = column.v4_addresses().size();
+        std::vector<uint32_t> network(n), broadcast(n), first(n), last(n);
+        compute_ranges_v4(column.v4_addresses(), column.v4_cidrs(), {network, broadcast, first, last});
+        std::vector<AddressClassMask> classes(n);
+        classify_batch(column.v4_addresses(), classes);
+        for (size_t i = 0, v4 = 0; i < column.size(); ++i)
+        {
+            if (column.is_ipv4(i))
+            {
+                REQUIRE(network[v4] == prefixes[i].network_value().v4().value);
+                REQUIRE(classes[v4] == classify(prefixes[i].ip_value()));
+                ++v4;
+            }
+        }
+    }
+}
+
+TEST_CASE("PrefixColumn appends IPv4 columns in bulk", "[prefixcolumn]")
+{
+    PrefixColumn column;
+    column.push_back(IPAnalyzer("2001:db8::/32"));
+    std::vector<uint32_t> addresses(100);
+    std::vector<uint8_t> cidrs(100);
+    for (size_t i = 0; i < addresses.size(); ++i)
+    {
+        addresses[i] = static_cast<uint32_t>(0x0A000000 + i);
+        cidrs[i] = static_cast<uint8_t>(i % 33);
+    }
+    column.append_v4(addresses, cidrs);
+    column.push_back(IPAnalyzer("::1/128"));
+
+    PrefixColumn expected;
+    expected.push_back(IPAnalyzer("2001:db8::/32"));
+    for (size_t i = 0; i < addresses.size(); ++i)
+    {
+        expected.push_back(IPv4Value{addresses[i]}, cidrs[i]);
+    }
+    expected.push_back(IPAnalyzer("::1/128"));
+    REQUIRE(column == expected);
+    REQUIRE(column.family_index(101) == 1);
+
+    cidrs[50] = 33;
+    REQUIRE_THROWS_AS(column.append_v4(addresses, cidrs), std::invalid_argument);
+    REQUIRE_THROWS_AS(column.append_v4(addresses, std::span(cidrs).first(10)), std::invalid_argument);
+    REQUIRE(column == expected);
+}
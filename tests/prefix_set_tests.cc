@@ -0,0 +1,128 @@
+#include <catch2/catch_all.hpp>
+#include "prefix_set.hh"
+#include <random>
+#include <vector>
+
+namespace
+{
+
+    constexpr uint32_t kBase = 0x0A000000;
+    constexpr uint32_t kSpan = 1 << 16;
+
+    PrefixSet RandomSet(std::mt19937 &rng, std::vector<bool> &bitmap)
+    {
+        std::vector<IPAnalyzer> prefixes;
+        bitmap.assign(kSpan, false);
+        for (int i = 0; i < 300; ++i)
+        {
+            const auto cidr = static_cast<uint8_t>(20 + rng() % 13);
+            prefixes.emplace_back(IPValue(IPv4Value{kBase | static_cast<uint32_t>(rng() % kSpan)}), cidr);
+            const uint32_t first = prefixes.back().network_value().v4().value - kBase;
+            for (uint32_t j = 0; j < (uint32_t{1} << (32 - cidr)); ++j)
+            {
+                bitmap[first + j] = true;
+            }
+        }
+        return PrefixSet(prefixes);
+    }
+
+    void RequireMatches(const PrefixSet &set, const std::vector<bool> &bitmap)
+    {
+        const auto ranges = set.v4_ranges();
+        for (size_t i = 1; i < ranges.size(); ++i)
+        {
+            REQUIRE(ranges[i - 1].last + 1 < ranges[i].first);
+        }
+        uint32_t mismatches = 0;
+        for (uint32_t offset = 0; offset < kSpan; ++offset)
+        {
+            mismatches += set.contains(IPv4Value{kBase + offset}) != bitmap[offset];
+        }
+        REQUIRE(mismatches == 0);
+        REQUIRE_FALSE(set.contains(IPv4Value{kBase - 1}));
+        REQUIRE_FALSE(set.contains(IPv4Value{kBase + kSpan}));
+    }
+
+}
+
+TEST_CASE("PrefixSet builds normalized ranges", "[prefixset]")
+{
+    const std::vector<IPAnalyzer> prefixes = {
+        IPAnalyzer("10.0.1.0/24"),
+        IPAnalyzer("10.0.0.0/24"),
+        IPAnalyzer("10.0.0.128/25"),
+        IPAnalyzer("192.168.0.0/16"),
+        IPAnalyzer("2001:db8::/64"),
+        IPAnalyzer("2001:db8:0:1::/64"),
+    };
+    const PrefixSet set(prefixes);
+
+    REQUIRE(set.v4_ranges().size() == 2);
+    REQUIRE(set.v4_ranges()[0] == IPv4Range{0x0A000000, 0x0A0001FF});
+    REQUIRE(set.v4_ranges()[1] == IPv4Range{0xC0A80000, 0xC0A8FFFF});
+    REQUIRE(set.v6_ranges().size() == 1);
+
+    REQUIRE(set.contains(IPValue(IPv4Value{0x0A0001FF})));
+    REQUIRE_FALSE(set.contains(IPValue(IPv4Value{0x0A000200})));
+    REQUIRE(set.contains(IPAnalyzer("2001:db8::1:ffff:ffff:ffff:ffff/128").ip_value()));
+    REQUIRE_FALSE(set.contains(IPAnalyzer("2001:db8:0:2::/128").ip_value()));
+    REQUIRE_FALSE(PrefixSet().contains(IPv4Value{0}));
+
+    REQUIRE(PrefixSet({{5, 9}, {0, 4}, {20, 30}, {25, 26}}, {}).v4_ranges().size() == 2);
+    REQUIRE_THROWS_AS(PrefixSet({{9, 5}}, {}), std::invalid_argument);
+}
+
+TEST_CASE("PrefixSet handles the ends of the address space", "[prefixset]")
+{
+    const PrefixSet all({{0, 0xFFFFFFFF}}, {{0, kUint128Max}});
+    REQUIRE(all.contains(IPv4Value{0}));
+    REQUIRE(all.contains(IPv4Value{0xFFFFFFFF}));
+    REQUIRE(all.contains(IPv6Value{}));
+
+    const PrefixSet top({{0xFFFFFFFF, 0xFFFFFFFF}}, {{kUint128Max, kUint128Max}});
+    const PrefixSet rest = all.subtract(top);
+    REQUIRE(rest.v4_ranges()[0] == IPv4Range{0, 0xFFFFFFFE});
+    REQUIRE(rest.v6_ranges()[0] == IPv6Range{0, kUint128Max - 1});
+    REQUIRE(rest.unite(top) == all);
+    REQUIRE(all.intersect(top) == top);
+    REQUIRE(top.subtract(all).empty());
+
+    const auto prefixes = all.to_prefixes();
+    REQUIRE(prefixes.size() == 2);
+    REQUIRE(prefixes[0].get_cidr() == 0);
+    REQUIRE(prefixes[1].get_cidr() == 0);
+}
+
+TEST_CASE("PrefixSet operations agree with a bitmap", "[prefixset]")
+{
+    std::mt19937 rng(11);
+    for (int round = 0; round < 5; ++round)
+    {
+        std::vector<bool> a_bits;
+        std::vector<bool> b_bits;
+        const PrefixSet a = RandomSet(rng, a_bits);
+        const PrefixSet b = RandomSet(rng, b_bits);
+        RequireMatches(a, a_bits);
+
+        std::vector<bool> expected(kSpan);
+        for (uint32_t i = 0; i < kSpan; ++i)
+        {
+            expected[i] = a_bits[i] || b_bits[i];
+        }
+        RequireMatches(a.unite(b), expected);
+
+        for (uint32_t i = 0; i < kSpan; ++i)
+        {
+            expected[i] = a_bits[i] && b_bits[i];
+        }
+        RequireMatches(a.intersect(b), expected);
+
+        for (uint32_t i = 0; i < kSpan; ++i)
+        {
+            expected[i] = a_bits[i] && !b_bits[i];
+        }
+        const PrefixSet difference = a.subtract(b);
+        RequireMatches(difference, expected);
+        REQUIRE(PrefixSet(difference.to_prefixes()) == difference);
+    }
+}
@@ -0,0 +1,512 @@
+#include <catch2/catch_all.hpp>
+#include "prefix_table.hh"
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+    uint32_t LinearLookup(const std::vector<IPAnalyzer> &prefixes, IPv4Value address)
+    {
+        uint32_t best = PrefixTable::kNoMatch;
+        int best_cidr = -1;
+        for (uint32_t i = 0; i < prefixes.size(); ++i)
+        {
+            const IPAnalyzer &prefix = prefixes[i];
+            const uint32_t mask = prefix.netmask_value().v4().value;
+            if ((address.value & mask) == prefix.network_value().v4().value && prefix.get_cidr() >= best_cidr)
+            {
+                best = i;
+                best_cidr = prefix.get_cidr();
+            }
+        }
+        return best;
+    }
+
+    // Reference for updated tables: every present prefix with the order it
+    // was added in; the longest match wins, the newest among equals.
+    struct ReferenceTable
+    {
+        std::vector<std::optional<std::pair<IPAnalyzer, uint64_t>>> slots;
+        uint64_t clock = 0;
+
+        void add(uint32_t index, const IPAnalyzer &prefix)
+        {
+            if (index >= slots.size())
+            {
+                slots.resize(index + 1);
+            }
+            slots[index].emplace(prefix, clock++);
+        }
+
+        // The index remove() has to drop, or kNoMatch.
+        uint32_t find(const IPAnalyzer &prefix) const
+        {
+            uint32_t found = PrefixTable::kNoMatch;
+            for (uint32_t i = 0; i < slots.size(); ++i)
+            {
+                if (slots[i] && slots[i]->first.get_cidr() == prefix.get_cidr() &&
+                    slots[i]->first.network_value() == prefix.network_value() &&
+                    (found == PrefixTable::kNoMatch || slots[i]->second > slots[found]->second))
+                {
+                    found = i;
+                }
+            }
+            return found;
+        }
+
+        uint32_t lookup(const IPValue &address) const
+        {
+            uint32_t best = PrefixTable::kNoMatch;
+            for (uint32_t i = 0; i < slots.size(); ++i)
+            {
+                if (!slots[i])
+                {
+                    continue;
+                }
+                const IPAnalyzer &prefix = slots[i]->first;
+                if (prefix.ip_value().family() != address.family() ||
+                    IPAnalyzer(address, prefix.get_cidr()).network_value() != prefix.network_value())
+                {
+                    continue;
+                }
+                const auto &current = slots[best == PrefixTable::kNoMatch ? i : best];
+                if (best == PrefixTable::kNoMatch || prefix.get_cidr() > current->first.get_cidr() ||
+                    (prefix.get_cidr() == current->first.get_cidr() && slots[i]->second > current->second))
+                {
+                    best = i;
+                }
+            }
+            return best;
+        }
+    };
+
+    // Prefixes crowded into 10.0.0.0/14 and 2001:db8::/40 so that updates
+    // nest, overlap and repeat.
+    IPAnalyzer RandomUpdatePrefix(std::mt19937 &rng)
+    {
+        if (rng() % 2)
+        {
+            return IPAnalyzer(IPValue(IPv4Value{0x0A000000 | static_cast<uint32_t>(rng() & 0x0003FFFF)}), static_cast<uint8_t>(8 + rng() % 25));
+        }
+        IPv6Value address{{0x20, 0x01, 0x0d, 0xb8, static_cast<uint8_t>(rng() % 4), static_cast<uint8_t>(rng() % 4)}};
+        address.bytes[15] = static_cast<uint8_t>(rng());
+        const uint8_t cidrs[] = {16, 32, 36, 40, 48, 56, 128};
+        return IPAnalyzer(IPValue(address), cidrs[rng() % std::size(cidrs)]);
+    }
+
+    IPValue RandomUpdateProbe(std::mt19937 &rng)
+    {
+        return RandomUpdatePrefix(rng).ip_value();
+    }
+
+}
+
+TEST_CASE("PrefixTable longest prefix match for IPv4", "[prefixtable]")
+{
+    std::vector<IPAnalyzer> prefixes = {
+        IPAnalyzer("10.0.0.0/8"),
+        IPAnalyzer("10.1.0.0/16"),
+        IPAnalyzer("10.1.2.0/24"),
+        IPAnalyzer("10.1.2.128/25"),
+        IPAnalyzer("10.1.2.200/32"),
+        IPAnalyzer("192.168.1.77/24"),
+    };
+    PrefixTable table(prefixes);
+
+    REQUIRE(table.size() == prefixes.size());
+    REQUIRE(table.lookup(IPv4Value{0x0A090909}) == 0);
+    REQUIRE(table.lookup(IPv4Value{0x0A010909}) == 1);
+    REQUIRE(table.lookup(IPv4Value{0x0A010201}) == 2);
+    REQUIRE(table.lookup(IPv4Value{0x0A010281}) == 3);
+    REQUIRE(table.lookup(IPv4Value{0x0A0102C8}) == 4);
+    REQUIRE(table.lookup(IPv4Value{0x0A0102C9}) == 3);
+    REQUIRE(table.lookup(IPAnalyzer("192.168.1.1").ip_value()) == 5);
+    REQUIRE(table.lookup(IPv4Value{0x08080808}) == PrefixTable::kNoMatch);
+    REQUIRE(table.lookup(IPAnalyzer("2001:db8::1").ip_value()) == PrefixTable::kNoMatch);
+}
+
+TEST_CASE("PrefixTable default routes and duplicates", "[prefixtable]")
+{
+    std::vector<IPAnalyzer> prefixes = {
+        IPAnalyzer("0.0.0.0/0"),
+        IPAnalyzer("::/0"),
+        IPAnalyzer("172.16.0.0/12"),
+        IPAnalyzer("172.16.0.0/12"),
+    };
+    PrefixTable table(prefixes);
+
+    REQUIRE(table.lookup(IPv4Value{0x01020304}) == 0);
+    REQUIRE(table.lookup(IPAnalyzer("2a00::1").ip_value()) == 1);
+    REQUIRE(table.lookup(IPAnalyzer("172.20.1.1").ip_value()) == 3);
+}
+
+TEST_CASE("PrefixTable longest prefix match for IPv6", "[prefixtable]")
+{
+    std::vector<IPAnalyzer> prefixes = {
+        IPAnalyzer("2001:db8::/32"),
+        IPAnalyzer("2001:db8:1::/48"),
+        IPAnalyzer("2001:db8:1:2::/64"),
+        IPAnalyzer("2001:db8:1:2::1/128"),
+        IPAnalyzer("2001:db8:1:2:8000::/65"),
+        IPAnalyzer("fe80::/10"),
+    };
+    PrefixTable table(prefixes);
+
+    REQUIRE(table.lookup(IPAnalyzer("2001:db8:ffff::1").ip_value()) == 0);
+    REQUIRE(table.lookup(IPAnalyzer("2001:db8:1:ffff::1").ip_value()) == 1);
+    REQUIRE(table.lookup(IPAnalyzer("2001:db8:1:2::2").ip_value()) == 2);
+    REQUIRE(table.lookup(IPAnalyzer("2001:db8:1:2::1").ip_value()) == 3);
+    REQUIRE(table.lookup(IPAnalyzer("2001:db8:1:2:8000::1").ip_value()) == 4);
+    REQUIRE(table.lookup(IPAnalyzer("febf::1").ip_value()) == 5);
+    REQUIRE(table.lookup(IPAnalyzer("2001:db9::1").ip_value()) == PrefixTable::kNoMatch);
+}
+
+TEST_CASE("PrefixTable matches a linear scan on random prefixes", "[prefixtable]")
+{
+    std::mt19937 rng(42);
+    std::vector<IPAnalyzer> prefixes;
+    for (int i = 0; i < 200; ++i)
+    {
+        const uint32_t address = rng() & 0x0FFFFFFF;
+        const IPValue value(IPv4Value{address});
+        prefixes.emplace_back(make_ip_address(value)->to_string() + "/" + std::to_string(8 + rng() % 25));
+    }
+    PrefixTable table(prefixes);
+
+    for (int i = 0; i < 500; ++i)
+    {
+        const IPv4Value probe{static_cast<uint32_t>(i < 200 ? prefixes[i].ip_value().v4().value ^ (rng() & 0x3FF) : rng() & 0x0FFFFFFF)};
+        REQUIRE(table.lookup(probe) == LinearLookup(prefixes, probe));
+    }
+}
+
+TEST_CASE("PrefixTable index files round trip", "[prefixtable][index]")
+{
+    const std::string path = "prefix_table_tests.idx";
+    std::vector<IPAnalyzer> prefixes = {
+        IPAnalyzer("10.0.0.0/8"),
+        IPAnalyzer("10.1.2.128/25"),
+        IPAnalyzer("192.168.1.77/24"),
+        IPAnalyzer("2001:db8::/32"),
+        IPAnalyzer("2001:db8:1:2::1/128"),
+    };
+    const PrefixTable built(prefixes);
+    built.save(path);
+
+    SECTION("Lookups and prefixes match the built table")
+    {
+        for (const IndexCheck check : {IndexCheck::kHeader, IndexCheck::kChecksum})
+        {
+            const PrefixTable loaded = PrefixTable::load(path, check);
+            REQUIRE(loaded.size() == prefixes.size());
+            REQUIRE(loaded.memory_usage() == built.memory_usage());
+            REQUIRE(loaded.source_checksum() == PrefixTable::source_checksum(prefixes));
+            REQUIRE(loaded.lookup(IPAnalyzer("10.1.2.200").ip_value()) == 1);
+            REQUIRE(loaded.lookup(IPAnalyzer("10.9.9.9").ip_value()) == 0);
+            REQUIRE(loaded.lookup(IPAnalyzer("2001:db8:1:2::1").ip_value()) == 4);
+            REQUIRE(loaded.lookup(IPAnalyzer("8.8.8.8").ip_value()) == PrefixTable::kNoMatch);
+            for (uint32_t i = 0; i < prefixes.size(); ++i)
+            {
+                REQUIRE(loaded.prefix(i).ip_value() == prefixes[i].ip_value());
+                REQUIRE(loaded.prefix(i).get_cidr() == prefixes[i].get_cidr());
+            }
+        }
+    }
+
+    SECTION("Copies outlive the original")
+    {
+        PrefixTable copy;
+        {
+            const PrefixTable loaded = PrefixTable::load(path);
+            copy = loaded;
+        }
+        REQUIRE(copy.lookup(IPAnalyzer("192.168.1.1").ip_value()) == 2);
+    }
+
+    SECTION("A changed source list is detected")
+    {
+        prefixes.emplace_back("172.16.0.0/12");
+        REQUIRE(PrefixTable::load(path).source_checksum() != PrefixTable::source_checksum(prefixes));
+    }
+
+    SECTION("Corruption is rejected")
+    {
+        std::FILE *file = std::fopen(path.c_str(), "r+b");
+        REQUIRE(file != nullptr);
+        std::fseek(file, 300, SEEK_SET);
+        std::fputc(0x5A, file);
+        std::fclose(file);
+
+        REQUIRE_NOTHROW(PrefixTable::load(path, IndexCheck::kHeader));
+        REQUIRE_THROWS_AS(PrefixTable::load(path, IndexCheck::kChecksum), std::runtime_error);
+    }
+
+    SECTION("Truncation and bad magic are rejected")
+    {
+        const std::string other = path + ".bad";
+        std::FILE *file = std::fopen(other.c_str(), "wb");
+        std::fputs("not an index, but long enough to hold a header of one hundred and twenty-eight bytes......"
+                   "..........................................",
+                   file);
+        std::fclose(file);
+        REQUIRE_THROWS_AS(PrefixTable::load(other), std::runtime_error);
+        std::remove(other.c_str());
+
+        REQUIRE_THROWS_AS(PrefixTable::load(path + ".missing"), std::system_error);
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("Empty PrefixTable index", "[prefixtable][index]")
+{
+    const std::string path = "prefix_table_empty.idx";
+    PrefixTable().save(path);
+    const PrefixTable loaded = PrefixTable::load(path, IndexCheck::kChecksum);
+    REQUIRE(loaded.size() == 0);
+    REQUIRE(loaded.lookup(IPAnalyzer("1.2.3.4").ip_value()) == PrefixTable::kNoMatch);
+    REQUIRE(loaded.source_checksum() == PrefixTable::source_checksum({}));
+    REQUIRE(PrefixTable::source_checksum({}) == 0xEF46DB3751D8E999);
+    std::remove(path.c_str());
+}
+
+TEST_CASE("PrefixTable add and remove update lookups", "[prefixtable][update]")
+{
+    PrefixTable table(std::vector<IPAnalyzer>{IPAnalyzer("10.0.0.0/8"), IPAnalyzer("2001:db8::/32")});
+    REQUIRE(table.contains(IPAnalyzer("2001:db8::/32")));
+    REQUIRE_FALSE(table.contains(IPAnalyzer("10.0.0.0/9")));
+    REQUIRE(table.add(IPAnalyzer("10.1.0.0/16")) == 2);
+    REQUIRE(table.contains(IPAnalyzer("10.1.0.0/16")));
+    REQUIRE(table.add(IPAnalyzer("10.1.2.128/25")) == 3);
+    REQUIRE(table.lookup(IPAnalyzer("10.1.2.200").ip_value()) == 3);
+    REQUIRE(table.lookup(IPAnalyzer("10.1.2.1").ip_value()) == 2);
+
+    REQUIRE(table.remove(IPAnalyzer("10.1.0.0/16")));
+    REQUIRE_FALSE(table.remove(IPAnalyzer("10.1.0.0/16")));
+    REQUIRE_FALSE(table.contains(IPAnalyzer("10.1.0.0/16")));
+    REQUIRE(table.lookup(IPAnalyzer("10.1.2.1").ip_value()) == 0);
+    REQUIRE(table.lookup(IPAnalyzer("10.1.2.200").ip_value()) == 3);
+    REQUIRE_THROWS_AS(table.prefix(2), std::out_of_range);
+
+    // The freed index is reused; a duplicate shadows the older entry.
+    REQUIRE(table.add(IPAnalyzer("10.200.0.0/8")) == 2);
+    REQUIRE(table.lookup(IPAnalyzer("10.1.2.1").ip_value()) == 2);
+    REQUIRE(table.remove(IPAnalyzer("10.0.0.0/8")));
+    REQUIRE(table.lookup(IPAnalyzer("10.1.2.1").ip_value()) == 0);
+    REQUIRE(table.prefix(0).get_cidr() == 8);
+
+    REQUIRE(table.add(IPAnalyzer("2001:db8:1:2::1/128")) == 2);
+    REQUIRE(table.lookup(IPAnalyzer("2001:db8:1:2::1").ip_value()) == 2);
+    REQUIRE(table.remove(IPAnalyzer("2001:db8:1:2::1/128")));
+    REQUIRE(table.lookup(IPAnalyzer("2001:db8:1:2::1").ip_value()) == 1);
+    REQUIRE(table.source_checksum() != PrefixTable(std::vector<IPAnalyzer>{IPAnalyzer("10.0.0.0/8")}).source_checksum());
+}
+
+TEST_CASE("PrefixTable updates match a linear scan", "[prefixtable][update]")
+{
+    std::mt19937 rng(27);
+    PrefixTable table;
+    ReferenceTable reference;
+    std::vector<IPAnalyzer> added;
+    for (int step = 0; step < 3000; ++step)
+    {
+        if (added.empty() || rng() % 3 != 0)
+        {
+            const IPAnalyzer prefix = RandomUpdatePrefix(rng);
+            reference.add(table.add(prefix), prefix);
+            added.push_back(prefix);
+        }
+        else
+        {
+            const IPAnalyzer &prefix = added[rng() % added.size()];
+            const uint32_t expected = reference.find(prefix);
+            REQUIRE(table.remove(prefix) == (expected != PrefixTable::kNoMatch));
+            if (expected != PrefixTable::kNoMatch)
+            {
+                reference.slots[expected].reset();
+            }
+        }
+
+        if (step % 100 == 0)
+        {
+            for (int i = 0; i < 200; ++i)
+            {
+                const IPValue probe = RandomUpdateProbe(rng);
+                REQUIRE(table.lookup(probe) == reference.lookup(probe));
+            }
+        }
+    }
+
+    SECTION("Removing everything leaves no match")
+    {
+        for (const IPAnalyzer &prefix : added)
+        {
+            table.remove(prefix);
+        }
+        for (int i = 0; i < 200; ++i)
+        {
+            REQUIRE(table.lookup(RandomUpdateProbe(rng)) == PrefixTable::kNoMatch);
+        }
+    }
+}
+
+TEST_CASE("Updating a PrefixTable leaves its copies unchanged", "[prefixtable][update]")
+{
+    const std::string path = "prefix_table_update.idx";
+    const PrefixTable built(std::vector<IPAnalyzer>{IPAnalyzer("10.0.0.0/8")});
+    built.save(path);
+    const PrefixTable loaded = PrefixTable::load(path, IndexCheck::kChecksum);
+
+    for (const PrefixTable *original : {&built, &loaded})
+    {
+        PrefixTable copy = *original;
+        REQUIRE(copy.add(IPAnalyzer("10.1.0.0/16")) == 1);
+        REQUIRE(copy.remove(IPAnalyzer("10.0.0.0/8")));
+        REQUIRE(copy.lookup(IPAnalyzer("10.1.1.1").ip_value()) == 1);
+        REQUIRE(copy.lookup(IPAnalyzer("10.2.1.1").ip_value()) == PrefixTable::kNoMatch);
+        REQUIRE(original->lookup(IPAnalyzer("10.1.1.1").ip_value()) == 0);
+        REQUIRE(original->size() == 1);
+    }
+
+    PrefixTable updated = loaded;
+    updated.add(IPAnalyzer("2001:db8::/32"));
+    updated.save(path);
+    const PrefixTable reloaded = PrefixTable::load(path, IndexCheck::kChecksum);
+    REQUIRE(reloaded.lookup(IPAnalyzer("2001:db8::1").ip_value()) == 1);
+    REQUIRE(reloaded.source_checksum() == updated.source_checksum());
+    std::remove(path.c_str());
+}
+
+TEST_CASE("LivePrefixTable publishes updates to new snapshots", "[prefixtable][update]")
+{
+    std::mt19937 rng(28);
+    LivePrefixTable live(PrefixTable(std::vector<IPAnalyzer>{IPAnalyzer("10.0.0.0/8")}));
+    LivePrefixTable::Reader reader(live);
+    LivePrefixTable::Reader before_reader(live);
+    LivePrefixTable::Reader held_reader(live);
+    ReferenceTable reference;
+    reference.add(0, IPAnalyzer("10.0.0.0/8"));
+    std::vector<IPAnalyzer> added;
+
+    for (int round = 0; round < 20; ++round)
+    {
+        // Pinning across the next round forces a copy instead of a replay.
+        std::optional<LivePrefixTable::Snapshot> held;
+        if (round % 3 == 0)
+        {
+            held.emplace(held_reader.snapshot());
+        }
+        const ReferenceTable before = reference;
+
+        for (int i = 0; i < 50; ++i)
+        {
+            if (added.empty() || rng() % 3 != 0)
+            {
+                const IPAnalyzer prefix = RandomUpdatePrefix(rng);
+                reference.add(live.add(prefix), prefix);
+                added.push_back(prefix);
+            }
+            else
+            {
+                const IPAnalyzer &prefix = added[rng() % added.size()];
+                const uint32_t expected = reference.find(prefix);
+                REQUIRE(live.remove(prefix) == (expected != PrefixTable::kNoMatch));
+                if (expected != PrefixTable::kNoMatch)
+                {
+                    reference.slots[expected].reset();
+                }
+            }
+        }
+        REQUIRE(live.pending() > 0);
+
+        const auto unpublished = before_reader.snapshot();
+        live.publish();
+        REQUIRE(live.pending() == 0);
+        const auto published = reader.snapshot();
+        for (int i = 0; i < 200; ++i)
+        {
+            const IPValue probe = RandomUpdateProbe(rng);
+            REQUIRE(published->lookup(probe) == reference.lookup(probe));
+            REQUIRE(unpublished->lookup(probe) == before.lookup(probe));
+            if (held)
+            {
+                REQUIRE((*held)->lookup(probe) == before.lookup(probe));
+            }
+        }
+    }
+}
+
+TEST_CASE("LivePrefixTable ignores removals of missing prefixes", "[prefixtable][update]")
+{
+    LivePrefixTable live(PrefixTable(std::vector<IPAnalyzer>{IPAnalyzer("10.0.0.0/8")}));
+    LivePrefixTable::Reader reader(live);
+    const PrefixTable *before = &*reader.snapshot();
+    REQUIRE_FALSE(live.remove(IPAnalyzer("10.0.0.0/16")));
+    REQUIRE(live.pending() == 0);
+    live.publish();
+    REQUIRE(&*reader.snapshot() == before);
+
+    REQUIRE(live.remove(IPAnalyzer("10.0.0.0/8")));
+    REQUIRE_FALSE(live.remove(IPAnalyzer("10.0.0.0/8")));
+    REQUIRE(live.pending() == 1);
+}
+
+TEST_CASE("LivePrefixTable readers run alongside the writer", "[prefixtable][update]")
+{
+    LivePrefixTable live(PrefixTable(std::vector<IPAnalyzer>{IPAnalyzer("10.0.0.0/8")}));
+    std::atomic<bool> done{false};
+    std::atomic<int> bad{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t)
+    {
+        readers.emplace_back([&]
+                             {
+            LivePrefixTable::Reader reader(live);
+            // The /16 flips between absent and index 1; the /8 stays.
+            const auto consistent = [](const PrefixTable &table)
+            {
+                const uint32_t inner = table.lookup(IPv4Value{0x0A010101});
+                return (inner == 0 || inner == 1) && table.lookup(IPv4Value{0x0AC80001}) == 0;
+            };
+            while (!done.load(std::memory_order_relaxed))
+            {
+                if (!consistent(*reader.snapshot()))
+                {
+                    ++bad;
+                }
+                std::this_thread::yield();
+            } });
+    }
+
+    for (int i = 0; i < 200; ++i)
+    {
+        REQUIRE(live.add(IPAnalyzer("10.1.0.0/16")) == 1);
+        live.publish();
+        REQUIRE(live.remove(IPAnalyzer("10.1.0.0/16")));
+        live.publish();
+    }
+    done = true;
+    for (auto &thread : readers)
+    {
+        thread.join();
+    }
+    REQUIRE(bad == 0);
+
+    std::vector<std::unique_ptr<LivePrefixTable::Reader>> registered;
+    for (size_t i = 0; i < LivePrefixTable::kMaxReaders; ++i)
+    {
+        registered.push_back(std::make_unique<LivePrefixTable::Reader>(live));
+    }
+    REQUIRE_THROWS_AS(LivePrefixTable::Reader(live), std::length_error);
+    registered.pop_back();
+    REQUIRE_NOTHROW(LivePrefixTable::Reader(live));
+}
@@ -0,0 +1,148 @@
+#include <catch2/catch_all.hpp>
+#include "range_kernels.hh"
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+TEST_CASE("compute_ranges_v4 matches IPAnalyzer", "[rangekernels]")
+{
+    std::mt19937 rng(7);
+    std::vector<uint32_t> addresses;
+    std::vector<uint8_t> cidrs;
+    for (int round = 0; round < 3; ++round)
+    {
+        for (uint8_t cidr = 0; cidr <= 32; ++cidr)
+        {
+            addresses.push_back(rng());
+            cidrs.push_back(cidr);
+        }
+    }
+
+    const size_t n = addresses.size();
+    std::vector<uint32_t> network(n), broadcast(n), first(n), last(n);
+    compute_ranges_v4(addresses, cidrs, {network, broadcast, first, last});
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const auto text = make_ip_address(IPv4Value{addresses[i]})->to_string() + "/" + std::to_string(cidrs[i]);
+        const IPAnalyzer analyzer(text);
+        const auto [expected_first, expected_last] = analyzer.host_range_value();
+        INFO(text);
+        REQUIRE(network[i] == analyzer.network_value().v4().value);
+        REQUIRE(broadcast[i] == analyzer.broadcast_value().v4().value);
+        REQUIRE(first[i] == expected_first.v4().value);
+        REQUIRE(last[i] == expected_last.v4().value);
+    }
+}
+
+TEST_CASE("compute_ranges_v6 matches IPAnalyzer", "[rangekernels]")
+{
+    std::mt19937 rng(11);
+    std::vector<IPv6Value> addresses;
+    std::vector<uint8_t> cidrs;
+    for (int cidr = 0; cidr <= 128; ++cidr)
+    {
+        IPv6Value address{};
+        for (auto &byte : address.bytes)
+        {
+            byte = static_cast<uint8_t>(rng());
+        }
+        addresses.push_back(address);
+        cidrs.push_back(static_cast<uint8_t>(cidr));
+    }
+
+    const size_t n = addresses.size();
+    std::vector<IPv6Value> network(n), broadcast(n), first(n), last(n);
+    compute_ranges_v6(addresses, cidrs, {network, broadcast, first, last});
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const auto text = make_ip_address(addresses[i])->to_string() + "/" + std::to_string(cidrs[i]);
+        const IPAnalyzer analyzer(text);
+        const auto [expected_first, expected_last] = analyzer.host_range_value();
+        INFO(text);
+        REQUIRE(IPValue(network[i]) == analyzer.network_value());
+        REQUIRE(IPValue(broadcast[i]) == analyzer.broadcast_value());
+        REQUIRE(IPValue(first[i]) == expected_first);
+        REQUIRE(IPValue(last[i]) == expected_last);
+    }
+}
+
+TEST_CASE("Fixed-length range kernels match IPAnalyzer", "[rangekernels]")
+{
+    std::mt19937 rng(13);
+    constexpr size_t kBatch = 64;
+
+    SECTION("IPv4")
+    {
+        std::vector<uint32_t> addresses(kBatch);
+        for (auto &address : addresses)
+        {
+            address = rng();
+        }
+        std::vector<uint32_t> network(kBatch), broadcast(kBatch), first(kBatch), last(kBatch);
+        std::vector<uint32_t> uniform_network(kBatch), uniform_broadcast(kBatch), uniform_first(kBatch), uniform_last(kBatch);
+        for (uint8_t cidr = 0; cidr <= 32; ++cidr)
+        {
+            compute_ranges_v4(addresses, cidr, {network, broadcast, first, last});
+            const std::vector<uint8_t> cidrs(kBatch, cidr);
+            compute_ranges_v4(addresses, cidrs, {uniform_network, uniform_broadcast, uniform_first, uniform_last});
+            REQUIRE(uniform_network == network);
+            REQUIRE(uniform_broadcast == broadcast);
+            REQUIRE(uniform_first == first);
+            REQUIRE(uniform_last == last);
+            for (size_t i = 0; i < kBatch; ++i)
+            {
+                const IPAnalyzer analyzer(IPValue(IPv4Value{addresses[i]}), cidr);
+                const auto [expected_first, expected_last] = analyzer.host_range_value();
+                REQUIRE(network[i] == analyzer.network_value().v4().value);
+                REQUIRE(broadcast[i] == analyzer.broadcast_value().v4().value);
+                REQUIRE(first[i] == expected_first.v4().value);
+                REQUIRE(last[i] == expected_last.v4().value);
+            }
+        }
+
+        REQUIRE_THROWS_AS(compute_ranges_v4(addresses, uint8_t{33}, {network, broadcast, first, last}), std::invalid_argument);
+    }
+
+    SECTION("IPv6")
+    {
+        std::vector<IPv6Value> addresses(kBatch);
+        for (auto &address : addresses)
+        {
+            for (auto &byte : address.bytes)
+            {
+                byte = static_cast<uint8_t>(rng());
+            }
+        }
+        std::vector<IPv6Value> network(kBatch), broadcast(kBatch), first(kBatch), last(kBatch);
+        std::vector<IPv6Value> uniform_network(kBatch), uniform_broadcast(kBatch), uniform_first(kBatch), uniform_last(kBatch);
+        for (int cidr = 0; cidr <= 128; ++cidr)
+        {
+            compute_ranges_v6(addresses, static_cast<uint8_t>(cidr), {network, broadcast, first, last});
+            const std::vector<uint8_t> cidrs(kBatch, static_cast<uint8_t>(cidr));
+            compute_ranges_v6(addresses, cidrs, {uniform_network, uniform_broadcast, uniform_first, uniform_last});
+            REQUIRE(uniform_network == network);
+            REQUIRE(uniform_last == last);
+            for (size_t i = 0; i < kBatch; ++i)
+            {
+                const IPAnalyzer analyzer(IPValue(addresses[i]), static_cast<uint8_t>(cidr));
+                const auto [expected_first, expected_last] = analyzer.host_range_value();
+                REQUIRE(IPValue(network[i]) == analyzer.network_value());
+                REQUIRE(IPValue(broadcast[i]) == analyzer.broadcast_value());
+                REQUIRE(IPValue(first[i]) == expected_first);
+                REQUIRE(IPValue(last[i]) == expected_last);
+            }
+        }
+        REQUIRE_THROWS_AS(compute_ranges_v6(addresses, uint8_t{129}, {network, broadcast, first, last}), std::invalid_argument);
+    }
+}
+
+TEST_CASE("Range kernels reject mismatched spans", "[rangekernels]")
+{
+    std::vector<uint32_t> addresses(4), outputs(3);
+    std::vector<uint8_t> cidrs(4);
+    REQUIRE_THROWS_AS(compute_ranges_v4(addresses, cidrs, {outputs, outputs, outputs, outputs}), std::invalid_argument);
+    REQUIRE_THROWS_AS(compute_ranges_v4(addresses, uint8_t{8}, {outputs, outputs, outputs, outputs}), std::invalid_argument);
+}
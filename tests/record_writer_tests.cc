@@ -0,0 +1,99 @@
+#include <catch2/catch_all.hpp>
+#include "address_class.hh"
+#include "record_writer.hh"
+#include <cstring>
+#include <string>
+
+namespace
+{
+
+    std::string Record(OutputFormat format, std::string_view input)
+    {
+        const auto writer = make_record_writer(format);
+        fmt::memory_buffer out;
+        const auto parsed = IPAnalyzer::parse(input);
+        if (parsed)
+        {
+            writer->write_record(out, input, *parsed);
+        }
+        else
+        {
+            writer->write_error(out, input, parsed.error());
+        }
+        return fmt::to_string(out);
+    }
+
+    uint32_t ReadLittleEndian32(const std::string &record, size_t offset)
+    {
+        uint32_t value = 0;
+        for (size_t i = 0; i < 4; ++i)
+        {
+            value |= static_cast<uint32_t>(static_cast<uint8_t>(record[offset + i])) << (8 * i);
+        }
+        return value;
+    }
+
+}
+
+TEST_CASE("parse_output_format names", "[writer]")
+{
+    REQUIRE(parse_output_format("text") == OutputFormat::kText);
+    REQUIRE(parse_output_format("ndjson") == OutputFormat::kNdjson);
+    REQUIRE(parse_output_format("csv") == OutputFormat::kCsv);
+    REQUIRE(parse_output_format("binary") == OutputFormat::kBinary);
+    REQUIRE_FALSE(parse_output_format("json").has_value());
+}
+
+TEST_CASE("Text records are tab separated", "[writer]")
+{
+    REQUIRE(Record(OutputFormat::kText, "192.168.0.1/24") ==
+            "192.168.0.1/24\t192.168.0.0/24\t255.255.255.0\t192.168.0.1\t192.168.0.254\t254\t1\n");
+    REQUIRE(Record(OutputFormat::kText, "1.2.3.4/33") == "1.2.3.4/33\terror\tCIDR value too large for the address family\n");
+}
+
+TEST_CASE("NDJSON records", "[writer]")
+{
+    REQUIRE(Record(OutputFormat::kNdjson, "2001:db8::1/64") ==
+            "{\"input\":\"2001:db8::1/64\",\"network\":\"2001:db8::/64\",\"netmask\":\"ffff:ffff:ffff:ffff::\","
+            "\"first\":\"2001:db8::1\",\"last\":\"2001:db8::ffff:ffff:ffff:fffe\",\"hosts\":18446744073709551614,"
+            "\"private\":false}\n");
+    REQUIRE(Record(OutputFormat::kNdjson, "a\"b\\c\x01") ==
+            "{\"input\":\"a\\\"b\\\\c\\u0001\",\"error\":\"Invalid character in address\"}\n");
+}
+
+TEST_CASE("CSV records", "[writer]")
+{
+    const auto writer = make_record_writer(OutputFormat::kCsv);
+    fmt::memory_buffer header;
+    writer->write_header(header);
+    REQUIRE(fmt::to_string(header) == "input,network,netmask,first,last,hosts,private,error\n");
+
+    REQUIRE(Record(OutputFormat::kCsv, "10.0.0.1/8") == "10.0.0.1/8,10.0.0.0/8,255.0.0.0,10.0.0.1,10.255.255.254,16777214,1,\n");
+    REQUIRE(Record(OutputFormat::kCsv, "1,2\"3") == "\"1,2\"\"3\",,,,,,,Invalid address format\n");
+}
+
+TEST_CASE("Binary records have a fixed layout", "[writer]")
+{
+    const std::string v4 = Record(OutputFormat::kBinary, "192.168.7.9/16");
+    REQUIRE(v4.size() == kBinaryRecordSize);
+    REQUIRE(std::memcmp(v4.data(), "\xC0\xA8\x00\x00", 4) == 0);
+    REQUIRE(v4.substr(4, 12) == std::string(12, '\0'));
+    REQUIRE(v4[16] == 16);
+    REQUIRE(v4[17] == 4);
+    REQUIRE(v4[18] == 0);
+    REQUIRE(ReadLittleEndian32(v4, 20) == static_cast<AddressClassMask>(AddressClass::kPrivate));
+
+    const std::string v6 = Record(OutputFormat::kBinary, "fe80::1:2/10");
+    REQUIRE(v6.size() == kBinaryRecordSize);
+    REQUIRE(static_cast<uint8_t>(v6[0]) == 0xFE);
+    REQUIRE(static_cast<uint8_t>(v6[1]) == 0x80);
+    REQUIRE(v6.substr(2, 14) == std::string(14, '\0'));
+    REQUIRE(v6[16] == 10);
+    REQUIRE(v6[17] == 6);
+    REQUIRE(ReadLittleEndian32(v6, 20) == static_cast<AddressClassMask>(AddressClass::kLinkLocal));
+
+    const std::string error = Record(OutputFormat::kBinary, "300.0.0.0/8");
+    REQUIRE(error.size() == kBinaryRecordSize);
+    REQUIRE(error[17] == 0);
+    REQUIRE(error[18] == static_cast<char>(ParseError::kOctetOutOfRange));
+}
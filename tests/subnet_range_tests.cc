@@ -0,0 +1,91 @@
+#include <catch2/catch_all.hpp>
+#include "address_format.hh"
+#include "subnet_range.hh"
+#include <string>
+#include <vector>
+
+namespace
+{
+
+    std::string Text(const IPValue &address)
+    {
+        fmt::memory_buffer buffer;
+        format_address(buffer, address);
+        return fmt::to_string(buffer);
+    }
+
+}
+
+TEST_CASE("SubnetRange splits a prefix into children", "[subnetrange]")
+{
+    std::vector<std::string> subnets;
+    for (const IPAnalyzer &subnet : SubnetRange(IPAnalyzer("192.168.5.77/22"), 24))
+    {
+        subnets.push_back(Text(subnet.ip_value()) + "/" + std::to_string(subnet.get_cidr()));
+    }
+    REQUIRE(subnets == std::vector<std::string>{"192.168.4.0/24", "192.168.5.0/24", "192.168.6.0/24", "192.168.7.0/24"});
+
+    REQUIRE(std::ranges::distance(SubnetRange(IPAnalyzer("10.0.0.0/8"), 24)) == 65536);
+    REQUIRE(std::ranges::distance(SubnetRange(IPAnalyzer("10.0.0.0/8"), 8)) == 1);
+    REQUIRE(std::ranges::distance(SubnetRange(IPAnalyzer("0.0.0.0/0"), 4)) == 16);
+
+    auto last = SubnetRange(IPAnalyzer("0.0.0.0/0"), 1).begin();
+    ++last;
+    REQUIRE(Text((*last).ip_value()) == "128.0.0.0");
+    ++last;
+    REQUIRE(last == std::default_sentinel);
+
+    REQUIRE_THROWS_AS(SubnetRange(IPAnalyzer("10.0.0.0/16"), 8), std::invalid_argument);
+    REQUIRE_THROWS_AS(SubnetRange(IPAnalyzer("10.0.0.0/16"), 33), std::invalid_argument);
+}
+
+TEST_CASE("SubnetRange handles IPv6 and the top of the address space", "[subnetrange]")
+{
+    std::vector<std::string> subnets;
+    for (const IPAnalyzer &subnet : SubnetRange(IPAnalyzer("2001:db8::/47"), 48))
+    {
+        subnets.push_back(Text(subnet.ip_value()));
+    }
+    REQUIRE(subnets == std::vector<std::string>{"2001:db8::", "2001:db8:1::"});
+
+    auto it = SubnetRange(IPAnalyzer("::/0"), 128).begin();
+    REQUIRE(Text((*it).ip_value()) == "::");
+    ++it;
+    REQUIRE(Text((*it).ip_value()) == "::1");
+
+    REQUIRE(std::ranges::distance(SubnetRange(IPAnalyzer("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ff00/120"), 128)) == 256);
+    REQUIRE(std::ranges::distance(SubnetRange(IPAnalyzer("255.255.255.0/24"), 32)) == 256);
+
+    // Splitting a whole address space at length 0 yields the prefix itself.
+    const SubnetRange whole(IPAnalyzer("::/0"), 0);
+    REQUIRE(std::ranges::distance(whole) == 1);
+    REQUIRE(Text((*whole.begin()).ip_value()) == "::");
+    REQUIRE((*whole.begin()).get_cidr() == 0);
+    REQUIRE(std::ranges::distance(SubnetRange(IPAnalyzer("0.0.0.0/0"), 0)) == 1);
+    REQUIRE(std::ranges::distance(SubnetRange(IPAnalyzer("::/0"), 1)) == 2);
+}
+
+TEST_CASE("HostRange walks usable hosts", "[subnetrange]")
+{
+    std::vector<std::string> hosts;
+    for (const IPValue &host : HostRange(IPAnalyzer("192.168.1.9/29")))
+    {
+        hosts.push_back(Text(host));
+    }
+    REQUIRE(hosts.size() == 6);
+    REQUIRE(hosts.front() == "192.168.1.9");
+    REQUIRE(hosts.back() == "192.168.1.14");
+
+    REQUIRE(std::ranges::distance(HostRange(IPAnalyzer("10.0.0.0/31"))) == 2);
+    REQUIRE(std::ranges::distance(HostRange(IPAnalyzer("10.0.0.7/32"))) == 1);
+    REQUIRE(std::ranges::distance(HostRange(IPAnalyzer("10.0.0.0/16"))) == 65534);
+    REQUIRE(std::ranges::distance(HostRange(IPAnalyzer("2001:db8::/120"))) == 254);
+
+    auto first_two = HostRange(IPAnalyzer("::/0")) | std::views::take(2);
+    std::vector<std::string> v6;
+    for (const IPValue &host : first_two)
+    {
+        v6.push_back(Text(host));
+    }
+    REQUIRE(v6 == std::vector<std::string>{"::1", "::2"});
+}
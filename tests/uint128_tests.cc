@@ -0,0 +1,68 @@
+#include <catch2/catch_all.hpp>
+#include "ip_analyzer.hh"
+#include <random>
+#include <string>
+
+namespace
+{
+
+    std::string Decimal(uint128 value)
+    {
+        char text[kUint128DecimalLength];
+        const auto [ptr, ec] = uint128_to_chars(text, text + sizeof(text), value);
+        REQUIRE(ec == std::errc());
+        return std::string(text, ptr);
+    }
+
+    static_assert(to_uint128(to_ipv6_value(make_uint128(0x20010DB800000000, 42))) == make_uint128(0x20010DB800000000, 42));
+    static_assert(ipv6_mask(0) == 0);
+    static_assert(ipv6_mask(128) == kUint128Max);
+    static_assert(ipv6_mask(1) == make_uint128(0x8000000000000000, 0));
+
+}
+
+TEST_CASE("uint128 arithmetic and bit helpers", "[uint128]")
+{
+    const uint128 low_max = make_uint128(0, UINT64_MAX);
+    REQUIRE(low_max + 1 == make_uint128(1, 0));
+    REQUIRE(make_uint128(1, 0) - 1 == low_max);
+    REQUIRE(kUint128Max + 1 == 0);
+    REQUIRE((uint128(1) << 127) >> 127 == 1);
+    REQUIRE((kUint128Max >> 64) == low_max);
+    REQUIRE(make_uint128(1, 0) > low_max);
+    REQUIRE(countr_zero_128(make_uint128(4, 0)) == 66);
+    REQUIRE(countr_zero_128(0) == 128);
+    REQUIRE(bit_width_128(make_uint128(1, 0)) == 65);
+    REQUIRE(bit_width_128(kUint128Max) == 128);
+
+    IPv6Value address{};
+    address.bytes[0] = 0x20;
+    address.bytes[15] = 0x01;
+    REQUIRE(uint128_high(to_uint128(address)) == 0x2000000000000000);
+    REQUIRE(uint128_low(to_uint128(address)) == 1);
+}
+
+TEST_CASE("uint128_to_chars formats decimals", "[uint128]")
+{
+    REQUIRE(Decimal(0) == "0");
+    REQUIRE(Decimal(UINT64_MAX) == "18446744073709551615");
+    REQUIRE(Decimal(make_uint128(1, 0)) == "18446744073709551616");
+    REQUIRE(Decimal(make_uint128(0x0000000000000001, 0x2000000000000000)) == "20752587082923245568");
+    REQUIRE(Decimal(kUint128Max) == "340282366920938463463374607431768211455");
+
+    std::mt19937_64 rng(5);
+    for (int i = 0; i < 1000; ++i)
+    {
+        const uint128 value = make_uint128(rng() >> (rng() % 64), rng());
+        const std::string text = Decimal(value);
+        uint128 parsed = 0;
+        for (char c : text)
+        {
+            parsed = (parsed << 3) + (parsed << 1) + uint128(static_cast<uint64_t>(c - '0'));
+        }
+        REQUIRE(parsed == value);
+    }
+
+    char small[5];
+    REQUIRE(uint128_to_chars(small, small + sizeof(small), make_uint128(1, 0)).ec == std::errc::value_too_large);
+}